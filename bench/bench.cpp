@@ -0,0 +1,411 @@
+/// \file
+///
+/// \brief Benchmarks the stages of diffusion maps and writes the results as
+///        JSON.
+///
+/// Usage: bench [--sizes N,...] [--dims D,...] [--nnz-per-row K,...]
+///              [--distributions uniform|gaussian,...] [--threads T,...]
+///              [--stages NAME,...] [--repeats R] [--min-time SECONDS]
+///              [--max-kernel-size N]
+///              [--kernel-epsilon EPS] [--n-eigenpairs K] [--tol TOL]
+///              [--max-iters N] [--chebyshev-degree D]
+///              [--first-touch 0|1] [--huge-pages 0|1] [--output FILE]
+///
+/// Every combination of the sizes, dimensions, numbers of non-zero elements
+/// per row and distributions is a case. Every stage is timed on every case
+/// with every number of threads.
+///
+/// --first-touch and --huge-pages set the diffusion_maps::AllocationPolicy.
+/// To compare them on a multi-socket host, run the benchmark under numactl,
+/// e.g. `numactl --cpunodebind=0,1 bench --threads 64 --first-touch 0` and
+/// then `--first-touch 1`.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "bench.hpp"
+#include "diffusion_maps/allocation.hpp"
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/kernel.hpp"
+
+bench::Fixture::Fixture(const Config &config, const Case &params)
+    : config(&config), params(params),
+      data(params.n_samples, params.n_features), rng(0) {
+  const std::size_t n = params.n_samples;
+  const double d = static_cast<double>(params.n_features);
+
+  const bool gaussian = params.distribution == "gaussian";
+  std::default_random_engine data_rng(0);
+  std::uniform_real_distribution<double> uniform(0, 1);
+  std::normal_distribution<double> normal_data;
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t j = 0; j < params.n_features; ++j) {
+      data(i, j) = gaussian ? normal_data(data_rng) : uniform(data_rng);
+    }
+  }
+
+  // Choose the cutoff radius so that a ball of that radius holds about
+  // nnz_per_row points at the average density seen by a point, then γ so that
+  // exp(-γ r²) = ε. The average density is n for the unit hypercube and
+  // n (4π)^(-d/2) for the standard normal distribution.
+
+  const double pi = std::acos(-1.0);
+  const double unit_ball_volume = std::pow(pi, d / 2) / std::tgamma(d / 2 + 1);
+  const double density = gaussian ? n * std::pow(4 * pi, -d / 2) : n;
+  const double radius =
+      std::pow(static_cast<double>(params.nnz_per_row) /
+                   (density * unit_ball_volume),
+               1 / d);
+  gamma = -std::log(config.kernel_epsilon) / (radius * radius);
+
+  from_kernel = n <= config.max_kernel_size;
+  diffusion_maps::SparseMatrix kernel_matrix;
+  if (from_kernel) {
+    kernel_matrix = diffusion_maps::internal::compute_kernel_matrix(
+        data, diffusion_maps::kernel::Gaussian(gamma), config.kernel_epsilon);
+    for (std::size_t i = 0; i < n; ++i) {
+      for (std::size_t ir = kernel_matrix.row_ixs()[i];
+           ir < kernel_matrix.row_ixs()[i + 1]; ++ir) {
+        triplets.push_back(
+            {i, kernel_matrix.col_ixs()[ir], kernel_matrix.data()[ir]});
+      }
+    }
+  } else {
+    // A random symmetric matrix with the same density and a unit diagonal.
+
+    std::uniform_int_distribution<std::size_t> col_dist(0, n - 1);
+    std::uniform_real_distribution<double> value_dist(config.kernel_epsilon,
+                                                      1);
+    for (std::size_t i = 0; i < n; ++i) {
+      triplets.push_back({i, i, 1});
+      for (std::size_t m = 0; m < params.nnz_per_row / 2; ++m) {
+        const std::size_t j = col_dist(data_rng);
+        const double value = value_dist(data_rng);
+        if (j != i) {
+          triplets.push_back({i, j, value});
+          triplets.push_back({j, i, value});
+        }
+      }
+    }
+    std::sort(triplets.begin(), triplets.end());
+    triplets.erase(std::unique(triplets.begin(), triplets.end(),
+                               [](const auto &a, const auto &b) {
+                                 return !(a < b) && !(b < a);
+                               }),
+                   triplets.end());
+
+    auto copy = triplets;
+    kernel_matrix = diffusion_maps::SparseMatrix(n, n, copy);
+  }
+
+  double mean = 0, sq_mean = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const double row_nnz = static_cast<double>(kernel_matrix.row_ixs()[i + 1] -
+                                               kernel_matrix.row_ixs()[i]);
+    mean += row_nnz / n;
+    sq_mean += row_nnz * row_nnz / n;
+  }
+  row_nnz_cv = std::sqrt(std::max(sq_mean - mean * mean, 0.0)) / mean;
+
+  diffusion_matrix = std::move(kernel_matrix);
+  diffusion_maps::internal::compute_symmetrised_diffusion_matrix(
+      diffusion_matrix);
+
+  std::normal_distribution normal;
+  x = diffusion_maps::Vector(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = normal(data_rng);
+  }
+}
+
+std::vector<bench::Stage> &bench::stages() {
+  static std::vector<Stage> registry;
+  return registry;
+}
+
+/// \brief Parses a comma-separated list.
+///
+/// \tparam T The type of the elements.
+/// \param[in] arg The list.
+/// \return The elements.
+/// \exception std::invalid_argument If an element cannot be parsed.
+template <typename T> static std::vector<T> parse_list(const std::string &arg) {
+  std::vector<T> result;
+  std::stringstream ss(arg);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    std::stringstream item_ss(item);
+    T value;
+    if (!(item_ss >> value) || !item_ss.eof()) {
+      throw std::invalid_argument("cannot parse '" + item + "'");
+    }
+    result.push_back(value);
+  }
+  return result;
+}
+
+/// \brief Parses a single value.
+///
+/// \tparam T The type of the value.
+/// \param[in] arg The value.
+/// \return The value.
+/// \exception std::invalid_argument If the value cannot be parsed.
+template <typename T> static T parse_value(const std::string &arg) {
+  const std::vector<T> values = parse_list<T>(arg);
+  if (values.size() != 1) {
+    throw std::invalid_argument("expected a single value: '" + arg + "'");
+  }
+  return values[0];
+}
+
+/// Escapes a string for JSON.
+static std::string json_string(const std::string &s) {
+  std::string result = "\"";
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += c;
+  }
+  return result + "\"";
+}
+
+/// Formats a number for JSON.
+static std::string json_number(const double x) {
+  if (!std::isfinite(x)) {
+    return "null";
+  }
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%.9g", x);
+  return buf;
+}
+
+/// Runs the benchmarks and writes the results as JSON.
+static void run(const bench::Config &config, std::ostream &out) {
+  for (const std::string &name : config.stages) {
+    const auto &registry = bench::stages();
+    if (std::none_of(
+            registry.begin(), registry.end(),
+            [&name](const auto &stage) { return stage.name == name; })) {
+      throw std::invalid_argument("unknown stage: " + name);
+    }
+  }
+
+  int max_threads = 1;
+#ifdef _OPENMP
+  max_threads = omp_get_max_threads();
+#endif
+
+  const diffusion_maps::AllocationPolicy policy =
+      diffusion_maps::allocation_policy();
+  out << "{\n  \"max_threads\": " << max_threads
+      << ",\n  \"parallel_first_touch\": "
+      << (policy.parallel_first_touch ? "true" : "false")
+      << ",\n  \"huge_pages\": " << (policy.huge_pages ? "true" : "false")
+      << ",\n  \"min_time\": " << json_number(config.min_time)
+      << ",\n  \"repeats\": " << config.repeats << ",\n  \"results\": [";
+  bool first = true;
+
+  for (const bench::Case &params : config.cases) {
+    std::cerr << "Case n_samples=" << params.n_samples
+              << " n_features=" << params.n_features
+              << " nnz_per_row=" << params.nnz_per_row
+              << " distribution=" << params.distribution << std::endl;
+#ifdef _OPENMP
+    omp_set_num_threads(max_threads);
+#endif
+    bench::Fixture fixture(config, params);
+
+    for (const int n_threads : config.n_threads) {
+#ifdef _OPENMP
+      omp_set_num_threads(n_threads);
+#endif
+
+      for (const bench::Stage &stage : bench::stages()) {
+        if (!config.stages.empty() &&
+            std::find(config.stages.begin(), config.stages.end(),
+                      stage.name) == config.stages.end()) {
+          continue;
+        }
+        if (stage.applies && !stage.applies(fixture)) {
+          continue;
+        }
+        std::cerr << "  " << stage.name << " (" << n_threads << " threads)"
+                  << std::endl;
+
+        // Each repetition calls the stage until the minimum time is reached,
+        // excluding the setup, and records the time per call.
+
+        std::vector<double> times;
+        unsigned n_calls = 0;
+        for (unsigned r = 0; r < config.repeats; ++r) {
+          double elapsed = 0;
+          unsigned calls = 0;
+          do {
+            fixture.scratch_triplets.clear();
+            fixture.counters.clear();
+            if (stage.setup) {
+              stage.setup(fixture);
+            }
+            const auto start = std::chrono::steady_clock::now();
+            stage.run(fixture);
+            const auto stop = std::chrono::steady_clock::now();
+            elapsed += std::chrono::duration<double>(stop - start).count();
+            ++calls;
+          } while (elapsed < config.min_time);
+          times.push_back(elapsed / calls);
+          n_calls += calls;
+        }
+
+        std::sort(times.begin(), times.end());
+        double mean = 0;
+        for (const double t : times) {
+          mean += t / times.size();
+        }
+
+        out << (first ? "\n" : ",\n") << "    {\"stage\": "
+            << json_string(stage.name)
+            << ", \"n_samples\": " << params.n_samples
+            << ", \"n_features\": " << params.n_features
+            << ", \"nnz_per_row\": " << params.nnz_per_row
+            << ", \"distribution\": " << json_string(params.distribution)
+            << ", \"n_threads\": " << n_threads
+            << ", \"matrix\": " << json_string(fixture.from_kernel ? "kernel"
+                                                                   : "random")
+            << ", \"gamma\": " << json_number(fixture.gamma)
+            << ", \"row_nnz_cv\": " << json_number(fixture.row_nnz_cv)
+            << ", \"n_calls\": " << n_calls
+            << ", \"min_s\": " << json_number(times.front())
+            << ", \"median_s\": " << json_number(times[times.size() / 2])
+            << ", \"mean_s\": " << json_number(mean)
+            << ", \"max_s\": " << json_number(times.back())
+            << ", \"counters\": {";
+        bool first_counter = true;
+        for (const auto &[key, value] : fixture.counters) {
+          out << (first_counter ? "" : ", ") << json_string(key) << ": "
+              << json_number(value);
+          first_counter = false;
+        }
+        out << "}}" << std::flush;
+        first = false;
+      }
+    }
+  }
+
+  out << "\n  ]\n}\n";
+}
+
+int main(int argc, char **argv) {
+  bench::register_pipeline_stages();
+
+  bench::Config config;
+  std::vector<std::size_t> sizes = {1000, 10000};
+  std::vector<std::size_t> dims = {3};
+  std::vector<std::size_t> nnz_per_row = {32};
+  std::vector<std::string> distributions = {"uniform"};
+  std::string output;
+
+  try {
+    for (int i = 1; i < argc; ++i) {
+      const std::string flag = argv[i];
+      if (i + 1 >= argc) {
+        throw std::invalid_argument("missing value for " + flag);
+      }
+      const std::string arg = argv[++i];
+
+      if (flag == "--sizes") {
+        sizes = parse_list<std::size_t>(arg);
+      } else if (flag == "--dims") {
+        dims = parse_list<std::size_t>(arg);
+      } else if (flag == "--nnz-per-row") {
+        nnz_per_row = parse_list<std::size_t>(arg);
+      } else if (flag == "--distributions") {
+        distributions = parse_list<std::string>(arg);
+      } else if (flag == "--threads") {
+        config.n_threads = parse_list<int>(arg);
+      } else if (flag == "--stages") {
+        config.stages = parse_list<std::string>(arg);
+      } else if (flag == "--repeats") {
+        config.repeats = parse_value<unsigned>(arg);
+      } else if (flag == "--min-time") {
+        config.min_time = parse_value<double>(arg);
+      } else if (flag == "--max-kernel-size") {
+        config.max_kernel_size = parse_value<std::size_t>(arg);
+      } else if (flag == "--kernel-epsilon") {
+        config.kernel_epsilon = parse_value<double>(arg);
+      } else if (flag == "--n-eigenpairs") {
+        config.n_eigenpairs = parse_value<unsigned>(arg);
+      } else if (flag == "--tol") {
+        config.eig_solver_tol = parse_value<double>(arg);
+      } else if (flag == "--max-iters") {
+        config.eig_solver_max_iter = parse_value<unsigned>(arg);
+      } else if (flag == "--chebyshev-degree") {
+        config.chebyshev_degree = parse_value<unsigned>(arg);
+      } else if (flag == "--first-touch") {
+        diffusion_maps::AllocationPolicy policy =
+            diffusion_maps::allocation_policy();
+        policy.parallel_first_touch = parse_value<bool>(arg);
+        diffusion_maps::set_allocation_policy(policy);
+      } else if (flag == "--huge-pages") {
+        diffusion_maps::AllocationPolicy policy =
+            diffusion_maps::allocation_policy();
+        policy.huge_pages = parse_value<bool>(arg);
+        diffusion_maps::set_allocation_policy(policy);
+      } else if (flag == "--output") {
+        output = arg;
+      } else {
+        throw std::invalid_argument("unknown option: " + flag);
+      }
+    }
+
+    if (config.repeats == 0) {
+      throw std::invalid_argument("repeats must be positive");
+    }
+    for (const std::string &distribution : distributions) {
+      if (distribution != "uniform" && distribution != "gaussian") {
+        throw std::invalid_argument("unknown distribution: " + distribution);
+      }
+    }
+    for (const std::size_t n : sizes) {
+      for (const std::size_t d : dims) {
+        for (const std::size_t k : nnz_per_row) {
+          if (n < 2 || d == 0 || k == 0) {
+            throw std::invalid_argument("sizes must be at least 2, and dims "
+                                        "and nnz-per-row positive");
+          }
+          for (const std::string &distribution : distributions) {
+            config.cases.push_back({n, d, k, distribution});
+          }
+        }
+      }
+    }
+
+    if (output.empty()) {
+      run(config, std::cout);
+    } else {
+      std::ofstream out(output);
+      if (!out) {
+        throw std::runtime_error("cannot open " + output);
+      }
+      run(config, out);
+    }
+  } catch (const std::exception &e) {
+    std::cerr << "bench: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+/// \file
+///
+/// \brief Benchmark harness.
+
+#ifndef DIFFUSION_MAPS_BENCH_BENCH_HPP
+#define DIFFUSION_MAPS_BENCH_BENCH_HPP
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "diffusion_maps/compressed_matrix.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sell_matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+/// Benchmark harness.
+namespace bench {
+
+/// The parameters of a benchmark case.
+class Case {
+public:
+  /// The number of data points.
+  std::size_t n_samples;
+  /// The number of features of each data point.
+  std::size_t n_features;
+  /// The target average number of non-zero elements per row of the kernel
+  /// matrix.
+  std::size_t nnz_per_row;
+  /// \brief The distribution of the data points: "uniform" in the unit
+  ///        hypercube, which gives a similar number of non-zero elements in
+  ///        every row, or "gaussian", which gives many more in the dense
+  ///        centre than in the tails.
+  std::string distribution = "uniform";
+};
+
+/// The configuration shared by all benchmark cases.
+class Config {
+public:
+  /// The cases.
+  std::vector<Case> cases;
+  /// The numbers of threads.
+  std::vector<int> n_threads = {1};
+  /// The names of the stages to run. All stages if empty.
+  std::vector<std::string> stages;
+  /// The number of timed repetitions of each stage.
+  unsigned repeats = 5;
+  /// The minimum time in seconds of each repetition. A stage is called as many
+  /// times as needed to reach it and the time per call is reported.
+  double min_time = 0.1;
+  /// The largest number of data points for which the kernel matrix is computed
+  /// from the data. Larger cases use a random sparse matrix instead, since the
+  /// kernel matrix takes quadratic time.
+  std::size_t max_kernel_size = 20000;
+  /// The value below which the output of the kernel is treated as zero.
+  double kernel_epsilon = 1e-6;
+  /// The number of eigenpairs for the eigendecomposition stages.
+  unsigned n_eigenpairs = 5;
+  /// The tolerance of the eigendecomposition solver.
+  double eig_solver_tol = 1e-6;
+  /// The maximum number of iterations of the eigendecomposition solver.
+  unsigned eig_solver_max_iter = 1000;
+  /// The degree of the Chebyshev polynomial of the Chebyshev-filtered solver.
+  unsigned chebyshev_degree = 8;
+};
+
+/// The inputs of a benchmark case, shared by the stages.
+class Fixture {
+public:
+  /// The configuration.
+  const Config *config;
+  /// The case.
+  Case params;
+  /// The data matrix, drawn from Case::distribution.
+  diffusion_maps::Matrix data;
+  /// \brief The kernel parameter γ that gives about Case::nnz_per_row non-zero
+  ///        elements per row.
+  double gamma;
+  /// Whether the kernel matrix was computed from the data.
+  bool from_kernel;
+  /// \brief The coefficient of variation of the number of non-zero elements
+  ///        per row of the kernel matrix.
+  double row_nnz_cv;
+  /// The non-zero elements of the kernel matrix.
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  /// The "symmetrised" diffusion matrix.
+  diffusion_maps::SparseMatrix diffusion_matrix;
+  /// \brief The "symmetrised" diffusion matrix in reverse Cuthill-McKee order.
+  ///        Built by the first stage that needs it.
+  diffusion_maps::SparseMatrix rcm_diffusion_matrix;
+  /// \brief The "symmetrised" diffusion matrix in the SELL-C-σ format. Built
+  ///        by the first stage that needs it.
+  diffusion_maps::SellMatrix sell_diffusion_matrix;
+  /// \brief The "symmetrised" diffusion matrix in the compressed CSR format
+  ///        with float values. Built by the first stage that needs it.
+  diffusion_maps::CompressedMatrix compressed_diffusion_matrix;
+  /// \brief The "symmetrised" diffusion matrix as a dense matrix. Rebuilt
+  ///        before each call of the stage that needs it, which destroys it.
+  diffusion_maps::Matrix dense_diffusion_matrix;
+  /// A random vector with one element per data point.
+  diffusion_maps::Vector x;
+  /// The random number generator of the stages.
+  std::default_random_engine rng;
+  /// Scratch space for the stages, reset before each call.
+  std::vector<diffusion_maps::SparseMatrix::Triplet> scratch_triplets;
+  /// \brief The counters of the last call of a stage, e.g. the number of
+  ///        iterations. Reported alongside the times.
+  std::map<std::string, double> counters;
+
+  /// Builds the inputs of a case.
+  Fixture(const Config &config, const Case &params);
+};
+
+/// A stage of the pipeline to be timed.
+class Stage {
+public:
+  /// The name of the stage.
+  std::string name;
+  /// Whether the stage applies to a fixture. Always if empty.
+  std::function<bool(const Fixture &)> applies;
+  /// Prepares a call of the stage. Not timed. Nothing if empty.
+  std::function<void(Fixture &)> setup;
+  /// Runs the stage. Timed.
+  std::function<void(Fixture &)> run;
+};
+
+/// \brief The registry of stages, in the order they are run.
+///
+/// \return A reference to the registry.
+std::vector<Stage> &stages();
+
+/// Registers the stages of the pipeline.
+void register_pipeline_stages();
+
+} // namespace bench
+
+#endif
@@ -0,0 +1,347 @@
+#include <cstddef>
+#include <numeric>
+#include <stdexcept>
+#include <vector>
+
+#include "bench.hpp"
+#include "diffusion_maps/compressed_matrix.hpp"
+#include "diffusion_maps/internal/dense_eig_solver.hpp"
+#include "diffusion_maps/internal/eig_solver.hpp"
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/internal/reordering.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/metric.hpp"
+#include "diffusion_maps/plan.hpp"
+#include "diffusion_maps/sell_matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/stats.hpp"
+#include "diffusion_maps/vector.hpp"
+
+void bench::register_pipeline_stages() {
+  std::vector<Stage> &registry = stages();
+
+  // Step 1 of diffusion maps.
+
+  registry.push_back(
+      {"compute_kernel_matrix",
+       [](const Fixture &fixture) { return fixture.from_kernel; }, nullptr,
+       [](Fixture &fixture) {
+         const auto kernel_matrix =
+             diffusion_maps::internal::compute_kernel_matrix(
+                 fixture.data, diffusion_maps::kernel::Gaussian(fixture.gamma),
+                 fixture.config->kernel_epsilon);
+         fixture.counters["n_nz"] = kernel_matrix.n_nz();
+       }});
+
+  // The full kernel matrix of the dense solver, with the same γ.
+
+  registry.push_back(
+      {"compute_dense_kernel_matrix",
+       [](const Fixture &fixture) { return fixture.from_kernel; }, nullptr,
+       [](Fixture &fixture) {
+         diffusion_maps::Stats stats;
+         const diffusion_maps::Matrix kernel_matrix =
+             diffusion_maps::internal::compute_dense_kernel_matrix(
+                 fixture.data, diffusion_maps::kernel::Gaussian(fixture.gamma),
+                 fixture.config->kernel_epsilon, &stats);
+         fixture.counters["n_nz"] = stats.n_nz;
+       }});
+
+  // The same kernel through the generic kernel function, which evaluates it on
+  // copies of the rows, and the other metrics with the same γ.
+
+  registry.push_back(
+      {"compute_kernel_matrix_generic",
+       [](const Fixture &fixture) { return fixture.from_kernel; }, nullptr,
+       [](Fixture &fixture) {
+         const diffusion_maps::kernel::Gaussian kernel(fixture.gamma);
+         const auto kernel_matrix =
+             diffusion_maps::internal::compute_kernel_matrix(
+                 fixture.data,
+                 [&kernel](const diffusion_maps::Vector &x,
+                           const diffusion_maps::Vector &y) {
+                   return kernel(x, y);
+                 },
+                 fixture.config->kernel_epsilon);
+         fixture.counters["n_nz"] = kernel_matrix.n_nz();
+       }});
+
+  registry.push_back(
+      {"compute_kernel_matrix_cosine",
+       [](const Fixture &fixture) { return fixture.from_kernel; }, nullptr,
+       [](Fixture &fixture) {
+         const auto kernel_matrix =
+             diffusion_maps::internal::compute_kernel_matrix(
+                 fixture.data,
+                 diffusion_maps::kernel::MetricGaussian<
+                     diffusion_maps::metric::Cosine>(fixture.gamma),
+                 fixture.config->kernel_epsilon);
+         fixture.counters["n_nz"] = kernel_matrix.n_nz();
+       }});
+
+  registry.push_back(
+      {"compute_kernel_matrix_l1",
+       [](const Fixture &fixture) { return fixture.from_kernel; }, nullptr,
+       [](Fixture &fixture) {
+         const auto kernel_matrix =
+             diffusion_maps::internal::compute_kernel_matrix(
+                 fixture.data,
+                 diffusion_maps::kernel::MetricGaussian<
+                     diffusion_maps::metric::L1>(fixture.gamma),
+                 fixture.config->kernel_epsilon);
+         fixture.counters["n_nz"] = kernel_matrix.n_nz();
+       }});
+
+  // The Euclidean kernel again, reading quantised data points.
+
+  registry.push_back(
+      {"compute_kernel_matrix_float16",
+       [](const Fixture &fixture) { return fixture.from_kernel; }, nullptr,
+       [](Fixture &fixture) {
+         diffusion_maps::Stats stats;
+         const auto kernel_matrix =
+             diffusion_maps::internal::compute_kernel_matrix(
+                 fixture.data, diffusion_maps::kernel::Gaussian(fixture.gamma),
+                 fixture.config->kernel_epsilon, &stats,
+                 diffusion_maps::Precision::FLOAT16);
+         fixture.counters["n_nz"] = kernel_matrix.n_nz();
+         fixture.counters["n_kernel_evals_exact"] = stats.n_kernel_evals_exact;
+       }});
+
+  registry.push_back(
+      {"compute_kernel_matrix_int8",
+       [](const Fixture &fixture) { return fixture.from_kernel; }, nullptr,
+       [](Fixture &fixture) {
+         diffusion_maps::Stats stats;
+         const auto kernel_matrix =
+             diffusion_maps::internal::compute_kernel_matrix(
+                 fixture.data, diffusion_maps::kernel::Gaussian(fixture.gamma),
+                 fixture.config->kernel_epsilon, &stats,
+                 diffusion_maps::Precision::INT8);
+         fixture.counters["n_nz"] = kernel_matrix.n_nz();
+         fixture.counters["n_kernel_evals_exact"] = stats.n_kernel_evals_exact;
+       }});
+
+  // The triplets are sorted in-place, so each call gets a fresh copy.
+
+  registry.push_back(
+      {"sparse_matrix_triplets", nullptr,
+       [](Fixture &fixture) { fixture.scratch_triplets = fixture.triplets; },
+       [](Fixture &fixture) {
+         const std::size_t n = fixture.params.n_samples;
+         const diffusion_maps::SparseMatrix matrix(n, n,
+                                                   fixture.scratch_triplets);
+         fixture.counters["n_nz"] = matrix.n_nz();
+       }});
+
+  // Step 2 of diffusion maps from the triplets: assembling the kernel matrix
+  // and normalising it in two passes, or in one.
+
+  registry.push_back(
+      {"symmetrised_diffusion_matrix", nullptr,
+       [](Fixture &fixture) { fixture.scratch_triplets = fixture.triplets; },
+       [](Fixture &fixture) {
+         const std::size_t n = fixture.params.n_samples;
+         diffusion_maps::SparseMatrix matrix(n, n, fixture.scratch_triplets);
+         diffusion_maps::internal::compute_symmetrised_diffusion_matrix(
+             matrix);
+         fixture.counters["n_nz"] = matrix.n_nz();
+       }});
+
+  registry.push_back(
+      {"fused_symmetrised_diffusion_matrix", nullptr,
+       [](Fixture &fixture) { fixture.scratch_triplets = fixture.triplets; },
+       [](Fixture &fixture) {
+         const std::size_t n = fixture.params.n_samples;
+         diffusion_maps::Vector invsqrt_row_sum;
+         const diffusion_maps::SparseMatrix matrix =
+             diffusion_maps::internal::assemble_symmetrised_diffusion_matrix(
+                 n, fixture.scratch_triplets, 0, invsqrt_row_sum, 0);
+         fixture.counters["n_nz"] = matrix.n_nz();
+       }});
+
+  registry.push_back({"sparse_matrix_spmv", nullptr, nullptr,
+                      [](Fixture &fixture) {
+                        const diffusion_maps::Vector y =
+                            fixture.diffusion_matrix * fixture.x;
+                        fixture.counters["n_nz"] =
+                            fixture.diffusion_matrix.n_nz();
+                      }});
+
+  // The SELL-C-σ format of the sparse matrix-vector products.
+
+  registry.push_back(
+      {"sell_matrix_from_csr", nullptr, nullptr, [](Fixture &fixture) {
+         const diffusion_maps::SellMatrix matrix(fixture.diffusion_matrix);
+         fixture.counters["n_nz"] = matrix.n_nz();
+         fixture.counters["n_stored"] = matrix.n_stored();
+       }});
+
+  registry.push_back(
+      {"sell_matrix_spmv", nullptr,
+       [](Fixture &fixture) {
+         if (fixture.sell_diffusion_matrix.n_rows() == 0) {
+           fixture.sell_diffusion_matrix =
+               diffusion_maps::SellMatrix(fixture.diffusion_matrix);
+         }
+       },
+       [](Fixture &fixture) {
+         const diffusion_maps::Vector y =
+             fixture.sell_diffusion_matrix * fixture.x;
+         fixture.counters["n_nz"] = fixture.sell_diffusion_matrix.n_nz();
+         fixture.counters["n_stored"] =
+             fixture.sell_diffusion_matrix.n_stored();
+       }});
+
+  // The compressed CSR format of the sparse matrix-vector products.
+
+  registry.push_back(
+      {"compressed_matrix_from_csr", nullptr, nullptr, [](Fixture &fixture) {
+         const diffusion_maps::CompressedMatrix matrix(
+             fixture.diffusion_matrix);
+         fixture.counters["n_nz"] = matrix.n_nz();
+         fixture.counters["n_bytes"] = matrix.n_bytes();
+       }});
+
+  registry.push_back(
+      {"compressed_matrix_spmv", nullptr,
+       [](Fixture &fixture) {
+         if (fixture.compressed_diffusion_matrix.n_rows() == 0) {
+           fixture.compressed_diffusion_matrix =
+               diffusion_maps::CompressedMatrix(fixture.diffusion_matrix);
+         }
+       },
+       [](Fixture &fixture) {
+         const diffusion_maps::Vector y =
+             fixture.compressed_diffusion_matrix * fixture.x;
+         fixture.counters["n_nz"] = fixture.compressed_diffusion_matrix.n_nz();
+         fixture.counters["n_bytes"] =
+             fixture.compressed_diffusion_matrix.n_bytes();
+       }});
+
+  // Reordering for locality of the sparse matrix-vector products.
+
+  registry.push_back(
+      {"reverse_cuthill_mckee", nullptr, nullptr, [](Fixture &fixture) {
+         const auto perm = diffusion_maps::internal::reverse_cuthill_mckee(
+             fixture.diffusion_matrix);
+         fixture.counters["n"] = perm.size();
+       }});
+
+  registry.push_back(
+      {"sparse_matrix_spmv_rcm", nullptr,
+       [](Fixture &fixture) {
+         if (fixture.rcm_diffusion_matrix.n_rows() == 0) {
+           fixture.rcm_diffusion_matrix = diffusion_maps::internal::permute(
+               fixture.diffusion_matrix,
+               diffusion_maps::internal::reverse_cuthill_mckee(
+                   fixture.diffusion_matrix));
+         }
+       },
+       [](Fixture &fixture) {
+         const diffusion_maps::Vector y =
+             fixture.rcm_diffusion_matrix * fixture.x;
+         fixture.counters["n_nz"] = fixture.rcm_diffusion_matrix.n_nz();
+       }});
+
+  // Step 3 of diffusion maps.
+
+  registry.push_back(
+      {"symmetric_power_method", nullptr, nullptr, [](Fixture &fixture) {
+         unsigned n_iters = 0;
+         const auto result = diffusion_maps::internal::symmetric_power_method(
+             fixture.diffusion_matrix, fixture.x, nullptr, 0,
+             fixture.config->eig_solver_tol,
+             fixture.config->eig_solver_max_iter, &n_iters);
+         fixture.counters["n_iters"] = n_iters;
+         fixture.counters["converged"] = result.has_value();
+       }});
+
+  registry.push_back({"eigsh", nullptr, nullptr, [](Fixture &fixture) {
+                        std::normal_distribution dist;
+                        std::vector<unsigned> n_iters;
+                        const auto [eigenvalues, eigenvectors] =
+                            diffusion_maps::internal::eigsh(
+                                fixture.diffusion_matrix,
+                                fixture.config->n_eigenpairs,
+                                fixture.config->eig_solver_tol,
+                                fixture.config->eig_solver_max_iter,
+                                [&fixture, &dist]() {
+                                  return dist(fixture.rng);
+                                },
+                                nullptr, 0, &n_iters);
+                        fixture.counters["n_iters"] = std::accumulate(
+                            n_iters.begin(), n_iters.end(), 0.0);
+                        fixture.counters["n_eigenpairs"] = eigenvalues.size();
+                      }});
+
+  registry.push_back(
+      {"chebyshev_eigsh", nullptr, nullptr, [](Fixture &fixture) {
+         std::normal_distribution dist;
+         std::vector<unsigned> n_iters;
+         diffusion_maps::Stats stats;
+         const auto [eigenvalues, eigenvectors] =
+             diffusion_maps::internal::chebyshev_eigsh(
+                 fixture.diffusion_matrix, fixture.config->n_eigenpairs,
+                 fixture.config->eig_solver_tol,
+                 fixture.config->eig_solver_max_iter,
+                 fixture.config->chebyshev_degree,
+                 [&fixture, &dist]() { return dist(fixture.rng); }, nullptr, 0,
+                 &n_iters, &stats);
+         fixture.counters["n_iters"] =
+             std::accumulate(n_iters.begin(), n_iters.end(), 0.0);
+         fixture.counters["n_spmv"] = stats.n_spmv;
+         fixture.counters["n_eigenpairs"] = eigenvalues.size();
+       }});
+
+  registry.push_back(
+      {"eigsh_sell", nullptr,
+       [](Fixture &fixture) {
+         if (fixture.sell_diffusion_matrix.n_rows() == 0) {
+           fixture.sell_diffusion_matrix =
+               diffusion_maps::SellMatrix(fixture.diffusion_matrix);
+         }
+       },
+       [](Fixture &fixture) {
+         std::normal_distribution dist;
+         std::vector<unsigned> n_iters;
+         const auto [eigenvalues, eigenvectors] =
+             diffusion_maps::internal::eigsh(
+                 fixture.sell_diffusion_matrix, fixture.config->n_eigenpairs,
+                 fixture.config->eig_solver_tol,
+                 fixture.config->eig_solver_max_iter,
+                 [&fixture, &dist]() { return dist(fixture.rng); }, nullptr, 0,
+                 &n_iters);
+         fixture.counters["n_iters"] =
+             std::accumulate(n_iters.begin(), n_iters.end(), 0.0);
+         fixture.counters["n_eigenpairs"] = eigenvalues.size();
+       }});
+
+  // The dense solver, on the diffusion matrix expanded before each call.
+
+  registry.push_back(
+      {"dense_eigsh",
+       [](const Fixture &fixture) {
+         return fixture.params.n_samples <=
+                diffusion_maps::PLAN_DENSE_MAX_SAMPLES;
+       },
+       [](Fixture &fixture) {
+         const diffusion_maps::SparseMatrix &matrix = fixture.diffusion_matrix;
+         const std::size_t n_samples = matrix.n_rows();
+         fixture.dense_diffusion_matrix =
+             diffusion_maps::Matrix(n_samples, n_samples);
+         for (std::size_t i = 0; i < n_samples; ++i) {
+           for (std::size_t ir = matrix.row_ixs()[i];
+                ir < matrix.row_ixs()[i + 1]; ++ir) {
+             fixture.dense_diffusion_matrix(i, matrix.col_ixs()[ir]) =
+                 matrix.data()[ir];
+           }
+         }
+       },
+       [](Fixture &fixture) {
+         const auto [eigenvalues, eigenvectors] =
+             diffusion_maps::internal::dense_eigsh(
+                 fixture.dense_diffusion_matrix, fixture.config->n_eigenpairs);
+         fixture.counters["n_eigenpairs"] = eigenvalues.size();
+       }});
+}
@@ -1,5 +1,10 @@
 """A library for diffusion maps."""
 
-from .diffusion_maps import diffusion_maps
+from .diffusion_maps import (AsyncFit, Cancelled, Decomposition, SweepResult,
+                             WarmStart, decompose, diffusion_maps,
+                             diffusion_maps_async, diffusion_maps_batch, plan,
+                             sweep)
 
-__all__ = ['diffusion_maps']
+__all__ = ['AsyncFit', 'Cancelled', 'Decomposition', 'SweepResult',
+           'WarmStart', 'decompose', 'diffusion_maps', 'diffusion_maps_async',
+           'diffusion_maps_batch', 'plan', 'sweep']
@@ -1,36 +1,303 @@
 """Diffusion maps."""
 
-from typing import Optional
+import asyncio
+import sys
+import time
+from typing import List, Optional, Sequence, Tuple, Union
 
 import numpy as np
 
 import _diffusion_maps
 
 
+WarmStart = _diffusion_maps.WarmStart
+"""State carried from one fit to the next to warm-start the eigendecomposition
+solver.
+
+Pass the same object as `warm_start` to every fit of a sequence of refits on
+slowly drifting data. If the data points change between fits, call
+``remap(prev_ixs)`` before the next fit, where ``prev_ixs[i]`` is the index of
+the i-th new data point in the previous fit, or ``None`` if the point is new.
+After a fit, ``n_iters_saved()`` gives the number of iterations saved compared
+with the last fit that was not warm-started.
+"""
+
+Decomposition = _diffusion_maps.Decomposition
+"""Eigendecomposition of the diffusion matrix, returned by `decompose`.
+
+``embed(diffusion_time)`` computes the diffusion maps for a diffusion time in
+time linear in the number of data points, without recomputing the kernel matrix
+or the eigendecomposition. ``eigenvalues`` holds the eigenvalues, including the
+trivial first one.
+"""
+
+SweepResult = _diffusion_maps.SweepResult
+"""The result of a fit in a hyperparameter sweep, returned by `sweep`.
+
+``setting.gamma`` and ``setting.kernel_epsilon`` are the hyperparameters,
+``decomposition`` is the `Decomposition`, ``n_nz`` is the number of non-zero
+elements in the kernel matrix, and ``eigengap`` is the relative gap
+``(λ_k - λ_{k+1}) / λ_k`` after the last retained eigenvalue, or NaN if it is
+not available. A larger gap means a more stable embedding.
+"""
+
+Cancelled = _diffusion_maps.Cancelled
+"""Raised by the result of a fit that was cancelled with `AsyncFit.cancel`."""
+
 default_kernel_epsilon = 1e-6
 default_eig_solver_tol = 1e-6
 default_eig_solver_max_iter = 100000
+default_randomized_oversampling = 10
+default_randomized_n_power_iters = 4
+default_chebyshev_degree = 8
+
+
+def _is_sparse(data) -> bool:
+    """Whether the data matrix is a scipy.sparse matrix."""
+    # SciPy is optional, and is loaded if the caller already uses it.
+    scipy_sparse = sys.modules.get('scipy.sparse')
+    return scipy_sparse is not None and scipy_sparse.issparse(data)
+
+
+def _csr_arrays(data) -> tuple:
+    """Returns the shape and CSR arrays of a sparse data matrix, with the types
+    of the extension module. The arrays are not copied if the matrix is already
+    in the canonical CSR format with float64 values and int64 indices."""
+    csr = data.tocsr()
+    if not csr.has_canonical_format:
+        csr = csr.copy()
+        csr.sum_duplicates()
+    return (csr.shape[0], csr.shape[1],
+            np.ascontiguousarray(csr.data, dtype=np.float64),
+            np.ascontiguousarray(csr.indices, dtype=np.int64),
+            np.ascontiguousarray(csr.indptr, dtype=np.int64))
+
+
+def _feature_std(data) -> np.ndarray:
+    """Returns the standard deviation of each feature of a dense or sparse data
+    matrix."""
+    if not _is_sparse(data):
+        return np.std(data, axis=0)
+    mean = np.asarray(data.mean(axis=0)).ravel()
+    sq_mean = np.asarray(data.multiply(data).mean(axis=0)).ravel()
+    return np.sqrt(np.maximum(sq_mean - mean * mean, 0))
+
+
+def _decompose(data, *args) -> Decomposition:
+    """Calls the decompose function of the extension module for dense or sparse
+    data."""
+    if _is_sparse(data):
+        return _diffusion_maps.decompose_sparse(*_csr_arrays(data), *args)
+    return _diffusion_maps.decompose(data, *args)
+
+
+def _diffusion_maps(data, *args) -> np.ndarray:
+    """Calls the diffusion_maps function of the extension module for dense or
+    sparse data."""
+    if _is_sparse(data):
+        return _diffusion_maps.diffusion_maps_sparse(*_csr_arrays(data), *args)
+    return _diffusion_maps.diffusion_maps(data, *args)
+
+
+def _kernel_obj(data: np.ndarray, kernel: str, kwargs: dict):
+    """Translates the kernel name and parameters into a kernel object."""
+    if kernel == 'gaussian':
+        if 'gamma' in kwargs:
+            if 'sigma' in kwargs:
+                raise ValueError('cannot specify both gamma and sigma')
+            else:
+                gamma = kwargs['gamma']
+        elif 'sigma' in kwargs:
+            sigma = kwargs['sigma']
+            gamma = 1 / (2 * sigma*sigma)
+        else:
+            # Use default value.
+            n_features = data.shape[1]
+            gamma = 1 / n_features
+
+        metric = kwargs.get('metric', 'euclidean')
+        if metric not in ('euclidean', 'cosine', 'l1', 'mahalanobis'):
+            raise ValueError(f'unknown metric: {metric}')
+        if metric == 'mahalanobis':
+            scale = kwargs.get('scale')
+            if scale is None:
+                scale = _feature_std(data)
+                # Constant features do not contribute to the distance.
+                scale[scale == 0] = 1
+            scale = np.asarray(scale, dtype=np.float64)
+            if scale.shape != (data.shape[1],) or not np.all(scale > 0):
+                raise ValueError('scale must have one positive value per '
+                                 'feature')
+            return _diffusion_maps.kernel.Gaussian(gamma, metric, list(scale))
+
+        return _diffusion_maps.kernel.Gaussian(gamma, metric)
+    else:
+        raise ValueError(f'unknown kernel: {kernel}')
+
+
+def _options(kernel_epsilon: float, eig_solver_tol: float,
+             eig_solver_max_iter: int, eig_solver: str,
+             randomized_oversampling: int, randomized_n_power_iters: int,
+             reordering: str = 'none', matrix_format: str = 'csr',
+             chebyshev_degree: int = default_chebyshev_degree,
+             alpha: float = 0.0, self_tuning_neighbours: int = 0,
+             kernel_precision: str = 'double', memory_budget: int = 0,
+             auto_plan: bool = False):
+    """Builds the options of the extension module."""
+    if eig_solver == 'power_method':
+        eig_solver_obj = _diffusion_maps.EigSolver.POWER_METHOD
+    elif eig_solver == 'randomized':
+        eig_solver_obj = _diffusion_maps.EigSolver.RANDOMIZED
+    elif eig_solver == 'chebyshev':
+        eig_solver_obj = _diffusion_maps.EigSolver.CHEBYSHEV
+    elif eig_solver == 'dense':
+        eig_solver_obj = _diffusion_maps.EigSolver.DENSE
+    else:
+        raise ValueError(f'unknown eigendecomposition solver: {eig_solver}')
+
+    if reordering == 'none':
+        reordering_obj = _diffusion_maps.Reordering.NONE
+    elif reordering == 'rcm':
+        reordering_obj = _diffusion_maps.Reordering.RCM
+    elif reordering == 'morton':
+        reordering_obj = _diffusion_maps.Reordering.MORTON
+    else:
+        raise ValueError(f'unknown reordering: {reordering}')
+
+    if matrix_format == 'csr':
+        matrix_format_obj = _diffusion_maps.MatrixFormat.CSR
+    elif matrix_format == 'sell':
+        matrix_format_obj = _diffusion_maps.MatrixFormat.SELL
+    elif matrix_format == 'compressed_float':
+        matrix_format_obj = _diffusion_maps.MatrixFormat.COMPRESSED_FLOAT
+    elif matrix_format == 'compressed_bf16':
+        matrix_format_obj = _diffusion_maps.MatrixFormat.COMPRESSED_BFLOAT16
+    else:
+        raise ValueError(f'unknown matrix format: {matrix_format}')
+
+    if kernel_precision == 'double':
+        kernel_precision_obj = _diffusion_maps.Precision.DOUBLE
+    elif kernel_precision == 'float16':
+        kernel_precision_obj = _diffusion_maps.Precision.FLOAT16
+    elif kernel_precision == 'int8':
+        kernel_precision_obj = _diffusion_maps.Precision.INT8
+    else:
+        raise ValueError(f'unknown kernel precision: {kernel_precision}')
+
+    options = _diffusion_maps.Options()
+    options.kernel_epsilon = kernel_epsilon
+    options.eig_solver = eig_solver_obj
+    options.eig_solver_tol = eig_solver_tol
+    options.eig_solver_max_iter = eig_solver_max_iter
+    options.randomized_oversampling = randomized_oversampling
+    options.randomized_n_power_iters = randomized_n_power_iters
+    options.chebyshev_degree = chebyshev_degree
+    options.alpha = alpha
+    options.self_tuning_neighbours = self_tuning_neighbours
+    options.reordering = reordering_obj
+    options.matrix_format = matrix_format_obj
+    options.kernel_precision = kernel_precision_obj
+    if memory_budget < 0:
+        raise ValueError('memory budget must be non-negative')
+    options.memory_budget = memory_budget
+    options.auto_plan = auto_plan
+    return options
+
+
+def decompose(
+        data: np.ndarray, n_components: int, kernel: str,
+        *, rng_seed: Optional[int] = None,
+        kernel_epsilon: float = default_kernel_epsilon,
+        eig_solver_tol: float = default_eig_solver_tol,
+        eig_solver_max_iter: int = default_eig_solver_max_iter,
+        eig_solver: str = 'power_method',
+        randomized_oversampling: int = default_randomized_oversampling,
+        randomized_n_power_iters: int = default_randomized_n_power_iters,
+        chebyshev_degree: int = default_chebyshev_degree,
+        alpha: float = 0.0,
+        self_tuning_neighbours: int = 0,
+        kernel_precision: str = 'double',
+        reordering: str = 'none',
+        matrix_format: str = 'csr',
+        memory_budget: int = 0,
+        auto_plan: bool = False,
+        warm_start: Optional[WarmStart] = None,
+        return_stats: bool = False,
+        **kwargs) -> Union[Decomposition, Tuple[Decomposition, dict]]:
+    """Computes the eigendecomposition of the diffusion matrix, from which the
+    diffusion maps for any diffusion time can be computed with
+    ``Decomposition.embed``.
+
+    The parameters and exceptions are the same as those of `diffusion_maps`,
+    without `diffusion_time`.
+
+    Returns
+    -------
+    Decomposition
+        The eigendecomposition.
+    dict
+        The timings and counters of the fit, if `return_stats` is true.
+    """
+
+    # Check the dimensions.
+    if data.ndim != 2:
+        raise ValueError('data must be a 2D array')
+
+    kernel_obj = _kernel_obj(data, kernel, kwargs)
+    options = _options(kernel_epsilon, eig_solver_tol, eig_solver_max_iter,
+                       eig_solver, randomized_oversampling,
+                       randomized_n_power_iters, reordering,
+                       matrix_format, chebyshev_degree, alpha,
+                       self_tuning_neighbours, kernel_precision,
+                       memory_budget, auto_plan)
+
+    stats = _diffusion_maps.Stats() if return_stats else None
+    decomposition = _decompose(data, n_components, kernel_obj, rng_seed,
+                               options, warm_start, stats)
+
+    return (decomposition, stats.as_dict()) if return_stats else decomposition
 
 
 def diffusion_maps(
-        data: np.ndarray, n_components: int, kernel: str, diffusion_time: float,
+        data: np.ndarray, n_components: int, kernel: str,
+        diffusion_time: Union[float, Sequence[float]],
         *, rng_seed: Optional[int] = None,
         kernel_epsilon: float = default_kernel_epsilon,
         eig_solver_tol: float = default_eig_solver_tol,
         eig_solver_max_iter: int = default_eig_solver_max_iter,
-        **kwargs) -> np.ndarray:
+        eig_solver: str = 'power_method',
+        randomized_oversampling: int = default_randomized_oversampling,
+        randomized_n_power_iters: int = default_randomized_n_power_iters,
+        chebyshev_degree: int = default_chebyshev_degree,
+        alpha: float = 0.0,
+        self_tuning_neighbours: int = 0,
+        kernel_precision: str = 'double',
+        reordering: str = 'none',
+        matrix_format: str = 'csr',
+        memory_budget: int = 0,
+        auto_plan: bool = False,
+        warm_start: Optional[WarmStart] = None,
+        return_stats: bool = False,
+        **kwargs) -> Union[np.ndarray, List[np.ndarray],
+                           Tuple[Union[np.ndarray, List[np.ndarray]], dict]]:
     """Diffusion maps.
 
     Parameters
     ----------
-    data : np.ndarray
-        The data matrix where each row is a data point.
+    data : np.ndarray or scipy.sparse matrix
+        The data matrix where each row is a data point. A sparse matrix is
+        converted to the CSR format if needed, and its arrays are used without
+        copies if it is already in the canonical CSR format with float64
+        values and int64 indices. The kernel matrix is then computed only from
+        the non-zero features, which is much faster for high-dimensional
+        sparse data such as text or one-hot features.
     n_components : int
         The dimension of the projected subspace.
     kernel : {'gaussian'}
         The kernel function.
-    diffusion_time : float
-        The diffusion time.
+    diffusion_time : float or sequence of float
+        The diffusion time. If a sequence is given, the embeddings for all the
+        diffusion times are computed from a single eigendecomposition.
     rng_seed : int, optional
         The seed for the random number generator.
     kernel_epsilon : float, default 1e-6
@@ -39,13 +306,108 @@ def diffusion_maps(
         The tolerance of the eigendecomposition solver.
     eig_solver_max_iter : int, default 100000
         The maximum number of iterations of the eigendecomposition solver.
+    eig_solver : {'power_method', 'randomized', 'chebyshev', 'dense'}, \
+default 'power_method'
+        The eigendecomposition solver. 'power_method' iterates until the
+        tolerance is met. 'randomized' runs randomised subspace iteration for a
+        fixed number of passes over the kernel matrix and ignores
+        `eig_solver_tol` and `eig_solver_max_iter`. 'chebyshev' runs
+        Chebyshev-filtered subspace iteration until the residuals of the
+        eigenpairs are below `eig_solver_tol`, for at most
+        `eig_solver_max_iter` passes of `chebyshev_degree` + 1 products each.
+        It usually needs far fewer products than 'power_method', since the
+        wanted eigenvalues are clustered near 1. 'dense' stores the diffusion
+        matrix as a dense matrix, reduces it to tridiagonal form and solves
+        the tridiagonal eigenproblem directly, in O(n³) time and 8 n² bytes
+        whatever the spectrum; it suits nearly dense kernel matrices of up to
+        a few tens of thousands of points, and ignores `matrix_format`,
+        `eig_solver_tol` and `eig_solver_max_iter`.
+    randomized_oversampling : int, default 10
+        The number of extra vectors in the random block of the randomised
+        eigendecomposition solver.
+    randomized_n_power_iters : int, default 4
+        The number of power iterations of the randomised eigendecomposition
+        solver.
+    chebyshev_degree : int, default 8
+        The degree of the Chebyshev polynomial of the Chebyshev-filtered
+        eigendecomposition solver.
+    alpha : float, default 0
+        The exponent α of the density normalisation of the kernel matrix,
+        ``K⁽ᵅ⁾ᵢⱼ = Kᵢⱼ / (qᵢ qⱼ)^α`` where ``q`` is its row sums. 0 keeps the
+        classic normalised graph Laplacian, 0.5 approximates the Fokker-Planck
+        operator and 1 removes the effect of the sampling density, so that the
+        embedding reflects only the geometry of the data.
+    self_tuning_neighbours : int, default 0
+        If positive, the kernel is replaced by the self-tuning kernel
+        ``exp(-‖xᵢ - xⱼ‖² / (σᵢ σⱼ))``, where σᵢ is the distance from the i-th
+        data point to its `self_tuning_neighbours`-th nearest neighbour among
+        those whose kernel value is above `kernel_epsilon`. The kernel
+        parameter then only selects which pairs are kept.
+    kernel_precision : {'double', 'float16', 'int8'}, default 'double'
+        The precision in which the data points are read to compute the kernel
+        matrix of dense data. 'float16' and 'int8' quantise each feature over
+        its range, which reads 4 or 8 times less data when there are many
+        features. The pairs of data points near the cutoff of the kernel are
+        evaluated again in double precision, so the sparsity of the kernel
+        matrix is the same as with 'double', but the other kernel values carry
+        the quantisation error.
+    reordering : {'none', 'rcm', 'morton'}, default 'none'
+        The reordering of the data points before the eigendecomposition
+        solver, for locality of its sparse matrix-vector products. 'rcm'
+        applies reverse Cuthill-McKee to the kernel matrix and 'morton' sorts
+        the data points along a Z-order curve, and is not supported for sparse
+        data. The results are returned in the original order.
+    matrix_format : {'csr', 'sell', 'compressed_float', 'compressed_bf16'}, \
+default 'csr'
+        The storage format of the diffusion matrix in the eigendecomposition
+        solver. 'sell' converts it to the sliced ELLPACK format, whose
+        matrix-vector products use SIMD, at the cost of a second copy of the
+        matrix. 'compressed_float' and 'compressed_bf16' convert it to a
+        compressed CSR format with 16-bit gaps between column indices and
+        float or bfloat16 values, 6 or 4 bytes per element instead of 16, which
+        speeds up the products when they are bound by the memory bandwidth.
+        The values are rounded, with a relative error of about 6e-8 or 4e-3.
+    memory_budget : int, default 0
+        If positive, the memory budget of the fit in bytes. The fit is then
+        planned before the kernel matrix is computed, see `plan`, and raises
+        a `ValueError` if the estimated peak memory exceeds the budget.
+    auto_plan : bool, default False
+        If true, the fit is planned, see `plan`, and runs with the matrix
+        format and the eigendecomposition solver chosen by the plan instead of
+        `matrix_format` and `eig_solver`. A kernel matrix with at least half
+        of its elements non-zero, over at most 30000 points, gets the 'dense'
+        solver.
+    warm_start : WarmStart, optional
+        If given, the eigendecomposition solver starts from the eigenvectors
+        stored in it, and the eigenvectors and iteration counts of this fit are
+        stored back into it.
+    return_stats : bool, default False
+        If true, also return the timings and counters of the fit.
     **kwargs : dict, optional
         The keyword arguments of the kernel function.
 
     Returns
     -------
-    np.ndarray
-        The lower-dimensional embedding of the data in the diffusion space.
+    np.ndarray or list of np.ndarray
+        The lower-dimensional embedding of the data in the diffusion space, or
+        a list of embeddings, one per diffusion time, if `diffusion_time` is a
+        sequence.
+    dict
+        The timings and counters of the fit, if `return_stats` is true:
+
+        - 'kernel_time', 'reordering_time', 'normalisation_time',
+          'eig_solver_time' and 'embedding_time': the wall time in seconds of
+          each stage.
+        - 'n_kernel_evals' and 'n_kernel_evals_skipped': the number of pairs of
+          data points for which the kernel was and was not evaluated.
+        - 'n_kernel_evals_exact': the number of pairs of quantised data points
+          that were evaluated again in double precision.
+        - 'n_nz': the number of non-zero elements in the kernel matrix.
+        - 'peak_bytes': an estimate of the peak memory held by the large
+          buffers.
+        - 'n_spmv': the number of sparse matrix-vector products.
+        - 'n_iters' and 'residuals': the number of iterations and the residual
+          ``‖A v - λ v‖`` of each eigenpair.
 
     Raises
     ------
@@ -60,6 +422,22 @@ def diffusion_maps(
         If the kernel parameters are not valid.
     ValueError
         If the diffusion time is negative.
+    ValueError
+        If `alpha` is not in [0, 1].
+    ValueError
+        If the eigendecomposition solver is not supported.
+    ValueError
+        If the reordering is not supported, or is 'morton' for sparse data.
+    ValueError
+        If the matrix format is not supported.
+    ValueError
+        If the kernel precision is not supported.
+    ValueError
+        If `memory_budget` is negative, or the estimated peak memory of the
+        fit exceeds it.
+    ValueError
+        If the eigenvectors in `warm_start` do not have one element per data
+        point.
 
     Kernels
     -------
@@ -69,31 +447,421 @@ def diffusion_maps(
       The kernel parameter (`gamma` or `sigma`) can be specified as a keyword
       argument. If both are not specified, `gamma` defaults to
       1 / ``n_features``. If both are specified, raise a `ValueError`.
+
+      The kernel is ``exp(-gamma * d(x, y))``, where the distance ``d`` is
+      chosen with the `metric` keyword argument:
+
+      - 'euclidean' (default): the squared Euclidean distance.
+      - 'cosine': the cosine distance ``1 - x·y / (‖x‖ ‖y‖)``.
+      - 'l1': the L1 distance, which gives the Laplacian kernel.
+      - 'mahalanobis': the squared Mahalanobis distance with a diagonal
+        covariance, ``∑ ((x_f - y_f) / scale_f)²``. The `scale` keyword
+        argument gives the scale of each feature, and defaults to its standard
+        deviation, or 1 for constant features.
     """
 
     # Check the dimensions.
     if data.ndim != 2:
         raise ValueError('data must be a 2D array')
 
-    # Check kernel.
-    if kernel == 'gaussian':
-        if 'gamma' in kwargs:
-            if 'sigma' in kwargs:
-                raise ValueError('cannot specify both gamma and sigma')
-            else:
-                gamma = kwargs['gamma']
-        elif 'sigma' in kwargs:
-            sigma = kwargs['sigma']
-            gamma = 1 / (2 * sigma*sigma)
-        else:
-            # Use default value.
-            n_features = data.shape[1]
-            gamma = 1 / n_features
+    # Check kernel and eigendecomposition solver.
+    kernel_obj = _kernel_obj(data, kernel, kwargs)
+    options = _options(kernel_epsilon, eig_solver_tol, eig_solver_max_iter,
+                       eig_solver, randomized_oversampling,
+                       randomized_n_power_iters, reordering,
+                       matrix_format, chebyshev_degree, alpha,
+                       self_tuning_neighbours, kernel_precision,
+                       memory_budget, auto_plan)
 
-        kernel_obj = _diffusion_maps.kernel.Gaussian(gamma)
-    else:
-        raise ValueError(f'unknown kernel: {kernel}')
+    stats = _diffusion_maps.Stats() if return_stats else None
+
+    if np.ndim(diffusion_time) != 0:
+        diffusion_times = list(diffusion_time)
+        if any(t < 0 for t in diffusion_times):
+            raise ValueError('diffusion time must be non-negative')
+        decomposition = _decompose(data, n_components, kernel_obj, rng_seed,
+                                   options, warm_start, stats)
+        start = time.perf_counter()
+        result = [decomposition.embed(t) for t in diffusion_times]
+        if not return_stats:
+            return result
+        stats_dict = stats.as_dict()
+        stats_dict['embedding_time'] += time.perf_counter() - start
+        return result, stats_dict
+
+    result = _diffusion_maps(data, n_components, kernel_obj, diffusion_time,
+                             rng_seed, options, warm_start, stats)
+
+    return (result, stats.as_dict()) if return_stats else result
+
+
+class AsyncFit:
+    """A fit running on another thread, returned by `diffusion_maps_async`.
+
+    Poll it with `done` and `progress`, or await it in a coroutine. The fit
+    checks for cancellation at the start of each stage and at each iteration
+    of the eigendecomposition solver. Dropping the last reference to a fit
+    whose result was not retrieved cancels it and waits for it to stop.
+    """
+
+    _stages = {
+        _diffusion_maps.Stage.KERNEL: 'kernel',
+        _diffusion_maps.Stage.REORDERING: 'reordering',
+        _diffusion_maps.Stage.NORMALISATION: 'normalisation',
+        _diffusion_maps.Stage.EIG_SOLVER: 'eig_solver',
+        _diffusion_maps.Stage.EMBEDDING: 'embedding',
+    }
+
+    def __init__(self, fit, stats):
+        self._fit = fit
+        self._stats = stats
+
+    def done(self) -> bool:
+        """Whether the fit has finished, successfully or not."""
+        return self._fit.done()
+
+    def cancel(self) -> None:
+        """Asks the fit to stop at its next progress report."""
+        self._fit.cancel()
+
+    def progress(self) -> dict:
+        """Returns the latest progress report of the fit.
+
+        Returns
+        -------
+        dict
+            - 'stage': the current stage, one of 'kernel', 'reordering',
+              'normalisation', 'eig_solver' and 'embedding'.
+            - 'eigenpair': in the eigendecomposition solver, the index of the
+              eigenpair being computed, or, for the 'chebyshev' solver, the
+              number of eigenpairs that have converged.
+            - 'iteration': in the eigendecomposition solver, the number of
+              iterations performed for the eigenpair.
+            - 'error': in the eigendecomposition solver, the error compared
+              with `eig_solver_tol`, or NaN if there is none.
+        """
+        progress = self._fit.progress()
+        progress['stage'] = self._stages[progress['stage']]
+        return progress
+
+    def result(self) -> Union[np.ndarray, Tuple[np.ndarray, dict]]:
+        """Waits for the fit to finish and returns its result, as
+        `diffusion_maps` would. May only be called once.
+
+        Raises
+        ------
+        Cancelled
+            If the fit was cancelled.
+        ValueError
+            If an argument of the fit is not valid.
+        """
+        result = self._fit.result()
+        return (result, self._stats.as_dict()) if self._stats else result
+
+    def __await__(self):
+        while not self.done():
+            yield from asyncio.sleep(0.01).__await__()
+        return self.result()
+
+
+def diffusion_maps_async(
+        data: np.ndarray, n_components: int, kernel: str,
+        diffusion_time: float,
+        *, rng_seed: Optional[int] = None,
+        kernel_epsilon: float = default_kernel_epsilon,
+        eig_solver_tol: float = default_eig_solver_tol,
+        eig_solver_max_iter: int = default_eig_solver_max_iter,
+        eig_solver: str = 'power_method',
+        randomized_oversampling: int = default_randomized_oversampling,
+        randomized_n_power_iters: int = default_randomized_n_power_iters,
+        chebyshev_degree: int = default_chebyshev_degree,
+        alpha: float = 0.0,
+        self_tuning_neighbours: int = 0,
+        kernel_precision: str = 'double',
+        reordering: str = 'none',
+        matrix_format: str = 'csr',
+        memory_budget: int = 0,
+        auto_plan: bool = False,
+        warm_start: Optional[WarmStart] = None,
+        return_stats: bool = False,
+        **kwargs) -> AsyncFit:
+    """Diffusion maps, computed on another thread.
+
+    The parameters are the same as those of `diffusion_maps`, but the data
+    matrix must be a dense array and the diffusion time a single value. The
+    data matrix must not be modified until the fit is done. The fit starts
+    from a copy of `warm_start`, and `warm_start` is only updated when
+    `AsyncFit.result` returns, so it can be read at any time.
+
+    Returns
+    -------
+    AsyncFit
+        The fit, whose result is that of `diffusion_maps`.
+
+    Raises
+    ------
+    ValueError
+        If the data matrix is sparse.
+    ValueError
+        As in `diffusion_maps`, for the arguments checked before the fit
+        starts. The others are raised by `AsyncFit.result`.
+    """
+
+    # Check the dimensions.
+    if _is_sparse(data):
+        raise ValueError('diffusion_maps_async does not support sparse data')
+    if data.ndim != 2:
+        raise ValueError('data must be a 2D array')
+
+    kernel_obj = _kernel_obj(data, kernel, kwargs)
+    options = _options(kernel_epsilon, eig_solver_tol, eig_solver_max_iter,
+                       eig_solver, randomized_oversampling,
+                       randomized_n_power_iters, reordering,
+                       matrix_format, chebyshev_degree, alpha,
+                       self_tuning_neighbours, kernel_precision,
+                       memory_budget, auto_plan)
+
+    stats = _diffusion_maps.Stats() if return_stats else None
+    fit = _diffusion_maps.diffusion_maps_async(
+        data, n_components, kernel_obj, diffusion_time, rng_seed, options,
+        warm_start, stats)
+    return AsyncFit(fit, stats)
+
+
+def sweep(
+        data: np.ndarray, n_components: int, gamma: Sequence[float],
+        kernel_epsilon: Union[float, Sequence[float]] = default_kernel_epsilon,
+        *, rng_seed: Optional[int] = None,
+        eig_solver_tol: float = default_eig_solver_tol,
+        eig_solver_max_iter: int = default_eig_solver_max_iter,
+        eig_solver: str = 'power_method',
+        randomized_oversampling: int = default_randomized_oversampling,
+        randomized_n_power_iters: int = default_randomized_n_power_iters,
+        chebyshev_degree: int = default_chebyshev_degree,
+        matrix_format: str = 'csr',
+        alpha: float = 0.0
+) -> List[SweepResult]:
+    """Fits diffusion maps with the Gaussian kernel for every combination of
+    the given values of `gamma` and `kernel_epsilon`.
+
+    The pairwise distances are computed once at the loosest cutoff in the sweep
+    and shared by all the fits, which run in parallel.
+
+    Parameters
+    ----------
+    data : np.ndarray
+        The data matrix where each row is a data point.
+    n_components : int
+        The dimension of the projected subspace.
+    gamma : sequence of float
+        The values of the kernel parameter γ = 1 / 2σ².
+    kernel_epsilon : float or sequence of float, default 1e-6
+        The values below which the output of the kernel would be treated as
+        zero.
+    rng_seed : int, optional
+        The seed for the random number generator.
+    eig_solver_tol, eig_solver_max_iter, eig_solver, randomized_oversampling, \
+randomized_n_power_iters, chebyshev_degree, matrix_format, alpha
+        As in `diffusion_maps`.
+
+    Returns
+    -------
+    list of SweepResult
+        The result of each setting, with `gamma` varying slowest.
+
+    Raises
+    ------
+    ValueError
+        If the data matrix is not a two-dimensional array, or is sparse.
+    ValueError
+        If `n_components` is negative or greater than the number of data points
+        minus 1.
+    ValueError
+        If a value of `gamma` is not positive or a value of `kernel_epsilon` is
+        not in (0, 1).
+    ValueError
+        If `alpha` is not in [0, 1].
+    ValueError
+        If the eigendecomposition solver is not supported.
+    ValueError
+        If the matrix format is not supported.
+    """
+
+    # Check the dimensions.
+    if _is_sparse(data):
+        raise ValueError('sweep does not support sparse data')
+    if data.ndim != 2:
+        raise ValueError('data must be a 2D array')
+
+    kernel_epsilons = (list(kernel_epsilon) if np.ndim(kernel_epsilon) != 0
+                       else [kernel_epsilon])
+    settings = [_diffusion_maps.SweepSetting(g, e)
+                for g in gamma for e in kernel_epsilons]
+    options = _options(default_kernel_epsilon, eig_solver_tol,
+                       eig_solver_max_iter, eig_solver,
+                       randomized_oversampling, randomized_n_power_iters,
+                       matrix_format=matrix_format,
+                       chebyshev_degree=chebyshev_degree, alpha=alpha)
+
+    return _diffusion_maps.sweep(data, n_components, settings, rng_seed,
+                                 options)
+
+
+def diffusion_maps_batch(
+        datasets: Sequence[np.ndarray], n_components: int, kernel: str,
+        diffusion_time: float,
+        *, rng_seed: Optional[int] = None,
+        kernel_epsilon: float = default_kernel_epsilon,
+        eig_solver_tol: float = default_eig_solver_tol,
+        eig_solver_max_iter: int = default_eig_solver_max_iter,
+        eig_solver: str = 'power_method',
+        randomized_oversampling: int = default_randomized_oversampling,
+        randomized_n_power_iters: int = default_randomized_n_power_iters,
+        chebyshev_degree: int = default_chebyshev_degree,
+        alpha: float = 0.0,
+        self_tuning_neighbours: int = 0,
+        kernel_precision: str = 'double',
+        reordering: str = 'none',
+        matrix_format: str = 'csr',
+        memory_budget: int = 0,
+        auto_plan: bool = False,
+        **kwargs) -> List[np.ndarray]:
+    """Diffusion maps of many independent datasets.
+
+    The datasets are fitted concurrently, one whole fit per thread, so a batch
+    of small datasets keeps all the cores busy where calls to `diffusion_maps`
+    in a loop would not. Each dataset gets its own seed, drawn from `rng_seed`,
+    so the results do not depend on the scheduling of the fits.
+
+    The parameters are the same as those of `diffusion_maps`, but each data
+    matrix must be a dense array, the diffusion time a single value, and the
+    default kernel parameters are derived from each dataset.
+
+    Returns
+    -------
+    list of np.ndarray
+        The lower-dimensional embedding of each dataset in the diffusion space.
+
+    Raises
+    ------
+    ValueError
+        If a data matrix is not a two-dimensional array, or is sparse.
+    ValueError
+        As in `diffusion_maps`. The error of the first failing dataset is
+        raised.
+    """
+
+    # Check the dimensions.
+    for data in datasets:
+        if _is_sparse(data):
+            raise ValueError('diffusion_maps_batch does not support sparse '
+                             'data')
+        if data.ndim != 2:
+            raise ValueError('data must be a 2D array')
+
+    kernel_objs = [_kernel_obj(data, kernel, kwargs) for data in datasets]
+    options = _options(kernel_epsilon, eig_solver_tol, eig_solver_max_iter,
+                       eig_solver, randomized_oversampling,
+                       randomized_n_power_iters, reordering,
+                       matrix_format, chebyshev_degree, alpha,
+                       self_tuning_neighbours, kernel_precision,
+                       memory_budget, auto_plan)
+
+    return _diffusion_maps.diffusion_maps_batch(
+        list(datasets), n_components, kernel_objs, diffusion_time, rng_seed,
+        options)
+
+
+_matrix_format_names = {
+    _diffusion_maps.MatrixFormat.CSR: 'csr',
+    _diffusion_maps.MatrixFormat.SELL: 'sell',
+    _diffusion_maps.MatrixFormat.COMPRESSED_FLOAT: 'compressed_float',
+    _diffusion_maps.MatrixFormat.COMPRESSED_BFLOAT16: 'compressed_bf16',
+}
+
+_eig_solver_names = {
+    _diffusion_maps.EigSolver.POWER_METHOD: 'power_method',
+    _diffusion_maps.EigSolver.RANDOMIZED: 'randomized',
+    _diffusion_maps.EigSolver.CHEBYSHEV: 'chebyshev',
+    _diffusion_maps.EigSolver.DENSE: 'dense',
+}
+
+
+def plan(
+        data: np.ndarray, n_components: int, kernel: str,
+        *, kernel_epsilon: float = default_kernel_epsilon,
+        eig_solver_tol: float = default_eig_solver_tol,
+        eig_solver_max_iter: int = default_eig_solver_max_iter,
+        eig_solver: str = 'power_method',
+        randomized_oversampling: int = default_randomized_oversampling,
+        randomized_n_power_iters: int = default_randomized_n_power_iters,
+        chebyshev_degree: int = default_chebyshev_degree,
+        alpha: float = 0.0,
+        self_tuning_neighbours: int = 0,
+        kernel_precision: str = 'double',
+        reordering: str = 'none',
+        matrix_format: str = 'csr',
+        memory_budget: int = 0,
+        auto_plan: bool = False,
+        **kwargs) -> dict:
+    """Plans a fit of diffusion maps before the kernel matrix is computed.
+
+    A sample of pairs of data points, drawn with a fixed seed, gives the
+    number of non-zero elements of the kernel matrix, the peak memory and the
+    time of the kernel stage. With `auto_plan`, the plan also chooses the
+    matrix format and the eigendecomposition solver from the size of the
+    matrix. This is the plan that a fit with the same arguments and
+    `memory_budget` or `auto_plan` follows, so it can be logged beforehand.
+
+    The parameters are the same as those of `diffusion_maps`, but the data
+    matrix must be a dense array and there is no diffusion time.
+
+    Returns
+    -------
+    dict
+        The plan:
+
+        - 'n_samples': the number of data points.
+        - 'n_pairs_sampled': the number of pairs of distinct data points whose
+          kernel was evaluated.
+        - 'exhaustive': whether they were all the pairs, in which case the
+          estimates of the kernel matrix are exact.
+        - 'density': the estimated fraction of the pairs whose kernel is above
+          `kernel_epsilon`.
+        - 'n_nz': the estimated number of non-zero elements in the kernel
+          matrix.
+        - 'peak_bytes': the estimated peak memory held by the large buffers,
+          as in the stats of `diffusion_maps`.
+        - 'kernel_time': the estimated wall time in seconds of the kernel
+          stage.
+        - 'matrix_format' and 'eig_solver': the matrix format and the
+          eigendecomposition solver of the fit.
+
+    Raises
+    ------
+    ValueError
+        If the data matrix is not a two-dimensional array, or is sparse.
+    ValueError
+        As in `diffusion_maps`, except for the memory budget, which is only
+        checked by the fits.
+    """
+
+    # Check the dimensions.
+    if _is_sparse(data):
+        raise ValueError('plan does not support sparse data')
+    if data.ndim != 2:
+        raise ValueError('data must be a 2D array')
+
+    kernel_obj = _kernel_obj(data, kernel, kwargs)
+    options = _options(kernel_epsilon, eig_solver_tol, eig_solver_max_iter,
+                       eig_solver, randomized_oversampling,
+                       randomized_n_power_iters, reordering,
+                       matrix_format, chebyshev_degree, alpha,
+                       self_tuning_neighbours, kernel_precision,
+                       memory_budget, auto_plan)
 
-    return _diffusion_maps.diffusion_maps(data, n_components, kernel_obj,
-                                          diffusion_time, rng_seed, kernel_epsilon,
-                                          eig_solver_tol, eig_solver_max_iter)
+    result = _diffusion_maps.plan(data, n_components, kernel_obj,
+                                  options).as_dict()
+    result['matrix_format'] = _matrix_format_names[result['matrix_format']]
+    result['eig_solver'] = _eig_solver_names[result['eig_solver']]
+    return result
@@ -0,0 +1,158 @@
+/// \file
+///
+/// \brief Allocation of the arrays of vectors and matrices.
+
+#ifndef DIFFUSION_MAPS_ALLOCATION_HPP
+#define DIFFUSION_MAPS_ALLOCATION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#ifdef PAR
+#include <omp.h>
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace diffusion_maps {
+
+/// \brief How the arrays of Vector, Matrix and SparseMatrix are allocated and
+///        first written.
+///
+/// On NUMA systems, the operating system places each page on the node of the
+/// thread that first writes it. An array initialised by a single thread thus
+/// lands on a single node, and the threads of the other nodes read it
+/// remotely. With parallel first touch, the large arrays are initialised by
+/// all threads with the static partition of the parallel loops that process
+/// them later, e.g. by rows for SparseMatrix::operator*(), so that each thread
+/// mostly reads local memory.
+class AllocationPolicy {
+public:
+  /// Whether the large arrays are initialised by all threads.
+  bool parallel_first_touch = true;
+  /// \brief Whether the operating system is advised to back the large arrays
+  ///        with transparent huge pages. Only has an effect on Linux.
+  bool huge_pages = false;
+  /// The size in bytes from which an array is large.
+  std::size_t min_large_bytes = std::size_t{1} << 20;
+};
+
+namespace internal {
+
+/// The current allocation policy.
+inline AllocationPolicy current_allocation_policy;
+
+} // namespace internal
+
+/// The current allocation policy.
+inline AllocationPolicy allocation_policy() {
+  return internal::current_allocation_policy;
+}
+
+/// \brief Sets the allocation policy.
+///
+/// The policy is not synchronised with the allocations of other threads, so it
+/// should be set before the library is used.
+///
+/// \param[in] policy The allocation policy.
+inline void set_allocation_policy(const AllocationPolicy &policy) {
+  internal::current_allocation_policy = policy;
+}
+
+namespace internal {
+
+/// \brief Tells whether an array should be initialised by all threads under the
+///        current allocation policy.
+///
+/// Arrays allocated within a parallel region are initialised by the calling
+/// thread, which is the one that processes them.
+///
+/// \param[in] n_bytes The size of the array in bytes.
+/// \return Whether to initialise the array in parallel.
+inline bool first_touch_in_parallel(const std::size_t n_bytes) {
+#ifdef PAR
+  return current_allocation_policy.parallel_first_touch &&
+         n_bytes >= current_allocation_policy.min_large_bytes &&
+         !omp_in_parallel();
+#else
+  static_cast<void>(n_bytes);
+  return false;
+#endif
+}
+
+/// \brief Allocates an array without initialising it, advising the operating
+///        system to back it with huge pages if the policy asks for it.
+///
+/// \tparam T The type of the elements, which must be trivial.
+/// \param[in] size The number of elements.
+/// \return The array.
+template <typename T>
+std::unique_ptr<T[]> allocate_array(const std::size_t size) {
+  std::unique_ptr<T[]> array(new T[size]);
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+  const std::size_t n_bytes = size * sizeof(T);
+  if (current_allocation_policy.huge_pages &&
+      n_bytes >= current_allocation_policy.min_large_bytes) {
+    // Only the whole pages within the array can be advised. The advice is
+    // best-effort, so its failure is ignored.
+    const std::uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(array.get());
+    const std::uintptr_t begin =
+        (start + page_size - 1) / page_size * page_size;
+    const std::uintptr_t end = (start + n_bytes) / page_size * page_size;
+    if (end > begin) {
+      madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE);
+    }
+  }
+#endif
+
+  return array;
+}
+
+/// \brief Sets each element of an array, in parallel with a static schedule if
+///        first_touch_in_parallel().
+///
+/// \param[out] data The array.
+/// \param[in] size The number of elements.
+/// \param[in] value The value of each element.
+template <typename T>
+void fill_array(T *const data, const std::size_t size, const T value) {
+  [[maybe_unused]] const bool parallel =
+      first_touch_in_parallel(size * sizeof(T));
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+  for (std::size_t i = 0; i < size; ++i) {
+    data[i] = value;
+  }
+}
+
+/// \brief Copies an array, in parallel with a static schedule if
+///        first_touch_in_parallel().
+///
+/// \param[in] src The array to copy.
+/// \param[in] size The number of elements.
+/// \param[out] dst The copy.
+template <typename T>
+void copy_array(const T *const src, const std::size_t size, T *const dst) {
+  [[maybe_unused]] const bool parallel =
+      first_touch_in_parallel(size * sizeof(T));
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+  for (std::size_t i = 0; i < size; ++i) {
+    dst[i] = src[i];
+  }
+}
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
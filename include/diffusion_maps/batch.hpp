@@ -0,0 +1,133 @@
+/// \file
+///
+/// \brief Diffusion maps of many independent datasets.
+
+#ifndef DIFFUSION_MAPS_BATCH_HPP
+#define DIFFUSION_MAPS_BATCH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "diffusion_maps/decomposition.hpp"
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// The type of the kernel functions of a batch.
+using BatchKernel = std::function<double(const Vector &, const Vector &)>;
+
+namespace internal {
+
+std::vector<Decomposition>
+decompose_batch(const std::vector<Matrix> &datasets, std::size_t n_components,
+                const std::vector<BatchKernel> &kernels,
+                const Options &options,
+                const std::vector<std::uint_fast32_t> &seeds);
+
+std::vector<Matrix>
+diffusion_maps_batch(const std::vector<Matrix> &datasets,
+                     std::size_t n_components,
+                     const std::vector<BatchKernel> &kernels,
+                     double diffusion_time, const Options &options,
+                     const std::vector<std::uint_fast32_t> &seeds);
+
+/// \brief Draws the seed of each fit of a batch up front, so that the results
+///        do not depend on the scheduling of the fits.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] n_datasets The number of datasets.
+/// \param[in,out] rng The random number generator.
+/// \return The seed of each dataset.
+template <typename R>
+std::vector<std::uint_fast32_t> draw_batch_seeds(const std::size_t n_datasets,
+                                                 R &rng) {
+  std::uniform_int_distribution<std::uint_fast32_t> dist;
+  std::vector<std::uint_fast32_t> seeds(n_datasets);
+  for (auto &seed : seeds) {
+    seed = dist(rng);
+  }
+  return seeds;
+}
+
+} // namespace internal
+
+/// \brief Computes the eigendecompositions of the diffusion matrices of many
+///        independent datasets.
+///
+/// The datasets are fitted concurrently, one whole fit per thread, largest
+/// first so that the last fits to finish are short ones. Each fit runs on a
+/// single thread, since the parallel regions of a small fit are too short to
+/// scale. The fits of a thread run one after the other, so their buffers are
+/// recycled by the allocator of the thread. Each dataset draws its own seed
+/// from \p rng up front, so the results are the same as those of decompose()
+/// with a std::default_random_engine seeded with that seed, and do not depend
+/// on the scheduling of the fits.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] datasets The data matrices where each row is a data point.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernels The kernel function of each dataset, or a single kernel
+///                    function for all of them. They are called concurrently.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options. The warm start, the stats, the monitor and
+///                    the plan are ignored, since the fits run concurrently.
+/// \return The eigendecomposition of each dataset, in the same order as
+///         \p datasets.
+/// \exception std::invalid_argument If the number of kernel functions is
+///                                  neither 1 nor the number of datasets.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points of a dataset minus 1.
+///                                  The first failing dataset, in the order of
+///                                  \p datasets, determines the exception.
+template <typename R>
+std::vector<Decomposition>
+decompose_batch(const std::vector<Matrix> &datasets, std::size_t n_components,
+                const std::vector<BatchKernel> &kernels, R &rng,
+                const Options &options = Options()) {
+  return internal::decompose_batch(
+      datasets, n_components, kernels, options,
+      internal::draw_batch_seeds(datasets.size(), rng));
+}
+
+/// \brief Diffusion maps of many independent datasets.
+///
+/// The datasets are fitted as by decompose_batch(), and the results are the
+/// same as those of diffusion_maps() with a std::default_random_engine seeded
+/// with the seed of each dataset.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] datasets The data matrices where each row is a data point.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernels The kernel function of each dataset, or a single kernel
+///                    function for all of them. They are called concurrently.
+/// \param[in] diffusion_time The diffusion time.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options. The warm start, the stats, the monitor and
+///                    the plan are ignored, since the fits run concurrently.
+/// \return The lower-dimensional embedding of each dataset in the diffusion
+///         space, in the same order as \p datasets.
+/// \exception std::invalid_argument If the number of kernel functions is
+///                                  neither 1 nor the number of datasets.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points of a dataset minus 1.
+/// \exception std::invalid_argument If \p diffusion_time is negative.
+template <typename R>
+std::vector<Matrix>
+diffusion_maps_batch(const std::vector<Matrix> &datasets,
+                     std::size_t n_components,
+                     const std::vector<BatchKernel> &kernels,
+                     double diffusion_time, R &rng,
+                     const Options &options = Options()) {
+  return internal::diffusion_maps_batch(
+      datasets, n_components, kernels, diffusion_time, options,
+      internal::draw_batch_seeds(datasets.size(), rng));
+}
+
+} // namespace diffusion_maps
+
+#endif
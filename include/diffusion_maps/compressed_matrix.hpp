@@ -0,0 +1,186 @@
+/// \file
+///
+/// \brief Sparse matrix in a compressed CSR format.
+
+#ifndef DIFFUSION_MAPS_COMPRESSED_MATRIX_HPP
+#define DIFFUSION_MAPS_COMPRESSED_MATRIX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "diffusion_maps/linear_operator.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// The precisions in which CompressedMatrix stores its values.
+enum class ValuePrecision {
+  /// Double precision, as in SparseMatrix. 8 bytes per value.
+  DOUBLE,
+  /// \brief Single precision. 4 bytes per value, with a relative error of
+  ///        about 6·10⁻⁸.
+  FLOAT,
+  /// \brief bfloat16: the 16 high bits of a float. 2 bytes per value, with a
+  ///        relative error of about 4·10⁻³.
+  BFLOAT16,
+};
+
+/// \brief Sparse matrix in a compressed CSR format, with delta-encoded column
+///        indices and values in reduced precision.
+///
+/// The column indices of each row are sorted, and those of a kernel graph in
+/// a spatial order (see Reordering) are clustered near the diagonal, so the
+/// gaps between consecutive columns are small. Each row stores its first
+/// column in full, and the others as 16-bit gaps from the previous column.
+/// A gap of 2¹⁵ or more is escaped: it is split into 15-bit digits, most
+/// significant first, in consecutive words, all of which but the last have
+/// the high bit set.
+///
+/// With float or bfloat16 values, an element takes 6 or 4 bytes instead of
+/// 16 in SparseMatrix, plus the row arrays, and the matrix-vector products,
+/// which are bound by the memory bandwidth, decode them on the fly. Equal
+/// values are rounded the same way, so a symmetric matrix stays symmetric.
+class CompressedMatrix : public LinearOperator {
+public:
+  /// The high bit of the escaped gap words.
+  static constexpr std::uint16_t ESCAPE = 0x8000;
+  /// The number of bits of a gap in each word.
+  static constexpr unsigned GAP_DIGIT_BITS = 15;
+
+protected:
+  /// The number of rows.
+  std::size_t _n_rows;
+  /// The number of columns.
+  std::size_t _n_cols;
+  /// The precision of the values.
+  ValuePrecision _precision;
+  /// The index of the first element of each row, and the total.
+  std::vector<std::size_t> _row_ixs;
+  /// The column index of the first element of each row. 0 for empty rows.
+  std::vector<std::size_t> _first_cols;
+  /// The index of the first gap word of each row, and the total.
+  std::vector<std::size_t> _gap_ixs;
+  /// The encoded gaps between consecutive column indices within each row.
+  std::vector<std::uint16_t> _gaps;
+  /// The values in double precision, if that is the precision.
+  std::vector<double> _double_data;
+  /// The values in single precision, if that is the precision.
+  std::vector<float> _float_data;
+  /// The bits of the values in bfloat16, if that is the precision.
+  std::vector<std::uint16_t> _bfloat16_data;
+
+  /// \brief Calls a function with the decoder of the values in their
+  ///        precision, which maps the index of an element to its value.
+  ///
+  /// \tparam F The type of the function.
+  /// \param[in] f The function.
+  template <typename F> void visit_values(const F &f) const;
+
+public:
+  // Constructors.
+
+  /// Constructs an empty 0×0 matrix.
+  CompressedMatrix()
+      : _n_rows(0), _n_cols(0), _precision(ValuePrecision::FLOAT),
+        _row_ixs{0}, _gap_ixs{0} {}
+
+  /// \brief Compresses a sparse matrix in the CSR format.
+  ///
+  /// \param[in] a The sparse matrix. The column indices within each row must
+  ///              be sorted.
+  /// \param[in] precision The precision of the values.
+  explicit CompressedMatrix(const SparseMatrix &a,
+                            ValuePrecision precision = ValuePrecision::FLOAT);
+
+  // Accessors.
+
+  /// The number of rows.
+  std::size_t n_rows() const override { return _n_rows; }
+
+  /// The number of columns.
+  std::size_t n_cols() const override { return _n_cols; }
+
+  /// The number of non-zero elements.
+  std::size_t n_nz() const override { return _row_ixs[_n_rows]; }
+
+  /// The precision of the values.
+  ValuePrecision precision() const { return _precision; }
+
+  /// The number of gap words, including the escaped ones.
+  std::size_t n_gap_words() const { return _gaps.size(); }
+
+  /// The number of bytes held by the arrays of the matrix.
+  std::size_t n_bytes() const override {
+    return (_row_ixs.size() + _first_cols.size() + _gap_ixs.size()) *
+               sizeof(std::size_t) +
+           _gaps.size() * sizeof(std::uint16_t) +
+           _double_data.size() * sizeof(double) +
+           _float_data.size() * sizeof(float) +
+           _bfloat16_data.size() * sizeof(std::uint16_t);
+  }
+
+  /// \brief Decodes the matrix back into the CSR format.
+  ///
+  /// \return The sparse matrix, with the values rounded to the precision.
+  SparseMatrix decompress() const;
+
+  // Matrix operations.
+
+  /// \brief Matrix-vector multiplication.
+  ///
+  /// \param[in] v The vector to multiply.
+  /// \return The result of the multiplication.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  Vector operator*(const Vector &v) const override;
+
+  /// \brief Matrix-vector multiplication into an existing vector.
+  ///
+  /// \param[in] v The vector to multiply.
+  /// \param[out] result The result of the multiplication. It must not be
+  ///                    \p v.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  void multiply(const Vector &v, Vector &result) const override;
+
+  /// \brief Matrix-matrix multiplication with a dense matrix.
+  ///
+  /// \param[in] m The dense matrix to multiply.
+  /// \return The result of the multiplication as a row-major matrix.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  Matrix operator*(const Matrix &m) const override;
+};
+
+namespace internal {
+
+/// \brief Rounds a value to bfloat16, to the nearest with ties to even. The
+///        value must not be NaN.
+///
+/// \param[in] value The value.
+/// \return The bits of the bfloat16 value.
+inline std::uint16_t to_bfloat16(const double value) {
+  const float single = static_cast<float>(value);
+  std::uint32_t bits;
+  std::memcpy(&bits, &single, sizeof(bits));
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return static_cast<std::uint16_t>(bits >> 16);
+}
+
+/// \brief Converts a bfloat16 value to a float, exactly.
+///
+/// \param[in] bits The bits of the bfloat16 value.
+/// \return The value.
+inline float from_bfloat16(const std::uint16_t bits) {
+  const std::uint32_t single_bits = std::uint32_t{bits} << 16;
+  float single;
+  std::memcpy(&single, &single_bits, sizeof(single));
+  return single;
+}
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
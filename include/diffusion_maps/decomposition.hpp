@@ -0,0 +1,58 @@
+/// \file
+///
+/// \brief Eigendecomposition of the diffusion matrix.
+
+#ifndef DIFFUSION_MAPS_DECOMPOSITION_HPP
+#define DIFFUSION_MAPS_DECOMPOSITION_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// \brief Eigendecomposition of the diffusion matrix, from which the diffusion
+///        maps for any diffusion time can be computed in O(n k) time.
+class Decomposition {
+public:
+  /// \brief The eigenvalues of the "symmetrised" diffusion matrix, including
+  ///        the trivial first one.
+  std::vector<double> eigenvalues;
+  /// \brief The corresponding eigenvectors, as the columns of an n × k
+  ///        column-major block.
+  Matrix eigenvectors;
+  /// The inverse square root of the row sum of the kernel matrix.
+  Vector invsqrt_row_sum;
+
+  /// The number of data points.
+  std::size_t n_samples() const { return invsqrt_row_sum.size(); }
+
+  /// \brief The dimension of the diffusion space. It might be less than the
+  ///        number of components requested if the computation did not
+  ///        converge.
+  std::size_t n_components() const {
+    return eigenvalues.empty() ? 0 : eigenvalues.size() - 1;
+  }
+
+  /// \brief Computes the diffusion maps for a diffusion time.
+  ///
+  /// \param[in] diffusion_time The diffusion time.
+  /// \return The lower-dimensional embedding of the data in the diffusion
+  ///         space.
+  /// \exception std::invalid_argument If \p diffusion_time is negative.
+  Matrix embed(double diffusion_time) const;
+
+  /// \brief Computes the diffusion maps for several diffusion times.
+  ///
+  /// \param[in] diffusion_times The diffusion times.
+  /// \return The lower-dimensional embedding of the data in the diffusion space
+  ///         for each diffusion time.
+  /// \exception std::invalid_argument If any diffusion time is negative.
+  std::vector<Matrix> embed(const std::vector<double> &diffusion_times) const;
+};
+
+} // namespace diffusion_maps
+
+#endif
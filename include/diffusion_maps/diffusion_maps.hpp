@@ -5,26 +5,29 @@
 #ifndef DIFFUSION_MAPS_DIFFUSION_MAPS_HPP
 #define DIFFUSION_MAPS_DIFFUSION_MAPS_HPP
 
+#include <chrono>
+#include <cstdint>
 #include <functional>
+#include <future>
 #include <memory>
 #include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
+#include "diffusion_maps/decomposition.hpp"
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/kernel.hpp"
 #include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/monitor.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/stats.hpp"
 #include "diffusion_maps/vector.hpp"
+#include "diffusion_maps/warm_start.hpp"
 
 /// Namespace for everything related to diffusion maps.
 namespace diffusion_maps {
 
-namespace internal {
-
-Matrix diffusion_maps(
-    const Matrix &data, std::size_t n_components,
-    const std::function<double(const Vector &, const Vector &)> &kernel,
-    double diffusion_time, double kernel_epsilon, double eig_solver_tol,
-    unsigned eig_solver_max_iter, const std::function<double()> &rng);
-
-}
-
 /// Default kernel epsilon for the diffusion_maps() function.
 constexpr double DEFAULT_KERNEL_EPSILON = 1e-6;
 
@@ -36,6 +39,472 @@ constexpr double DEFAULT_EIG_SOLVER_TOL = 1e-6;
 ///        for the diffusion_maps() function.
 constexpr unsigned DEFAULT_EIG_SOLVER_MAX_ITER = 100000;
 
+/// \brief Default oversampling of the randomised eigendecomposition solver for
+///        the diffusion_maps() function.
+constexpr unsigned DEFAULT_RANDOMIZED_OVERSAMPLING = 10;
+
+/// \brief Default number of power iterations of the randomised
+///        eigendecomposition solver for the diffusion_maps() function.
+constexpr unsigned DEFAULT_RANDOMIZED_N_POWER_ITERS = 4;
+
+/// \brief Default degree of the Chebyshev polynomial of the Chebyshev-filtered
+///        eigendecomposition solver for the diffusion_maps() function.
+constexpr unsigned DEFAULT_CHEBYSHEV_DEGREE = 8;
+
+/// \brief Default number of pairs of data points sampled by the planner, see
+///        plan().
+constexpr unsigned DEFAULT_PLAN_N_PAIRS = 10000;
+
+class Plan;
+
+/// Eigendecomposition solvers.
+enum class EigSolver {
+  /// \brief Symmetric power method with reprojection. Runs until convergence,
+  ///        see internal::eigsh().
+  POWER_METHOD,
+  /// \brief Randomised subspace iteration. Runs for a fixed number of passes,
+  ///        see internal::randomized_eigsh().
+  RANDOMIZED,
+  /// \brief Chebyshev-filtered subspace iteration. Runs until convergence,
+  ///        usually with far fewer sparse matrix-vector products than the
+  ///        power method when the eigenvalues are clustered near 1, see
+  ///        internal::chebyshev_eigsh().
+  CHEBYSHEV,
+  /// \brief Dense symmetric eigensolver. The diffusion matrix is stored as a
+  ///        dense matrix, built directly from the data points without
+  ///        self-tuning bandwidths, reduced to tridiagonal form, and its
+  ///        largest eigenpairs are found by bisection and inverse iteration,
+  ///        see internal::dense_eigsh(). Takes O(n³) operations and 8 n² bytes
+  ///        whatever the spectrum, which beats the sparse formats and the
+  ///        iterative solvers when the kernel matrix is nearly dense, up to a
+  ///        few tens of thousands of data points. Ignores the storage format,
+  ///        the tolerance and the eigenvectors of the warm start, and fits
+  ///        from a dense data matrix skip the reordering.
+  DENSE,
+};
+
+/// Reorderings of the data points applied before the eigendecomposition.
+enum class Reordering {
+  /// Keep the order of the input.
+  NONE,
+  /// \brief Reverse Cuthill-McKee ordering of the kernel graph, see
+  ///        internal::reverse_cuthill_mckee().
+  RCM,
+  /// \brief Morton (Z-order) ordering of the coordinates, see
+  ///        internal::morton_order().
+  MORTON,
+};
+
+/// Storage formats of the diffusion matrix in the eigendecomposition solver.
+enum class MatrixFormat {
+  /// Compressed sparse rows, see SparseMatrix.
+  CSR,
+  /// \brief Sliced ELLPACK, see SellMatrix. Faster matrix-vector products with
+  ///        SIMD when the number of non-zero elements per row is similar
+  ///        within each window of rows, at the cost of a conversion and a
+  ///        second copy of the matrix.
+  SELL,
+  /// \brief Compressed CSR with float values, see CompressedMatrix. 6 bytes
+  ///        per element instead of 16, for faster matrix-vector products when
+  ///        they are bound by the memory bandwidth, at the cost of a
+  ///        conversion and of rounding the values to single precision.
+  COMPRESSED_FLOAT,
+  /// \brief Compressed CSR with bfloat16 values, see CompressedMatrix. 4
+  ///        bytes per element, but the values carry a relative error of about
+  ///        4·10⁻³, which perturbs the eigenvectors accordingly.
+  COMPRESSED_BFLOAT16,
+};
+
+/// Options of the diffusion_maps() function.
+class Options {
+public:
+  /// The value below which the output of the kernel would be treated as zero.
+  double kernel_epsilon = DEFAULT_KERNEL_EPSILON;
+  /// The eigendecomposition solver.
+  EigSolver eig_solver = EigSolver::POWER_METHOD;
+  /// The tolerance of the eigendecomposition solver.
+  double eig_solver_tol = DEFAULT_EIG_SOLVER_TOL;
+  /// The maximum number of iterations of the eigendecomposition solver.
+  unsigned eig_solver_max_iter = DEFAULT_EIG_SOLVER_MAX_ITER;
+  /// \brief The number of extra vectors in the random block of the randomised
+  ///        eigendecomposition solver.
+  unsigned randomized_oversampling = DEFAULT_RANDOMIZED_OVERSAMPLING;
+  /// \brief The number of power iterations of the randomised eigendecomposition
+  ///        solver.
+  unsigned randomized_n_power_iters = DEFAULT_RANDOMIZED_N_POWER_ITERS;
+  /// \brief The degree of the Chebyshev polynomial of the Chebyshev-filtered
+  ///        eigendecomposition solver.
+  unsigned chebyshev_degree = DEFAULT_CHEBYSHEV_DEGREE;
+  /// \brief If not null, the eigendecomposition solver starts from the
+  ///        eigenvectors stored in it, and the eigenvectors and iteration
+  ///        counts of this fit are stored back into it.
+  WarmStart *warm_start = nullptr;
+  /// If not null, the timings and counters of this fit are added to it.
+  Stats *stats = nullptr;
+  /// \brief If not null, the progress of this fit is reported to it, and the
+  ///        fit throws Cancelled once it is cancelled through it.
+  Monitor *monitor = nullptr;
+  /// \brief The reordering of the data points. The pipeline runs in the
+  ///        permuted order, which makes the sparse matrix-vector products of
+  ///        the eigendecomposition solver more cache-friendly for unordered
+  ///        data, and the output is returned in the original order. Only
+  ///        applies to fits from a data matrix.
+  Reordering reordering = Reordering::NONE;
+  /// \brief The storage format of the diffusion matrix in the
+  ///        eigendecomposition solver.
+  MatrixFormat matrix_format = MatrixFormat::CSR;
+  /// \brief The exponent α in [0, 1] of the α-normalisation of the kernel
+  ///        matrix, see internal::compute_symmetrised_diffusion_matrix(). 0
+  ///        is the classical diffusion maps; 1 removes the influence of the
+  ///        density of the data. Does not apply to kernel graphs.
+  double alpha = 0;
+  /// \brief If positive, the kernel is replaced with a self-tuning kernel
+  ///        whose bandwidth at each data point is the distance to its k-th
+  ///        nearest neighbour, see internal::apply_self_tuning_bandwidths().
+  ///        The distance is the metric of the kernel if it is a
+  ///        kernel::MetricGaussian, and the Euclidean distance otherwise.
+  ///        The kernel and the kernel epsilon then only choose which pairs of
+  ///        data points are connected. Only applies to fits from a data
+  ///        matrix.
+  unsigned self_tuning_neighbours = 0;
+  /// \brief The precision in which the data points are read to compute the
+  ///        kernel matrix. A reduced precision reads less data when there are
+  ///        many features, and the pairs near the cutoff of the kernel are
+  ///        evaluated again in double precision, see
+  ///        internal::collect_quantised_kernel_triplets(). Only applies to
+  ///        kernel::MetricGaussian kernels of dense data points.
+  Precision kernel_precision = Precision::DOUBLE;
+  /// \brief If positive, the memory budget of the fit in bytes. The fit is
+  ///        then planned before the kernel matrix is computed, see plan(),
+  ///        and throws std::invalid_argument if the estimated peak memory
+  ///        exceeds the budget. Fits from a kernel graph are planned from
+  ///        their diffusion matrix instead, see
+  ///        internal::plan_from_diffusion_matrix().
+  std::size_t memory_budget = 0;
+  /// \brief Whether the fit is planned, see plan(), and runs with the storage
+  ///        format and the eigendecomposition solver chosen by the plan
+  ///        instead of #matrix_format and #eig_solver.
+  bool auto_plan = false;
+  /// The number of pairs of data points sampled by the planner.
+  unsigned plan_n_pairs = DEFAULT_PLAN_N_PAIRS;
+  /// \brief If not null, the fit is planned, see plan(), and its plan is
+  ///        stored into it.
+  Plan *plan = nullptr;
+};
+
+namespace internal {
+
+/// \brief Checks the arguments common to all variants of diffusion maps.
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options.
+/// \exception std::invalid_argument If any argument is invalid.
+void check_arguments(std::size_t n_samples, std::size_t n_components,
+                     const Options &options);
+
+/// \brief The number of vectors of n_samples elements held by the
+///        eigendecomposition solver, including the eigenvectors.
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in] n_eigenpairs The number of eigenpairs.
+/// \param[in] options The options, for the solver and its parameters.
+/// \return The number of vectors.
+std::size_t n_solver_vectors(std::size_t n_samples, unsigned n_eigenpairs,
+                             const Options &options);
+
+Decomposition
+decompose(const Matrix &data, std::size_t n_components,
+          const std::function<double(const Vector &, const Vector &)> &kernel,
+          const Options &options, const std::function<double()> &rng);
+
+/// \brief Runs diffusion maps from the kernel matrix on: the reordering and
+///        steps 2 and 3.
+///
+/// \param[in] kernel_matrix The kernel matrix.
+/// \param[in] data The data matrix, for the Morton reordering, or null if the
+///                 data points are not dense.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options.
+/// \param[in] rng The random number generator.
+/// \return The eigendecomposition.
+/// \exception std::invalid_argument If the Morton reordering is requested
+///                                  without dense data.
+Decomposition decompose_kernel_matrix(SparseMatrix kernel_matrix,
+                                      const Matrix *data,
+                                      std::size_t n_components,
+                                      const Options &options,
+                                      const std::function<double()> &rng);
+
+/// \brief Runs diffusion maps from the triplets of the kernel matrix on: the
+///        reordering and steps 2 and 3.
+///
+/// The kernel matrix is assembled directly into the "symmetrised" diffusion
+/// matrix, see internal::assemble_symmetrised_diffusion_matrix(), and the
+/// Morton reordering relabels the triplets beforehand. The reverse
+/// Cuthill-McKee ordering needs the kernel matrix, so with it the triplets are
+/// assembled and passed to decompose_kernel_matrix() instead.
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in,out] triplets The triplets of the non-zero elements of the kernel
+///                         matrix. Relabelled and sorted.
+/// \param[in] n_kernel_evals The number of pairs of data points, out of the
+///                           upper triangle, for which the kernel was
+///                           evaluated.
+/// \param[in] data The data matrix, for the Morton reordering, or null if the
+///                 data points are not dense.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options.
+/// \param[in] rng The random number generator.
+/// \return The eigendecomposition.
+/// \exception std::invalid_argument If the Morton reordering is requested
+///                                  without dense data.
+Decomposition decompose_kernel_triplets(
+    std::size_t n_samples, std::vector<SparseMatrix::Triplet> &triplets,
+    std::uint64_t n_kernel_evals, const Matrix *data, std::size_t n_components,
+    const Options &options, const std::function<double()> &rng);
+
+/// \brief Plans a fit of diffusion maps from a predicate on the pairs of data
+///        points, see plan() and internal::apply_plan().
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in] points_bytes The bytes held by the data points while the kernel
+///                         matrix is computed.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] above The predicate that tells whether the kernel of the i-th
+///                  and the j-th data points is above the kernel epsilon.
+/// \param[in] options The options of the fit.
+/// \return The options to run the fit with.
+/// \exception std::invalid_argument If the estimated peak memory exceeds the
+///                                  memory budget.
+Options plan_fit(std::size_t n_samples, std::size_t points_bytes,
+                 std::size_t n_components,
+                 const std::function<bool(std::size_t, std::size_t)> &above,
+                 const Options &options);
+
+template <typename Metric>
+Decomposition decompose(const SparseMatrix &data, std::size_t n_components,
+                        const kernel::MetricGaussian<Metric> &kernel,
+                        const Options &options,
+                        const std::function<double()> &rng) {
+  check_arguments(data.n_rows(), n_components, options);
+  if (options.reordering == Reordering::MORTON) {
+    throw std::invalid_argument("Morton reordering needs dense data");
+  }
+  Stats *const stats = options.stats;
+
+  // Plan the fit first, if asked to, before the kernel matrix is computed.
+
+  if (options.memory_budget > 0 || options.auto_plan || options.plan) {
+    return decompose(
+        data, n_components, kernel,
+        plan_fit(data.n_rows(), sparse_kernel_bytes(data), n_components,
+                 sparse_kernel_above(data, kernel, options.kernel_epsilon),
+                 options),
+        rng);
+  }
+
+  // Step 1: Compute the kernel matrix, or only its triplets without
+  // self-tuning bandwidths, see decompose_kernel_triplets().
+
+  report(options.monitor, Stage::KERNEL);
+  if (options.self_tuning_neighbours == 0) {
+    std::vector<SparseMatrix::Triplet> triplets;
+    std::uint64_t n_kernel_evals;
+    {
+      ScopedTimer timer(stats ? &stats->kernel_time : nullptr);
+      triplets = compute_kernel_triplets(data, kernel, options.kernel_epsilon,
+                                         n_kernel_evals, stats);
+    }
+    return decompose_kernel_triplets(data.n_rows(), triplets, n_kernel_evals,
+                                     nullptr, n_components, options, rng);
+  }
+
+  SparseMatrix kernel_matrix;
+  {
+    ScopedTimer timer(stats ? &stats->kernel_time : nullptr);
+    kernel_matrix =
+        compute_kernel_matrix(data, kernel, options.kernel_epsilon, stats);
+    apply_self_tuning_bandwidths(data, kernel_matrix,
+                                 options.self_tuning_neighbours, kernel.metric);
+  }
+
+  return decompose_kernel_matrix(std::move(kernel_matrix), nullptr,
+                                 n_components, options, rng);
+}
+
+Decomposition decompose(const SparseMatrix &diffusion_matrix,
+                        Vector invsqrt_row_sum, std::size_t n_components,
+                        const Options &options,
+                        const std::function<double()> &rng);
+
+Matrix diffusion_maps(
+    const Matrix &data, std::size_t n_components,
+    const std::function<double(const Vector &, const Vector &)> &kernel,
+    double diffusion_time, const Options &options,
+    const std::function<double()> &rng);
+
+} // namespace internal
+
+/// \brief Diffusion maps.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel function.
+/// \param[in] diffusion_time The diffusion time.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options.
+/// \return The lower-dimensional embedding of the data in the diffusion space.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+/// \exception std::invalid_argument If \p diffusion_time is negative.
+/// \exception std::invalid_argument If the warm-start eigenvectors do not have
+///                                  one element per data point.
+template <typename R>
+Matrix diffusion_maps(
+    const Matrix &data, std::size_t n_components,
+    const std::function<double(const Vector &, const Vector &)> &kernel,
+    double diffusion_time, R &rng, const Options &options) {
+  std::normal_distribution dist;
+  return internal::diffusion_maps(data, n_components, kernel, diffusion_time,
+                                  options,
+                                  [&rng, &dist]() { return dist(rng); });
+}
+
+/// \brief Computes the eigendecomposition of the diffusion matrix, from which
+///        the diffusion maps for any diffusion time can be computed.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel function.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options.
+/// \return The eigendecomposition.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+/// \exception std::invalid_argument If the warm-start eigenvectors do not have
+///                                  one element per data point.
+template <typename R>
+Decomposition
+decompose(const Matrix &data, std::size_t n_components,
+          const std::function<double(const Vector &, const Vector &)> &kernel,
+          R &rng, const Options &options = Options()) {
+  std::normal_distribution dist;
+  return internal::decompose(data, n_components, kernel, options,
+                             [&rng, &dist]() { return dist(rng); });
+}
+
+/// \brief Computes the eigendecomposition of the diffusion matrix of sparse
+///        data points, from which the diffusion maps for any diffusion time
+///        can be computed.
+///
+/// The pairwise distances are computed from the non-zero features of the data
+/// points only, see internal::compute_kernel_matrix(), so that
+/// high-dimensional sparse data never has to be densified.
+///
+/// \tparam Metric The distance metric of the kernel.
+/// \tparam R The type of the random number generator.
+/// \param[in] data The sparse data matrix where each row is a data point. The
+///                 column indices within each row must be sorted.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options.
+/// \return The eigendecomposition.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+/// \exception std::invalid_argument If the Morton reordering is requested.
+/// \exception std::invalid_argument If the warm-start eigenvectors do not have
+///                                  one element per data point.
+template <typename Metric, typename R>
+Decomposition decompose(const SparseMatrix &data, std::size_t n_components,
+                        const kernel::MetricGaussian<Metric> &kernel, R &rng,
+                        const Options &options = Options()) {
+  std::normal_distribution dist;
+  return internal::decompose(data, n_components, kernel, options,
+                             [&rng, &dist]() { return dist(rng); });
+}
+
+/// \brief Diffusion maps of sparse data points.
+///
+/// \tparam Metric The distance metric of the kernel.
+/// \tparam R The type of the random number generator.
+/// \param[in] data The sparse data matrix where each row is a data point. The
+///                 column indices within each row must be sorted.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel.
+/// \param[in] diffusion_time The diffusion time.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options.
+/// \return The lower-dimensional embedding of the data in the diffusion space.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+/// \exception std::invalid_argument If \p diffusion_time is negative.
+/// \exception std::invalid_argument If the Morton reordering is requested.
+/// \exception std::invalid_argument If the warm-start eigenvectors do not have
+///                                  one element per data point.
+template <typename Metric, typename R>
+Matrix diffusion_maps(const SparseMatrix &data, std::size_t n_components,
+                      const kernel::MetricGaussian<Metric> &kernel,
+                      double diffusion_time, R &rng,
+                      const Options &options = Options()) {
+  if (diffusion_time < 0) {
+    throw std::invalid_argument("diffusion time must be non-negative");
+  }
+  const Decomposition decomposition =
+      decompose(data, n_components, kernel, rng, options);
+  internal::report(options.monitor, Stage::EMBEDDING);
+  internal::ScopedTimer timer(options.stats ? &options.stats->embedding_time
+                                            : nullptr);
+  if (options.stats) {
+    options.stats->record_bytes(decomposition.n_samples() *
+                                decomposition.n_components() * sizeof(double));
+  }
+  return decomposition.embed(diffusion_time);
+}
+
+/// \brief Diffusion maps for several diffusion times, sharing a single
+///        eigendecomposition.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel function.
+/// \param[in] diffusion_times The diffusion times.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options.
+/// \return The lower-dimensional embedding of the data in the diffusion space
+///         for each diffusion time.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+/// \exception std::invalid_argument If any diffusion time is negative.
+/// \exception std::invalid_argument If the warm-start eigenvectors do not have
+///                                  one element per data point.
+template <typename R>
+std::vector<Matrix> diffusion_maps(
+    const Matrix &data, std::size_t n_components,
+    const std::function<double(const Vector &, const Vector &)> &kernel,
+    const std::vector<double> &diffusion_times, R &rng,
+    const Options &options = Options()) {
+  for (const double diffusion_time : diffusion_times) {
+    if (diffusion_time < 0)
+      throw std::invalid_argument("diffusion time must be non-negative");
+  }
+  const Decomposition decomposition =
+      decompose(data, n_components, kernel, rng, options);
+  internal::report(options.monitor, Stage::EMBEDDING);
+  internal::ScopedTimer timer(options.stats ? &options.stats->embedding_time
+                                            : nullptr);
+  if (options.stats) {
+    options.stats->record_bytes(diffusion_times.size() *
+                                decomposition.n_samples() *
+                                decomposition.n_components() * sizeof(double));
+  }
+  return decomposition.embed(diffusion_times);
+}
+
 /// \brief Diffusion maps.
 ///
 /// \tparam R The type of the random number generator.
@@ -61,13 +530,159 @@ Matrix diffusion_maps(
     double kernel_epsilon = DEFAULT_KERNEL_EPSILON,
     double eig_solver_tol = DEFAULT_EIG_SOLVER_TOL,
     unsigned eig_solver_max_iter = DEFAULT_EIG_SOLVER_MAX_ITER) {
-  std::normal_distribution dist;
-  return internal::diffusion_maps(data, n_components, kernel, diffusion_time,
-                                  kernel_epsilon, eig_solver_tol,
-                                  eig_solver_max_iter,
-                                  [&rng, &dist]() { return dist(rng); });
+  Options options;
+  options.kernel_epsilon = kernel_epsilon;
+  options.eig_solver_tol = eig_solver_tol;
+  options.eig_solver_max_iter = eig_solver_max_iter;
+  return diffusion_maps(data, n_components, kernel, diffusion_time, rng,
+                        options);
 }
 
+/// \brief A fit running on another thread, returned by diffusion_maps_async()
+///        and decompose_async().
+///
+/// The fit can be cancelled at any time; it then stops at its next progress
+/// report, see Monitor. Destroying the handle of a fit whose result was not
+/// retrieved cancels the fit and waits for it to stop.
+///
+/// \tparam T The type of the result.
+template <typename T> class AsyncFit {
+protected:
+  /// The monitor of the fit, at a fixed address for the fit to report to.
+  std::unique_ptr<Monitor> _monitor;
+  /// The result of the fit.
+  std::future<T> _result;
+
+public:
+  /// \brief Constructs the handle of a fit.
+  ///
+  /// \param[in] monitor The monitor that the fit reports to.
+  /// \param[in] result The result of the fit.
+  AsyncFit(std::unique_ptr<Monitor> monitor, std::future<T> result)
+      : _monitor(std::move(monitor)), _result(std::move(result)) {}
+
+  AsyncFit(AsyncFit &&) = default;
+  AsyncFit &operator=(AsyncFit &&) = delete;
+
+  /// Cancels the fit if its result was not retrieved, and waits for it.
+  ~AsyncFit() {
+    if (_result.valid()) {
+      _monitor->cancel();
+      _result.wait();
+    }
+  }
+
+  /// Asks the fit to stop at its next progress report.
+  void cancel() { _monitor->cancel(); }
+
+  /// Tells whether the fit has finished, successfully or not.
+  bool ready() const {
+    return _result.wait_for(std::chrono::seconds(0)) ==
+           std::future_status::ready;
+  }
+
+  /// Waits for the fit to finish.
+  void wait() const { _result.wait(); }
+
+  /// \brief Waits for the fit to finish and retrieves its result. May only be
+  ///        called once.
+  ///
+  /// \return The result of the fit.
+  /// \exception Cancelled If the fit was cancelled.
+  /// \exception std::invalid_argument If an argument of the fit is invalid.
+  T get() { return _result.get(); }
+};
+
+/// \brief Diffusion maps, computed on another thread.
+///
+/// The fit is the same as that of diffusion_maps(), and its progress is
+/// reported to \p on_progress, on the thread that runs it, see Monitor.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] data The data matrix where each row is a data point. It is
+///                 read by the fit without being copied, so it must outlive
+///                 the fit, and so must the warm start and the stats of the
+///                 options. Temporaries are rejected at compile time.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel function.
+/// \param[in] diffusion_time The diffusion time.
+/// \param[in] rng The random number generator, moved to the fit.
+/// \param[in] options The options. The monitor is replaced with that of the
+///                    fit.
+/// \param[in] on_progress If not null, called with each progress report.
+/// \return The handle of the fit, whose result is the lower-dimensional
+///         embedding of the data in the diffusion space.
+template <typename R>
+AsyncFit<Matrix> diffusion_maps_async(
+    const Matrix &data, const std::size_t n_components,
+    std::function<double(const Vector &, const Vector &)> kernel,
+    const double diffusion_time, R rng, Options options = Options(),
+    std::function<void(const Progress &)> on_progress = nullptr) {
+  auto monitor = std::make_unique<Monitor>(std::move(on_progress));
+  options.monitor = monitor.get();
+  std::future<Matrix> result = std::async(
+      std::launch::async,
+      [&data, n_components, kernel = std::move(kernel), diffusion_time,
+       rng = std::move(rng), options]() mutable {
+        return diffusion_maps(data, n_components, kernel, diffusion_time, rng,
+                              options);
+      });
+  return AsyncFit<Matrix>(std::move(monitor), std::move(result));
+}
+
+/// \brief A temporary data matrix would be destroyed while the fit still reads
+///        it, see diffusion_maps_async().
+template <typename R>
+AsyncFit<Matrix> diffusion_maps_async(
+    Matrix &&data, std::size_t n_components,
+    std::function<double(const Vector &, const Vector &)> kernel,
+    double diffusion_time, R rng, Options options = Options(),
+    std::function<void(const Progress &)> on_progress = nullptr) = delete;
+
+/// \brief Computes the eigendecomposition of the diffusion matrix on another
+///        thread.
+///
+/// The fit is the same as that of decompose(), and its progress is reported
+/// to \p on_progress, on the thread that runs it, see Monitor.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] data The data matrix where each row is a data point. It is
+///                 read by the fit without being copied, so it must outlive
+///                 the fit, and so must the warm start and the stats of the
+///                 options. Temporaries are rejected at compile time.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel function.
+/// \param[in] rng The random number generator, moved to the fit.
+/// \param[in] options The options. The monitor is replaced with that of the
+///                    fit.
+/// \param[in] on_progress If not null, called with each progress report.
+/// \return The handle of the fit, whose result is the eigendecomposition.
+template <typename R>
+AsyncFit<Decomposition> decompose_async(
+    const Matrix &data, const std::size_t n_components,
+    std::function<double(const Vector &, const Vector &)> kernel, R rng,
+    Options options = Options(),
+    std::function<void(const Progress &)> on_progress = nullptr) {
+  auto monitor = std::make_unique<Monitor>(std::move(on_progress));
+  options.monitor = monitor.get();
+  std::future<Decomposition> result = std::async(
+      std::launch::async,
+      [&data, n_components, kernel = std::move(kernel), rng = std::move(rng),
+       options]() mutable {
+        return decompose(data, n_components, kernel, rng, options);
+      });
+  return AsyncFit<Decomposition>(std::move(monitor), std::move(result));
+}
+
+/// \brief A temporary data matrix would be destroyed while the fit still reads
+///        it, see decompose_async().
+template <typename R>
+AsyncFit<Decomposition> decompose_async(
+    Matrix &&data, std::size_t n_components,
+    std::function<double(const Vector &, const Vector &)> kernel, R rng,
+    Options options = Options(),
+    std::function<void(const Progress &)> on_progress = nullptr) = delete;
+
 } // namespace diffusion_maps
 
 #endif
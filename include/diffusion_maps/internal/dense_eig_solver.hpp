@@ -0,0 +1,154 @@
+#ifndef DIFFUSION_MAPS_INTERNAL_DENSE_EIG_SOLVER_HPP
+#define DIFFUSION_MAPS_INTERNAL_DENSE_EIG_SOLVER_HPP
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/monitor.hpp"
+#include "diffusion_maps/stats.hpp"
+
+namespace diffusion_maps {
+
+namespace internal {
+
+/// The number of columns reduced together in each panel of tridiagonalise().
+constexpr std::size_t TRIDIAGONAL_PANEL_SIZE = 32;
+
+/// \brief The number of columns of each tile of the trailing update of
+///        tridiagonalise().
+constexpr std::size_t TRIDIAGONAL_TILE_SIZE = 256;
+
+/// \brief The number of steps of inverse iteration for each eigenvector of
+///        tridiagonal_eigenvectors().
+constexpr unsigned TRIDIAGONAL_N_INVERSE_ITERS = 3;
+
+/// \brief Reduces a dense symmetric matrix to tridiagonal form T = Qᵀ A Q with
+///        Householder reflections.
+///
+/// The reflectors are formed in panels of TRIDIAGONAL_PANEL_SIZE columns, as
+/// in LAPACK's dsytrd. Within a panel, each column is updated with the
+/// reflectors of the panel so far, and its reflector is formed from a
+/// product of the trailing matrix with a vector; the updates of the trailing
+/// matrix are accumulated in two blocks V and W, and applied at the end of the
+/// panel as the rank-2b update A ← A - V Wᵀ - W Vᵀ. The update is split into
+/// tiles of TRIDIAGONAL_TILE_SIZE columns, so that a tile of each row stays in
+/// cache for the whole panel, and its rows run in parallel, as do the rows of
+/// the products. The updates of each column with the reflectors of its panel
+/// take O(n b) operations and run on one thread. Each element is computed by a
+/// single thread in a fixed order, so the result does not depend on the number
+/// of threads.
+///
+/// This takes about 4/3 n³ floating-point operations, half of them in the
+/// products, which are bound by the memory bandwidth.
+///
+/// \param[in,out] a The matrix, row-major and contiguous. Both triangles must
+///                  be stored. On return, row j holds the j-th reflector
+///                  H = I - τ v vᵀ in its elements j + 1 onwards, where
+///                  v[j + 1] = 1, and the rest is destroyed.
+/// \param[out] diagonal The diagonal of T.
+/// \param[out] off_diagonal The off-diagonal of T.
+/// \param[out] taus The scale τ of each reflector.
+/// \param[in] monitor If not null, the progress is reported to it after each
+///                    panel, with the number of panels reduced, see Monitor.
+/// \exception std::invalid_argument If \p a is not square, row-major and
+///                                  contiguous.
+/// \exception Cancelled If the fit is cancelled through \p monitor.
+void tridiagonalise(Matrix &a, std::vector<double> &diagonal,
+                    std::vector<double> &off_diagonal,
+                    std::vector<double> &taus,
+                    const Monitor *monitor = nullptr);
+
+/// \brief Finds the largest eigenvalues of a symmetric tridiagonal matrix by
+///        bisection.
+///
+/// Each eigenvalue is bisected independently, in parallel, from the
+/// Gershgorin interval, using the Sturm sequence of the matrix to count the
+/// eigenvalues below each point, until its interval shrinks to the rounding
+/// error. Its accuracy is thus about ε ‖T‖, however clustered the spectrum.
+///
+/// \param[in] diagonal The diagonal.
+/// \param[in] off_diagonal The off-diagonal.
+/// \param[in] k The number of eigenvalues to find.
+/// \return The \p k largest eigenvalues, in descending order.
+/// \exception std::invalid_argument If \p k is greater than the size of the
+///                                  matrix.
+std::vector<double>
+tridiagonal_eigenvalues(const std::vector<double> &diagonal,
+                        const std::vector<double> &off_diagonal, unsigned k);
+
+/// \brief Finds the eigenvectors of a symmetric tridiagonal matrix for known
+///        eigenvalues by inverse iteration.
+///
+/// Each eigenvector takes TRIDIAGONAL_N_INVERSE_ITERS solves with T - λ I,
+/// factorised once by Gaussian elimination with partial pivoting, from a
+/// fixed pseudo-random start. As in LAPACK's dstein, the eigenvalues closer
+/// than 10⁻³ ‖T‖ form a cluster, whose eigenvectors are orthogonalised against
+/// each other at each step, and equal eigenvalues are pulled apart slightly.
+/// The clusters are independent and run in parallel, while the eigenvectors of
+/// a cluster are found in order on one thread. Each eigenvector starts from
+/// its own seed, so the result does not depend on the number of threads.
+///
+/// \param[in] diagonal The diagonal.
+/// \param[in] off_diagonal The off-diagonal.
+/// \param[in] eigenvalues The eigenvalues, in descending order.
+/// \return The eigenvectors, normalised, as the columns of a column-major
+///         block.
+Matrix tridiagonal_eigenvectors(const std::vector<double> &diagonal,
+                                const std::vector<double> &off_diagonal,
+                                const std::vector<double> &eigenvalues);
+
+/// \brief Multiplies a block of vectors by the orthogonal matrix Q of
+///        tridiagonalise().
+///
+/// The reflectors are applied from the last one to the first. The columns of
+/// the block are independent, and run in parallel.
+///
+/// \param[in] a The reflectors, as returned by tridiagonalise().
+/// \param[in] taus The scales of the reflectors.
+/// \param[in,out] z The block, column-major.
+/// \exception std::invalid_argument If the dimensions are incorrect.
+void apply_reflectors(const Matrix &a, const std::vector<double> &taus,
+                      Matrix &z);
+
+/// \brief Find the \p k largest eigenvalues and their corresponding
+///        eigenvectors of a dense symmetric matrix.
+///
+/// The matrix is reduced to tridiagonal form, see tridiagonalise(), the
+/// eigenpairs of the tridiagonal matrix are found by bisection and inverse
+/// iteration, see tridiagonal_eigenvalues() and tridiagonal_eigenvectors(),
+/// and the eigenvectors are multiplied back by Q, see apply_reflectors().
+///
+/// Unlike the iterative solvers, the work does not depend on the spectrum:
+/// the reduction takes O(n³) operations, and the rest O(k n²). The
+/// eigenpairs are accurate to the rounding error of the reduction, so there
+/// is no tolerance. Like chebyshev_eigsh(), the eigenvalues are the largest
+/// ones, not the ones of largest magnitude.
+///
+/// \param[in,out] a The matrix, row-major and contiguous. It is destroyed on
+///                  return.
+/// \param[in] k The number of eigenvalues to find.
+/// \param[in,out] stats If not null, one iteration and the residual of each
+///                      eigenpair are appended to it. The residuals are those
+///                      of the tridiagonal matrix, equal to those of \p a up
+///                      to the rounding error of the reduction.
+/// \param[in] monitor If not null, the progress is reported to it after each
+///                    panel of the reduction, see Monitor.
+/// \return The largest eigenvalues, in descending order, and their
+///         corresponding eigenvectors, as the columns of a column-major block.
+/// \exception std::invalid_argument If \p a is not square, row-major and
+///                                  contiguous.
+/// \exception std::invalid_argument If \p k is greater than the number of rows
+///                                  in \p a.
+/// \exception Cancelled If the fit is cancelled through \p monitor.
+std::pair<std::vector<double>, Matrix> dense_eigsh(Matrix &a, unsigned k,
+                                                   Stats *stats = nullptr,
+                                                   const Monitor *monitor =
+                                                       nullptr);
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
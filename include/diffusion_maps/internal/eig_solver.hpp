@@ -5,7 +5,10 @@
 #include <optional>
 #include <vector>
 
-#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/linear_operator.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/monitor.hpp"
+#include "diffusion_maps/stats.hpp"
 #include "diffusion_maps/vector.hpp"
 
 namespace diffusion_maps {
@@ -36,39 +39,176 @@ namespace internal {
 /// multiplied by the matrix. Basically, this actively suppresses the components
 /// for β₁, β₂, ..., βₖ₋₁ in the eigenvector.
 ///
-/// \param[in] a The matrix.
+/// The reprojection is classical Gram-Schmidt applied twice (CGS2), against
+/// all the previously found eigenvectors at once: they are held in one block,
+/// so that it takes three parallel passes over the block, instead of two per
+/// eigenvector, and the partial sums are added in a fixed order, so that the
+/// result does not depend on the number of threads. The working vectors are
+/// allocated once, before the iterations.
+///
+/// \param[in] a The matrix, in any storage format.
 /// \param[in] x0 The initial guess for the eigenvector.
-/// \param[in] betas The array of previously found eigenvectors, all normalised
-///                  with respect to the Euclidean norm.
+/// \param[in] betas The previously found eigenvectors, as the first \p n_betas
+///                  columns of a column-major block, all normalised with
+///                  respect to the Euclidean norm. May be null if \p n_betas
+///                  is 0.
 /// \param[in] n_betas The number of previously found eigenvectors.
 /// \param[in] tol The tolerance for the Euclidean norm of the eigenvector.
 /// \param[in] max_iters The maximum number of iterations.
+/// \param[out] n_iters If not null, set to the number of iterations performed.
+/// \param[in] on_iteration If not null, called after each iteration with the
+///                         number of iterations performed and the change of
+///                         the eigenvector, which is compared with \p tol.
 /// \return An eigenvalue and its corresponding eigenvector. Or nullopt if the
 ///         maximum number of iterations is exceeded.
 /// \exception std::invalid_argument If the dimensions are incorrect.
-std::optional<std::pair<double, Vector>>
-symmetric_power_method(const SparseMatrix &a, const Vector &x0,
-                       const Vector *betas, std::size_t n_betas, double tol,
-                       unsigned max_iters);
+std::optional<std::pair<double, Vector>> symmetric_power_method(
+    const LinearOperator &a, const Vector &x0, const Matrix *betas,
+    std::size_t n_betas, double tol, unsigned max_iters,
+    unsigned *n_iters = nullptr,
+    const std::function<void(unsigned, double)> *on_iteration = nullptr);
 
 /// \brief Find \p k dominant eigenvalues and their corresponding eigenvectors
 ///        of a symmetric matrix using the symmetric power method.
 ///
-/// \param[in] a The matrix.
+/// \param[in] a The matrix, in any storage format.
 /// \param[in] k The number of dominant eigenvalues to find.
 /// \param[in] tol The tolerance for the eigenvectors.
 /// \param[in] max_iters The maximum number of iterations to find each
 ///                      eigenvector.
 /// \param[in] rng A function that generates a random number.
-/// \return The dominant eigenvalues and their corresponding eigenvectors. If
-///         the method fails to find all \p k eigenvalues and eigenvectors, it
-///         will return less than \p k eigenvalues and eigenvectors.
+/// \param[in] x0s The array of initial guesses for the first \p n_x0s
+///                eigenvectors, e.g. the eigenvectors of a previous fit on
+///                similar data. The remaining eigenvectors, and those whose
+///                guess is zero, start from random vectors.
+/// \param[in] n_x0s The number of initial guesses.
+/// \param[out] n_iters If not null, set to the number of iterations each
+///                     eigenpair took, including the failed one, if any.
+/// \param[in,out] stats If not null, the number of sparse matrix-vector
+///                      products is added to it, and the number of iterations
+///                      and the residual of each eigenpair are appended to it.
+///                      The residuals take one more product per eigenpair.
+/// \param[in] monitor If not null, the progress is reported to it after each
+///                    iteration, see Monitor.
+/// \return The dominant eigenvalues and their corresponding eigenvectors, as
+///         the columns of a column-major block. If the method fails to find
+///         all \p k eigenvalues and eigenvectors, it will return less than
+///         \p k eigenvalues and eigenvectors.
+/// \exception std::invalid_argument If \p a is not square.
+/// \exception std::invalid_argument If \p k is greater than the number of rows
+///                                  in \p a.
+/// \exception std::invalid_argument If the dimensions of the initial guesses
+///                                  are incorrect.
+/// \exception Cancelled If the fit is cancelled through \p monitor.
+std::pair<std::vector<double>, Matrix>
+eigsh(const LinearOperator &a, unsigned k, double tol, unsigned max_iters,
+      const std::function<double()> &rng, const Vector *x0s = nullptr,
+      std::size_t n_x0s = 0, std::vector<unsigned> *n_iters = nullptr,
+      Stats *stats = nullptr, const Monitor *monitor = nullptr);
+
+/// \brief Find \p k dominant eigenvalues and their corresponding eigenvectors
+///        of a symmetric matrix using randomised subspace iteration.
+///
+/// This is the randomised range finder of Halko, Martinsson and Tropp followed
+/// by a Rayleigh-Ritz projection. A random n × l block Ω, where l = \p k +
+/// \p oversampling (capped at n), is multiplied by \p a and orthonormalised to
+/// give a basis Q of the dominant subspace. The basis is refined by
+/// \p n_power_iters rounds of Q ← orth(A Q), which sharpens it by a factor of
+/// (λₗ₊₁ / λₖ)² per round. Finally, the l × l matrix Qᵀ A Q is diagonalised
+/// with the Jacobi method and its dominant eigenvectors are lifted back with Q.
+///
+/// Unlike eigsh(), the amount of work is fixed: \p a is multiplied by exactly
+/// \p n_power_iters + 2 blocks of l vectors, regardless of the spectrum. The
+/// accuracy is therefore not controlled by a tolerance; it improves with
+/// \p oversampling and \p n_power_iters and with the decay of the spectrum.
+///
+/// \param[in] a The matrix, in any storage format.
+/// \param[in] k The number of dominant eigenvalues to find.
+/// \param[in] oversampling The number of extra vectors in the random block.
+/// \param[in] n_power_iters The number of power iterations.
+/// \param[in] rng A function that generates a random number.
+/// \param[in] x0s The array of initial guesses, which replace the first
+///                \p n_x0s columns of Ω. Guesses beyond the block size are
+///                ignored.
+/// \param[in] n_x0s The number of initial guesses.
+/// \param[in,out] stats If not null, the number of sparse matrix-vector
+///                      products is added to it, and the number of passes and
+///                      the residual of each eigenpair are appended to it. The
+///                      residuals take one more product per eigenpair.
+/// \param[in] monitor If not null, the progress is reported to it after each
+///                    power iteration, see Monitor.
+/// \return The dominant eigenvalues, in descending order of magnitude, and
+///         their corresponding eigenvectors, as the columns of a column-major
+///         block.
+/// \exception std::invalid_argument If \p a is not square.
+/// \exception std::invalid_argument If \p k is greater than the number of rows
+///                                  in \p a.
+/// \exception std::invalid_argument If the dimensions of the initial guesses
+///                                  are incorrect.
+/// \exception Cancelled If the fit is cancelled through \p monitor.
+std::pair<std::vector<double>, Matrix>
+randomized_eigsh(const LinearOperator &a, unsigned k, unsigned oversampling,
+                 unsigned n_power_iters, const std::function<double()> &rng,
+                 const Vector *x0s = nullptr, std::size_t n_x0s = 0,
+                 Stats *stats = nullptr, const Monitor *monitor = nullptr);
+
+/// \brief Find the \p k largest eigenvalues and their corresponding
+///        eigenvectors of a symmetric matrix whose spectrum lies in [-1, 1]
+///        using Chebyshev-filtered subspace iteration.
+///
+/// A block of l = min(\p k + max(\p k, 4), n) orthonormal vectors is
+/// repeatedly multiplied by a Chebyshev polynomial of A of degree \p degree,
+/// re-orthonormalised and rotated onto its Ritz vectors. The polynomial is
+/// small on [-1, θₗ], where θₗ is the smallest Ritz value of the block, and
+/// grows fast above it, so each pass damps the unwanted part of the spectrum by
+/// roughly the ratio of Chebyshev polynomials instead of by (λₖ₊₁ / λₖ)^degree
+/// as the power method would. This matters most when the wanted eigenvalues
+/// are clustered near 1, as they are for the "symmetrised" diffusion matrix.
+/// Only sparse matrix-vector products and l working vectors are needed.
+///
+/// Unlike eigsh(), the eigenvalues are the largest ones, not the ones of
+/// largest magnitude. The two coincide for the "symmetrised" diffusion
+/// matrix of a positive-definite kernel.
+///
+/// \param[in] a The matrix, in any storage format.
+/// \param[in] k The number of eigenvalues to find.
+/// \param[in] tol The tolerance for the residual ‖A v - λ v‖ of each
+///                eigenpair (λ, v).
+/// \param[in] max_iters The maximum number of filtering passes. Each pass
+///                      takes \p degree + 1 products with a block of l
+///                      vectors.
+/// \param[in] degree The degree of the Chebyshev polynomial.
+/// \param[in] rng A function that generates a random number.
+/// \param[in] x0s The array of initial guesses for the first \p n_x0s vectors
+///                of the block. The remaining vectors, and those whose guess
+///                is zero, start from random vectors.
+/// \param[in] n_x0s The number of initial guesses.
+/// \param[out] n_iters If not null, set to the number of passes after which
+///                     each eigenpair met the tolerance, including the failed
+///                     one, if any.
+/// \param[in,out] stats If not null, the number of sparse matrix-vector
+///                      products is added to it, and the number of passes and
+///                      the residual of each eigenpair are appended to it.
+/// \param[in] monitor If not null, the progress is reported to it after each
+///                    pass, with the residual of the first eigenpair that has
+///                    not converged, see Monitor.
+/// \return The largest eigenvalues, in descending order, and their
+///         corresponding eigenvectors, as the columns of a column-major block.
+///         If the method fails to find all \p k eigenvalues and eigenvectors,
+///         it will return less than \p k eigenvalues and eigenvectors.
 /// \exception std::invalid_argument If \p a is not square.
 /// \exception std::invalid_argument If \p k is greater than the number of rows
 ///                                  in \p a.
-std::pair<std::vector<double>, std::vector<Vector>>
-eigsh(const SparseMatrix &a, unsigned k, double tol, unsigned max_iters,
-      const std::function<double()> &rng);
+/// \exception std::invalid_argument If \p degree is 0.
+/// \exception std::invalid_argument If the dimensions of the initial guesses
+///                                  are incorrect.
+/// \exception Cancelled If the fit is cancelled through \p monitor.
+std::pair<std::vector<double>, Matrix>
+chebyshev_eigsh(const LinearOperator &a, unsigned k, double tol,
+                unsigned max_iters, unsigned degree,
+                const std::function<double()> &rng, const Vector *x0s = nullptr,
+                std::size_t n_x0s = 0, std::vector<unsigned> *n_iters = nullptr,
+                Stats *stats = nullptr, const Monitor *monitor = nullptr);
 
 } // namespace internal
 
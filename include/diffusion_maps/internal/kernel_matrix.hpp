@@ -0,0 +1,930 @@
+#ifndef DIFFUSION_MAPS_INTERNAL_KERNEL_MATRIX_HPP
+#define DIFFUSION_MAPS_INTERNAL_KERNEL_MATRIX_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#ifdef PAR
+#include <omp.h>
+#endif
+
+#include "diffusion_maps/internal/quantised_points.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/metric.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/stats.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+namespace internal {
+
+/// \brief Calls a function with the kernel held by a kernel function, if it is
+///        a kernel::MetricGaussian with one of the built-in metrics.
+///
+/// This lets the loops over pairs of data points use the metric directly,
+/// inlined, instead of calling the kernel function through the
+/// std::function.
+///
+/// \param[in] function The kernel function.
+/// \param[in] f The function to call with the kernel.
+/// \return Whether \p f was called.
+template <typename F>
+bool visit_gaussian_kernel(
+    const std::function<double(const Vector &, const Vector &)> &function,
+    F &&f) {
+  if (const auto *const k = function.target<kernel::Gaussian>()) {
+    f(*k);
+  } else if (const auto *const k =
+                 function.target<kernel::MetricGaussian<metric::Cosine>>()) {
+    f(*k);
+  } else if (const auto *const k =
+                 function.target<kernel::MetricGaussian<metric::L1>>()) {
+    f(*k);
+  } else if (const auto *const k = function.target<
+                 kernel::MetricGaussian<metric::DiagonalMahalanobis>>()) {
+    f(*k);
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/// \brief Copies the data points into a contiguous row-major matrix, whatever
+///        the strides of the data matrix, and prepares them for a metric.
+///
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] metric The distance metric.
+/// \return The prepared data points.
+template <typename Metric>
+Matrix prepare_points(const Matrix &data, const Metric &metric) {
+  const std::size_t n_features = data.n_cols();
+  Matrix points(data.n_rows(), n_features);
+  const double *const src = data.data();
+  double *const dst = points.data();
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t i = 0; i < data.n_rows(); ++i) {
+    for (std::size_t f = 0; f < n_features; ++f) {
+      dst[i * n_features + f] =
+          src[i * data.row_stride() + f * data.col_stride()];
+    }
+  }
+
+  metric.prepare(points);
+  return points;
+}
+
+/// \brief Builds the kernel matrix from the triplets of its non-zero elements
+///        and records the statistics of the kernel stage.
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in,out] triplets The triplets of the non-zero elements. Sorted.
+/// \param[in] n_kernel_evals The number of pairs of data points, out of the
+///                           upper triangle, for which the kernel was
+///                           evaluated.
+/// \param[in,out] stats If not null, the kernel evaluations and the bytes held
+///                      by the triplets and the matrix are recorded in it.
+/// \return The kernel matrix.
+SparseMatrix
+assemble_kernel_matrix(std::size_t n_samples,
+                       std::vector<SparseMatrix::Triplet> &triplets,
+                       std::uint64_t n_kernel_evals, Stats *stats);
+
+/// \brief Computes the triplets of the kernel matrix.
+///
+/// Gaussian kernels with one of the built-in metrics are dispatched to the
+/// overload for kernel::MetricGaussian.
+///
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] kernel The kernel function.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[in,out] stats If not null, the bytes held by the data points are
+///                      recorded in it.
+/// \param[in] precision The precision in which the data points are read. Other
+///                      kernels than the built-in Gaussian kernels always read
+///                      them in double precision.
+/// \return The triplets of the non-zero elements, in no particular order. The
+///         kernel was evaluated for every pair of the upper triangle.
+std::vector<SparseMatrix::Triplet> compute_kernel_triplets(
+    const Matrix &data,
+    const std::function<double(const Vector &, const Vector &)> &kernel,
+    double epsilon, Stats *stats = nullptr,
+    Precision precision = Precision::DOUBLE);
+
+/// \brief Computes the kernel matrix, from the triplets of
+///        compute_kernel_triplets().
+///
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] kernel The kernel function.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[in,out] stats If not null, the kernel evaluations and the bytes held
+///                      by the triplets and the matrix are recorded in it.
+/// \param[in] precision The precision in which the data points are read. Other
+///                      kernels than the built-in Gaussian kernels always read
+///                      them in double precision.
+/// \return The kernel matrix.
+SparseMatrix compute_kernel_matrix(
+    const Matrix &data,
+    const std::function<double(const Vector &, const Vector &)> &kernel,
+    double epsilon, Stats *stats = nullptr,
+    Precision precision = Precision::DOUBLE);
+
+/// \brief Computes the kernel matrix as a dense matrix.
+///
+/// The kernel is evaluated for every pair of the upper triangle, in tiles of
+/// PAIR_TILE_SIZE × PAIR_TILE_SIZE pairs that run in parallel, and mirrored
+/// into the lower triangle. Gaussian kernels with one of the built-in metrics
+/// use the metric directly, as in compute_kernel_triplets(). The elements
+/// below the kernel epsilon are 0, so that the non-zero elements are those of
+/// compute_kernel_matrix(), with the same values.
+///
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] kernel The kernel function.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[in,out] stats If not null, the kernel evaluations, the number of
+///                      non-zero elements and the bytes held by the data
+///                      points and the matrix are recorded in it.
+/// \return The kernel matrix, row-major and contiguous.
+Matrix compute_dense_kernel_matrix(
+    const Matrix &data,
+    const std::function<double(const Vector &, const Vector &)> &kernel,
+    double epsilon, Stats *stats = nullptr);
+
+/// \brief The distance beyond which a Gaussian kernel is below ε.
+///
+/// \param[in] kernel The kernel.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \return -ln(ε) / γ, or infinity if γ is 0.
+template <typename Metric>
+double max_kernel_distance(const kernel::MetricGaussian<Metric> &kernel,
+                           const double epsilon) {
+  // exp(-γ d) > ε if and only if d < -ln(ε) / γ.
+  return kernel.gamma > 0 ? -std::log(epsilon) / kernel.gamma
+                          : std::numeric_limits<double>::infinity();
+}
+
+/// The side of the square tiles of pairs of data points in
+/// collect_symmetric_triplets().
+constexpr std::size_t PAIR_TILE_SIZE = 64;
+
+/// \brief Collects the triplets of a symmetric matrix from the elements of its
+///        upper triangle.
+///
+/// The upper triangle is split into tiles of PAIR_TILE_SIZE × PAIR_TILE_SIZE
+/// elements, the diagonal ones being half full, and each tile is an OpenMP
+/// task. The threads take the tiles as they become idle, so that the work is
+/// balanced however uneven the rows of the triangle are, and the data points of
+/// the rows and columns of a tile stay in cache while it is processed. Each
+/// thread appends to its own triplets, which are concatenated at the end.
+///
+/// \param[in] n The number of rows and columns.
+/// \param[in] element The function that returns the (i, j) element for j ≥ i,
+///                    or 0 if it is not stored. It is called concurrently.
+/// \return The triplets of both triangles, in no particular order.
+template <typename Element>
+std::vector<SparseMatrix::Triplet>
+collect_symmetric_triplets(const std::size_t n, const Element &element) {
+  const std::size_t n_blocks = (n + PAIR_TILE_SIZE - 1) / PAIR_TILE_SIZE;
+  std::vector<std::vector<SparseMatrix::Triplet>> thread_triplets(1);
+
+#ifdef PAR
+#pragma omp parallel
+#pragma omp single
+#endif
+  {
+#ifdef PAR
+    thread_triplets.resize(omp_get_num_threads());
+#endif
+
+    for (std::size_t bi = 0; bi < n_blocks; ++bi) {
+      for (std::size_t bj = bi; bj < n_blocks; ++bj) {
+#ifdef PAR
+#pragma omp task firstprivate(bi, bj)
+#endif
+        {
+#ifdef PAR
+          auto &triplets = thread_triplets[omp_get_thread_num()];
+#else
+          auto &triplets = thread_triplets[0];
+#endif
+          const std::size_t i_end = std::min((bi + 1) * PAIR_TILE_SIZE, n);
+          const std::size_t j_end = std::min((bj + 1) * PAIR_TILE_SIZE, n);
+          for (std::size_t i = bi * PAIR_TILE_SIZE; i < i_end; ++i) {
+            for (std::size_t j = std::max(i, bj * PAIR_TILE_SIZE); j < j_end;
+                 ++j) {
+              const double value = element(i, j);
+              if (value != 0) {
+                triplets.push_back({i, j, value});
+                if (i != j) {
+                  triplets.push_back({j, i, value});
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+
+  if (thread_triplets.size() == 1) {
+    return std::move(thread_triplets[0]);
+  }
+
+  std::vector<std::size_t> offsets(thread_triplets.size() + 1, 0);
+  for (std::size_t t = 0; t < thread_triplets.size(); ++t) {
+    offsets[t + 1] = offsets[t] + thread_triplets[t].size();
+  }
+  std::vector<SparseMatrix::Triplet> triplets(offsets.back());
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t t = 0; t < thread_triplets.size(); ++t) {
+    std::copy(thread_triplets[t].begin(), thread_triplets[t].end(),
+              triplets.begin() + offsets[t]);
+    thread_triplets[t] = {};
+  }
+
+  return triplets;
+}
+
+/// \brief Collects the triplets of the kernel matrix of a Gaussian kernel,
+///        from the distances between the pairs of data points of the upper
+///        triangle, see collect_symmetric_triplets().
+///
+/// Each data point is at distance 0 from itself, so that the diagonal is
+/// always 1.
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in] kernel The kernel.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[in] distance The function that returns the distance between the i-th
+///                     and j-th data points for j > i. It may return infinity
+///                     for pairs that are known to be beyond the cutoff, and
+///                     is called concurrently.
+/// \return The triplets of both triangles.
+template <typename Metric, typename Distance>
+std::vector<SparseMatrix::Triplet>
+collect_kernel_triplets(const std::size_t n_samples,
+                        const kernel::MetricGaussian<Metric> &kernel,
+                        const double epsilon, const Distance &distance) {
+  const double max_distance = max_kernel_distance(kernel, epsilon);
+
+  return collect_symmetric_triplets(
+      n_samples, [&](const std::size_t i, const std::size_t j) {
+        const double d = j == i ? 0 : distance(i, j);
+        if (!(d < max_distance)) {
+          return 0.0;
+        }
+        const double value = std::exp(-kernel.gamma * d);
+        return value > epsilon ? value : 0.0;
+      });
+}
+
+/// \brief Collects the triplets of the kernel matrix of a Gaussian kernel from
+///        quantised data points.
+///
+/// The distances are evaluated on the quantised points, which reads 4 or 8
+/// times less data than the points in double precision. The pairs whose
+/// original distance is certainly beyond the cutoff are skipped, and those
+/// whose original distance may be on either side of it are evaluated again in
+/// double precision, so that the sparsity pattern is the same as in double
+/// precision. The other pairs keep the distance of the quantised points.
+///
+/// \tparam Code The type of the codes, see QuantisedPoints.
+/// \param[in] points The data points, prepared for the metric, in a contiguous
+///                   row-major matrix.
+/// \param[in] kernel The kernel.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[in,out] stats If not null, the evaluations in double precision and
+///                      the bytes held by the codes are recorded in it.
+/// \return The triplets of both triangles.
+template <typename Code, typename Metric>
+std::vector<SparseMatrix::Triplet>
+collect_quantised_kernel_triplets(const Matrix &points,
+                                  const kernel::MetricGaussian<Metric> &kernel,
+                                  const double epsilon, Stats *const stats) {
+  const std::size_t n_features = points.n_cols();
+  const double *const x = points.data();
+  const QuantisedPoints<Code, Metric::FORM> quantised(
+      points, max_kernel_distance(kernel, epsilon));
+  std::uint64_t n_exact = 0;
+
+  std::vector<SparseMatrix::Triplet> triplets = collect_kernel_triplets(
+      points.n_rows(), kernel, epsilon,
+      [&](const std::size_t i, const std::size_t j) {
+        const double distance = quantised.distance(i, j);
+        const int side = quantised.compare(distance, i, j);
+        if (side > 0) {
+          return std::numeric_limits<double>::infinity();
+        } else if (side < 0) {
+          return std::max(distance, 0.0);
+        }
+#ifdef PAR
+#pragma omp atomic
+#endif
+        ++n_exact;
+        return kernel.metric.distance(x + i * n_features, x + j * n_features,
+                                      n_features);
+      });
+
+  if (stats) {
+    stats->n_kernel_evals_exact += n_exact;
+    stats->record_bytes(points.n_rows() * n_features * sizeof(double) +
+                        quantised.n_bytes());
+  }
+  return triplets;
+}
+
+/// \brief Computes the triplets of the kernel matrix of a Gaussian kernel.
+///
+/// The data points are first copied into a contiguous matrix and prepared for
+/// the metric. The metric is then inlined into the loop over the pairs of data
+/// points, and the exponential is only evaluated for the pairs whose distance
+/// is below the cutoff -ln(ε) / γ. Each data point is at distance 0 from
+/// itself, so that the diagonal is always 1.
+///
+/// With a reduced precision, the loop reads quantised data points instead, see
+/// collect_quantised_kernel_triplets().
+///
+/// \tparam Metric The distance metric.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] kernel The kernel.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[in,out] stats If not null, the bytes held by the data points are
+///                      recorded in it.
+/// \param[in] precision The precision in which the data points are read.
+/// \return The triplets of the non-zero elements, in no particular order. The
+///         kernel was evaluated for every pair of the upper triangle.
+template <typename Metric>
+std::vector<SparseMatrix::Triplet>
+compute_kernel_triplets(const Matrix &data,
+                        const kernel::MetricGaussian<Metric> &kernel,
+                        const double epsilon, Stats *const stats = nullptr,
+                        const Precision precision = Precision::DOUBLE) {
+  const std::size_t n_samples = data.n_rows();
+  const std::size_t n_features = data.n_cols();
+  const Matrix points = prepare_points(data, kernel.metric);
+  const double *const x = points.data();
+
+  std::vector<SparseMatrix::Triplet> triplets;
+  switch (precision) {
+  case Precision::DOUBLE:
+    triplets = collect_kernel_triplets(
+        n_samples, kernel, epsilon,
+        [&](const std::size_t i, const std::size_t j) {
+          return kernel.metric.distance(x + i * n_features, x + j * n_features,
+                                        n_features);
+        });
+    if (stats) {
+      stats->record_bytes(n_samples * n_features * sizeof(double));
+    }
+    break;
+  case Precision::FLOAT16:
+    triplets = collect_quantised_kernel_triplets<Half>(points, kernel, epsilon,
+                                                       stats);
+    break;
+  case Precision::INT8:
+    triplets = collect_quantised_kernel_triplets<std::int8_t>(points, kernel,
+                                                              epsilon, stats);
+    break;
+  }
+  return triplets;
+}
+
+/// \brief Computes the kernel matrix of a Gaussian kernel, from the triplets
+///        of compute_kernel_triplets().
+///
+/// \tparam Metric The distance metric.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] kernel The kernel.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[in,out] stats If not null, the kernel evaluations and the bytes held
+///                      by the triplets and the matrix are recorded in it.
+/// \param[in] precision The precision in which the data points are read.
+/// \return The kernel matrix.
+template <typename Metric>
+SparseMatrix compute_kernel_matrix(const Matrix &data,
+                                   const kernel::MetricGaussian<Metric> &kernel,
+                                   const double epsilon,
+                                   Stats *const stats = nullptr,
+                                   const Precision precision =
+                                       Precision::DOUBLE) {
+  const std::size_t n_samples = data.n_rows();
+  std::vector<SparseMatrix::Triplet> triplets =
+      compute_kernel_triplets(data, kernel, epsilon, stats, precision);
+  return assemble_kernel_matrix(
+      n_samples, triplets, (std::uint64_t{n_samples} * (n_samples + 1)) / 2,
+      stats);
+}
+
+/// \brief The bytes held while the kernel matrix of sparse data points is
+///        computed, see compute_kernel_triplets(): the prepared copy of the
+///        data points, its inverted index and the per-row arrays.
+///
+/// \param[in] data The data matrix where each row is a data point.
+/// \return The size in bytes.
+inline std::size_t sparse_kernel_bytes(const SparseMatrix &data) {
+  return data.n_bytes() +
+         (4 * data.n_rows() + data.n_cols() + 1 + data.n_nz()) *
+             sizeof(std::size_t);
+}
+
+/// \brief Makes a predicate that tells whether the kernel of a pair of sparse
+///        data points is above the kernel epsilon, for the planner, see
+///        plan().
+///
+/// The distance is summed over the features that are non-zero in either
+/// point, merging the sorted column indices of both rows, so that each pair
+/// costs one pass over the two rows and needs no inverted index.
+///
+/// \tparam Metric The distance metric.
+/// \param[in] data The data matrix where each row is a data point. The column
+///                 indices within each row must be sorted.
+/// \param[in] kernel The kernel.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \return The predicate on the indices of two data points. It holds its own
+///         prepared copy of the data points.
+template <typename Metric>
+std::function<bool(std::size_t, std::size_t)>
+sparse_kernel_above(const SparseMatrix &data,
+                    const kernel::MetricGaussian<Metric> &kernel,
+                    const double epsilon) {
+  auto points = std::make_shared<SparseMatrix>(data);
+  kernel.metric.prepare(*points);
+  const double max_distance = max_kernel_distance(kernel, epsilon);
+
+  return [points, kernel, epsilon, max_distance](const std::size_t i,
+                                                 const std::size_t j) {
+    const Metric &metric = kernel.metric;
+    const double *const values = points->data();
+    const std::size_t *const col_ixs = points->col_ixs();
+    const std::size_t *const row_ixs = points->row_ixs();
+
+    double distance = metric.zero_distance();
+    std::size_t ir = row_ixs[i], jr = row_ixs[j];
+    while (ir < row_ixs[i + 1] || jr < row_ixs[j + 1]) {
+      if (jr == row_ixs[j + 1] ||
+          (ir < row_ixs[i + 1] && col_ixs[ir] < col_ixs[jr])) {
+        distance += metric.term(values[ir++], 0);
+      } else if (ir == row_ixs[i + 1] || col_ixs[jr] < col_ixs[ir]) {
+        distance += metric.term(0, values[jr++]);
+      } else {
+        distance += metric.term(values[ir++], values[jr++]);
+      }
+    }
+    return distance < max_distance &&
+           std::exp(-kernel.gamma * distance) > epsilon;
+  };
+}
+
+/// \brief Computes the triplets of the kernel matrix of a Gaussian kernel of
+///        sparse data points.
+///
+/// The data points are first copied and prepared for the metric. Each row is
+/// then scattered into a dense array of the features, against which the
+/// distance to another row costs one pass over the non-zero elements of that
+/// row. The rows that share a feature with it are found through an inverted
+/// index of the features. The distance to the other rows only depends on
+/// each row on its own, so they are visited in increasing order of it, and
+/// only until the cutoff -ln(ε) / γ is reached. With high-dimensional sparse
+/// data such as bag-of-words, most pairs share no feature and are never
+/// visited.
+///
+/// \tparam Metric The distance metric.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] kernel The kernel.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[out] n_kernel_evals The number of pairs of data points, out of the
+///                            upper triangle, for which the kernel was
+///                            evaluated.
+/// \param[in,out] stats If not null, the bytes held by the data points and
+///                      the inverted index are recorded in it.
+/// \return The triplets of the non-zero elements, in no particular order.
+template <typename Metric>
+std::vector<SparseMatrix::Triplet>
+compute_kernel_triplets(const SparseMatrix &data,
+                        const kernel::MetricGaussian<Metric> &kernel,
+                        const double epsilon, std::uint64_t &n_kernel_evals,
+                        Stats *const stats = nullptr) {
+  const std::size_t n_samples = data.n_rows();
+  const std::size_t n_features = data.n_cols();
+  const Metric &metric = kernel.metric;
+  SparseMatrix points(data);
+  metric.prepare(points);
+  const double *const values = points.data();
+  const std::size_t *const col_ixs = points.col_ixs();
+  const std::size_t *const row_ixs = points.row_ixs();
+
+  // The distance between rows i and j that share no feature is
+  // zero_distance + own[i] + other[j].
+
+  std::vector<double> own(n_samples, 0), other(n_samples, 0);
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+      own[i] += metric.term(values[ir], 0);
+      other[i] += metric.term(0, values[ir]);
+    }
+  }
+
+  std::vector<std::size_t> by_other(n_samples);
+  std::iota(by_other.begin(), by_other.end(), 0);
+  std::sort(by_other.begin(), by_other.end(),
+            [&other](const std::size_t i, const std::size_t j) {
+              return other[i] < other[j];
+            });
+
+  // The inverted index: the rows in which each feature is non-zero, in
+  // ascending order.
+
+  std::vector<std::size_t> feature_ixs(n_features + 1, 0);
+  std::vector<std::size_t> feature_rows(points.n_nz());
+  for (std::size_t ir = 0; ir < points.n_nz(); ++ir) {
+    ++feature_ixs[col_ixs[ir] + 1];
+  }
+  std::partial_sum(feature_ixs.begin(), feature_ixs.end(),
+                   feature_ixs.begin());
+  {
+    std::vector<std::size_t> next(feature_ixs.begin(), feature_ixs.end() - 1);
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        feature_rows[next[col_ixs[ir]]++] = i;
+      }
+    }
+  }
+
+  const double max_distance = max_kernel_distance(kernel, epsilon);
+
+  std::vector<SparseMatrix::Triplet> triplets;
+  std::uint64_t n_evals = 0;
+
+#ifdef PAR
+#pragma omp parallel reduction(+ : n_evals)
+#endif
+  {
+    std::vector<double> dense(n_features, 0);
+    // seen[j] is i once row j has been visited for row i.
+    std::vector<std::size_t> seen(n_samples, n_samples);
+    std::vector<std::size_t> overlapping;
+    std::vector<SparseMatrix::Triplet> row_triplets;
+
+    const auto add = [&](const std::size_t i, const std::size_t j,
+                         const double distance) {
+      ++n_evals;
+      if (!(distance < max_distance)) {
+        return;
+      }
+      const double value = std::exp(-kernel.gamma * distance);
+      if (value > epsilon) {
+        row_triplets.push_back({i, j, value});
+        if (i != j) {
+          row_triplets.push_back({j, i, value});
+        }
+      }
+    };
+
+#ifdef PAR
+#pragma omp for schedule(dynamic)
+#endif
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      row_triplets.clear();
+      overlapping.clear();
+
+      // The row itself and the following rows that share a feature with it.
+
+      seen[i] = i;
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        const std::size_t f = col_ixs[ir];
+        dense[f] = values[ir];
+        const auto first =
+            std::upper_bound(feature_rows.begin() + feature_ixs[f],
+                             feature_rows.begin() + feature_ixs[f + 1], i);
+        for (auto it = first; it != feature_rows.begin() + feature_ixs[f + 1];
+             ++it) {
+          if (seen[*it] != i) {
+            seen[*it] = i;
+            overlapping.push_back(*it);
+          }
+        }
+      }
+
+      add(i, i, 0);
+      for (const std::size_t j : overlapping) {
+        double distance = metric.zero_distance() + own[i];
+        for (std::size_t jr = row_ixs[j]; jr < row_ixs[j + 1]; ++jr) {
+          const double x = dense[col_ixs[jr]];
+          distance += metric.term(x, values[jr]) - metric.term(x, 0);
+        }
+        add(i, j, distance);
+      }
+
+      // The following rows that share no feature with it, up to the cutoff.
+
+      const double base = metric.zero_distance() + own[i];
+      for (std::size_t k = 0;
+           k < n_samples && base + other[by_other[k]] < max_distance; ++k) {
+        const std::size_t j = by_other[k];
+        if (j > i && seen[j] != i) {
+          add(i, j, base + other[j]);
+        }
+      }
+
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        dense[col_ixs[ir]] = 0;
+      }
+
+#ifdef PAR
+#pragma omp critical
+#endif
+      triplets.insert(triplets.end(), row_triplets.begin(),
+                      row_triplets.end());
+    }
+  }
+
+  if (stats) {
+    stats->record_bytes(sparse_kernel_bytes(points));
+  }
+  n_kernel_evals = n_evals;
+  return triplets;
+}
+
+/// \brief Computes the kernel matrix of a Gaussian kernel of sparse data
+///        points, from the triplets of compute_kernel_triplets().
+///
+/// \tparam Metric The distance metric.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] kernel The kernel.
+/// \param[in] epsilon The value below which the output of the kernel would be
+///                    treated as zero.
+/// \param[in,out] stats If not null, the kernel evaluations and the bytes held
+///                      by the triplets and the matrix are recorded in it.
+/// \return The kernel matrix.
+template <typename Metric>
+SparseMatrix compute_kernel_matrix(const SparseMatrix &data,
+                                   const kernel::MetricGaussian<Metric> &kernel,
+                                   const double epsilon,
+                                   Stats *const stats = nullptr) {
+  std::uint64_t n_kernel_evals;
+  std::vector<SparseMatrix::Triplet> triplets =
+      compute_kernel_triplets(data, kernel, epsilon, n_kernel_evals, stats);
+  return assemble_kernel_matrix(data.n_rows(), triplets, n_kernel_evals,
+                                stats);
+}
+
+/// \brief Replaces the values of a kernel matrix with a self-tuning kernel with
+///        a bandwidth per data point, for a given distance. The matrix is
+///        updated in-place.
+///
+/// The bandwidth σᵢ of data point i is the square root of its distance d to
+/// its k-th nearest neighbour among the non-zero elements of its row, or to its
+/// farthest one if the row has fewer, and each non-zero element becomes
+/// exp(-d(xᵢ, xⱼ) / (σᵢ σⱼ)) (Zelnik-Manor and Perona, 2004). Dense regions
+/// thus get narrow kernels and sparse regions wide ones. The sparsity pattern
+/// is kept, so the distances are only computed for the pairs already in the
+/// matrix, in two parallel passes over its rows.
+///
+/// \tparam Distance The type of the distance function.
+/// \param[in,out] kernel_matrix The kernel matrix.
+/// \param[in] n_neighbours The neighbour k whose distance is the bandwidth.
+/// \param[in] distance The distance d(xᵢ, xⱼ), called with i and j.
+/// \return The bandwidths σᵢ.
+/// \exception std::invalid_argument If \p n_neighbours is 0.
+template <typename Distance>
+Vector apply_self_tuning_bandwidths(SparseMatrix &kernel_matrix,
+                                    const unsigned n_neighbours,
+                                    const Distance &distance) {
+  if (n_neighbours == 0) {
+    throw std::invalid_argument("number of neighbours must be positive");
+  }
+
+  const std::size_t n_samples = kernel_matrix.n_rows();
+  const std::size_t *const row_ixs = kernel_matrix.row_ixs();
+  const std::size_t *const col_ixs = kernel_matrix.col_ixs();
+  double *const values = kernel_matrix.data();
+  Vector sigma(n_samples);
+
+  // Pass 1: Replace the values with the distances and find the distance to the
+  // k-th nearest neighbour of each data point.
+
+#ifdef PAR
+#pragma omp parallel
+#endif
+  {
+    std::vector<double> distances;
+
+#ifdef PAR
+#pragma omp for
+#endif
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      distances.clear();
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        const std::size_t j = col_ixs[ir];
+        values[ir] = j == i ? 0 : distance(i, j);
+        if (j != i) {
+          distances.push_back(values[ir]);
+        }
+      }
+
+      if (!distances.empty()) {
+        const auto kth =
+            distances.begin() +
+            (std::min<std::size_t>(n_neighbours, distances.size()) - 1);
+        std::nth_element(distances.begin(), kth, distances.end());
+        sigma[i] = std::sqrt(std::max(*kth, 0.0));
+      }
+    }
+  }
+
+  // Pass 2: Evaluate the kernel. Coincident points, whose bandwidth product is
+  // zero, are fully connected to each other and to nothing else.
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+      const double scale = sigma[i] * sigma[col_ixs[ir]];
+      values[ir] = scale > 0 ? std::exp(-values[ir] / scale)
+                             : (values[ir] <= 0 ? 1 : 0);
+    }
+  }
+
+  return sigma;
+}
+
+/// \brief Replaces the values of a kernel matrix with a self-tuning kernel with
+///        a bandwidth per data point, see the overload for a given distance.
+///
+/// \tparam Metric The distance metric d. With the default squared Euclidean
+///                distance, σᵢ is the Euclidean distance to the k-th nearest
+///                neighbour.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in,out] kernel_matrix The kernel matrix of \p data.
+/// \param[in] n_neighbours The neighbour k whose distance is the bandwidth.
+/// \param[in] metric The distance metric.
+/// \return The bandwidths σᵢ.
+/// \exception std::invalid_argument If \p n_neighbours is 0 or the dimensions
+///                                  are incorrect.
+template <typename Metric = metric::SqEuclidean>
+Vector apply_self_tuning_bandwidths(const Matrix &data,
+                                    SparseMatrix &kernel_matrix,
+                                    const unsigned n_neighbours,
+                                    const Metric &metric = Metric()) {
+  if (kernel_matrix.n_rows() != data.n_rows() ||
+      kernel_matrix.n_cols() != data.n_rows()) {
+    throw std::invalid_argument("incompatible dimensions");
+  }
+
+  const std::size_t n_features = data.n_cols();
+  const Matrix points = prepare_points(data, metric);
+  const double *const x = points.data();
+  return apply_self_tuning_bandwidths(
+      kernel_matrix, n_neighbours,
+      [&metric, x, n_features](const std::size_t i, const std::size_t j) {
+        return metric.distance(x + i * n_features, x + j * n_features,
+                               n_features);
+      });
+}
+
+/// \brief Replaces the values of a kernel matrix of sparse data points with a
+///        self-tuning kernel with a bandwidth per data point, see the overload
+///        for a given distance.
+///
+/// \tparam Metric The distance metric d.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in,out] kernel_matrix The kernel matrix of \p data.
+/// \param[in] n_neighbours The neighbour k whose distance is the bandwidth.
+/// \param[in] metric The distance metric.
+/// \return The bandwidths σᵢ.
+/// \exception std::invalid_argument If \p n_neighbours is 0 or the dimensions
+///                                  are incorrect.
+template <typename Metric = metric::SqEuclidean>
+Vector apply_self_tuning_bandwidths(const SparseMatrix &data,
+                                    SparseMatrix &kernel_matrix,
+                                    const unsigned n_neighbours,
+                                    const Metric &metric = Metric()) {
+  if (kernel_matrix.n_rows() != data.n_rows() ||
+      kernel_matrix.n_cols() != data.n_rows()) {
+    throw std::invalid_argument("incompatible dimensions");
+  }
+
+  SparseMatrix points(data);
+  metric.prepare(points);
+  const double *const values = points.data();
+  const std::size_t *const col_ixs = points.col_ixs();
+  const std::size_t *const row_ixs = points.row_ixs();
+
+  // Merge the non-zero elements of the two rows.
+
+  return apply_self_tuning_bandwidths(
+      kernel_matrix, n_neighbours,
+      [&metric, values, col_ixs, row_ixs](const std::size_t i,
+                                          const std::size_t j) {
+        double distance = metric.zero_distance();
+        std::size_t ir = row_ixs[i], jr = row_ixs[j];
+        while (ir < row_ixs[i + 1] || jr < row_ixs[j + 1]) {
+          if (jr == row_ixs[j + 1] ||
+              (ir < row_ixs[i + 1] && col_ixs[ir] < col_ixs[jr])) {
+            distance += metric.term(values[ir++], 0);
+          } else if (ir == row_ixs[i + 1] || col_ixs[jr] < col_ixs[ir]) {
+            distance += metric.term(0, values[jr++]);
+          } else {
+            distance += metric.term(values[ir++], values[jr++]);
+          }
+        }
+        return distance;
+      });
+}
+
+/// \brief Computes the "symmetrised" diffusion matrix from the kernel matrix.
+///        The matrix is updated in-place.
+///
+/// With \p alpha > 0, the kernel matrix is first α-normalised (Coifman and
+/// Lafon, 2006): each element Kᵢⱼ is divided by (qᵢ qⱼ)^α, where qᵢ is the row
+/// sum of K, a kernel density estimate at data point i. α = 0 gives the
+/// classical normalised graph Laplacian, α = 1/2 the Fokker-Planck diffusion
+/// and α = 1 the Laplace-Beltrami operator, whose embedding does not depend on
+/// the density of the data. This takes one more pass over the matrix.
+///
+/// \param[in,out] kernel_matrix The kernel matrix.
+/// \param[in] alpha The normalisation exponent α in [0, 1].
+/// \return The inverse square root of the row sum of the (α-normalised)
+///         kernel matrix.
+Vector compute_symmetrised_diffusion_matrix(SparseMatrix &kernel_matrix,
+                                            double alpha = 0);
+
+/// \brief Computes the "symmetrised" diffusion matrix from a dense kernel
+///        matrix. The matrix is updated in-place.
+///
+/// The row sums and the scaling are those of the overload for SparseMatrix,
+/// in the same order, so that the non-zero elements are the same.
+///
+/// \param[in,out] kernel_matrix The kernel matrix, row-major and contiguous.
+/// \param[in] alpha The normalisation exponent α in [0, 1].
+/// \return The inverse square root of the row sum of the (α-normalised)
+///         kernel matrix.
+Vector compute_symmetrised_diffusion_matrix(Matrix &kernel_matrix,
+                                            double alpha = 0);
+
+/// \brief Builds the "symmetrised" diffusion matrix directly from the
+///        triplets of the kernel matrix, and records the statistics of the
+///        kernel stage.
+///
+/// This fuses assemble_kernel_matrix() and
+/// compute_symmetrised_diffusion_matrix(). The degrees, and with \p alpha > 0
+/// the kernel density estimates, are summed over the sorted triplets, row by
+/// row in the order of the columns as in a product with a vector of ones, and
+/// the scaling is applied as the values are written into the CSR arrays. The
+/// matrix is thus written once and never read back. With \p alpha = 0, the
+/// result is the same as that of the two passes, and otherwise it may differ
+/// in the last bit where the compiler contracts the products and the sums.
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in,out] triplets The triplets of the non-zero elements of the kernel
+///                         matrix. Sorted.
+/// \param[in] alpha The normalisation exponent α in [0, 1].
+/// \param[out] invsqrt_row_sum The inverse square root of the row sum of the
+///                             (α-normalised) kernel matrix.
+/// \param[in] n_kernel_evals The number of pairs of data points, out of the
+///                           upper triangle, for which the kernel was
+///                           evaluated.
+/// \param[in,out] stats If not null, the kernel evaluations and the bytes held
+///                      by the triplets, the matrix and the row sums are
+///                      recorded in it.
+/// \return The "symmetrised" diffusion matrix.
+SparseMatrix assemble_symmetrised_diffusion_matrix(
+    std::size_t n_samples, std::vector<SparseMatrix::Triplet> &triplets,
+    double alpha, Vector &invsqrt_row_sum, std::uint64_t n_kernel_evals,
+    Stats *stats = nullptr);
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
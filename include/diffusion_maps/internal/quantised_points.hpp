@@ -0,0 +1,356 @@
+#ifndef DIFFUSION_MAPS_INTERNAL_QUANTISED_POINTS_HPP
+#define DIFFUSION_MAPS_INTERNAL_QUANTISED_POINTS_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX512F__) ||                                                    \
+    (defined(__AVX2__) && defined(__F16C__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/metric.hpp"
+
+namespace diffusion_maps {
+
+namespace internal {
+
+/// \brief IEEE 754 half-precision (binary16) number, stored as its bits.
+///
+/// Only zeros and normal numbers are produced by Codec<Half>::encode(), so that
+/// decoding without the F16C instructions is a few integer operations that
+/// vectorise.
+struct Half {
+  /// The bits of the number.
+  std::uint16_t bits;
+};
+
+/// \brief Conversion between the scaled features in [-RANGE, RANGE] and their
+///        codes.
+///
+/// \tparam Code The type of the codes.
+template <typename Code> struct Codec;
+
+/// Conversion to 8-bit integers, rounding to the nearest integer.
+template <> struct Codec<std::int8_t> {
+  /// The largest magnitude of the scaled features.
+  static constexpr double RANGE = 127;
+
+  /// Encodes a scaled feature.
+  static std::int8_t encode(const double v) {
+    return static_cast<std::int8_t>(std::lround(v));
+  }
+
+  /// Decodes a scaled feature.
+  static float decode(const std::int8_t code) { return code; }
+};
+
+/// \brief Conversion to half precision, rounding to the nearest even and
+///        flushing the numbers below the smallest normal number, 2⁻¹⁴, to 0.
+template <> struct Codec<Half> {
+  /// The largest magnitude of the scaled features.
+  static constexpr double RANGE = 1;
+
+  /// Encodes a scaled feature.
+  static Half encode(const double v) {
+    const float f = static_cast<float>(v);
+    std::uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    const std::uint16_t sign = (bits >> 16) & 0x8000u;
+    std::uint32_t rest = bits & 0x7fffffffu;
+    if (rest < (113u << 23)) {
+      return {sign};
+    }
+    // Rebias the exponent from 127 to 15 and round the mantissa from 23 to 10
+    // bits. A carry into the exponent gives the correct result.
+    rest -= 112u << 23;
+    rest += 0xfffu + ((rest >> 13) & 1);
+    return {static_cast<std::uint16_t>(sign | (rest >> 13))};
+  }
+
+  /// Decodes a scaled feature.
+  static float decode(const Half code) {
+    const std::uint32_t sign = std::uint32_t{code.bits & 0x8000u} << 16;
+    const std::uint32_t rest = code.bits & 0x7fffu;
+    const std::uint32_t bits = sign | (rest ? (rest << 13) + (112u << 23) : 0);
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+  }
+};
+
+/// \brief Data points with quantised features, for reading less data in the
+///        loops over pairs of data points that compare their distances with a
+///        cutoff.
+///
+/// Each feature f is centred on the middle oᶠ of its range and divided by a
+/// scale sᶠ to fit in [-RANGE, RANGE] of the codec, so that xᶠ ≈ oᶠ + sᶠ cᶠ
+/// where cᶠ is the decoded code. The features are not centred for the
+/// metric::Form::UNIT_DOT form, whose distance is not invariant to
+/// translations. The distance between two quantised points is evaluated in
+/// single precision from the codes, with the offsets cancelling out, using
+/// AVX-512 or AVX2 and F16C conversions of the codes when the library is
+/// compiled for them.
+///
+/// The norm of the quantisation error of each point, in the norm of the form,
+/// is kept so that the distance between the original points can be bounded,
+/// see compare().
+///
+/// \tparam Code The type of the codes, std::int8_t or Half.
+/// \tparam FORM The form of the distance between the points.
+template <typename Code, metric::Form FORM> class QuantisedPoints {
+protected:
+  /// The number of points.
+  std::size_t _n_rows;
+  /// The number of features.
+  std::size_t _n_cols;
+  /// The number of features rounded up to a multiple of 16.
+  std::size_t _stride;
+  /// The codes of the features, row by row, each row padded with zeros.
+  std::vector<Code> _codes;
+  /// \brief The weight of each feature in the distance: sᶠ for the L1 form,
+  ///        and (sᶠ)² for the others, and 0 for the padding.
+  std::vector<float> _weights;
+  /// The norm of the quantisation error of each point.
+  std::vector<double> _errors;
+  /// The cutoff of the distance.
+  double _cutoff;
+  /// The square root of the cutoff.
+  double _root_cutoff;
+  /// \brief The bound on the relative rounding error of the distance between
+  ///        quantised points, (n + 3) u for n features and the unit roundoff
+  ///        u of single precision.
+  double _rounding;
+  /// The bound on the rounding errors of the comparisons themselves.
+  double _slack;
+
+#if defined(__AVX512F__)
+  // The zero-masked conversions are the same as the unmasked ones, but do not
+  // trip GCC's uninitialised-variable warning.
+
+  /// Loads and decodes 16 half-precision codes.
+  static __m512 load(const Half *const codes) {
+    return _mm512_maskz_cvtph_ps(
+        0xffff, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(codes)));
+  }
+
+  /// Loads and decodes 16 8-bit codes.
+  static __m512 load(const std::int8_t *const codes) {
+    return _mm512_maskz_cvtepi32_ps(
+        0xffff,
+        _mm512_maskz_cvtepi8_epi32(
+            0xffff, _mm_loadu_si128(reinterpret_cast<const __m128i *>(codes))));
+  }
+#elif defined(__AVX2__) && defined(__F16C__) && defined(__FMA__)
+  /// Loads and decodes 8 half-precision codes.
+  static __m256 load(const Half *const codes) {
+    return _mm256_cvtph_ps(
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(codes)));
+  }
+
+  /// Loads and decodes 8 8-bit codes.
+  static __m256 load(const std::int8_t *const codes) {
+    return _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(
+        _mm_loadl_epi64(reinterpret_cast<const __m128i *>(codes))));
+  }
+#endif
+
+#if defined(__AVX512F__) ||                                                    \
+    (defined(__AVX2__) && defined(__F16C__) && defined(__FMA__))
+  /// The sum of the 8 lanes.
+  static float reduce(const __m256 v) {
+    __m128 s =
+        _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_hadd_ps(s, s);
+    s = _mm_hadd_ps(s, s);
+    return _mm_cvtss_f32(s);
+  }
+#endif
+
+public:
+  /// \brief Quantises points.
+  ///
+  /// \param[in] points The points, prepared for the metric, in a contiguous
+  ///                   row-major matrix.
+  /// \param[in] cutoff The cutoff of the distance. May be infinite.
+  QuantisedPoints(const Matrix &points, const double cutoff)
+      : _n_rows(points.n_rows()), _n_cols(points.n_cols()),
+        _stride((_n_cols + 15) / 16 * 16), _codes(_n_rows * _stride),
+        _weights(_stride), _errors(_n_rows),
+        _cutoff(cutoff), _root_cutoff(std::sqrt(cutoff)),
+        _rounding((_n_cols + 3) * (std::numeric_limits<float>::epsilon() / 2)),
+        _slack(std::isfinite(cutoff) ? 1e-12 * (1 + cutoff) : 0) {
+    const double *const x = points.data();
+
+    std::vector<double> offsets(_n_cols, 0), scales(_n_cols, 1);
+    for (std::size_t f = 0; f < _n_cols; ++f) {
+      double min = 0, max = 0;
+      for (std::size_t i = 0; i < _n_rows; ++i) {
+        const double value = x[i * _n_cols + f];
+        min = i == 0 ? value : std::min(min, value);
+        max = i == 0 ? value : std::max(max, value);
+      }
+      if (FORM == metric::Form::UNIT_DOT) {
+        max = std::max(std::abs(min), std::abs(max));
+      } else {
+        offsets[f] = (min + max) / 2;
+        max -= offsets[f];
+      }
+      if (max > 0) {
+        scales[f] = max / Codec<Code>::RANGE;
+      }
+      _weights[f] = static_cast<float>(
+          FORM == metric::Form::L1 ? scales[f] : scales[f] * scales[f]);
+    }
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < _n_rows; ++i) {
+      double error = 0;
+      for (std::size_t f = 0; f < _n_cols; ++f) {
+        const double value = x[i * _n_cols + f];
+        const double scaled = std::clamp((value - offsets[f]) / scales[f],
+                                         -Codec<Code>::RANGE,
+                                         Codec<Code>::RANGE);
+        const Code code = Codec<Code>::encode(scaled);
+        _codes[i * _stride + f] = code;
+        const double diff =
+            value - (offsets[f] + scales[f] * Codec<Code>::decode(code));
+        error += FORM == metric::Form::L1 ? std::abs(diff) : diff * diff;
+      }
+      _errors[i] = FORM == metric::Form::L1 ? error : std::sqrt(error);
+    }
+  }
+
+  /// The number of bytes held by the codes.
+  std::size_t n_bytes() const { return _codes.size() * sizeof(Code); }
+
+  /// The distance between the i-th and j-th quantised points.
+  double distance(const std::size_t i, const std::size_t j) const {
+    const Code *const x = _codes.data() + i * _stride;
+    const Code *const y = _codes.data() + j * _stride;
+    const float *const w = _weights.data();
+    float sum = 0;
+
+    // The padding of the rows has zero codes and weights, so that whole blocks
+    // of features are processed without a remainder loop.
+
+#if defined(__AVX512F__)
+    __m512 acc = _mm512_setzero_ps();
+    for (std::size_t f = 0; f < _stride; f += 16) {
+      const __m512 cx = load(x + f), cy = load(y + f);
+      const __m512 ws = _mm512_loadu_ps(w + f);
+      if constexpr (FORM == metric::Form::SQ_EUCLIDEAN) {
+        const __m512 d = _mm512_sub_ps(cx, cy);
+        acc = _mm512_fmadd_ps(_mm512_mul_ps(ws, d), d, acc);
+      } else if constexpr (FORM == metric::Form::L1) {
+        acc = _mm512_fmadd_ps(ws, _mm512_abs_ps(_mm512_sub_ps(cx, cy)), acc);
+      } else {
+        acc = _mm512_fmadd_ps(_mm512_mul_ps(ws, cx), cy, acc);
+      }
+    }
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, acc);
+    sum = reduce(_mm256_add_ps(_mm256_load_ps(lanes),
+                               _mm256_load_ps(lanes + 8)));
+#elif defined(__AVX2__) && defined(__F16C__) && defined(__FMA__)
+    __m256 acc = _mm256_setzero_ps();
+    for (std::size_t f = 0; f < _stride; f += 8) {
+      const __m256 cx = load(x + f), cy = load(y + f);
+      const __m256 ws = _mm256_loadu_ps(w + f);
+      if constexpr (FORM == metric::Form::SQ_EUCLIDEAN) {
+        const __m256 d = _mm256_sub_ps(cx, cy);
+        acc = _mm256_fmadd_ps(_mm256_mul_ps(ws, d), d, acc);
+      } else if constexpr (FORM == metric::Form::L1) {
+        const __m256 d =
+            _mm256_andnot_ps(_mm256_set1_ps(-0.0f), _mm256_sub_ps(cx, cy));
+        acc = _mm256_fmadd_ps(ws, d, acc);
+      } else {
+        acc = _mm256_fmadd_ps(_mm256_mul_ps(ws, cx), cy, acc);
+      }
+    }
+    sum = reduce(acc);
+#else
+    // The differences of the 8-bit codes are exact in integers.
+#ifdef PAR
+#pragma omp simd reduction(+ : sum)
+#endif
+    for (std::size_t f = 0; f < _stride; ++f) {
+      if constexpr (FORM == metric::Form::UNIT_DOT) {
+        sum += w[f] * Codec<Code>::decode(x[f]) * Codec<Code>::decode(y[f]);
+      } else {
+        float d;
+        if constexpr (std::is_same_v<Code, std::int8_t>) {
+          d = static_cast<float>(x[f] - y[f]);
+        } else {
+          d = Codec<Code>::decode(x[f]) - Codec<Code>::decode(y[f]);
+        }
+        sum += FORM == metric::Form::L1 ? w[f] * std::abs(d) : w[f] * d * d;
+      }
+    }
+#endif
+
+    return FORM == metric::Form::UNIT_DOT ? 1 - double{sum} : double{sum};
+  }
+
+  /// \brief Tells on which side of the cutoff the distance between the i-th
+  ///        and j-th original points is.
+  ///
+  /// The distance d between the quantised points is first widened by the
+  /// rounding errors of its evaluation, at most #_rounding times the sum of
+  /// the magnitudes of its terms. With the quantisation errors eᵢ and eⱼ of
+  /// the points, the original distance is then within (√d ∓ (eᵢ + eⱼ))² for
+  /// the SQ_EUCLIDEAN form, d ∓ (eᵢ + eⱼ) for the L1 form, and
+  /// d ∓ (eⱼ + eᵢ (1 + eⱼ)) for the UNIT_DOT form, whose original points are
+  /// at most of unit length.
+  ///
+  /// \param[in] distance The distance between the quantised points.
+  /// \param[in] i The index of the first point.
+  /// \param[in] j The index of the second point.
+  /// \return -1 if the original distance is below the cutoff, 1 if it is at or
+  ///         beyond it, and 0 if it may be on either side.
+  int compare(const double distance, const std::size_t i,
+              const std::size_t j) const {
+    const double e_i = _errors[i], e_j = _errors[j];
+    const double magnitude = FORM == metric::Form::UNIT_DOT
+                                 ? (1 + e_i) * (1 + e_j)
+                                 : std::abs(distance);
+    const double rounding = _rounding * magnitude + _slack;
+
+    if constexpr (FORM == metric::Form::SQ_EUCLIDEAN) {
+      // Compare the roots without evaluating them.
+      const double e = e_i + e_j;
+      if (distance - rounding >= (_root_cutoff + e) * (_root_cutoff + e)) {
+        return 1;
+      }
+      if (e < _root_cutoff &&
+          distance + rounding < (_root_cutoff - e) * (_root_cutoff - e)) {
+        return -1;
+      }
+    } else {
+      const double e =
+          FORM == metric::Form::L1 ? e_i + e_j : e_j + e_i * (1 + e_j);
+      if (distance - rounding - e >= _cutoff) {
+        return 1;
+      }
+      if (distance + rounding + e < _cutoff) {
+        return -1;
+      }
+    }
+    return 0;
+  }
+};
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
@@ -0,0 +1,81 @@
+/// \file
+///
+/// \brief Parallel sums that do not depend on the number of threads.
+
+#ifndef DIFFUSION_MAPS_INTERNAL_REDUCTION_HPP
+#define DIFFUSION_MAPS_INTERNAL_REDUCTION_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+namespace diffusion_maps {
+
+namespace internal {
+
+/// The number of terms in each block of deterministic_sum().
+constexpr std::size_t SUM_BLOCK_SIZE = 4096;
+
+/// \brief The number of blocks from which deterministic_sum() runs in
+///        parallel.
+constexpr std::size_t MIN_PARALLEL_SUM_BLOCKS = 4;
+
+/// \brief Sums terms in parallel, with a result that does not depend on the
+///        number of threads or on the scheduling.
+///
+/// An OpenMP reduction adds the terms in an order that depends on how the
+/// iterations are split between the threads, so its result changes in the
+/// last bits with the number of threads. Here, the terms are split into fixed
+/// blocks of SUM_BLOCK_SIZE, each summed in order by a single thread, and the
+/// block sums are then added pairwise along a fixed tree, which also keeps
+/// the rounding error at O(log(n / SUM_BLOCK_SIZE)) blocks.
+///
+/// \p term is called exactly once for each index, so it may also update the
+/// element it reads, e.g. to normalise a vector while measuring it.
+///
+/// \tparam Term The type of the function that gives each term.
+/// \param[in] n The number of terms.
+/// \param[in] term The function that gives the i-th term.
+/// \return The sum of the terms.
+template <typename Term>
+double deterministic_sum(const std::size_t n, const Term &term) {
+  const auto block_sum = [&term](const std::size_t start,
+                                 const std::size_t stop) {
+    double sum = 0;
+#ifdef PAR
+#pragma omp simd reduction(+ : sum)
+#endif
+    for (std::size_t i = start; i < stop; ++i) {
+      sum += term(i);
+    }
+    return sum;
+  };
+
+  const std::size_t n_blocks = (n + SUM_BLOCK_SIZE - 1) / SUM_BLOCK_SIZE;
+  if (n_blocks <= 1) {
+    return block_sum(0, n);
+  }
+
+  std::vector<double> sums(n_blocks);
+  [[maybe_unused]] const bool parallel = n_blocks >= MIN_PARALLEL_SUM_BLOCKS;
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+  for (std::size_t b = 0; b < n_blocks; ++b) {
+    const std::size_t start = b * SUM_BLOCK_SIZE;
+    sums[b] = block_sum(start, std::min(start + SUM_BLOCK_SIZE, n));
+  }
+
+  for (std::size_t width = 1; width < n_blocks; width *= 2) {
+    for (std::size_t b = 0; b + width < n_blocks; b += 2 * width) {
+      sums[b] += sums[b + width];
+    }
+  }
+  return sums[0];
+}
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef DIFFUSION_MAPS_INTERNAL_REORDERING_HPP
+#define DIFFUSION_MAPS_INTERNAL_REORDERING_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+namespace internal {
+
+/// \brief Computes the reverse Cuthill-McKee ordering of a symmetric sparse
+///        matrix.
+///
+/// Each connected component is traversed breadth-first from a vertex of
+/// minimum degree, visiting the neighbours of each vertex in ascending order of
+/// degree, and the resulting order is reversed. Neighbouring vertices end up
+/// close to each other, so the permuted matrix has a small bandwidth and the
+/// vector elements that a sparse matrix-vector product reads for a row are
+/// close to those it reads for the previous row.
+///
+/// \param[in] a The matrix. Only its sparsity pattern is used.
+/// \return The permutation, where element i is the original index of the i-th
+///         vertex in the new order.
+/// \exception std::invalid_argument If \p a is not square.
+std::vector<std::size_t> reverse_cuthill_mckee(const SparseMatrix &a);
+
+/// \brief Computes the Morton (Z-order) ordering of a set of points.
+///
+/// Each coordinate is scaled to the bounding box of the points and quantised
+/// to min(21, 63 / d) bits, where d is the number of coordinates used (at most
+/// 63), and the points are sorted by the interleaved bits. Points that are
+/// close in space tend to be close in the order.
+///
+/// \param[in] data The data matrix where each row is a data point.
+/// \return The permutation, where element i is the original index of the i-th
+///         point in the new order.
+std::vector<std::size_t> morton_order(const Matrix &data);
+
+/// \brief Permutes the rows and columns of a square sparse matrix.
+///
+/// \param[in] a The matrix.
+/// \param[in] perm The permutation, where element i is the original index of
+///                 the i-th row and column in the new order.
+/// \return The permuted matrix P A Pᵀ.
+/// \exception std::invalid_argument If \p a is not square or the size of
+///                                  \p perm is incorrect.
+SparseMatrix permute(const SparseMatrix &a,
+                     const std::vector<std::size_t> &perm);
+
+/// \brief Permutes a vector.
+///
+/// \param[in] v The vector.
+/// \param[in] perm The permutation, where element i is the original index of
+///                 the i-th element in the new order.
+/// \return The permuted vector, whose i-th element is v[perm[i]].
+Vector permute(const Vector &v, const std::vector<std::size_t> &perm);
+
+/// \brief Reverts the permutation of a vector.
+///
+/// \param[in] v The permuted vector.
+/// \param[in] perm The permutation, where element i is the original index of
+///                 the i-th element in the new order.
+/// \return The vector in the original order, whose perm[i]-th element is v[i].
+Vector unpermute(const Vector &v, const std::vector<std::size_t> &perm);
+
+/// \brief Reverts the permutation of the rows of a matrix, e.g. of a block of
+///        eigenvectors.
+///
+/// \param[in] m The matrix with permuted rows.
+/// \param[in] perm The permutation, where element i is the original index of
+///                 the i-th row in the new order.
+/// \return The column-major matrix in the original order, whose perm[i]-th
+///         row is the i-th row of \p m.
+Matrix unpermute(const Matrix &m, const std::vector<std::size_t> &perm);
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
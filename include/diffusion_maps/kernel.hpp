@@ -5,42 +5,74 @@
 #ifndef DIFFUSION_MAPS_KERNEL_HPP
 #define DIFFUSION_MAPS_KERNEL_HPP
 
+#include <cmath>
+
+#include "diffusion_maps/metric.hpp"
 #include "diffusion_maps/vector.hpp"
 
 namespace diffusion_maps {
 
+/// Precisions in which the data points are read to evaluate the kernel.
+enum class Precision {
+  /// The data points as given.
+  DOUBLE,
+  /// \brief IEEE 754 half precision, after centring and scaling each feature.
+  ///        4 times less data to read, with a relative error of about 10⁻³
+  ///        per feature.
+  FLOAT16,
+  /// \brief 8-bit integers over the range of each feature. 8 times less data
+  ///        to read, with an error of up to 1/254 of the range per feature.
+  INT8,
+};
+
 /// Diffusion kernels.
 namespace kernel {
 
-/// Gaussian kernel.
-class Gaussian {
+/// \brief Gaussian kernel exp(-γ d(x, y)) over a distance metric.
+///
+/// With the default metric::SqEuclidean, this is the usual Gaussian kernel
+/// exp(-γ ‖x - y‖²), see #Gaussian. The kernel matrix of the built-in metrics
+/// is computed by a loop in which the metric is inlined, see
+/// internal::compute_kernel_matrix().
+///
+/// \tparam Metric The distance metric, see the \ref metric namespace.
+template <typename Metric = metric::SqEuclidean> class MetricGaussian {
 public:
   /// Kernel parameter γ = 1 / 2σ².
   double gamma;
+  /// The distance metric.
+  Metric metric;
 
   /// \brief Constructs a Gaussian kernel with the given parameter γ.
   ///
   /// \param[in] gamma Kernel parameter γ = 1 / 2σ².
-  Gaussian(const double gamma) : gamma(gamma) {}
+  /// \param[in] metric The distance metric.
+  MetricGaussian(const double gamma, const Metric &metric = Metric())
+      : gamma(gamma), metric(metric) {}
 
   /// \brief Constructs a Gaussian kernel with the given parameter γ.
   ///
   /// \param[in] gamma Kernel parameter γ = 1 / 2σ².
-  static Gaussian with_gamma(const double gamma) { return Gaussian(gamma); }
+  static MetricGaussian with_gamma(const double gamma) {
+    return MetricGaussian(gamma);
+  }
 
   /// \brief Constructs a Gaussian kernel with the given σ.
   ///
   /// \param[in] sigma Kernel parameter σ.
-  static Gaussian with_sigma(const double sigma) {
-    return Gaussian(1.0 / (2.0 * sigma * sigma));
+  static MetricGaussian with_sigma(const double sigma) {
+    return MetricGaussian(1.0 / (2.0 * sigma * sigma));
   }
 
   /// Evaluates the kernel function.
   double operator()(const Vector &x, const Vector &y) const {
-    return std::exp(-gamma * (x - y).sq_l2_norm());
+    return std::exp(-gamma * metric(x, y));
   }
 };
 
+/// Gaussian kernel exp(-γ ‖x - y‖²).
+using Gaussian = MetricGaussian<metric::SqEuclidean>;
+
 } // namespace kernel
 
 } // namespace diffusion_maps
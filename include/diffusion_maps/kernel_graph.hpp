@@ -0,0 +1,234 @@
+/// \file
+///
+/// \brief Kernel graph supporting streaming insertions and deletions.
+
+#ifndef DIFFUSION_MAPS_KERNEL_GRAPH_HPP
+#define DIFFUSION_MAPS_KERNEL_GRAPH_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// \brief Mutable kernel graph of a set of data points under the Gaussian
+///        kernel.
+///
+/// The graph holds the same non-zero elements as the kernel matrix that
+/// diffusion_maps() builds from the same points, but points can be inserted and
+/// removed one at a time. Each point is identified by an ID that stays fixed
+/// for as long as the point is in the graph. IDs of removed points are reused.
+///
+/// Points are bucketed in a uniform grid whose cell width is the distance
+/// beyond which the kernel falls below the kernel epsilon, so an update only
+/// evaluates the kernel against the points in the neighbouring cells and only
+/// touches the rows, row sums and inverse square roots of row sums of the
+/// point's neighbours. The grid uses at most the first three coordinates, so
+/// it prunes well for low-dimensional data only.
+class KernelGraph {
+protected:
+  /// The maximum number of coordinates used to bucket the points.
+  static constexpr std::size_t MAX_GRID_DIMS = 3;
+
+  /// The coordinates of a grid cell.
+  using Cell = std::array<std::int64_t, MAX_GRID_DIMS>;
+
+  /// Hash function of grid cells.
+  class CellHash {
+  public:
+    /// Hashes a grid cell.
+    std::size_t operator()(const Cell &cell) const {
+      std::size_t hash = 0;
+      for (const std::int64_t c : cell) {
+        hash = hash * 1000003 ^ std::hash<std::int64_t>()(c);
+      }
+      return hash;
+    }
+  };
+
+  /// A point and its row of the kernel matrix.
+  class Node {
+  public:
+    /// Whether the node holds a point.
+    bool live = false;
+    /// The point.
+    Vector point;
+    /// The grid cell of the point.
+    Cell cell;
+    /// \brief The non-zero elements of the row as (ID, value) pairs, sorted by
+    ///        ID. Includes the diagonal element.
+    std::vector<std::pair<std::size_t, double>> neighbours;
+    /// The row sum.
+    double row_sum = 0;
+    /// The inverse square root of the row sum.
+    double invsqrt_row_sum = 0;
+  };
+
+  /// The number of features of each point.
+  std::size_t _n_features;
+  /// The kernel function.
+  kernel::Gaussian _kernel;
+  /// The value below which the output of the kernel is treated as zero.
+  double _kernel_epsilon;
+  /// The distance beyond which the kernel is treated as zero.
+  double _radius;
+  /// The nodes, indexed by ID.
+  std::vector<Node> _nodes;
+  /// The IDs of the removed points, available for reuse.
+  std::vector<std::size_t> _free_ids;
+  /// The number of points in the graph.
+  std::size_t _size;
+  /// The IDs of the points in each non-empty grid cell.
+  std::unordered_map<Cell, std::vector<std::size_t>, CellHash> _grid;
+
+  /// Computes the grid cell of a point.
+  Cell cell_of(const Vector &point) const;
+
+  /// \brief Exports a snapshot of the kernel matrix.
+  ///
+  /// \param[in] row_ids The IDs of the points in ascending order.
+  /// \param[in] scale If not null, element (i, j) is multiplied by
+  ///                  scale[i] * scale[j].
+  SparseMatrix export_matrix(const std::vector<std::size_t> &row_ids,
+                             const Vector *scale) const;
+
+public:
+  /// \brief Constructs an empty kernel graph.
+  ///
+  /// \param[in] n_features The number of features of each point.
+  /// \param[in] kernel The kernel function.
+  /// \param[in] kernel_epsilon The value below which the output of the kernel
+  ///                           would be treated as zero.
+  /// \exception std::invalid_argument If \p kernel_epsilon is not in (0, 1) or
+  ///                                  the kernel parameter is not positive.
+  KernelGraph(std::size_t n_features, const kernel::Gaussian &kernel,
+              double kernel_epsilon = DEFAULT_KERNEL_EPSILON);
+
+  /// The number of features of each point.
+  std::size_t n_features() const { return _n_features; }
+
+  /// The number of points in the graph.
+  std::size_t size() const { return _size; }
+
+  /// \brief Whether the graph contains a point with ID \p id.
+  bool contains(const std::size_t id) const {
+    return id < _nodes.size() && _nodes[id].live;
+  }
+
+  /// \brief Inserts a point. Costs O(number of points in the neighbouring grid
+  ///        cells).
+  ///
+  /// \param[in] point The point.
+  /// \return The ID of the point.
+  /// \exception std::invalid_argument If the number of features of \p point is
+  ///                                  incorrect.
+  std::size_t insert(const Vector &point);
+
+  /// \brief Removes a point. Costs O(Σ degree of its neighbours).
+  ///
+  /// \param[in] id The ID of the point.
+  /// \exception std::out_of_range If there is no point with ID \p id.
+  void remove(std::size_t id);
+
+  /// \brief The point with ID \p id.
+  ///
+  /// \exception std::out_of_range If there is no point with ID \p id.
+  const Vector &point(std::size_t id) const;
+
+  /// \brief The number of non-zero elements in the row of the point with ID
+  ///        \p id, including the diagonal element.
+  ///
+  /// \exception std::out_of_range If there is no point with ID \p id.
+  std::size_t degree(std::size_t id) const;
+
+  /// \brief The row sum of the kernel matrix for the point with ID \p id.
+  ///
+  /// \exception std::out_of_range If there is no point with ID \p id.
+  double row_sum(std::size_t id) const;
+
+  /// \brief The inverse square root of the row sum of the kernel matrix for the
+  ///        point with ID \p id.
+  ///
+  /// \exception std::out_of_range If there is no point with ID \p id.
+  double invsqrt_row_sum(std::size_t id) const;
+
+  /// \brief The IDs of the points in ascending order. The i-th row of the
+  ///        snapshots corresponds to the i-th ID.
+  std::vector<std::size_t> ids() const;
+
+  /// Exports a snapshot of the kernel matrix.
+  SparseMatrix kernel_matrix() const;
+
+  /// \brief Exports a snapshot of the "symmetrised" diffusion matrix.
+  ///
+  /// \return The "symmetrised" diffusion matrix and the inverse square root of
+  ///         the row sum of the kernel matrix.
+  std::pair<SparseMatrix, Vector> symmetrised_diffusion_matrix() const;
+};
+
+/// \brief Computes the eigendecomposition of the diffusion matrix on the
+///        current snapshot of a kernel graph.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] graph The kernel graph.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options. The kernel epsilon is ignored in favour of
+///                    that of \p graph.
+/// \return The eigendecomposition. The i-th element of each eigenvector
+///         corresponds to the i-th ID returned by KernelGraph::ids().
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+/// \exception std::invalid_argument If the warm-start eigenvectors do not have
+///                                  one element per data point.
+template <typename R>
+Decomposition decompose(const KernelGraph &graph, std::size_t n_components,
+                        R &rng, const Options &options = Options()) {
+  std::normal_distribution dist;
+  auto [diffusion_matrix, invsqrt_row_sum] =
+      graph.symmetrised_diffusion_matrix();
+  return internal::decompose(diffusion_matrix, std::move(invsqrt_row_sum),
+                             n_components, options,
+                             [&rng, &dist]() { return dist(rng); });
+}
+
+/// \brief Diffusion maps on the current snapshot of a kernel graph.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] graph The kernel graph.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] diffusion_time The diffusion time.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options. The kernel epsilon is ignored in favour of
+///                    that of \p graph.
+/// \return The lower-dimensional embedding of the data in the diffusion space.
+///         The i-th row corresponds to the i-th ID returned by
+///         KernelGraph::ids().
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+/// \exception std::invalid_argument If \p diffusion_time is negative.
+/// \exception std::invalid_argument If the warm-start eigenvectors do not have
+///                                  one element per data point.
+template <typename R>
+Matrix diffusion_maps(const KernelGraph &graph, std::size_t n_components,
+                      double diffusion_time, R &rng,
+                      const Options &options = Options()) {
+  if (diffusion_time < 0)
+    throw std::invalid_argument("diffusion time must be non-negative");
+  return decompose(graph, n_components, rng, options).embed(diffusion_time);
+}
+
+} // namespace diffusion_maps
+
+#endif
@@ -0,0 +1,62 @@
+/// \file
+///
+/// \brief Linear operator.
+
+#ifndef DIFFUSION_MAPS_LINEAR_OPERATOR_HPP
+#define DIFFUSION_MAPS_LINEAR_OPERATOR_HPP
+
+#include <cstddef>
+
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// \brief A matrix that can only be multiplied with vectors and dense matrices.
+///
+/// This is the interface through which the eigendecomposition solvers access
+/// the diffusion matrix, so that they work with any of its storage formats.
+class LinearOperator {
+public:
+  /// Destructor.
+  virtual ~LinearOperator() = default;
+
+  /// The number of rows.
+  virtual std::size_t n_rows() const = 0;
+
+  /// The number of columns.
+  virtual std::size_t n_cols() const = 0;
+
+  /// The number of non-zero elements.
+  virtual std::size_t n_nz() const = 0;
+
+  /// The number of bytes held by the arrays of the operator.
+  virtual std::size_t n_bytes() const = 0;
+
+  /// \brief Matrix-vector multiplication.
+  ///
+  /// \param[in] v The vector to multiply.
+  /// \return The result of the multiplication.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  virtual Vector operator*(const Vector &v) const = 0;
+
+  /// \brief Matrix-vector multiplication into an existing vector, so that
+  ///        iterative solvers do not allocate a vector per product.
+  ///
+  /// \param[in] v The vector to multiply.
+  /// \param[out] result The result of the multiplication, of n_rows()
+  ///                    elements. It must not be \p v.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  virtual void multiply(const Vector &v, Vector &result) const = 0;
+
+  /// \brief Matrix-matrix multiplication with a dense matrix.
+  ///
+  /// \param[in] m The dense matrix to multiply.
+  /// \return The result of the multiplication as a row-major matrix.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  virtual Matrix operator*(const Matrix &m) const = 0;
+};
+
+} // namespace diffusion_maps
+
+#endif
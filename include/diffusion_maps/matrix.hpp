@@ -7,13 +7,23 @@
 
 #include <cstddef>
 #include <memory>
+#include <stdexcept>
 #include <variant>
 
+#include "diffusion_maps/allocation.hpp"
 #include "diffusion_maps/internal/utils.hpp"
 #include "diffusion_maps/vector.hpp"
 
 namespace diffusion_maps {
 
+/// The order in which the elements of an owning matrix are stored.
+enum class Layout {
+  /// Row by row.
+  ROW_MAJOR,
+  /// Column by column, e.g. for a block of vectors.
+  COLUMN_MAJOR,
+};
+
 /// Matrix of doubles that may or may not own its data.
 class Matrix {
 protected:
@@ -29,14 +39,23 @@ protected:
   std::size_t _col_stride;
 
 public:
-  /// \brief Constructs an owning matrix of the given dimensions with
-  ///        uninitialized elements.
+  /// Constructs an empty 0×0 matrix.
+  Matrix() : Matrix(0, 0) {}
+
+  /// \brief Constructs an owning matrix of the given dimensions with each
+  ///        element set to 0, see AllocationPolicy.
   ///
   /// \param[in] n_rows The number of rows.
   /// \param[in] n_cols The number of columns.
-  Matrix(const std::size_t n_rows, const std::size_t n_cols)
-      : _data(std::make_unique<double[]>(n_rows * n_cols)), _n_rows(n_rows),
-        _n_cols(n_cols), _row_stride(n_cols), _col_stride(1) {}
+  /// \param[in] layout The order in which the elements are stored.
+  Matrix(const std::size_t n_rows, const std::size_t n_cols,
+         const Layout layout = Layout::ROW_MAJOR)
+      : _data(internal::allocate_array<double>(n_rows * n_cols)),
+        _n_rows(n_rows), _n_cols(n_cols),
+        _row_stride(layout == Layout::ROW_MAJOR ? n_cols : 1),
+        _col_stride(layout == Layout::ROW_MAJOR ? 1 : n_rows) {
+    internal::fill_array(data(), n_rows * n_cols, 0.0);
+  }
 
   /// \brief Constructs a non-owning matrix.
   ///
@@ -88,6 +107,19 @@ public:
   /// The stride in the column dimension.
   std::size_t col_stride() const { return _col_stride; }
 
+  /// \brief Drops the columns from index \p n_cols onwards, keeping the
+  ///        storage of the others.
+  ///
+  /// \param[in] n_cols The number of columns to keep.
+  /// \exception std::invalid_argument If \p n_cols is greater than the number
+  ///                                  of columns.
+  void truncate_cols(const std::size_t n_cols) {
+    if (n_cols > _n_cols) {
+      throw std::invalid_argument("cannot add columns");
+    }
+    _n_cols = n_cols;
+  }
+
   /// \brief Returns the ( \p i , \p j )-th element without bounds checking.
   ///
   /// \param[in] i The row index.
@@ -117,6 +149,18 @@ public:
     }
     return result;
   }
+
+  /// \brief Returns the \p j -th column without bounds checking.
+  ///
+  /// \param[in] j The column index.
+  /// \return The \p j -th column.
+  Vector col(const std::size_t j) const {
+    Vector result(_n_rows);
+    for (std::size_t i = 0; i < _n_rows; ++i) {
+      result[i] = (*this)(i, j);
+    }
+    return result;
+  }
 };
 
 } // namespace diffusion_maps
@@ -0,0 +1,308 @@
+/// \file
+///
+/// \brief Distance metrics for the kernels.
+
+#ifndef DIFFUSION_MAPS_METRIC_HPP
+#define DIFFUSION_MAPS_METRIC_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// \brief Distance metrics for the kernels.
+///
+/// A metric returns a dissimilarity d(x, y) ≥ 0 that the kernel turns into a
+/// similarity, e.g. exp(-γ d(x, y)) for kernel::MetricGaussian. Each metric
+/// provides:
+///
+/// - `void prepare(Matrix &points) const`, which transforms a contiguous
+///   row-major copy of the data points in-place, once per data set, so that
+/// - `double distance(const double *x, const double *y, std::size_t n) const`,
+///   the dissimilarity of two prepared points of \p n features, is a single
+///   vectorised pass without allocations, and
+/// - `double operator()(const Vector &x, const Vector &y) const`, the
+///   dissimilarity of two points as given.
+///
+/// For sparse data points, each metric also provides `void
+/// prepare(SparseMatrix &points) const`, and writes the distance between two
+/// prepared points as `zero_distance() + ∑ term(xᶠ, yᶠ)` over the features,
+/// with `term(0, 0) = 0`, so that only the non-zero features of either point
+/// contribute, see internal::compute_kernel_matrix().
+///
+/// Each metric also gives the Form of its distance between prepared points as
+/// `static constexpr Form FORM`, so that the distance can be evaluated on
+/// quantised points, see internal::QuantisedPoints.
+///
+/// The metric is a template parameter of the kernel, so that the distance is
+/// inlined into the loops that compute the kernel matrix.
+namespace metric {
+
+/// The forms of the distance between two prepared points x and y.
+enum class Form {
+  /// ‖x - y‖².
+  SQ_EUCLIDEAN,
+  /// ∑ |xᶠ - yᶠ|.
+  L1,
+  /// 1 - x·y, where x and y are of unit or zero length.
+  UNIT_DOT,
+};
+
+/// \brief Squared Euclidean distance ‖x - y‖².
+class SqEuclidean {
+public:
+  /// The form of the distance between prepared points.
+  static constexpr Form FORM = Form::SQ_EUCLIDEAN;
+
+  /// Does nothing.
+  void prepare(Matrix &) const {}
+
+  /// The distance between two prepared points.
+  double distance(const double *const x, const double *const y,
+                  const std::size_t n) const {
+    double sum = 0;
+#ifdef PAR
+#pragma omp simd reduction(+ : sum)
+#endif
+    for (std::size_t f = 0; f < n; ++f) {
+      const double d = x[f] - y[f];
+      sum += d * d;
+    }
+    return sum;
+  }
+
+  /// The distance between two points.
+  double operator()(const Vector &x, const Vector &y) const {
+    return distance(x.data(), y.data(), x.size());
+  }
+
+  /// Does nothing.
+  void prepare(SparseMatrix &) const {}
+
+  /// The distance between two points without non-zero features.
+  double zero_distance() const { return 0; }
+
+  /// The contribution of a feature to the distance between prepared points.
+  double term(const double x, const double y) const {
+    return (x - y) * (x - y);
+  }
+};
+
+/// \brief Cosine distance 1 - x·y / (‖x‖ ‖y‖).
+///
+/// The points are normalised to unit length when they are prepared, so that
+/// the distance is a single dot product. Points of zero length are at distance
+/// 1 from every other point, including the other points of zero length.
+class Cosine {
+public:
+  /// The form of the distance between prepared points.
+  static constexpr Form FORM = Form::UNIT_DOT;
+
+  /// Normalises each point to unit length.
+  void prepare(Matrix &points) const {
+    double *const data = points.data();
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < points.n_rows(); ++i) {
+      double *const x = data + i * points.row_stride();
+      double sq_norm = 0;
+      for (std::size_t f = 0; f < points.n_cols(); ++f) {
+        sq_norm += x[f] * x[f];
+      }
+      const double inv_norm = sq_norm > 0 ? 1 / std::sqrt(sq_norm) : 0;
+      for (std::size_t f = 0; f < points.n_cols(); ++f) {
+        x[f] *= inv_norm;
+      }
+    }
+  }
+
+  /// The distance between two prepared points.
+  double distance(const double *const x, const double *const y,
+                  const std::size_t n) const {
+    double dot = 0;
+#ifdef PAR
+#pragma omp simd reduction(+ : dot)
+#endif
+    for (std::size_t f = 0; f < n; ++f) {
+      dot += x[f] * y[f];
+    }
+    return 1 - dot;
+  }
+
+  /// The distance between two points.
+  double operator()(const Vector &x, const Vector &y) const {
+    const double sq_norm_x = x.dot(x), sq_norm_y = y.dot(y);
+    // As between prepared points, where a point of zero length stays zero.
+    if (sq_norm_x == 0 || sq_norm_y == 0) {
+      return 1;
+    }
+    return 1 - x.dot(y) / std::sqrt(sq_norm_x * sq_norm_y);
+  }
+
+  /// Normalises each sparse point to unit length.
+  void prepare(SparseMatrix &points) const {
+    double *const data = points.data();
+    const std::size_t *const row_ixs = points.row_ixs();
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < points.n_rows(); ++i) {
+      double sq_norm = 0;
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        sq_norm += data[ir] * data[ir];
+      }
+      const double inv_norm = sq_norm > 0 ? 1 / std::sqrt(sq_norm) : 0;
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        data[ir] *= inv_norm;
+      }
+    }
+  }
+
+  /// The distance between two points without non-zero features.
+  double zero_distance() const { return 1; }
+
+  /// The contribution of a feature to the distance between prepared points.
+  double term(const double x, const double y) const { return -x * y; }
+};
+
+/// \brief L1 (Manhattan) distance ∑ |xᶠ - yᶠ|. With kernel::MetricGaussian,
+///        this gives the Laplacian kernel.
+class L1 {
+public:
+  /// The form of the distance between prepared points.
+  static constexpr Form FORM = Form::L1;
+
+  /// Does nothing.
+  void prepare(Matrix &) const {}
+
+  /// The distance between two prepared points.
+  double distance(const double *const x, const double *const y,
+                  const std::size_t n) const {
+    double sum = 0;
+#ifdef PAR
+#pragma omp simd reduction(+ : sum)
+#endif
+    for (std::size_t f = 0; f < n; ++f) {
+      sum += std::abs(x[f] - y[f]);
+    }
+    return sum;
+  }
+
+  /// The distance between two points.
+  double operator()(const Vector &x, const Vector &y) const {
+    return distance(x.data(), y.data(), x.size());
+  }
+
+  /// Does nothing.
+  void prepare(SparseMatrix &) const {}
+
+  /// The distance between two points without non-zero features.
+  double zero_distance() const { return 0; }
+
+  /// The contribution of a feature to the distance between prepared points.
+  double term(const double x, const double y) const { return std::abs(x - y); }
+};
+
+/// \brief Squared Mahalanobis distance with a diagonal covariance,
+///        ∑ ((xᶠ - yᶠ) / sᶠ)², where sᶠ is the scale of feature f.
+///
+/// The features are divided by their scales when the points are prepared, so
+/// that the distance is the squared Euclidean distance.
+class DiagonalMahalanobis {
+public:
+  /// The form of the distance between prepared points.
+  static constexpr Form FORM = Form::SQ_EUCLIDEAN;
+
+  /// The inverse of the scale of each feature.
+  Vector inv_scale;
+
+  /// \brief Constructs the metric with the given scales.
+  ///
+  /// \param[in] scale The scale sᶠ of each feature, e.g. its standard
+  ///                  deviation.
+  /// \exception std::invalid_argument If a scale is not positive.
+  explicit DiagonalMahalanobis(const Vector &scale) : inv_scale(scale.size()) {
+    for (std::size_t f = 0; f < scale.size(); ++f) {
+      if (!(scale[f] > 0)) {
+        throw std::invalid_argument("scales must be positive");
+      }
+      inv_scale[f] = 1 / scale[f];
+    }
+  }
+
+  /// \brief Divides each feature by its scale.
+  ///
+  /// \exception std::invalid_argument If the number of features is not the
+  ///                                  number of scales.
+  void prepare(Matrix &points) const {
+    if (points.n_cols() != inv_scale.size()) {
+      throw std::invalid_argument("incorrect number of features");
+    }
+
+    double *const data = points.data();
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < points.n_rows(); ++i) {
+      double *const x = data + i * points.row_stride();
+      for (std::size_t f = 0; f < points.n_cols(); ++f) {
+        x[f] *= inv_scale[f];
+      }
+    }
+  }
+
+  /// \brief Divides each feature of the sparse points by its scale.
+  ///
+  /// \exception std::invalid_argument If the number of features is not the
+  ///                                  number of scales.
+  void prepare(SparseMatrix &points) const {
+    if (points.n_cols() != inv_scale.size()) {
+      throw std::invalid_argument("incorrect number of features");
+    }
+
+    double *const data = points.data();
+    const std::size_t *const col_ixs = points.col_ixs();
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t ir = 0; ir < points.n_nz(); ++ir) {
+      data[ir] *= inv_scale[col_ixs[ir]];
+    }
+  }
+
+  /// The distance between two prepared points.
+  double distance(const double *const x, const double *const y,
+                  const std::size_t n) const {
+    return SqEuclidean().distance(x, y, n);
+  }
+
+  /// The distance between two points.
+  double operator()(const Vector &x, const Vector &y) const {
+    double sum = 0;
+    for (std::size_t f = 0; f < x.size(); ++f) {
+      const double d = (x[f] - y[f]) * inv_scale[f];
+      sum += d * d;
+    }
+    return sum;
+  }
+
+  /// The distance between two points without non-zero features.
+  double zero_distance() const { return 0; }
+
+  /// The contribution of a feature to the distance between prepared points.
+  double term(const double x, const double y) const {
+    return (x - y) * (x - y);
+  }
+};
+
+} // namespace metric
+
+} // namespace diffusion_maps
+
+#endif
@@ -0,0 +1,135 @@
+/// \file
+///
+/// \brief Progress reports and cancellation of a fit.
+
+#ifndef DIFFUSION_MAPS_MONITOR_HPP
+#define DIFFUSION_MAPS_MONITOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+namespace diffusion_maps {
+
+/// The stages of a fit, in the order in which they run.
+enum class Stage {
+  /// Computing the kernel matrix.
+  KERNEL,
+  /// Reordering the data points.
+  REORDERING,
+  /// Normalising the kernel matrix into the diffusion matrix.
+  NORMALISATION,
+  /// The eigendecomposition solver.
+  EIG_SOLVER,
+  /// Computing the embeddings.
+  EMBEDDING,
+};
+
+/// The progress of a fit, as reported to Monitor::callback.
+class Progress {
+public:
+  /// The current stage.
+  Stage stage = Stage::KERNEL;
+  /// \brief In the eigendecomposition solver, the index of the eigenpair being
+  ///        computed. For the block solvers, the number of eigenpairs that
+  ///        have converged.
+  std::size_t eigenpair = 0;
+  /// \brief In the eigendecomposition solver, the number of iterations
+  ///        performed for the eigenpair. 0 when a stage starts.
+  unsigned iteration = 0;
+  /// \brief In the eigendecomposition solver, the error that is compared with
+  ///        the tolerance: the change of the eigenvector for the power method
+  ///        and the residual ‖A v - λ v‖ for the Chebyshev solver. NaN if
+  ///        there is none.
+  double error = std::numeric_limits<double>::quiet_NaN();
+};
+
+/// Thrown by a fit that was cancelled with Monitor::cancel().
+class Cancelled : public std::runtime_error {
+public:
+  Cancelled() : std::runtime_error("fit cancelled") {}
+};
+
+/// \brief Observes a fit: receives its progress, and cancels it.
+///
+/// Pass a pointer to an object of this class in Options::monitor. The fit
+/// reports its progress when each stage starts and at each iteration of the
+/// eigendecomposition solver, and checks for cancellation at the same points,
+/// so that a cancelled fit stops within one iteration by throwing Cancelled.
+/// The stages themselves are not interrupted.
+class Monitor {
+protected:
+  /// Whether the fit was cancelled.
+  std::atomic<bool> _cancelled = false;
+
+public:
+  /// \brief If not null, called with each progress report, on the thread that
+  ///        runs the fit.
+  std::function<void(const Progress &)> callback;
+
+  /// Constructs a monitor without a callback.
+  Monitor() = default;
+
+  /// \brief Constructs a monitor.
+  ///
+  /// \param[in] callback The function called with each progress report.
+  explicit Monitor(std::function<void(const Progress &)> callback)
+      : callback(std::move(callback)) {}
+
+  Monitor(const Monitor &) = delete;
+  Monitor &operator=(const Monitor &) = delete;
+
+  /// Asks the fit to stop at the next progress report. May be called from any
+  /// thread.
+  void cancel() { _cancelled = true; }
+
+  /// Tells whether cancel() was called.
+  bool cancelled() const { return _cancelled; }
+
+  /// \brief Reports progress: calls the callback, then checks for
+  ///        cancellation.
+  ///
+  /// \param[in] progress The progress.
+  /// \exception Cancelled If cancel() was called.
+  void report(const Progress &progress) const {
+    if (callback) {
+      callback(progress);
+    }
+    if (_cancelled) {
+      throw Cancelled();
+    }
+  }
+};
+
+namespace internal {
+
+/// \brief Reports progress to a monitor, if it is not null.
+///
+/// \param[in] monitor The monitor.
+/// \param[in] progress The progress.
+/// \exception Cancelled If the fit was cancelled.
+inline void report(const Monitor *const monitor, const Progress &progress) {
+  if (monitor) {
+    monitor->report(progress);
+  }
+}
+
+/// \brief Reports that a stage starts to a monitor, if it is not null.
+///
+/// \param[in] monitor The monitor.
+/// \param[in] stage The stage.
+/// \exception Cancelled If the fit was cancelled.
+inline void report(const Monitor *const monitor, const Stage stage) {
+  Progress progress;
+  progress.stage = stage;
+  report(monitor, progress);
+}
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
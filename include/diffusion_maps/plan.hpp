@@ -0,0 +1,227 @@
+/// \file
+///
+/// \brief Planning of a fit from a sample of the pairs of data points.
+
+#ifndef DIFFUSION_MAPS_PLAN_HPP
+#define DIFFUSION_MAPS_PLAN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// \brief The size in bytes of the diffusion matrix in the CSR format beyond
+///        which the planner assumes that the sparse matrix-vector products no
+///        longer fit in the cache, and are bound by the memory bandwidth.
+constexpr std::size_t PLAN_IN_CACHE_BYTES = std::size_t{32} << 20;
+
+/// \brief The density of the kernel matrix from which the planner chooses the
+///        dense eigensolver, EigSolver::DENSE. Beyond it, a dense matrix takes
+///        less memory than the values and column indices of the CSR format.
+constexpr double PLAN_DENSE_DENSITY = 0.5;
+
+/// \brief The largest number of data points for which the planner chooses the
+///        dense eigensolver, whose time grows as n³.
+constexpr std::size_t PLAN_DENSE_MAX_SAMPLES = 30000;
+
+/// \brief The execution plan of a fit, with the estimates it was chosen from.
+///
+/// See plan().
+class Plan {
+public:
+  /// The number of data points.
+  std::size_t n_samples = 0;
+  /// The number of pairs of distinct data points whose kernel was evaluated.
+  std::size_t n_pairs_sampled = 0;
+  /// \brief Whether the sample covered every pair of distinct data points, in
+  ///        which case the estimates of the kernel matrix are exact.
+  bool exhaustive = false;
+  /// \brief The estimated fraction of the pairs of distinct data points whose
+  ///        kernel is above the kernel epsilon.
+  double density = 0;
+  /// \brief The estimated number of non-zero elements of the kernel matrix,
+  ///        counting the diagonal as non-zero.
+  std::uint64_t n_nz = 0;
+  /// \brief The estimated peak memory held by the large buffers, as measured
+  ///        by Stats::peak_bytes.
+  std::size_t peak_bytes = 0;
+  /// The estimated wall time in seconds of the kernel stage.
+  double kernel_time = 0;
+  /// The storage format of the diffusion matrix.
+  MatrixFormat matrix_format = MatrixFormat::CSR;
+  /// The eigendecomposition solver.
+  EigSolver eig_solver = EigSolver::POWER_METHOD;
+
+  /// \brief Applies the choices of the plan to options.
+  ///
+  /// \param[in] options The options.
+  /// \return The options with the storage format and the eigendecomposition
+  ///         solver of the plan.
+  Options apply(Options options) const {
+    options.matrix_format = matrix_format;
+    options.eig_solver = eig_solver;
+    return options;
+  }
+
+  /// \brief Describes the plan on one line, for logging.
+  ///
+  /// \return The description.
+  std::string to_string() const;
+};
+
+/// \brief Plans a fit of diffusion maps before the kernel matrix is computed.
+///
+/// Options::plan_n_pairs pairs of distinct data points are drawn uniformly,
+/// with a fixed seed so that the fits that plan themselves follow the same
+/// plan, and their kernel is compared to the kernel epsilon. Built-in
+/// Gaussian kernels compare the distance to the cutoff instead, as in
+/// internal::compute_kernel_triplets(). If there are no more pairs than that,
+/// they are all evaluated. The fraction above the epsilon gives the number of
+/// non-zero elements, with a relative error of about
+/// √((1 - density) / (density · n_pairs)), small precisely when the matrix is
+/// nearly dense. The time of the sample gives that of the kernel stage.
+///
+/// The peak memory is that of the largest stage: the triplets, counted at
+/// twice their number since their vector grows while they are collected, with
+/// the CSR arrays they are assembled into, or the CSR arrays with the
+/// converted matrix and the vectors of the solver.
+///
+/// With Options::auto_plan, the storage format and the solver are chosen from
+/// the size of the matrix. While it fits in the cache (#PLAN_IN_CACHE_BYTES),
+/// the products are cheap and the plain CSR format and the power method are
+/// chosen. Beyond, they are bound by the memory bandwidth, so the compressed
+/// CSR format with float values, which reads 6 bytes per element instead of
+/// 16, and the Chebyshev-filtered solver, which needs far fewer products, are
+/// chosen. A nearly dense matrix (#PLAN_DENSE_DENSITY) of at most
+/// #PLAN_DENSE_MAX_SAMPLES data points goes to the dense eigensolver instead.
+/// Each choice falls back to the next leaner one while the estimate exceeds
+/// Options::memory_budget. Otherwise, the plan keeps the format and the solver
+/// of the options.
+///
+/// With the dense eigensolver, the peak memory is that of the dense matrix,
+/// with the data points while it is computed and with the vectors of the
+/// solver afterwards. Self-tuning bandwidths need the CSR arrays first, which
+/// are held while the dense matrix is expanded from them.
+///
+/// Fits from sparse data points and from a kernel graph are planned too, see
+/// the overload for sparse data points and
+/// internal::plan_from_diffusion_matrix().
+///
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel function.
+/// \param[in] options The options of the fit.
+/// \return The plan.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+Plan plan(const Matrix &data, std::size_t n_components,
+          const std::function<double(const Vector &, const Vector &)> &kernel,
+          const Options &options = Options());
+
+namespace internal {
+
+/// \brief Plans a fit of diffusion maps from a predicate on the pairs of data
+///        points, see plan().
+///
+/// The data points are taken to be sparse, so the dense solver expands the
+/// assembled CSR arrays.
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in] points_bytes The bytes held by the data points while the kernel
+///                         matrix is computed.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] above The predicate that tells whether the kernel of the i-th
+///                  and the j-th data points is above the kernel epsilon.
+/// \param[in] options The options of the fit.
+/// \return The plan.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+Plan plan_from_pairs(std::size_t n_samples, std::size_t points_bytes,
+                     std::size_t n_components,
+                     const std::function<bool(std::size_t, std::size_t)> &above,
+                     const Options &options);
+
+} // namespace internal
+
+/// \brief Plans a fit of diffusion maps of sparse data points before the
+///        kernel matrix is computed.
+///
+/// As the overload for dense data points, except that the distance of each
+/// sampled pair is summed over the non-zero features of both points, see
+/// internal::sparse_kernel_above(). The kernel stage only visits the pairs
+/// that share a feature or are within the cutoff, so the estimated time of
+/// the kernel stage is an upper bound.
+///
+/// \tparam Metric The distance metric.
+/// \param[in] data The data matrix where each row is a data point. The column
+///                 indices within each row must be sorted.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] kernel The kernel.
+/// \param[in] options The options of the fit.
+/// \return The plan.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+template <typename Metric>
+Plan plan(const SparseMatrix &data, std::size_t n_components,
+          const kernel::MetricGaussian<Metric> &kernel,
+          const Options &options = Options()) {
+  return internal::plan_from_pairs(
+      data.n_rows(), internal::sparse_kernel_bytes(data), n_components,
+      internal::sparse_kernel_above(data, kernel, options.kernel_epsilon),
+      options);
+}
+
+namespace internal {
+
+/// \brief Plans a fit of diffusion maps from its "symmetrised" diffusion
+///        matrix, as with a kernel graph, see plan().
+///
+/// The number of non-zero elements is exact, and there is no kernel stage, so
+/// the peak memory is that of the solver, or of the dense matrix expanded
+/// from the CSR arrays.
+///
+/// \param[in] diffusion_matrix The "symmetrised" diffusion matrix.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options of the fit.
+/// \return The plan.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+Plan plan_from_diffusion_matrix(const SparseMatrix &diffusion_matrix,
+                                std::size_t n_components,
+                                const Options &options);
+
+/// \brief Stores a plan into Options::plan, checks it against
+///        Options::memory_budget, and gives the options to run the fit with.
+///
+/// \param[in] plan The plan.
+/// \param[in] options The options of the fit.
+/// \return The options, with the storage format and the solver of the plan
+///         under Options::auto_plan, and without the planning options, so
+///         that the fit is not planned again.
+/// \exception std::invalid_argument If the estimated peak memory exceeds the
+///                                  budget.
+Options apply_plan(const Plan &plan, const Options &options);
+
+/// \brief Checks that the estimated peak memory of a plan is within the
+///        memory budget.
+///
+/// \param[in] plan The plan.
+/// \param[in] memory_budget The memory budget in bytes, or 0 for none.
+/// \exception std::invalid_argument If the estimated peak memory exceeds the
+///                                  budget.
+void check_memory_budget(const Plan &plan, std::size_t memory_budget);
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
@@ -0,0 +1,126 @@
+/// \file
+///
+/// \brief Sparse matrix in the SELL-C-σ format.
+
+#ifndef DIFFUSION_MAPS_SELL_MATRIX_HPP
+#define DIFFUSION_MAPS_SELL_MATRIX_HPP
+
+#include <cstddef>
+#include <vector>
+
+#include "diffusion_maps/linear_operator.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// Default sorting window σ of the SELL-C-σ format.
+constexpr std::size_t DEFAULT_SELL_SIGMA = 256;
+
+/// \brief Sparse matrix in the SELL-C-σ (sliced ELLPACK) format.
+///
+/// The rows are grouped into chunks of C = #CHUNK_SIZE consecutive rows, and
+/// the elements of each chunk are stored column by column, padded with zeros
+/// to the length of its longest row. The j-th elements of the C rows of a chunk
+/// are therefore contiguous, so a matrix-vector product processes C rows at
+/// once with SIMD loads and gathers instead of one variable-length row at a
+/// time as with the CSR format.
+///
+/// To keep the padding small when the number of non-zero elements per row
+/// varies, the rows within each window of σ consecutive rows are sorted by
+/// descending length before they are chunked. The columns are not permuted,
+/// and products are returned in the original row order.
+class SellMatrix : public LinearOperator {
+public:
+  /// \brief The number of rows per chunk, C. One AVX-512 register, or two AVX2
+  ///        registers, of doubles.
+  static constexpr std::size_t CHUNK_SIZE = 8;
+
+protected:
+  /// The number of rows.
+  std::size_t _n_rows;
+  /// The number of columns.
+  std::size_t _n_cols;
+  /// The number of non-zero elements, excluding the padding.
+  std::size_t _n_nz;
+  /// The sorting window σ.
+  std::size_t _sigma;
+  /// The data array, column by column within each chunk, including the padding.
+  std::vector<double> _data;
+  /// The column indices of each stored element. Zero for the padding.
+  std::vector<std::size_t> _col_ixs;
+  /// The index of the first stored element of each chunk, and the total.
+  std::vector<std::size_t> _chunk_ixs;
+  /// The original index of the row in each slot of the chunks.
+  std::vector<std::size_t> _row_perm;
+
+public:
+  // Constructors.
+
+  /// Constructs an empty 0×0 matrix.
+  SellMatrix() : _n_rows(0), _n_cols(0), _n_nz(0), _sigma(1), _chunk_ixs{0} {}
+
+  /// \brief Converts a sparse matrix in the CSR format.
+  ///
+  /// \param[in] a The sparse matrix.
+  /// \param[in] sigma The sorting window σ, in rows. 1 disables the sorting.
+  /// \exception std::invalid_argument If \p sigma is 0.
+  explicit SellMatrix(const SparseMatrix &a,
+                      std::size_t sigma = DEFAULT_SELL_SIGMA);
+
+  // Accessors.
+
+  /// The number of rows.
+  std::size_t n_rows() const override { return _n_rows; }
+
+  /// The number of columns.
+  std::size_t n_cols() const override { return _n_cols; }
+
+  /// The number of non-zero elements, excluding the padding.
+  std::size_t n_nz() const override { return _n_nz; }
+
+  /// The number of stored elements, including the padding.
+  std::size_t n_stored() const { return _data.size(); }
+
+  /// The sorting window σ.
+  std::size_t sigma() const { return _sigma; }
+
+  /// The number of bytes held by the arrays of the matrix.
+  std::size_t n_bytes() const override {
+    return n_stored() * (sizeof(double) + sizeof(std::size_t)) +
+           (_chunk_ixs.size() + _row_perm.size()) * sizeof(std::size_t);
+  }
+
+  // Matrix operations.
+
+  /// \brief Matrix-vector multiplication.
+  ///
+  /// Uses AVX-512 or AVX2 gathers when the library is compiled for them.
+  ///
+  /// \param[in] v The vector to multiply.
+  /// \return The result of the multiplication.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  Vector operator*(const Vector &v) const override;
+
+  /// \brief Matrix-vector multiplication into an existing vector.
+  ///
+  /// Uses AVX-512 or AVX2 gathers when the library is compiled for them.
+  ///
+  /// \param[in] v The vector to multiply.
+  /// \param[out] result The result of the multiplication. It must not be
+  ///                    \p v.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  void multiply(const Vector &v, Vector &result) const override;
+
+  /// \brief Matrix-matrix multiplication with a dense matrix.
+  ///
+  /// \param[in] m The dense matrix to multiply.
+  /// \return The result of the multiplication as a row-major matrix.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  Matrix operator*(const Matrix &m) const override;
+};
+
+} // namespace diffusion_maps
+
+#endif
@@ -7,28 +7,85 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <stdexcept>
 #include <tuple>
+#include <variant>
 #include <vector>
 
+#include "diffusion_maps/allocation.hpp"
+#include "diffusion_maps/linear_operator.hpp"
+#include "diffusion_maps/matrix.hpp"
 #include "diffusion_maps/vector.hpp"
 
 namespace diffusion_maps {
 
-/// Sparse matrix in the CSR format.
-class SparseMatrix {
+/// Sparse matrix in the CSR format that may or may not own its arrays.
+class SparseMatrix : public LinearOperator {
 protected:
   /// The number of rows.
   std::size_t _n_rows;
   /// The number of columns.
   std::size_t _n_cols;
   /// The data array of the matrix.
-  std::unique_ptr<double[]> _data;
+  std::variant<std::unique_ptr<double[]>, double *> _data;
   /// The column indices of each non-zero element.
-  std::unique_ptr<std::size_t[]> _col_ixs;
+  std::variant<std::unique_ptr<std::size_t[]>, std::size_t *> _col_ixs;
   /// The indices of each row.
-  std::unique_ptr<std::size_t[]> _row_ixs;
+  std::variant<std::unique_ptr<std::size_t[]>, std::size_t *> _row_ixs;
+
+  /// \brief Returns the pointer to an array, whether it is owned or not.
+  ///
+  /// \tparam T The type of the elements.
+  /// \param[in] array The array.
+  /// \return The pointer to the first element.
+  template <typename T>
+  static T *
+  pointer(const std::variant<std::unique_ptr<T[]>, T *> &array) noexcept {
+    return std::holds_alternative<T *>(array)
+               ? std::get<T *>(array)
+               : std::get<std::unique_ptr<T[]>>(array).get();
+  }
+
+  /// \brief Allocates the arrays and copies those of another matrix, by rows
+  ///        with the allocation policy.
+  ///
+  /// \param[in] other The sparse matrix to copy.
+  void copy_arrays(const SparseMatrix &other) {
+    const std::size_t n_nz = other.n_nz();
+    _data = internal::allocate_array<double>(n_nz);
+    _col_ixs = internal::allocate_array<std::size_t>(n_nz);
+    _row_ixs = internal::allocate_array<std::size_t>(_n_rows + 1);
+
+    const std::size_t *const src_row_ixs = other.row_ixs();
+    std::size_t *const row_ixs = pointer(_row_ixs);
+    if (src_row_ixs) {
+      std::copy_n(src_row_ixs, _n_rows + 1, row_ixs);
+    } else {
+      std::fill_n(row_ixs, _n_rows + 1, 0);
+    }
+    if (n_nz == 0) {
+      return;
+    }
+
+    const double *const src_data = other.data();
+    const std::size_t *const src_col_ixs = other.col_ixs();
+    double *const data = pointer(_data);
+    std::size_t *const col_ixs = pointer(_col_ixs);
+    [[maybe_unused]] const bool parallel = internal::first_touch_in_parallel(
+        n_nz * (sizeof(double) + sizeof(std::size_t)));
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+    for (std::size_t i = 0; i < _n_rows; ++i) {
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        data[ir] = src_data[ir];
+        col_ixs[ir] = src_col_ixs[ir];
+      }
+    }
+  }
 
 public:
   /// A non-zero element of a sparse matrix as a (i, j, value) triplet.
@@ -42,25 +99,32 @@ public:
     double value;
 
     /// \brief Less-than comparison operator. Compares the row and column
-    ///        indices.
+    ///        indices, then the bit patterns of the values, so that sorting
+    ///        gives the same order whatever the initial order of the triplets,
+    ///        even with duplicate elements.
     ///
     /// \param[in] other The other triple.
     /// \return True if this triple is less than the other triple in the
     ///         aforementioned order.
     bool operator<(const Triplet &other) const {
-      return std::tie(row, col) < std::tie(other.row, other.col);
+      std::uint64_t bits, other_bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      std::memcpy(&other_bits, &other.value, sizeof(other_bits));
+      return std::tie(row, col, bits) <
+             std::tie(other.row, other.col, other_bits);
     }
   };
 
   // Constructors.
 
   /// Constructs an empty 0×0 matrix.
-  SparseMatrix()
-      : _n_rows(0), _n_cols(0), _data(nullptr), _col_ixs(nullptr),
-        _row_ixs(nullptr) {}
+  SparseMatrix() : _n_rows(0), _n_cols(0) {}
 
   /// \brief Constructs a sparse matrix from a vector of triplets.
   ///
+  /// The arrays are filled by rows with the allocation policy, see
+  /// AllocationPolicy.
+  ///
   /// \param[in] n_rows The number of rows.
   /// \param[in] n_cols The number of columns.
   /// \param[in,out] triplets The vector of triplets. Elements are sorted
@@ -68,34 +132,75 @@ public:
   SparseMatrix(const std::size_t n_rows, const std::size_t n_cols,
                std::vector<Triplet> &triplets)
       : _n_rows(n_rows), _n_cols(n_cols),
-        _data(std::make_unique<double[]>(triplets.size())),
-        _col_ixs(std::make_unique<std::size_t[]>(triplets.size())),
-        _row_ixs(std::make_unique<std::size_t[]>(n_rows + 1)) {
+        _data(internal::allocate_array<double>(triplets.size())),
+        _col_ixs(internal::allocate_array<std::size_t>(triplets.size())),
+        _row_ixs(internal::allocate_array<std::size_t>(n_rows + 1)) {
     // Sort the triplets by row and column indices.
     std::sort(triplets.begin(), triplets.end());
 
-    // Fill the arrays.
+    // Find the rows, then fill the arrays by rows.
+    double *const data = pointer(_data);
+    std::size_t *const col_ixs = pointer(_col_ixs);
+    std::size_t *const row_ixs = pointer(_row_ixs);
     for (std::size_t ri = 0, ti = 0; ri < n_rows; ++ri) {
-      _row_ixs[ri] = ti;
-      for (; ti < triplets.size() && triplets[ti].row == ri; ++ti) {
-        _col_ixs[ti] = triplets[ti].col;
-        _data[ti] = triplets[ti].value;
+      row_ixs[ri] = ti;
+      while (ti < triplets.size() && triplets[ti].row == ri) {
+        ++ti;
+      }
+    }
+    row_ixs[n_rows] = triplets.size();
+
+    [[maybe_unused]] const bool parallel = internal::first_touch_in_parallel(
+        triplets.size() * (sizeof(double) + sizeof(std::size_t)));
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+    for (std::size_t ri = 0; ri < n_rows; ++ri) {
+      for (std::size_t ti = row_ixs[ri]; ti < row_ixs[ri + 1]; ++ti) {
+        col_ixs[ti] = triplets[ti].col;
+        data[ti] = triplets[ti].value;
       }
     }
-    _row_ixs[n_rows] = triplets.size();
   }
 
-  /// \brief Copy constructor.
+  /// \brief Constructs a sparse matrix from its CSR arrays.
+  ///
+  /// The column indices within each row must be sorted in ascending order.
+  ///
+  /// \param[in] n_rows The number of rows.
+  /// \param[in] n_cols The number of columns.
+  /// \param[in] data The data array.
+  /// \param[in] col_ixs The column indices of each non-zero element.
+  /// \param[in] row_ixs The indices of each row, with \p n_rows + 1 elements.
+  SparseMatrix(const std::size_t n_rows, const std::size_t n_cols,
+               std::unique_ptr<double[]> data,
+               std::unique_ptr<std::size_t[]> col_ixs,
+               std::unique_ptr<std::size_t[]> row_ixs)
+      : _n_rows(n_rows), _n_cols(n_cols), _data(std::move(data)),
+        _col_ixs(std::move(col_ixs)), _row_ixs(std::move(row_ixs)) {}
+
+  /// \brief Constructs a non-owning sparse matrix from its CSR arrays, which
+  ///        must outlive it.
+  ///
+  /// The column indices within each row must be sorted in ascending order.
+  ///
+  /// \param[in] n_rows The number of rows.
+  /// \param[in] n_cols The number of columns.
+  /// \param[in] data The data array.
+  /// \param[in] col_ixs The column indices of each non-zero element.
+  /// \param[in] row_ixs The indices of each row, with \p n_rows + 1 elements.
+  SparseMatrix(const std::size_t n_rows, const std::size_t n_cols,
+               double *const data, std::size_t *const col_ixs,
+               std::size_t *const row_ixs)
+      : _n_rows(n_rows), _n_cols(n_cols), _data(data), _col_ixs(col_ixs),
+        _row_ixs(row_ixs) {}
+
+  /// \brief Copy constructor. The copy always owns its arrays.
   ///
   /// \param[in] other The sparse matrix to copy.
   SparseMatrix(const SparseMatrix &other)
-      : _n_rows(other._n_rows), _n_cols(other._n_cols),
-        _data(std::make_unique<double[]>(other.n_nz())),
-        _col_ixs(std::make_unique<std::size_t[]>(other.n_nz())),
-        _row_ixs(std::make_unique<std::size_t[]>(other._n_rows + 1)) {
-    std::copy_n(other._data.get(), other.n_nz(), _data.get());
-    std::copy_n(other._col_ixs.get(), other.n_nz(), _col_ixs.get());
-    std::copy_n(other._row_ixs.get(), other._n_rows + 1, _row_ixs.get());
+      : _n_rows(other._n_rows), _n_cols(other._n_cols) {
+    copy_arrays(other);
   }
 
   /// \brief Move constructor. The moved-from matrix is set to an empty 0×0
@@ -113,11 +218,11 @@ public:
   // Destructor.
 
   /// Destructor.
-  virtual ~SparseMatrix() = default;
+  ~SparseMatrix() override = default;
 
   // Assignment operators.
 
-  /// \brief Copy assignment operator.
+  /// \brief Copy assignment operator. The copy always owns its arrays.
   ///
   /// \param[in] other The sparse matrix to copy.
   /// \return A reference to this sparse matrix.
@@ -127,13 +232,7 @@ public:
 
     _n_rows = other._n_rows;
     _n_cols = other._n_cols;
-    _data = std::make_unique<double[]>(other.n_nz());
-    _col_ixs = std::make_unique<std::size_t[]>(other.n_nz());
-    _row_ixs = std::make_unique<std::size_t[]>(other._n_rows + 1);
-
-    std::copy_n(other._data.get(), other.n_nz(), _data.get());
-    std::copy_n(other._col_ixs.get(), other.n_nz(), _col_ixs.get());
-    std::copy_n(other._row_ixs.get(), other._n_rows + 1, _row_ixs.get());
+    copy_arrays(other);
 
     return *this;
   }
@@ -162,25 +261,34 @@ public:
   // Accessors.
 
   /// The number of rows.
-  std::size_t n_rows() const { return _n_rows; }
+  std::size_t n_rows() const override { return _n_rows; }
 
   /// The number of columns.
-  std::size_t n_cols() const { return _n_cols; }
+  std::size_t n_cols() const override { return _n_cols; }
 
   /// The number of non-zero elements.
-  std::size_t n_nz() const { return _row_ixs[_n_rows]; }
+  std::size_t n_nz() const override {
+    const std::size_t *const row_ixs = this->row_ixs();
+    return row_ixs ? row_ixs[_n_rows] : 0;
+  }
+
+  /// The number of bytes held by the arrays of the matrix.
+  std::size_t n_bytes() const override {
+    return n_nz() * (sizeof(double) + sizeof(std::size_t)) +
+           (_n_rows + 1) * sizeof(std::size_t);
+  }
 
   /// The data array.
-  double *data() { return _data.get(); }
+  double *data() { return pointer(_data); }
 
   /// The data array.
-  const double *data() const { return _data.get(); }
+  const double *data() const { return pointer(_data); }
 
   /// The column indices array.
-  const std::size_t *col_ixs() const { return _col_ixs.get(); }
+  const std::size_t *col_ixs() const { return pointer(_col_ixs); }
 
   /// The row indices array.
-  const std::size_t *row_ixs() const { return _row_ixs.get(); }
+  const std::size_t *row_ixs() const { return pointer(_row_ixs); }
 
   // Matrix operations.
 
@@ -189,22 +297,72 @@ public:
   /// \param[in] v The vector to multiply.
   /// \return The result of the multiplication.
   /// \exception std::invalid_argument If the dimensions are incompatible.
-  Vector operator*(const Vector &v) const {
-    if (_n_cols != v.size())
+  Vector operator*(const Vector &v) const override {
+    Vector result(_n_rows);
+    multiply(v, result);
+    return result;
+  }
+
+  /// \brief Matrix-vector multiplication into an existing vector.
+  ///
+  /// \param[in] v The vector to multiply.
+  /// \param[out] result The result of the multiplication. It must not be
+  ///                    \p v.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  void multiply(const Vector &v, Vector &result) const override {
+    if (_n_cols != v.size() || _n_rows != result.size())
       throw std::invalid_argument("incompatible dimensions");
 
-    Vector result(_n_rows);
+    const double *const data = this->data();
+    const std::size_t *const col_ixs = this->col_ixs();
+    const std::size_t *const row_ixs = this->row_ixs();
 
 #ifdef PAR
 #pragma omp parallel for
 #endif
     for (std::size_t i = 0; i < _n_rows; ++i) {
       double sum = 0;
-      for (std::size_t j = _row_ixs[i]; j < _row_ixs[i + 1]; ++j) {
-        sum += _data[j] * v[_col_ixs[j]];
+      for (std::size_t j = row_ixs[i]; j < row_ixs[i + 1]; ++j) {
+        sum += data[j] * v[col_ixs[j]];
       }
       result[i] = sum;
     }
+  }
+
+  /// \brief Matrix-matrix multiplication with a dense matrix.
+  ///
+  /// Each non-zero element of this matrix is read once for all the columns of
+  /// \p m, so multiplying a block of vectors at once is much cheaper than
+  /// multiplying them one at a time.
+  ///
+  /// \param[in] m The dense matrix to multiply.
+  /// \return The result of the multiplication as a row-major matrix.
+  /// \exception std::invalid_argument If the dimensions are incompatible.
+  Matrix operator*(const Matrix &m) const override {
+    if (_n_cols != m.n_rows())
+      throw std::invalid_argument("incompatible dimensions");
+
+    const std::size_t n_cols = m.n_cols();
+    Matrix result(_n_rows, n_cols);
+    const double *const data = this->data();
+    const std::size_t *const col_ixs = this->col_ixs();
+    const std::size_t *const row_ixs = this->row_ixs();
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < _n_rows; ++i) {
+      for (std::size_t k = 0; k < n_cols; ++k) {
+        result(i, k) = 0;
+      }
+      for (std::size_t j = row_ixs[i]; j < row_ixs[i + 1]; ++j) {
+        const double value = data[j];
+        const std::size_t c = col_ixs[j];
+        for (std::size_t k = 0; k < n_cols; ++k) {
+          result(i, k) += value * m(c, k);
+        }
+      }
+    }
 
     return result;
   }
@@ -0,0 +1,110 @@
+/// \file
+///
+/// \brief Timings and counters of a fit.
+
+#ifndef DIFFUSION_MAPS_STATS_HPP
+#define DIFFUSION_MAPS_STATS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace diffusion_maps {
+
+/// \brief Timings and counters of a fit, for finding out which stage of the
+///        pipeline a slow fit spends its time in.
+///
+/// Pass a pointer to an object of this class in Options::stats to have it
+/// filled in. Nothing is measured if the pointer is null. The times and
+/// counters accumulate across fits until reset() is called.
+class Stats {
+public:
+  /// Wall time in seconds spent computing the kernel matrix.
+  double kernel_time = 0;
+  /// Wall time in seconds spent reordering the data points.
+  double reordering_time = 0;
+  /// \brief Wall time in seconds spent normalising the kernel matrix into the
+  ///        "symmetrised" diffusion matrix. This includes assembling it from
+  ///        its triplets when both are done in one pass.
+  double normalisation_time = 0;
+  /// Wall time in seconds spent in the eigendecomposition solver.
+  double eig_solver_time = 0;
+  /// Wall time in seconds spent computing the embeddings.
+  double embedding_time = 0;
+
+  /// The number of kernel evaluations performed.
+  std::uint64_t n_kernel_evals = 0;
+  /// \brief The number of pairs of data points for which the kernel was not
+  ///        evaluated, e.g. because their value was mirrored from the
+  ///        symmetric pair.
+  std::uint64_t n_kernel_evals_skipped = 0;
+  /// \brief The number of kernel evaluations with quantised data points that
+  ///        were repeated in double precision, because the pair was near the
+  ///        cutoff of the kernel.
+  std::uint64_t n_kernel_evals_exact = 0;
+  /// The number of non-zero elements in the kernel matrix.
+  std::size_t n_nz = 0;
+  /// \brief An estimate of the peak number of bytes held by the large buffers
+  ///        of the pipeline: the triplets, the sparse matrices, the vectors
+  ///        with one element per data point and the embeddings.
+  std::size_t peak_bytes = 0;
+  /// \brief The number of sparse matrix-vector products. A product with a
+  ///        block of vectors counts once per vector.
+  std::uint64_t n_spmv = 0;
+
+  /// The number of iterations each eigenpair took, including the failed one.
+  std::vector<unsigned> n_iters;
+  /// \brief The residual ‖A v - λ v‖ of each eigenpair (λ, v) found, where A is
+  ///        the "symmetrised" diffusion matrix.
+  std::vector<double> residuals;
+
+  /// Resets the times and counters.
+  void reset() { *this = Stats(); }
+
+  /// Records that \p bytes bytes are held at the same time.
+  void record_bytes(const std::size_t bytes) {
+    peak_bytes = std::max(peak_bytes, bytes);
+  }
+};
+
+namespace internal {
+
+/// \brief Adds the wall time of its lifetime to a counter, if the counter is
+///        not null.
+class ScopedTimer {
+protected:
+  /// The counter.
+  double *_time;
+  /// The start time.
+  std::chrono::steady_clock::time_point _start;
+
+public:
+  /// \brief Starts the timer.
+  ///
+  /// \param[in,out] time The counter in seconds. Nothing is measured if null.
+  explicit ScopedTimer(double *const time) : _time(time) {
+    if (_time) {
+      _start = std::chrono::steady_clock::now();
+    }
+  }
+
+  ScopedTimer(const ScopedTimer &) = delete;
+  ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+  /// Stops the timer.
+  ~ScopedTimer() {
+    if (_time) {
+      *_time += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - _start)
+                    .count();
+    }
+  }
+};
+
+} // namespace internal
+
+} // namespace diffusion_maps
+
+#endif
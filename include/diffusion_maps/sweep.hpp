@@ -0,0 +1,102 @@
+/// \file
+///
+/// \brief Hyperparameter sweep of diffusion maps with the Gaussian kernel.
+
+#ifndef DIFFUSION_MAPS_SWEEP_HPP
+#define DIFFUSION_MAPS_SWEEP_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "diffusion_maps/decomposition.hpp"
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/matrix.hpp"
+
+namespace diffusion_maps {
+
+/// A setting of the hyperparameters of the Gaussian kernel.
+class SweepSetting {
+public:
+  /// Kernel parameter γ = 1 / 2σ².
+  double gamma;
+  /// The value below which the output of the kernel would be treated as zero.
+  double kernel_epsilon = DEFAULT_KERNEL_EPSILON;
+};
+
+/// The result of a fit in a hyperparameter sweep.
+class SweepResult {
+public:
+  /// The setting of the hyperparameters.
+  SweepSetting setting;
+  /// The eigendecomposition of the diffusion matrix.
+  Decomposition decomposition;
+  /// The number of non-zero elements in the kernel matrix.
+  std::size_t n_nz = 0;
+  /// \brief The relative eigengap (λₖ - λₖ₊₁) / λₖ after the last retained
+  ///        eigenvalue λₖ. A larger gap means that the embedding is more
+  ///        stable to perturbations of the data. NaN if λₖ₊₁ is not available,
+  ///        i.e., if the number of components is the number of data points
+  ///        minus 1 or the eigendecomposition solver did not converge.
+  double eigengap = 0;
+};
+
+namespace internal {
+
+std::vector<SweepResult> sweep(const Matrix &data, std::size_t n_components,
+                               const std::vector<SweepSetting> &settings,
+                               const Options &options,
+                               const std::vector<std::uint_fast32_t> &seeds);
+
+} // namespace internal
+
+/// \brief Fits diffusion maps with the Gaussian kernel for several settings of
+///        the hyperparameters.
+///
+/// The pairwise squared distances are computed once, for the pairs within the
+/// loosest cutoff distance in the sweep, i.e., the largest √(-ln ε / γ). The
+/// kernel matrix of each setting is then derived from the cached distances by
+/// an in-place exp rescale, and the settings are fitted in parallel. Each
+/// setting draws its own seed from \p rng up front, so the results do not
+/// depend on the scheduling of the fits.
+///
+/// \tparam R The type of the random number generator.
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] settings The settings of the hyperparameters.
+/// \param[in,out] rng The random number generator.
+/// \param[in] options The options. The kernel epsilon is ignored in favour of
+///                    that of each setting, and so are the warm start, the
+///                    stats, the monitor and the plan, since the fits run
+///                    concurrently. The memory budget and the automatic plan
+///                    apply to the diffusion matrix of each setting.
+/// \return The result of each setting, in the same order as \p settings.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1.
+/// \exception std::invalid_argument If the kernel parameter of a setting is not
+///                                  positive or its kernel epsilon is not in
+///                                  (0, 1).
+/// \exception std::invalid_argument If self-tuning bandwidths, a reordering or
+///                                  a reduced kernel precision is requested,
+///                                  since the sweep always derives plain
+///                                  squared-Euclidean Gaussian kernels from
+///                                  distances in double precision.
+///
+/// If the fits of several settings fail, the failure of the first of them in
+/// the order of \p settings is rethrown, whatever the scheduling.
+template <typename R>
+std::vector<SweepResult> sweep(const Matrix &data, std::size_t n_components,
+                               const std::vector<SweepSetting> &settings,
+                               R &rng, const Options &options = Options()) {
+  std::uniform_int_distribution<std::uint_fast32_t> dist;
+  std::vector<std::uint_fast32_t> seeds(settings.size());
+  for (auto &seed : seeds) {
+    seed = dist(rng);
+  }
+  return internal::sweep(data, n_components, settings, options, seeds);
+}
+
+} // namespace diffusion_maps
+
+#endif
@@ -12,6 +12,9 @@
 #include <memory>
 #include <stdexcept>
 
+#include "diffusion_maps/allocation.hpp"
+#include "diffusion_maps/internal/reduction.hpp"
+
 namespace diffusion_maps {
 
 /// Vector.
@@ -28,11 +31,10 @@ public:
   /// Constructs a vector of size 0.
   Vector() : _size(0), _data(nullptr) {}
 
-  /// \brief Constructs a vector of size \p size.
+  /// \brief Constructs a vector of size \p size with each element set to 0.
   ///
   /// \param[in] size The size of the vector.
-  Vector(const std::size_t size)
-      : _size(size), _data(std::make_unique<double[]>(_size)) {}
+  Vector(const std::size_t size) : Vector(size, 0) {}
 
   /// \brief Constructs a vector of size \p size with each element set to
   ///        \p value.
@@ -40,15 +42,15 @@ public:
   /// \param[in] size The size of the vector.
   /// \param[in] value The value of each element.
   Vector(const std::size_t size, const double value)
-      : _size(size), _data(std::make_unique<double[]>(_size)) {
-    std::fill_n(_data.get(), _size, value);
+      : _size(size), _data(internal::allocate_array<double>(_size)) {
+    internal::fill_array(_data.get(), _size, value);
   }
 
   /// \brief Constructs a vector from an initializer list.
   ///
   /// \param[in] list The initializer list.
   Vector(const std::initializer_list<double> list)
-      : _size(list.size()), _data(std::make_unique<double[]>(_size)) {
+      : _size(list.size()), _data(internal::allocate_array<double>(_size)) {
     std::copy(list.begin(), list.end(), _data.get());
   }
 
@@ -56,8 +58,8 @@ public:
   ///
   /// \param[in] other The vector to copy.
   Vector(const Vector &other)
-      : _size(other._size), _data(std::make_unique<double[]>(_size)) {
-    std::copy_n(other._data.get(), _size, _data.get());
+      : _size(other._size), _data(internal::allocate_array<double>(_size)) {
+    internal::copy_array(other._data.get(), _size, _data.get());
   }
 
   /// \brief Move constructor. The moved-from vector is set to a 0-sized vector.
@@ -84,8 +86,8 @@ public:
       return *this;
 
     _size = other._size;
-    _data = std::make_unique<double[]>(_size);
-    std::copy_n(other._data.get(), _size, _data.get());
+    _data = internal::allocate_array<double>(_size);
+    internal::copy_array(other._data.get(), _size, _data.get());
 
     return *this;
   }
@@ -271,6 +273,9 @@ public:
 
   /// \brief Dot product.
   ///
+  /// Computed in parallel, with a result that does not depend on the number
+  /// of threads, see internal::deterministic_sum().
+  ///
   /// \param[in] other The vector to dot with.
   /// \return The dot product of the vectors.
   /// \exception std::invalid_argument If the vectors are not of the same size.
@@ -278,11 +283,9 @@ public:
     if (_size != other._size)
       throw std::invalid_argument("vector sizes are not equal");
 
-    double result = 0;
-    for (std::size_t i = 0; i < _size; ++i)
-      result += _data[i] * other._data[i];
-
-    return result;
+    const double *const x = _data.get(), *const y = other._data.get();
+    return internal::deterministic_sum(
+        _size, [x, y](const std::size_t i) { return x[i] * y[i]; });
   }
 
   /// The squared 2-norm (Euclidean norm) of the vector.
@@ -301,6 +304,18 @@ public:
                    [](double x) { return 1.0 / std::sqrt(x); });
     return result;
   }
+
+  /// \brief Returns a vector where each element is the corresponding element
+  ///        of this vector to the power of \p exponent.
+  ///
+  /// \param[in] exponent The exponent.
+  /// \return The power of the vector.
+  Vector pow(const double exponent) const {
+    Vector result(_size);
+    std::transform(_data.get(), _data.get() + _size, result._data.get(),
+                   [exponent](double x) { return std::pow(x, exponent); });
+    return result;
+  }
 };
 
 } // namespace diffusion_maps
@@ -0,0 +1,90 @@
+/// \file
+///
+/// \brief Warm-starting the eigendecomposition solver across fits.
+
+#ifndef DIFFUSION_MAPS_WARM_START_HPP
+#define DIFFUSION_MAPS_WARM_START_HPP
+
+#include <cstddef>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include "diffusion_maps/vector.hpp"
+
+namespace diffusion_maps {
+
+/// \brief State carried from one fit to the next so that the
+///        eigendecomposition solver can start from the previous eigenvectors.
+///
+/// Pass the same object to every fit of a sequence of refits on slowly
+/// drifting data. The first fit starts from random vectors and records how many
+/// iterations it took. Each later fit starts from the eigenvectors of the
+/// previous one and records how many iterations that saved. If the data points
+/// change between fits, call remap() before the next fit.
+class WarmStart {
+public:
+  /// \brief The eigenvectors of the symmetrised diffusion matrix found by the
+  ///        last fit, including the trivial first one. They are used as the
+  ///        initial guesses of the next fit.
+  std::vector<Vector> eigenvectors;
+  /// The number of iterations each eigenpair took in the last fit.
+  std::vector<unsigned> n_iters;
+  /// \brief The number of iterations each eigenpair took in the last fit that
+  ///        was not warm-started.
+  std::vector<unsigned> cold_n_iters;
+
+  /// Whether the next fit will start from random vectors.
+  bool empty() const { return eigenvectors.empty(); }
+
+  /// Forgets everything, so that the next fit starts from random vectors.
+  void reset() {
+    eigenvectors.clear();
+    n_iters.clear();
+    cold_n_iters.clear();
+  }
+
+  /// \brief Maps the eigenvectors onto a new set of data points.
+  ///
+  /// \param[in] prev_ixs For each data point of the next fit, the index of the
+  ///                     same point in the last fit, or nullopt if the point is
+  ///                     new. The guesses are padded with zero for new points.
+  /// \exception std::out_of_range If an index is out of range. The
+  ///                              eigenvectors are then left unchanged.
+  void remap(const std::vector<std::optional<std::size_t>> &prev_ixs) {
+    // Check every index before changing anything.
+    for (const Vector &eigenvector : eigenvectors) {
+      for (const std::optional<std::size_t> &prev_ix : prev_ixs) {
+        if (prev_ix && *prev_ix >= eigenvector.size())
+          throw std::out_of_range("index out of range");
+      }
+    }
+
+    for (Vector &eigenvector : eigenvectors) {
+      Vector remapped(prev_ixs.size());
+      for (std::size_t i = 0; i < prev_ixs.size(); ++i) {
+        if (prev_ixs[i]) {
+          remapped[i] = eigenvector[*prev_ixs[i]];
+        }
+      }
+      eigenvector = std::move(remapped);
+    }
+  }
+
+  /// \brief The number of iterations the last fit saved compared with the last
+  ///        fit that was not warm-started.
+  ///
+  /// Only the eigenpairs found by both fits are counted. The result may be
+  /// negative if warm-starting did not pay off.
+  long long n_iters_saved() const {
+    const std::size_t n = std::min(n_iters.size(), cold_n_iters.size());
+    return std::accumulate(cold_n_iters.begin(), cold_n_iters.begin() + n,
+                           0LL) -
+           std::accumulate(n_iters.begin(), n_iters.begin() + n, 0LL);
+  }
+};
+
+} // namespace diffusion_maps
+
+#endif
@@ -18,7 +18,17 @@ BUILD_DIR = build/$(PROFILE)
 
 all: $(BUILD_DIR)/libdiffusion_maps.a
 
-$(BUILD_DIR)/libdiffusion_maps.a: $(BUILD_DIR)/diffusion_maps.o $(BUILD_DIR)/eig_solver.o
+$(BUILD_DIR)/libdiffusion_maps.a: $(BUILD_DIR)/diffusion_maps.o $(BUILD_DIR)/eig_solver.o \
+                                  $(BUILD_DIR)/kernel_matrix.o \
+                                  $(BUILD_DIR)/reordering.o \
+                                  $(BUILD_DIR)/sell_matrix.o \
+                                  $(BUILD_DIR)/decomposition.o \
+                                  $(BUILD_DIR)/kernel_graph.o \
+                                  $(BUILD_DIR)/sweep.o \
+                                  $(BUILD_DIR)/batch.o \
+                                  $(BUILD_DIR)/compressed_matrix.o \
+                                  $(BUILD_DIR)/plan.o \
+                                  $(BUILD_DIR)/dense_eig_solver.o
 	$(AR) $(ARFLAGS) $@ $^
 
 $(BUILD_DIR)/%.o: src/%.cpp | $(BUILD_DIR)
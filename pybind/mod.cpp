@@ -1,15 +1,30 @@
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <random>
 #include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "pybind11/numpy.h"
 #include "pybind11/pybind11.h"
 #include "pybind11/stl.h"
 
+#include "diffusion_maps/batch.hpp"
+#include "diffusion_maps/decomposition.hpp"
 #include "diffusion_maps/diffusion_maps.hpp"
 #include "diffusion_maps/kernel.hpp"
 #include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/monitor.hpp"
+#include "diffusion_maps/plan.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/stats.hpp"
+#include "diffusion_maps/sweep.hpp"
 #include "diffusion_maps/vector.hpp"
+#include "diffusion_maps/warm_start.hpp"
 
 namespace py = pybind11;
 using namespace pybind11::literals;
@@ -25,37 +40,118 @@ public:
 class GaussianKernel : public KernelBase {
 public:
   double gamma;
+  std::string metric;
+  std::vector<double> scale;
 
-  GaussianKernel(double gamma) : gamma(gamma) {}
+  GaussianKernel(double gamma, std::string metric = "euclidean",
+                 std::vector<double> scale = {})
+      : gamma(gamma), metric(std::move(metric)), scale(std::move(scale)) {}
   virtual ~GaussianKernel() override = default;
   virtual std::function<double(const diffusion_maps::Vector &,
                                const diffusion_maps::Vector &)>
   translate() const override {
-    return diffusion_maps::kernel::Gaussian(gamma);
+    return visit(
+        [](const auto &kernel)
+            -> std::function<double(const diffusion_maps::Vector &,
+                                    const diffusion_maps::Vector &)> {
+          return kernel;
+        });
   };
+
+  // Calls f with the kernel of the metric.
+  template <typename F> auto visit(F &&f) const {
+    namespace metric_ns = diffusion_maps::metric;
+    using diffusion_maps::kernel::MetricGaussian;
+
+    if (metric == "euclidean") {
+      return f(diffusion_maps::kernel::Gaussian(gamma));
+    } else if (metric == "cosine") {
+      return f(MetricGaussian<metric_ns::Cosine>(gamma));
+    } else if (metric == "l1") {
+      return f(MetricGaussian<metric_ns::L1>(gamma));
+    } else if (metric == "mahalanobis") {
+      diffusion_maps::Vector scale_vector(scale.size());
+      std::copy(scale.begin(), scale.end(), scale_vector.data());
+      return f(MetricGaussian<metric_ns::DiagonalMahalanobis>(
+          gamma, metric_ns::DiagonalMahalanobis(scale_vector)));
+    }
+    throw std::invalid_argument("unknown metric: " + metric);
+  }
 };
 
-static py::array_t<double>
-_diffusion_maps(const py::array_t<double> data, const std::size_t n_components,
-                const KernelBase &kernel, const double diffusion_time,
-                const std::optional<std::size_t> rng_seed,
-                const double kernel_epsilon, const double eig_solver_tol,
-                const unsigned eig_solver_max_iter) {
+static diffusion_maps::Matrix to_matrix(const py::array_t<double> &data) {
   const auto info = data.request();
   if (info.ndim != 2) {
     throw std::runtime_error("data must be a 2D array");
   }
 
-  const diffusion_maps::Matrix data_matrix(
+  return diffusion_maps::Matrix(
       reinterpret_cast<double *>(info.ptr), info.shape[0], info.shape[1],
       info.strides[0] / sizeof(double), info.strides[1] / sizeof(double));
+}
 
-  std::default_random_engine rng(rng_seed ? *rng_seed : std::random_device()());
+using CsrValues =
+    py::array_t<double, py::array::c_style | py::array::forcecast>;
+using CsrIndices =
+    py::array_t<std::int64_t, py::array::c_style | py::array::forcecast>;
+
+// Wraps the arrays of a scipy.sparse CSR matrix without copying them, if they
+// already have these types.
+static diffusion_maps::SparseMatrix
+to_sparse_matrix(const std::size_t n_rows, const std::size_t n_cols,
+                 const CsrValues &data, const CsrIndices &indices,
+                 const CsrIndices &indptr) {
+  if (indptr.size() != static_cast<py::ssize_t>(n_rows + 1) ||
+      indices.size() != data.size()) {
+    throw std::invalid_argument("invalid CSR arrays");
+  }
+
+  // scipy.sparse does not check the indices by default, and the kernel reads
+  // and writes through them, so check them here.
+  const std::int64_t *const row_ptr = indptr.data();
+  const std::int64_t *const col_ixs = indices.data();
+  const std::int64_t n_nz = data.size();
+  if (row_ptr[0] != 0 || row_ptr[n_rows] != n_nz) {
+    throw std::invalid_argument(
+        "CSR index pointers must run from 0 to the number of elements");
+  }
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    if (row_ptr[i + 1] < row_ptr[i]) {
+      throw std::invalid_argument("CSR index pointers must be non-decreasing");
+    }
+  }
+  for (std::int64_t ir = 0; ir < n_nz; ++ir) {
+    if (col_ixs[ir] < 0 || static_cast<std::uint64_t>(col_ixs[ir]) >= n_cols) {
+      throw std::invalid_argument("CSR column index out of range");
+    }
+  }
+
+  // The sparse kernels merge rows by their column indices, so they must be
+  // sorted and unique within each row.
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    for (std::int64_t ir = row_ptr[i] + 1; ir < row_ptr[i + 1]; ++ir) {
+      if (col_ixs[ir] <= col_ixs[ir - 1]) {
+        throw std::invalid_argument(
+            "CSR column indices must be sorted and unique within each row");
+      }
+    }
+  }
+
+  // The arrays are only read. std::int64_t and std::size_t have the same size
+  // on the supported platforms.
+  static_assert(sizeof(std::int64_t) == sizeof(std::size_t));
+  const auto ixs = [](const CsrIndices &array) {
+    return reinterpret_cast<std::size_t *>(
+        const_cast<std::int64_t *>(array.data()));
+  };
+  return diffusion_maps::SparseMatrix(n_rows, n_cols,
+                                      const_cast<double *>(data.data()),
+                                      ixs(indices), ixs(indptr));
+}
 
+static py::array_t<double> to_array(diffusion_maps::Matrix &&matrix) {
   diffusion_maps::Matrix *const result =
-      new diffusion_maps::Matrix(diffusion_maps::diffusion_maps(
-          data_matrix, n_components, kernel.translate(), diffusion_time, rng,
-          kernel_epsilon, eig_solver_tol, eig_solver_max_iter));
+      new diffusion_maps::Matrix(std::move(matrix));
 
   return py::array_t<double>({result->n_rows(), result->n_cols()},
                              {result->row_stride() * sizeof(double),
@@ -63,12 +159,369 @@ _diffusion_maps(const py::array_t<double> data, const std::size_t n_components,
                              result->data(), py::cast(result));
 }
 
+static py::array_t<double>
+_diffusion_maps(const py::array_t<double> data, const std::size_t n_components,
+                const KernelBase &kernel, const double diffusion_time,
+                const std::optional<std::size_t> rng_seed,
+                diffusion_maps::Options options,
+                diffusion_maps::WarmStart *const warm_start,
+                diffusion_maps::Stats *const stats) {
+  const diffusion_maps::Matrix data_matrix = to_matrix(data);
+
+  std::default_random_engine rng(rng_seed ? *rng_seed : std::random_device()());
+  options.warm_start = warm_start;
+  options.stats = stats;
+
+  return to_array(diffusion_maps::diffusion_maps(data_matrix, n_components,
+                                                 kernel.translate(),
+                                                 diffusion_time, rng, options));
+}
+
+static diffusion_maps::Decomposition
+_decompose(const py::array_t<double> data, const std::size_t n_components,
+           const KernelBase &kernel, const std::optional<std::size_t> rng_seed,
+           diffusion_maps::Options options,
+           diffusion_maps::WarmStart *const warm_start,
+           diffusion_maps::Stats *const stats) {
+  const diffusion_maps::Matrix data_matrix = to_matrix(data);
+
+  std::default_random_engine rng(rng_seed ? *rng_seed : std::random_device()());
+  options.warm_start = warm_start;
+  options.stats = stats;
+
+  return diffusion_maps::decompose(data_matrix, n_components,
+                                   kernel.translate(), rng, options);
+}
+
+static py::array_t<double> _diffusion_maps_sparse(
+    const std::size_t n_rows, const std::size_t n_cols, const CsrValues data,
+    const CsrIndices indices, const CsrIndices indptr,
+    const std::size_t n_components, const GaussianKernel &kernel,
+    const double diffusion_time, const std::optional<std::size_t> rng_seed,
+    diffusion_maps::Options options,
+    diffusion_maps::WarmStart *const warm_start,
+    diffusion_maps::Stats *const stats) {
+  const diffusion_maps::SparseMatrix data_matrix =
+      to_sparse_matrix(n_rows, n_cols, data, indices, indptr);
+
+  std::default_random_engine rng(rng_seed ? *rng_seed : std::random_device()());
+  options.warm_start = warm_start;
+  options.stats = stats;
+
+  return to_array(kernel.visit([&](const auto &k) {
+    return diffusion_maps::diffusion_maps(data_matrix, n_components, k,
+                                          diffusion_time, rng, options);
+  }));
+}
+
+static diffusion_maps::Decomposition _decompose_sparse(
+    const std::size_t n_rows, const std::size_t n_cols, const CsrValues data,
+    const CsrIndices indices, const CsrIndices indptr,
+    const std::size_t n_components, const GaussianKernel &kernel,
+    const std::optional<std::size_t> rng_seed, diffusion_maps::Options options,
+    diffusion_maps::WarmStart *const warm_start,
+    diffusion_maps::Stats *const stats) {
+  const diffusion_maps::SparseMatrix data_matrix =
+      to_sparse_matrix(n_rows, n_cols, data, indices, indptr);
+
+  std::default_random_engine rng(rng_seed ? *rng_seed : std::random_device()());
+  options.warm_start = warm_start;
+  options.stats = stats;
+
+  return kernel.visit([&](const auto &k) {
+    return diffusion_maps::decompose(data_matrix, n_components, k, rng,
+                                     options);
+  });
+}
+
+// A fit running on another thread, for polling from Python. The arguments are
+// kept alive until the fit is destroyed, and the latest progress report is
+// kept for progress(). The fit writes to private copies of the warm start and
+// the stats, which are copied into the Python objects when result() returns,
+// so that Python never reads them while the fit writes them.
+class AsyncFitHandle {
+public:
+  py::object data, warm_start, stats;
+  std::optional<diffusion_maps::Matrix> data_matrix;
+  std::optional<diffusion_maps::WarmStart> fit_warm_start;
+  std::optional<diffusion_maps::Stats> fit_stats;
+  std::shared_ptr<std::mutex> mutex = std::make_shared<std::mutex>();
+  std::shared_ptr<diffusion_maps::Progress> progress =
+      std::make_shared<diffusion_maps::Progress>();
+  // Declared last, so that the fit stops before its arguments are released.
+  std::optional<diffusion_maps::AsyncFit<diffusion_maps::Matrix>> fit;
+
+  bool done() const { return !fit || fit->ready(); }
+
+  void cancel() {
+    if (fit) {
+      fit->cancel();
+    }
+  }
+
+  py::dict latest_progress() const {
+    const std::lock_guard<std::mutex> lock(*mutex);
+    return py::dict("stage"_a = progress->stage,
+                    "eigenpair"_a = progress->eigenpair,
+                    "iteration"_a = progress->iteration,
+                    "error"_a = progress->error);
+  }
+
+  py::array_t<double> result() {
+    if (!fit) {
+      throw std::runtime_error("the result was already retrieved");
+    }
+    {
+      py::gil_scoped_release release;
+      fit->wait();
+    }
+    diffusion_maps::AsyncFit<diffusion_maps::Matrix> finished =
+        std::move(*fit);
+    fit.reset();
+    py::array_t<double> embedding = to_array(finished.get());
+
+    // The fit is finished, so its copies can be read.
+    if (fit_warm_start) {
+      *warm_start.cast<diffusion_maps::WarmStart *>() =
+          std::move(*fit_warm_start);
+    }
+    if (fit_stats) {
+      *stats.cast<diffusion_maps::Stats *>() = std::move(*fit_stats);
+    }
+    return embedding;
+  }
+};
+
+static std::unique_ptr<AsyncFitHandle> _diffusion_maps_async(
+    const py::array_t<double> data, const std::size_t n_components,
+    const KernelBase &kernel, const double diffusion_time,
+    const std::optional<std::size_t> rng_seed,
+    diffusion_maps::Options options, const py::object warm_start,
+    const py::object stats) {
+  auto handle = std::make_unique<AsyncFitHandle>();
+  handle->data = data;
+  handle->warm_start = warm_start;
+  handle->stats = stats;
+  handle->data_matrix.emplace(to_matrix(data));
+  if (!warm_start.is_none()) {
+    options.warm_start = &handle->fit_warm_start.emplace(
+        *warm_start.cast<diffusion_maps::WarmStart *>());
+  }
+  if (!stats.is_none()) {
+    options.stats = &handle->fit_stats.emplace(
+        *stats.cast<diffusion_maps::Stats *>());
+  }
+
+  const auto on_progress = [mutex = handle->mutex, progress = handle->progress](
+                               const diffusion_maps::Progress &p) {
+    const std::lock_guard<std::mutex> lock(*mutex);
+    *progress = p;
+  };
+  handle->fit.emplace(diffusion_maps::diffusion_maps_async(
+      *handle->data_matrix, n_components, kernel.translate(), diffusion_time,
+      std::default_random_engine(rng_seed ? *rng_seed
+                                          : std::random_device()()),
+      options, on_progress));
+  return handle;
+}
+
+static std::vector<diffusion_maps::SweepResult>
+_sweep(const py::array_t<double> data, const std::size_t n_components,
+       const std::vector<diffusion_maps::SweepSetting> &settings,
+       const std::optional<std::size_t> rng_seed,
+       const diffusion_maps::Options &options) {
+  const diffusion_maps::Matrix data_matrix = to_matrix(data);
+
+  std::default_random_engine rng(rng_seed ? *rng_seed : std::random_device()());
+
+  return diffusion_maps::sweep(data_matrix, n_components, settings, rng,
+                               options);
+}
+
+static std::vector<py::array_t<double>>
+_diffusion_maps_batch(const std::vector<py::array_t<double>> &datasets,
+                      const std::size_t n_components,
+                      const std::vector<const KernelBase *> &kernels,
+                      const double diffusion_time,
+                      const std::optional<std::size_t> rng_seed,
+                      const diffusion_maps::Options &options) {
+  std::vector<diffusion_maps::Matrix> data_matrices;
+  for (const py::array_t<double> &data : datasets) {
+    data_matrices.push_back(to_matrix(data));
+  }
+  std::vector<diffusion_maps::BatchKernel> batch_kernels;
+  for (const KernelBase *const kernel : kernels) {
+    batch_kernels.push_back(kernel->translate());
+  }
+
+  std::default_random_engine rng(rng_seed ? *rng_seed : std::random_device()());
+
+  // The fits do not call into Python.
+  std::vector<diffusion_maps::Matrix> embeddings;
+  {
+    const py::gil_scoped_release release;
+    embeddings = diffusion_maps::diffusion_maps_batch(
+        data_matrices, n_components, batch_kernels, diffusion_time, rng,
+        options);
+  }
+
+  std::vector<py::array_t<double>> result;
+  for (diffusion_maps::Matrix &embedding : embeddings) {
+    result.push_back(to_array(std::move(embedding)));
+  }
+  return result;
+}
+
+static diffusion_maps::Plan _plan(const py::array_t<double> data,
+                                  const std::size_t n_components,
+                                  const KernelBase &kernel,
+                                  const diffusion_maps::Options &options) {
+  const diffusion_maps::Matrix data_matrix = to_matrix(data);
+
+  return diffusion_maps::plan(data_matrix, n_components, kernel.translate(),
+                              options);
+}
+
 PYBIND11_MODULE(_diffusion_maps, m) {
   m.def("diffusion_maps", &_diffusion_maps);
+  m.def("decompose", &_decompose);
+  m.def("diffusion_maps_sparse", &_diffusion_maps_sparse);
+  m.def("decompose_sparse", &_decompose_sparse);
+  m.def("sweep", &_sweep);
+  m.def("diffusion_maps_async", &_diffusion_maps_async);
+  m.def("diffusion_maps_batch", &_diffusion_maps_batch);
+  m.def("plan", &_plan);
+
+  py::register_exception<diffusion_maps::Cancelled>(m, "Cancelled");
 
   py::class_<diffusion_maps::Matrix>(m, "Matrix");
 
+  py::enum_<diffusion_maps::EigSolver>(m, "EigSolver")
+      .value("POWER_METHOD", diffusion_maps::EigSolver::POWER_METHOD)
+      .value("RANDOMIZED", diffusion_maps::EigSolver::RANDOMIZED)
+      .value("CHEBYSHEV", diffusion_maps::EigSolver::CHEBYSHEV)
+      .value("DENSE", diffusion_maps::EigSolver::DENSE);
+
+  py::enum_<diffusion_maps::Reordering>(m, "Reordering")
+      .value("NONE", diffusion_maps::Reordering::NONE)
+      .value("RCM", diffusion_maps::Reordering::RCM)
+      .value("MORTON", diffusion_maps::Reordering::MORTON);
+
+  py::enum_<diffusion_maps::MatrixFormat>(m, "MatrixFormat")
+      .value("CSR", diffusion_maps::MatrixFormat::CSR)
+      .value("SELL", diffusion_maps::MatrixFormat::SELL)
+      .value("COMPRESSED_FLOAT", diffusion_maps::MatrixFormat::COMPRESSED_FLOAT)
+      .value("COMPRESSED_BFLOAT16",
+             diffusion_maps::MatrixFormat::COMPRESSED_BFLOAT16);
+
+  py::enum_<diffusion_maps::Precision>(m, "Precision")
+      .value("DOUBLE", diffusion_maps::Precision::DOUBLE)
+      .value("FLOAT16", diffusion_maps::Precision::FLOAT16)
+      .value("INT8", diffusion_maps::Precision::INT8);
+
+  py::enum_<diffusion_maps::Stage>(m, "Stage")
+      .value("KERNEL", diffusion_maps::Stage::KERNEL)
+      .value("REORDERING", diffusion_maps::Stage::REORDERING)
+      .value("NORMALISATION", diffusion_maps::Stage::NORMALISATION)
+      .value("EIG_SOLVER", diffusion_maps::Stage::EIG_SOLVER)
+      .value("EMBEDDING", diffusion_maps::Stage::EMBEDDING);
+
+  py::class_<AsyncFitHandle>(m, "AsyncFit")
+      .def("done", &AsyncFitHandle::done)
+      .def("cancel", &AsyncFitHandle::cancel)
+      .def("progress", &AsyncFitHandle::latest_progress)
+      .def("result", &AsyncFitHandle::result);
+
+  py::class_<diffusion_maps::Decomposition>(m, "Decomposition")
+      .def_readonly("eigenvalues", &diffusion_maps::Decomposition::eigenvalues)
+      .def("n_samples", &diffusion_maps::Decomposition::n_samples)
+      .def("n_components", &diffusion_maps::Decomposition::n_components)
+      .def("embed",
+           [](const diffusion_maps::Decomposition &decomposition,
+              const double diffusion_time) {
+             return to_array(decomposition.embed(diffusion_time));
+           });
+
+  py::class_<diffusion_maps::SweepSetting>(m, "SweepSetting")
+      .def(py::init<double, double>())
+      .def_readonly("gamma", &diffusion_maps::SweepSetting::gamma)
+      .def_readonly("kernel_epsilon",
+                    &diffusion_maps::SweepSetting::kernel_epsilon);
+
+  py::class_<diffusion_maps::SweepResult>(m, "SweepResult")
+      .def_readonly("setting", &diffusion_maps::SweepResult::setting)
+      .def_readonly("decomposition",
+                    &diffusion_maps::SweepResult::decomposition)
+      .def_readonly("n_nz", &diffusion_maps::SweepResult::n_nz)
+      .def_readonly("eigengap", &diffusion_maps::SweepResult::eigengap);
+
+  py::class_<diffusion_maps::WarmStart>(m, "WarmStart")
+      .def(py::init<>())
+      .def_readonly("n_iters", &diffusion_maps::WarmStart::n_iters)
+      .def_readonly("cold_n_iters", &diffusion_maps::WarmStart::cold_n_iters)
+      .def("empty", &diffusion_maps::WarmStart::empty)
+      .def("reset", &diffusion_maps::WarmStart::reset)
+      .def("remap", &diffusion_maps::WarmStart::remap)
+      .def("n_iters_saved", &diffusion_maps::WarmStart::n_iters_saved);
+
+  py::class_<diffusion_maps::Stats>(m, "Stats")
+      .def(py::init<>())
+      .def("as_dict", [](const diffusion_maps::Stats &stats) {
+        return py::dict(
+            "kernel_time"_a = stats.kernel_time,
+            "reordering_time"_a = stats.reordering_time,
+            "normalisation_time"_a = stats.normalisation_time,
+            "eig_solver_time"_a = stats.eig_solver_time,
+            "embedding_time"_a = stats.embedding_time,
+            "n_kernel_evals"_a = stats.n_kernel_evals,
+            "n_kernel_evals_skipped"_a = stats.n_kernel_evals_skipped,
+            "n_kernel_evals_exact"_a = stats.n_kernel_evals_exact,
+            "n_nz"_a = stats.n_nz, "peak_bytes"_a = stats.peak_bytes,
+            "n_spmv"_a = stats.n_spmv, "n_iters"_a = stats.n_iters,
+            "residuals"_a = stats.residuals);
+      });
+
+  py::class_<diffusion_maps::Plan>(m, "Plan")
+      .def("__str__", &diffusion_maps::Plan::to_string)
+      .def("as_dict", [](const diffusion_maps::Plan &plan) {
+        return py::dict("n_samples"_a = plan.n_samples,
+                        "n_pairs_sampled"_a = plan.n_pairs_sampled,
+                        "exhaustive"_a = plan.exhaustive,
+                        "density"_a = plan.density, "n_nz"_a = plan.n_nz,
+                        "peak_bytes"_a = plan.peak_bytes,
+                        "kernel_time"_a = plan.kernel_time,
+                        "matrix_format"_a = plan.matrix_format,
+                        "eig_solver"_a = plan.eig_solver);
+      });
+
+  py::class_<diffusion_maps::Options>(m, "Options")
+      .def(py::init<>())
+      .def_readwrite("kernel_epsilon", &diffusion_maps::Options::kernel_epsilon)
+      .def_readwrite("eig_solver", &diffusion_maps::Options::eig_solver)
+      .def_readwrite("eig_solver_tol", &diffusion_maps::Options::eig_solver_tol)
+      .def_readwrite("eig_solver_max_iter",
+                     &diffusion_maps::Options::eig_solver_max_iter)
+      .def_readwrite("randomized_oversampling",
+                     &diffusion_maps::Options::randomized_oversampling)
+      .def_readwrite("randomized_n_power_iters",
+                     &diffusion_maps::Options::randomized_n_power_iters)
+      .def_readwrite("chebyshev_degree",
+                     &diffusion_maps::Options::chebyshev_degree)
+      .def_readwrite("alpha", &diffusion_maps::Options::alpha)
+      .def_readwrite("self_tuning_neighbours",
+                     &diffusion_maps::Options::self_tuning_neighbours)
+      .def_readwrite("reordering", &diffusion_maps::Options::reordering)
+      .def_readwrite("matrix_format", &diffusion_maps::Options::matrix_format)
+      .def_readwrite("kernel_precision",
+                     &diffusion_maps::Options::kernel_precision)
+      .def_readwrite("memory_budget", &diffusion_maps::Options::memory_budget)
+      .def_readwrite("auto_plan", &diffusion_maps::Options::auto_plan)
+      .def_readwrite("plan_n_pairs", &diffusion_maps::Options::plan_n_pairs);
+
   auto k = m.def_submodule("kernel");
   py::class_<KernelBase>(k, "KernelBase");
-  py::class_<GaussianKernel, KernelBase>(k, "Gaussian").def(py::init<double>());
+  py::class_<GaussianKernel, KernelBase>(k, "Gaussian")
+      .def(py::init<double>())
+      .def(py::init<double, std::string, std::vector<double>>(), "gamma"_a,
+           "metric"_a, "scale"_a = std::vector<double>());
 }
@@ -0,0 +1,122 @@
+#include "diffusion_maps/batch.hpp"
+
+#include <algorithm>
+#include <exception>
+#include <numeric>
+#include <stdexcept>
+
+#ifdef PAR
+#include <omp.h>
+#endif
+
+/// \brief Runs a fit on each dataset of a batch, one whole fit per thread.
+///
+/// \tparam T The type of the result of a fit.
+/// \tparam Fit The type of the fit function.
+/// \param[in] datasets The data matrices.
+/// \param[in] kernels The kernel function of each dataset, or a single kernel
+///                    function for all of them.
+/// \param[in] options The options.
+/// \param[in] seeds The seed of each dataset.
+/// \param[in] fit The function that fits a dataset, called with the data
+///                matrix, the kernel function, the options and the random
+///                number generator.
+/// \return The result of each dataset.
+/// \exception std::invalid_argument If the number of kernel functions is
+///                                  neither 1 nor the number of datasets.
+template <typename T, typename Fit>
+static std::vector<T>
+run_batch(const std::vector<diffusion_maps::Matrix> &datasets,
+          const std::vector<diffusion_maps::BatchKernel> &kernels,
+          const diffusion_maps::Options &options,
+          const std::vector<std::uint_fast32_t> &seeds, const Fit &fit) {
+  const std::size_t n_datasets = datasets.size();
+  if (kernels.size() != 1 && kernels.size() != n_datasets) {
+    throw std::invalid_argument(
+        "there must be one kernel or one kernel per dataset");
+  }
+
+  diffusion_maps::Options fit_options = options;
+  fit_options.warm_start = nullptr;
+  fit_options.stats = nullptr;
+  fit_options.monitor = nullptr;
+  fit_options.plan = nullptr;
+
+  // Fit the largest datasets first, so that the threads finish together.
+
+  std::vector<std::size_t> order(n_datasets);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&datasets](const std::size_t i, const std::size_t j) {
+                     return datasets[i].n_rows() > datasets[j].n_rows();
+                   });
+
+  std::vector<T> results(n_datasets);
+  std::vector<std::exception_ptr> exceptions(n_datasets);
+
+#ifdef PAR
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (std::size_t k = 0; k < n_datasets; ++k) {
+    // Run the parallel regions of the fit on this thread only, even if nested
+    // parallelism is enabled.
+#ifdef PAR
+    omp_set_num_threads(1);
+#endif
+    const std::size_t i = order[k];
+    try {
+      std::default_random_engine engine(seeds[i]);
+      const diffusion_maps::BatchKernel &kernel =
+          kernels.size() == 1 ? kernels[0] : kernels[i];
+      results[i] = fit(datasets[i], kernel, fit_options, engine);
+    } catch (...) {
+      exceptions[i] = std::current_exception();
+    }
+  }
+
+  // Report the failure of the first dataset, whatever the scheduling.
+
+  for (const std::exception_ptr &exception : exceptions) {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  return results;
+}
+
+std::vector<diffusion_maps::Decomposition>
+diffusion_maps::internal::decompose_batch(
+    const std::vector<Matrix> &datasets, const std::size_t n_components,
+    const std::vector<BatchKernel> &kernels, const Options &options,
+    const std::vector<std::uint_fast32_t> &seeds) {
+  return run_batch<Decomposition>(
+      datasets, kernels, options, seeds,
+      [n_components](const Matrix &data, const BatchKernel &kernel,
+                     const Options &fit_options,
+                     std::default_random_engine &engine) {
+        return diffusion_maps::decompose(data, n_components, kernel, engine,
+                                         fit_options);
+      });
+}
+
+std::vector<diffusion_maps::Matrix>
+diffusion_maps::internal::diffusion_maps_batch(
+    const std::vector<Matrix> &datasets, const std::size_t n_components,
+    const std::vector<BatchKernel> &kernels, const double diffusion_time,
+    const Options &options, const std::vector<std::uint_fast32_t> &seeds) {
+  if (diffusion_time < 0) {
+    throw std::invalid_argument("diffusion time must be non-negative");
+  }
+
+  return run_batch<Matrix>(
+      datasets, kernels, options, seeds,
+      [n_components, diffusion_time](const Matrix &data,
+                                     const BatchKernel &kernel,
+                                     const Options &fit_options,
+                                     std::default_random_engine &engine) {
+        return diffusion_maps::diffusion_maps(data, n_components, kernel,
+                                              diffusion_time, engine,
+                                              fit_options);
+      });
+}
@@ -0,0 +1,258 @@
+#include "diffusion_maps/compressed_matrix.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "diffusion_maps/allocation.hpp"
+
+/// \brief The number of words of an encoded gap between column indices.
+///
+/// \param[in] gap The gap.
+/// \return The number of words.
+static std::size_t count_gap_words(std::size_t gap) {
+  std::size_t n_words = 1;
+  while (gap >> diffusion_maps::CompressedMatrix::GAP_DIGIT_BITS) {
+    gap >>= diffusion_maps::CompressedMatrix::GAP_DIGIT_BITS;
+    ++n_words;
+  }
+  return n_words;
+}
+
+/// \brief Encodes a gap between column indices.
+///
+/// \param[in] gap The gap.
+/// \param[in,out] words The position at which to write the words, advanced
+///                      past them.
+static void write_gap(const std::size_t gap, std::uint16_t *&words) {
+  using diffusion_maps::CompressedMatrix;
+  constexpr std::size_t digit_mask = CompressedMatrix::ESCAPE - 1;
+
+  const std::size_t n_words = count_gap_words(gap);
+  for (std::size_t w = n_words; w-- > 0;) {
+    const std::size_t digit =
+        (gap >> (w * CompressedMatrix::GAP_DIGIT_BITS)) & digit_mask;
+    *words++ = static_cast<std::uint16_t>(
+        w > 0 ? digit | CompressedMatrix::ESCAPE : digit);
+  }
+}
+
+/// \brief Decodes a gap between column indices.
+///
+/// \param[in,out] words The position of the words of the gap, advanced past
+///                      them.
+/// \return The gap.
+static inline std::size_t read_gap(const std::uint16_t *&words) {
+  using diffusion_maps::CompressedMatrix;
+
+  std::uint16_t word = *words++;
+  std::size_t gap = 0;
+  while (word & CompressedMatrix::ESCAPE) {
+    gap = (gap << CompressedMatrix::GAP_DIGIT_BITS) |
+          (word & (CompressedMatrix::ESCAPE - 1));
+    word = *words++;
+  }
+  return (gap << CompressedMatrix::GAP_DIGIT_BITS) | word;
+}
+
+/// \brief Calls a function with the index and the column index of each
+///        element of a row, in order.
+///
+/// \param[in] start The index of the first element of the row.
+/// \param[in] stop The index past the last element of the row.
+/// \param[in] first_col The column index of the first element.
+/// \param[in] words The encoded gaps of the row.
+/// \param[in] f The function.
+template <typename F>
+static inline void for_each_in_row(const std::size_t start,
+                                   const std::size_t stop,
+                                   const std::size_t first_col,
+                                   const std::uint16_t *words, const F &f) {
+  if (start == stop) {
+    return;
+  }
+  std::size_t col = first_col;
+  f(start, col);
+  for (std::size_t ir = start + 1; ir < stop; ++ir) {
+    col += read_gap(words);
+    f(ir, col);
+  }
+}
+
+diffusion_maps::CompressedMatrix::CompressedMatrix(
+    const SparseMatrix &a, const ValuePrecision precision)
+    : _n_rows(a.n_rows()), _n_cols(a.n_cols()), _precision(precision),
+      _row_ixs(a.row_ixs(), a.row_ixs() + a.n_rows() + 1),
+      _first_cols(a.n_rows()), _gap_ixs(a.n_rows() + 1) {
+  const std::size_t *const row_ixs = a.row_ixs();
+  const std::size_t *const col_ixs = a.col_ixs();
+  const std::size_t n_nz = a.n_nz();
+
+  // Count the gap words of each row, then encode the rows in parallel.
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t i = 0; i < _n_rows; ++i) {
+    std::size_t n_words = 0;
+    for (std::size_t ir = row_ixs[i] + 1; ir < row_ixs[i + 1]; ++ir) {
+      n_words += count_gap_words(col_ixs[ir] - col_ixs[ir - 1]);
+    }
+    _gap_ixs[i + 1] = n_words;
+    _first_cols[i] = row_ixs[i] < row_ixs[i + 1] ? col_ixs[row_ixs[i]] : 0;
+  }
+  _gap_ixs[0] = 0;
+  for (std::size_t i = 0; i < _n_rows; ++i) {
+    _gap_ixs[i + 1] += _gap_ixs[i];
+  }
+
+  _gaps.resize(_gap_ixs[_n_rows]);
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t i = 0; i < _n_rows; ++i) {
+    std::uint16_t *words = _gaps.data() + _gap_ixs[i];
+    for (std::size_t ir = row_ixs[i] + 1; ir < row_ixs[i + 1]; ++ir) {
+      write_gap(col_ixs[ir] - col_ixs[ir - 1], words);
+    }
+  }
+
+  const double *const data = a.data();
+  switch (precision) {
+  case ValuePrecision::DOUBLE:
+    _double_data.assign(data, data + n_nz);
+    break;
+  case ValuePrecision::FLOAT:
+    _float_data.resize(n_nz);
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t ir = 0; ir < n_nz; ++ir) {
+      _float_data[ir] = static_cast<float>(data[ir]);
+    }
+    break;
+  case ValuePrecision::BFLOAT16:
+    _bfloat16_data.resize(n_nz);
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t ir = 0; ir < n_nz; ++ir) {
+      _bfloat16_data[ir] = internal::to_bfloat16(data[ir]);
+    }
+    break;
+  }
+}
+
+template <typename F>
+void diffusion_maps::CompressedMatrix::visit_values(const F &f) const {
+  switch (_precision) {
+  case ValuePrecision::DOUBLE:
+    f([data = _double_data.data()](const std::size_t ir) { return data[ir]; });
+    break;
+  case ValuePrecision::FLOAT:
+    f([data = _float_data.data()](const std::size_t ir) {
+      return static_cast<double>(data[ir]);
+    });
+    break;
+  case ValuePrecision::BFLOAT16:
+    f([data = _bfloat16_data.data()](const std::size_t ir) {
+      return static_cast<double>(internal::from_bfloat16(data[ir]));
+    });
+    break;
+  }
+}
+
+diffusion_maps::SparseMatrix
+diffusion_maps::CompressedMatrix::decompress() const {
+  const std::size_t n_nz = this->n_nz();
+  auto data = internal::allocate_array<double>(n_nz);
+  auto col_ixs = internal::allocate_array<std::size_t>(n_nz);
+  auto row_ixs = internal::allocate_array<std::size_t>(_n_rows + 1);
+  std::copy(_row_ixs.begin(), _row_ixs.end(), row_ixs.get());
+
+  // Write the rows into the arrays, by rows with the allocation policy.
+
+  [[maybe_unused]] const bool parallel = internal::first_touch_in_parallel(
+      n_nz * (sizeof(double) + sizeof(std::size_t)));
+  visit_values([&](const auto &value) {
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+    for (std::size_t i = 0; i < _n_rows; ++i) {
+      for_each_in_row(_row_ixs[i], _row_ixs[i + 1], _first_cols[i],
+                      _gaps.data() + _gap_ixs[i],
+                      [&](const std::size_t ir, const std::size_t col) {
+                        data[ir] = value(ir);
+                        col_ixs[ir] = col;
+                      });
+    }
+  });
+
+  return SparseMatrix(_n_rows, _n_cols, std::move(data), std::move(col_ixs),
+                      std::move(row_ixs));
+}
+
+diffusion_maps::Vector
+diffusion_maps::CompressedMatrix::operator*(const Vector &v) const {
+  Vector result(_n_rows);
+  multiply(v, result);
+  return result;
+}
+
+void diffusion_maps::CompressedMatrix::multiply(const Vector &v,
+                                                Vector &result) const {
+  if (_n_cols != v.size() || _n_rows != result.size())
+    throw std::invalid_argument("incompatible dimensions");
+
+  const double *const x = v.data();
+  double *const y = result.data();
+  const std::size_t *const row_ixs = _row_ixs.data();
+  const std::size_t *const first_cols = _first_cols.data();
+  const std::size_t *const gap_ixs = _gap_ixs.data();
+  const std::uint16_t *const gaps = _gaps.data();
+  const std::size_t n_rows = _n_rows;
+
+  visit_values([=](const auto &value) {
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < n_rows; ++i) {
+      double sum = 0;
+      for_each_in_row(row_ixs[i], row_ixs[i + 1], first_cols[i],
+                      gaps + gap_ixs[i],
+                      [&](const std::size_t ir, const std::size_t col) {
+                        sum += value(ir) * x[col];
+                      });
+      y[i] = sum;
+    }
+  });
+}
+
+diffusion_maps::Matrix
+diffusion_maps::CompressedMatrix::operator*(const Matrix &m) const {
+  if (_n_cols != m.n_rows())
+    throw std::invalid_argument("incompatible dimensions");
+
+  const std::size_t n_cols = m.n_cols();
+  Matrix result(_n_rows, n_cols);
+
+  visit_values([&](const auto &value) {
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < _n_rows; ++i) {
+      for (std::size_t k = 0; k < n_cols; ++k) {
+        result(i, k) = 0;
+      }
+      for_each_in_row(_row_ixs[i], _row_ixs[i + 1], _first_cols[i],
+                      _gaps.data() + _gap_ixs[i],
+                      [&](const std::size_t ir, const std::size_t col) {
+                        const double a_ij = value(ir);
+                        for (std::size_t k = 0; k < n_cols; ++k) {
+                          result(i, k) += a_ij * m(col, k);
+                        }
+                      });
+    }
+  });
+
+  return result;
+}
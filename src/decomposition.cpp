@@ -0,0 +1,52 @@
+#include "diffusion_maps/decomposition.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+diffusion_maps::Matrix
+diffusion_maps::Decomposition::embed(const double diffusion_time) const {
+  if (diffusion_time < 0) {
+    throw std::invalid_argument("diffusion time must be non-negative");
+  }
+
+  const std::size_t n_samples = this->n_samples();
+  const std::size_t n_components = this->n_components();
+  Matrix diffusion_maps(n_samples, n_components);
+
+  // We drop the first eigenpair because the eigenvector is constant in all
+  // dimensions.
+
+  std::vector<double> scales(n_components);
+  for (std::size_t j = 0; j < n_components; ++j) {
+    scales[j] = std::pow(eigenvalues[j + 1], diffusion_time);
+  }
+
+  // The eigenvectors may be stored in any layout, so they are read through
+  // the element accessor.
+
+  for (std::size_t j = 0; j < n_components; ++j) {
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      const double psi_i = invsqrt_row_sum[i] * eigenvectors(i, j + 1);
+      diffusion_maps(i, j) = scales[j] * psi_i;
+    }
+  }
+
+  return diffusion_maps;
+}
+
+std::vector<diffusion_maps::Matrix> diffusion_maps::Decomposition::embed(
+    const std::vector<double> &diffusion_times) const {
+  for (const double diffusion_time : diffusion_times) {
+    if (diffusion_time < 0) {
+      throw std::invalid_argument("diffusion time must be non-negative");
+    }
+  }
+
+  std::vector<Matrix> result;
+  result.reserve(diffusion_times.size());
+  for (const double diffusion_time : diffusion_times) {
+    result.push_back(embed(diffusion_time));
+  }
+
+  return result;
+}
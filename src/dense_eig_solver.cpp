@@ -0,0 +1,464 @@
+#include "diffusion_maps/internal/dense_eig_solver.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <stdexcept>
+
+#include "diffusion_maps/internal/reduction.hpp"
+
+/// \brief Checks that a matrix is square, row-major and contiguous.
+///
+/// \param[in] a The matrix.
+/// \exception std::invalid_argument If it is not.
+static void check_dense_matrix(const diffusion_maps::Matrix &a) {
+  if (a.n_rows() != a.n_cols()) {
+    throw std::invalid_argument("matrix is not square");
+  }
+  if (a.n_rows() > 1 && (a.row_stride() != a.n_cols() || a.col_stride() != 1)) {
+    throw std::invalid_argument("matrix is not row-major and contiguous");
+  }
+}
+
+/// \brief Computes the dot product of two arrays, in a fixed order.
+///
+/// \param[in] x The first array.
+/// \param[in] y The second array.
+/// \param[in] start The index of the first element.
+/// \param[in] stop The index past the last element.
+/// \return The dot product of the elements from \p start to \p stop.
+static inline double dot(const double *const x, const double *const y,
+                         const std::size_t start, const std::size_t stop) {
+  double sum = 0;
+#ifdef PAR
+#pragma omp simd reduction(+ : sum)
+#endif
+  for (std::size_t i = start; i < stop; ++i) {
+    sum += x[i] * y[i];
+  }
+  return sum;
+}
+
+void diffusion_maps::internal::tridiagonalise(Matrix &a,
+                                              std::vector<double> &diagonal,
+                                              std::vector<double> &off_diagonal,
+                                              std::vector<double> &taus,
+                                              const Monitor *const monitor) {
+  check_dense_matrix(a);
+  const std::size_t n = a.n_rows();
+  diagonal.assign(n, 0);
+  off_diagonal.assign(n > 0 ? n - 1 : 0, 0);
+  taus.assign(n > 0 ? n - 1 : 0, 0);
+  if (n == 0) {
+    return;
+  }
+
+  // The matrix is symmetric, so row j stands for column j, and the rows are
+  // contiguous.
+
+  double *const rows = a.data();
+  const std::size_t nb = std::min(TRIDIAGONAL_PANEL_SIZE, n);
+  Matrix v_block(n, nb, Layout::COLUMN_MAJOR);
+  Matrix w_block(n, nb, Layout::COLUMN_MAJOR);
+  double *const vs = v_block.data();
+  double *const ws = w_block.data();
+
+  Progress progress;
+  progress.stage = Stage::EIG_SOLVER;
+
+  for (std::size_t p = 0; p < n; p += nb) {
+    const std::size_t width = std::min(nb, n - p);
+    std::fill(vs, vs + n * nb, 0.0);
+    std::fill(ws, ws + n * nb, 0.0);
+
+    for (std::size_t c = 0; c < width; ++c) {
+      const std::size_t j = p + c;
+      double *const row = rows + j * n;
+
+      // Apply the reflectors of the panel so far to row j.
+
+      for (std::size_t b = 0; b < c; ++b) {
+        const double *const vb = vs + b * n;
+        const double *const wb = ws + b * n;
+        const double vj = vb[j], wj = wb[j];
+        for (std::size_t i = j; i < n; ++i) {
+          row[i] -= vj * wb[i] + wj * vb[i];
+        }
+      }
+      diagonal[j] = row[j];
+      if (j + 1 == n) {
+        break;
+      }
+
+      // Form the reflector that annihilates the elements from j + 2 on.
+
+      const std::size_t start = j + 1;
+      const double alpha = row[start];
+      const double sq_norm = dot(row, row, start + 1, n);
+      double tau = 0, beta = alpha;
+      if (sq_norm > 0) {
+        beta = -std::copysign(std::sqrt(alpha * alpha + sq_norm), alpha);
+        tau = (beta - alpha) / beta;
+        const double scale = 1 / (alpha - beta);
+        for (std::size_t i = start + 1; i < n; ++i) {
+          row[i] *= scale;
+        }
+      }
+      row[start] = 1;
+      off_diagonal[j] = beta;
+      taus[j] = tau;
+
+      double *const v = vs + c * n;
+      double *const w = ws + c * n;
+      std::copy(row + start, row + n, v + start);
+      if (tau == 0) {
+        continue;
+      }
+
+      // w = τ (A - V Wᵀ - W Vᵀ) v, with the trailing matrix as it was at the
+      // start of the panel, then w ← w - τ/2 (wᵀ v) v.
+
+      [[maybe_unused]] const bool parallel =
+          n - start >= TRIDIAGONAL_TILE_SIZE;
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+      for (std::size_t i = start; i < n; ++i) {
+        w[i] = dot(rows + i * n, v, start, n);
+      }
+      for (std::size_t b = 0; b < c; ++b) {
+        const double *const vb = vs + b * n;
+        const double *const wb = ws + b * n;
+        const double wv = dot(wb, v, start, n), vv = dot(vb, v, start, n);
+        for (std::size_t i = start; i < n; ++i) {
+          w[i] -= vb[i] * wv + wb[i] * vv;
+        }
+      }
+      for (std::size_t i = start; i < n; ++i) {
+        w[i] *= tau;
+      }
+      const double gamma = -0.5 * tau * dot(w, v, start, n);
+      for (std::size_t i = start; i < n; ++i) {
+        w[i] += gamma * v[i];
+      }
+    }
+
+    progress.iteration = static_cast<unsigned>(p / nb + 1);
+    report(monitor, progress);
+
+    // Apply the reflectors of the panel to the trailing matrix, tile by tile.
+
+    const std::size_t trailing = p + width;
+#ifdef PAR
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::size_t i = trailing; i < n; ++i) {
+      double *const row = rows + i * n;
+      for (std::size_t t = trailing; t < n; t += TRIDIAGONAL_TILE_SIZE) {
+        const std::size_t t_end = std::min(t + TRIDIAGONAL_TILE_SIZE, n);
+        for (std::size_t b = 0; b < width; ++b) {
+          const double *const vb = vs + b * n;
+          const double *const wb = ws + b * n;
+          const double vi = vb[i], wi = wb[i];
+          for (std::size_t k = t; k < t_end; ++k) {
+            row[k] -= vi * wb[k] + wi * vb[k];
+          }
+        }
+      }
+    }
+  }
+}
+
+/// \brief Counts the eigenvalues of a symmetric tridiagonal matrix that are
+///        below a value, from the signs of its Sturm sequence.
+///
+/// \param[in] diagonal The diagonal.
+/// \param[in] sq_off_diagonal The squares of the off-diagonal.
+/// \param[in] x The value.
+/// \param[in] pivmin The smallest magnitude of a pivot, which replaces the
+///                   pivots that would be smaller.
+/// \return The number of eigenvalues below \p x.
+static std::size_t count_below(const std::vector<double> &diagonal,
+                               const std::vector<double> &sq_off_diagonal,
+                               const double x, const double pivmin) {
+  std::size_t count = 0;
+  double q = 1;
+  for (std::size_t i = 0; i < diagonal.size(); ++i) {
+    q = diagonal[i] - x - (i > 0 ? sq_off_diagonal[i - 1] / q : 0);
+    if (std::abs(q) < pivmin) {
+      q = -pivmin;
+    }
+    count += q < 0;
+  }
+  return count;
+}
+
+std::vector<double> diffusion_maps::internal::tridiagonal_eigenvalues(
+    const std::vector<double> &diagonal,
+    const std::vector<double> &off_diagonal, const unsigned k) {
+  const std::size_t n = diagonal.size();
+  if (k > n) {
+    throw std::invalid_argument("k cannot be larger than the number of rows");
+  }
+  if (k == 0) {
+    return {};
+  }
+
+  constexpr double eps = std::numeric_limits<double>::epsilon();
+  std::vector<double> sq_off_diagonal(n - 1);
+  double max_sq_off_diagonal = 1;
+  for (std::size_t i = 0; i + 1 < n; ++i) {
+    sq_off_diagonal[i] = off_diagonal[i] * off_diagonal[i];
+    max_sq_off_diagonal = std::max(max_sq_off_diagonal, sq_off_diagonal[i]);
+  }
+  const double pivmin =
+      std::numeric_limits<double>::min() * max_sq_off_diagonal;
+
+  // The Gershgorin interval, widened by the rounding error.
+
+  double lower = diagonal[0], upper = diagonal[0];
+  for (std::size_t i = 0; i < n; ++i) {
+    const double radius = (i > 0 ? std::abs(off_diagonal[i - 1]) : 0) +
+                          (i + 1 < n ? std::abs(off_diagonal[i]) : 0);
+    lower = std::min(lower, diagonal[i] - radius);
+    upper = std::max(upper, diagonal[i] + radius);
+  }
+  const double margin =
+      2 * eps * n * std::max(std::abs(lower), std::abs(upper)) + 2 * pivmin;
+  lower -= margin;
+  upper += margin;
+
+  std::vector<double> eigenvalues(k);
+#ifdef PAR
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (unsigned r = 0; r < k; ++r) {
+    // The (n - 1 - r)-th smallest eigenvalue is in [lo, hi).
+    const std::size_t m = n - 1 - r;
+    double lo = lower, hi = upper;
+    while (true) {
+      const double mid = 0.5 * (lo + hi);
+      if (hi - lo <= 2 * eps * std::max(std::abs(lo), std::abs(hi)) + pivmin ||
+          mid <= lo || mid >= hi) {
+        break;
+      }
+      if (count_below(diagonal, sq_off_diagonal, mid, pivmin) > m) {
+        hi = mid;
+      } else {
+        lo = mid;
+      }
+    }
+    eigenvalues[r] = 0.5 * (lo + hi);
+  }
+  return eigenvalues;
+}
+
+diffusion_maps::Matrix diffusion_maps::internal::tridiagonal_eigenvectors(
+    const std::vector<double> &diagonal,
+    const std::vector<double> &off_diagonal,
+    const std::vector<double> &eigenvalues) {
+  const std::size_t n = diagonal.size(), k = eigenvalues.size();
+  Matrix z(n, k, Layout::COLUMN_MAJOR);
+  if (n == 0) {
+    return z;
+  }
+
+  double norm = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    norm = std::max(norm, std::abs(diagonal[i]) +
+                              (i > 0 ? std::abs(off_diagonal[i - 1]) : 0) +
+                              (i + 1 < n ? std::abs(off_diagonal[i]) : 0));
+  }
+  constexpr double eps = std::numeric_limits<double>::epsilon();
+  const double cluster_gap = 1e-3 * norm;
+  const double separation = 10 * eps * norm;
+  const double tiny = std::max(eps * norm, std::numeric_limits<double>::min());
+
+  // Split the eigenvalues into clusters, and pull apart the close ones.
+
+  std::vector<double> lambdas(eigenvalues);
+  std::vector<std::size_t> cluster_starts;
+  for (std::size_t c = 0; c < k; ++c) {
+    if (c == 0 || eigenvalues[c - 1] - eigenvalues[c] > cluster_gap) {
+      cluster_starts.push_back(c);
+    } else if (lambdas[c - 1] - lambdas[c] < separation) {
+      lambdas[c] = lambdas[c - 1] - separation;
+    }
+  }
+  cluster_starts.push_back(k);
+
+  // The clusters are independent, and run in parallel. Within a cluster, each
+  // eigenvector is orthogonalised against the earlier ones, in order. Each
+  // eigenvector starts from its own seed, so the result does not depend on
+  // the number of threads.
+
+  const std::size_t n_clusters = cluster_starts.size() - 1;
+#ifdef PAR
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (std::size_t s = 0; s < n_clusters; ++s) {
+    // The factors of P (T - λ I) = L U, where U has two superdiagonals.
+    std::vector<double> u0(n), u1(n), u2(n), multipliers(n);
+    std::vector<bool> swapped(n);
+    std::vector<double> x(n);
+    std::uniform_real_distribution<double> dist(-1, 1);
+    const std::size_t cluster_start = cluster_starts[s];
+
+    for (std::size_t c = cluster_start; c < cluster_starts[s + 1]; ++c) {
+      const double lambda = lambdas[c];
+      for (std::size_t i = 0; i < n; ++i) {
+        u0[i] = diagonal[i] - lambda;
+        u1[i] = i + 1 < n ? off_diagonal[i] : 0;
+        u2[i] = 0;
+      }
+      for (std::size_t i = 0; i + 1 < n; ++i) {
+        const double sub = off_diagonal[i];
+        swapped[i] = std::abs(sub) > std::abs(u0[i]);
+        if (swapped[i]) {
+          const double m = u0[i] / sub;
+          const double super = u1[i];
+          u0[i] = sub;
+          u1[i] = u0[i + 1];
+          u2[i] = u1[i + 1];
+          u0[i + 1] = super - m * u1[i];
+          u1[i + 1] = -m * u2[i];
+          multipliers[i] = m;
+        } else {
+          if (std::abs(u0[i]) < tiny) {
+            u0[i] = std::copysign(tiny, u0[i]);
+          }
+          const double m = sub / u0[i];
+          u0[i + 1] -= m * u1[i];
+          multipliers[i] = m;
+        }
+      }
+      if (std::abs(u0[n - 1]) < tiny) {
+        u0[n - 1] = std::copysign(tiny, u0[n - 1]);
+      }
+
+      std::default_random_engine engine(static_cast<unsigned>(c + 1));
+      for (std::size_t i = 0; i < n; ++i) {
+        x[i] = dist(engine);
+      }
+      for (unsigned iter = 0; iter < TRIDIAGONAL_N_INVERSE_ITERS; ++iter) {
+        for (std::size_t i = 0; i + 1 < n; ++i) {
+          if (swapped[i]) {
+            std::swap(x[i], x[i + 1]);
+          }
+          x[i + 1] -= multipliers[i] * x[i];
+        }
+        for (std::size_t i = n; i-- > 0;) {
+          const double next = i + 1 < n ? x[i + 1] : 0;
+          const double after = i + 2 < n ? x[i + 2] : 0;
+          x[i] = (x[i] - u1[i] * next - u2[i] * after) / u0[i];
+        }
+
+        // Orthogonalise against the eigenvectors of the cluster, then
+        // normalise, scaling by the largest element first against overflow.
+
+        for (std::size_t b = cluster_start; b < c; ++b) {
+          const double *const zb = &z(0, b);
+          const double projection = dot(zb, x.data(), 0, n);
+          for (std::size_t i = 0; i < n; ++i) {
+            x[i] -= projection * zb[i];
+          }
+        }
+        double max_abs = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+          max_abs = std::max(max_abs, std::abs(x[i]));
+        }
+        if (max_abs == 0) {
+          break;
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+          x[i] /= max_abs;
+        }
+        const double inv_norm = 1 / std::sqrt(dot(x.data(), x.data(), 0, n));
+        for (std::size_t i = 0; i < n; ++i) {
+          x[i] *= inv_norm;
+        }
+      }
+
+      for (std::size_t i = 0; i < n; ++i) {
+        z(i, c) = x[i];
+      }
+    }
+  }
+  return z;
+}
+
+void diffusion_maps::internal::apply_reflectors(const Matrix &a,
+                                                const std::vector<double> &taus,
+                                                Matrix &z) {
+  check_dense_matrix(a);
+  const std::size_t n = a.n_rows();
+  if (z.n_rows() != n || taus.size() != (n > 0 ? n - 1 : 0) ||
+      (z.n_cols() > 1 && z.row_stride() != 1)) {
+    throw std::invalid_argument("incompatible dimensions");
+  }
+
+  const double *const rows = a.data();
+  const std::size_t k = z.n_cols();
+#ifdef PAR
+#pragma omp parallel for schedule(static)
+#endif
+  for (std::size_t c = 0; c < k; ++c) {
+    double *const x = &z(0, c);
+    for (std::size_t j = taus.size(); j-- > 0;) {
+      if (taus[j] == 0) {
+        continue;
+      }
+      const double *const v = rows + j * n;
+      const double s = taus[j] * dot(v, x, j + 1, n);
+      for (std::size_t i = j + 1; i < n; ++i) {
+        x[i] -= s * v[i];
+      }
+    }
+  }
+}
+
+std::pair<std::vector<double>, diffusion_maps::Matrix>
+diffusion_maps::internal::dense_eigsh(Matrix &a, const unsigned k,
+                                      Stats *const stats,
+                                      const Monitor *const monitor) {
+  check_dense_matrix(a);
+  if (k > a.n_rows()) {
+    throw std::invalid_argument("k cannot be larger than the number of rows");
+  }
+
+  std::vector<double> diagonal, off_diagonal, taus;
+  tridiagonalise(a, diagonal, off_diagonal, taus, monitor);
+  std::vector<double> eigenvalues =
+      tridiagonal_eigenvalues(diagonal, off_diagonal, k);
+  Matrix eigenvectors =
+      tridiagonal_eigenvectors(diagonal, off_diagonal, eigenvalues);
+
+  if (stats) {
+    const std::size_t n = diagonal.size();
+    std::vector<double> residuals(k);
+#ifdef PAR
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::size_t c = 0; c < k; ++c) {
+      double sq_norm = 0;
+      for (std::size_t i = 0; i < n; ++i) {
+        double r = (diagonal[i] - eigenvalues[c]) * eigenvectors(i, c);
+        if (i > 0) {
+          r += off_diagonal[i - 1] * eigenvectors(i - 1, c);
+        }
+        if (i + 1 < n) {
+          r += off_diagonal[i] * eigenvectors(i + 1, c);
+        }
+        sq_norm += r * r;
+      }
+      residuals[c] = std::sqrt(sq_norm);
+    }
+    stats->n_iters.insert(stats->n_iters.end(), k, 1);
+    stats->residuals.insert(stats->residuals.end(), residuals.begin(),
+                            residuals.end());
+  }
+
+  apply_reflectors(a, taus, eigenvectors);
+  return {std::move(eigenvalues), std::move(eigenvectors)};
+}
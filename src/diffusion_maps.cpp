@@ -1,121 +1,527 @@
 #include "diffusion_maps/diffusion_maps.hpp"
 
+#include <algorithm>
+#include <optional>
+#include <tuple>
 #include <vector>
 
+#include "diffusion_maps/compressed_matrix.hpp"
+#include "diffusion_maps/internal/dense_eig_solver.hpp"
 #include "diffusion_maps/internal/eig_solver.hpp"
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/internal/reordering.hpp"
+#include "diffusion_maps/linear_operator.hpp"
+#include "diffusion_maps/plan.hpp"
+#include "diffusion_maps/sell_matrix.hpp"
 #include "diffusion_maps/sparse_matrix.hpp"
 
-/// \brief Computes the kernel matrix.
-///
-/// \param[in] data The data matrix where each row is a data point.
-/// \param[in] kernel The kernel function.
-/// \param[in] epsilon The value below which the output of the kernel would be
-///                    treated as zero.
-/// \return The kernel matrix.
-static diffusion_maps::SparseMatrix compute_kernel_matrix(
-    const diffusion_maps::Matrix &data,
-    const std::function<double(const diffusion_maps::Vector &,
-                               const diffusion_maps::Vector &)> &kernel,
-    const double epsilon) {
-  const std::size_t n_samples = data.n_rows();
-  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
-
-#ifdef PAR
-#pragma omp parallel for
-#endif
-  for (std::size_t i = 0; i < n_samples; ++i) {
-    for (std::size_t j = i; j < n_samples; ++j) {
-      const double value = kernel(data.row(i), data.row(j));
-      if (std::abs(value) > epsilon) {
-#ifdef PAR
-#pragma omp critical
-#endif
-        {
-          triplets.push_back({i, j, value});
-          if (i != j) {
-            triplets.push_back({j, i, value});
-          }
-        }
+void diffusion_maps::internal::check_arguments(const std::size_t n_samples,
+                                               const std::size_t n_components,
+                                               const Options &options) {
+  if (n_components > n_samples - 1) {
+    throw std::invalid_argument("too many components");
+  }
+  if (!(options.alpha >= 0 && options.alpha <= 1)) {
+    throw std::invalid_argument("alpha must be in [0, 1]");
+  }
+  if (options.warm_start) {
+    for (const auto &eigenvector : options.warm_start->eigenvectors) {
+      if (eigenvector.size() != n_samples) {
+        throw std::invalid_argument(
+            "warm-start eigenvectors do not match the data");
       }
     }
   }
+}
+
+std::size_t diffusion_maps::internal::n_solver_vectors(
+    const std::size_t n_samples, const unsigned n_eigenpairs,
+    const Options &options) {
+  switch (options.eig_solver) {
+  case EigSolver::POWER_METHOD:
+    break;
+  case EigSolver::RANDOMIZED:
+    return 3 * std::min<std::size_t>(
+                   n_eigenpairs + options.randomized_oversampling, n_samples) +
+           n_eigenpairs;
+  case EigSolver::CHEBYSHEV:
+    // The block, its product, the two previous terms of the recurrence and
+    // the rotation of the Rayleigh-Ritz step.
+    return 4 * std::min<std::size_t>(
+                   n_eigenpairs + std::max(n_eigenpairs, 4u), n_samples) +
+           n_eigenpairs;
+  case EigSolver::DENSE:
+    // The tridiagonal matrix, the scales of the reflectors and the two blocks
+    // of a panel of the reduction.
+    return 3 + 2 * std::min(TRIDIAGONAL_PANEL_SIZE, n_samples) + n_eigenpairs;
+  }
+  return n_eigenpairs + 4;
+}
+
+/// \brief Stores the eigenpairs of a fit into its warm start, and wraps them
+///        into its eigendecomposition.
+///
+/// \param[in] eigenvalues The eigenvalues.
+/// \param[in] eigenvectors The eigenvectors, as the columns of a block.
+/// \param[in] n_iters The number of iterations each eigenpair took.
+/// \param[in] invsqrt_row_sum The inverse square root of the row sum of the
+///                            kernel matrix.
+/// \param[in,out] warm_start If not null, the warm start of the fit.
+/// \return The eigendecomposition.
+static diffusion_maps::Decomposition
+make_decomposition(std::vector<double> eigenvalues,
+                   diffusion_maps::Matrix eigenvectors,
+                   std::vector<unsigned> n_iters,
+                   diffusion_maps::Vector invsqrt_row_sum,
+                   diffusion_maps::WarmStart *const warm_start) {
+  if (warm_start) {
+    if (warm_start->empty()) {
+      warm_start->cold_n_iters = n_iters;
+    }
+    warm_start->n_iters = std::move(n_iters);
+    warm_start->eigenvectors.clear();
+    for (std::size_t j = 0; j < eigenvectors.n_cols(); ++j) {
+      warm_start->eigenvectors.push_back(eigenvectors.col(j));
+    }
+  }
 
-  return diffusion_maps::SparseMatrix(n_samples, n_samples, triplets);
+  diffusion_maps::Decomposition decomposition;
+  decomposition.eigenvalues = std::move(eigenvalues);
+  decomposition.eigenvectors = std::move(eigenvectors);
+  decomposition.invsqrt_row_sum = std::move(invsqrt_row_sum);
+  return decomposition;
 }
 
-/// \brief Computes the "symmetrised" diffusion matrix from the kernel matrix.
-///        The matrix is updated in-place.
+/// \brief Runs step 3 on a dense diffusion matrix, with the dense
+///        eigensolver, see internal::dense_eigsh().
 ///
-/// \param[in,out] kernel_matrix The kernel matrix.
-/// \return The inverse square root of the row sum of the kernel matrix.
-static diffusion_maps::Vector compute_symmetrised_diffusion_matrix(
-    diffusion_maps::SparseMatrix &kernel_matrix) {
-  const diffusion_maps::Vector invsqrt_row_sum =
-      (kernel_matrix * diffusion_maps::Vector(kernel_matrix.n_rows(), 1))
-          .inv_sqrt();
+/// \param[in,out] diffusion_matrix The "symmetrised" diffusion matrix. It is
+///                                 destroyed on return.
+/// \param[in] invsqrt_row_sum The inverse square root of the row sum of the
+///                            kernel matrix.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options.
+/// \param[in] held_bytes The bytes of the other buffers held by the fit
+///                       meanwhile.
+/// \return The eigendecomposition.
+static diffusion_maps::Decomposition
+decompose_dense(diffusion_maps::Matrix &diffusion_matrix,
+                diffusion_maps::Vector invsqrt_row_sum,
+                const std::size_t n_components,
+                const diffusion_maps::Options &options,
+                const std::size_t held_bytes) {
+  const std::size_t n_samples = diffusion_matrix.n_rows();
+  const unsigned n_eigenpairs = n_components + 1;
+  auto [eigenvalues, eigenvectors] = diffusion_maps::internal::dense_eigsh(
+      diffusion_matrix, n_eigenpairs, options.stats, options.monitor);
 
-#ifdef PAR
-#pragma omp parallel for
-#endif
-  for (std::size_t i = 0; i < kernel_matrix.n_rows(); ++i) {
-    for (std::size_t ir = kernel_matrix.row_ixs()[i];
-         ir < kernel_matrix.row_ixs()[i + 1]; ++ir) {
-      const std::size_t j = kernel_matrix.col_ixs()[ir];
-      double &v = kernel_matrix.data()[ir];
+  if (options.stats) {
+    // The matrix, the inverse square roots of the row sums, the eigenvectors
+    // and the working vectors of the solver.
+    const std::size_t n_vectors = diffusion_maps::internal::n_solver_vectors(
+        n_samples, n_eigenpairs, options);
+    options.stats->record_bytes(
+        held_bytes + n_samples * n_samples * sizeof(double) +
+        (n_vectors + 1) * n_samples * sizeof(double));
+  }
+
+  // The solver is direct, so each eigenpair takes a single iteration.
+  std::vector<unsigned> n_iters(eigenvalues.size(), 1);
+  return make_decomposition(std::move(eigenvalues), std::move(eigenvectors),
+                            std::move(n_iters), std::move(invsqrt_row_sum),
+                            options.warm_start);
+}
+
+/// \brief Runs step 3 on a diffusion matrix whose data points may have been
+///        reordered, and returns the eigendecomposition in the original order.
+///
+/// \param[in] diffusion_matrix The "symmetrised" diffusion matrix.
+/// \param[in] invsqrt_row_sum The inverse square root of the row sum of the
+///                            kernel matrix.
+/// \param[in] perm The permutation, where element i is the original index of
+///                 the i-th data point in the new order, or empty if the data
+///                 points were not reordered.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options.
+/// \param[in] rng The random number generator.
+/// \return The eigendecomposition.
+static diffusion_maps::Decomposition
+decompose_permuted(const diffusion_maps::SparseMatrix &diffusion_matrix,
+                   diffusion_maps::Vector invsqrt_row_sum,
+                   const std::vector<std::size_t> &perm,
+                   const std::size_t n_components,
+                   const diffusion_maps::Options &options,
+                   const std::function<double()> &rng) {
+  using diffusion_maps::internal::permute;
+  using diffusion_maps::internal::unpermute;
+
+  if (perm.empty()) {
+    return diffusion_maps::internal::decompose(
+        diffusion_matrix, std::move(invsqrt_row_sum), n_components, options,
+        rng);
+  }
 
-      v *= invsqrt_row_sum[i] * invsqrt_row_sum[j];
+  // The warm-start eigenvectors are in the original order, so permute them
+  // for the solver and revert them afterwards, even if the solver throws.
+
+  diffusion_maps::WarmStart *const warm_start = options.warm_start;
+  const auto permute_warm_start = [warm_start, &perm](const bool inverse) {
+    if (warm_start) {
+      for (diffusion_maps::Vector &eigenvector : warm_start->eigenvectors) {
+        eigenvector = inverse ? unpermute(eigenvector, perm)
+                              : permute(eigenvector, perm);
+      }
     }
+  };
+
+  diffusion_maps::Decomposition decomposition;
+  permute_warm_start(false);
+  try {
+    decomposition = diffusion_maps::internal::decompose(
+        diffusion_matrix, std::move(invsqrt_row_sum), n_components, options,
+        rng);
+  } catch (...) {
+    permute_warm_start(true);
+    throw;
   }
+  permute_warm_start(true);
 
-  return invsqrt_row_sum;
+  decomposition.eigenvectors = unpermute(decomposition.eigenvectors, perm);
+  decomposition.invsqrt_row_sum =
+      unpermute(decomposition.invsqrt_row_sum, perm);
+  return decomposition;
 }
 
-diffusion_maps::Matrix diffusion_maps::internal::diffusion_maps(
+diffusion_maps::Decomposition diffusion_maps::internal::decompose(
     const Matrix &data, const std::size_t n_components,
     const std::function<double(const Vector &, const Vector &)> &kernel,
-    const double diffusion_time, const double kernel_epsilon,
-    const double eig_solver_tol, const unsigned eig_solver_max_iter,
-    const std::function<double()> &rng) {
-  const std::size_t n_samples = data.n_rows();
-  if (n_components > n_samples - 1) {
-    throw std::invalid_argument("too many components");
+    const Options &options, const std::function<double()> &rng) {
+  check_arguments(data.n_rows(), n_components, options);
+  Stats *const stats = options.stats;
+
+  // Plan the fit first, if asked to, before the kernel matrix is computed.
+
+  if (options.memory_budget > 0 || options.auto_plan || options.plan) {
+    return decompose(
+        data, n_components, kernel,
+        apply_plan(diffusion_maps::plan(data, n_components, kernel, options),
+                   options),
+        rng);
   }
-  if (diffusion_time < 0) {
-    throw std::invalid_argument("diffusion time must be non-negative");
+
+  // Step 1: Compute the kernel matrix. Without self-tuning bandwidths, which
+  // need it assembled, the dense solver has it computed as a dense matrix,
+  // and the others only its triplets, so that it can be assembled and
+  // normalised in one pass.
+
+  report(options.monitor, Stage::KERNEL);
+  if (options.self_tuning_neighbours == 0 &&
+      options.eig_solver == EigSolver::DENSE) {
+    Matrix diffusion_matrix;
+    {
+      ScopedTimer timer(stats ? &stats->kernel_time : nullptr);
+      diffusion_matrix =
+          compute_dense_kernel_matrix(data, kernel, options.kernel_epsilon,
+                                      stats);
+    }
+
+    // Step 2: Compute the "symmetrised" diffusion matrix, in-place.
+
+    report(options.monitor, Stage::NORMALISATION);
+    Vector invsqrt_row_sum;
+    {
+      ScopedTimer timer(stats ? &stats->normalisation_time : nullptr);
+      invsqrt_row_sum = compute_symmetrised_diffusion_matrix(diffusion_matrix,
+                                                             options.alpha);
+    }
+
+    // Step 3.
+
+    report(options.monitor, Stage::EIG_SOLVER);
+    ScopedTimer timer(stats ? &stats->eig_solver_time : nullptr);
+    return decompose_dense(diffusion_matrix, std::move(invsqrt_row_sum),
+                           n_components, options, 0);
+  }
+  if (options.self_tuning_neighbours == 0) {
+    std::vector<SparseMatrix::Triplet> triplets;
+    {
+      ScopedTimer timer(stats ? &stats->kernel_time : nullptr);
+      triplets = compute_kernel_triplets(data, kernel, options.kernel_epsilon,
+                                         stats, options.kernel_precision);
+    }
+    const std::size_t n_samples = data.n_rows();
+    return decompose_kernel_triplets(
+        n_samples, triplets, (std::uint64_t{n_samples} * (n_samples + 1)) / 2,
+        &data, n_components, options, rng);
+  }
+
+  SparseMatrix kernel_matrix;
+  {
+    ScopedTimer timer(stats ? &stats->kernel_time : nullptr);
+    kernel_matrix = compute_kernel_matrix(data, kernel, options.kernel_epsilon,
+                                          stats, options.kernel_precision);
+    // Use the metric of the kernel, if it is known.
+    if (!visit_gaussian_kernel(kernel, [&](const auto &gaussian) {
+          apply_self_tuning_bandwidths(data, kernel_matrix,
+                                       options.self_tuning_neighbours,
+                                       gaussian.metric);
+        })) {
+      apply_self_tuning_bandwidths(data, kernel_matrix,
+                                   options.self_tuning_neighbours);
+    }
   }
 
-  // Step 1: Compute the kernel matrix.
+  return decompose_kernel_matrix(std::move(kernel_matrix), &data, n_components,
+                                 options, rng);
+}
 
-  auto kernel_matrix = compute_kernel_matrix(data, kernel, kernel_epsilon);
+diffusion_maps::Decomposition
+diffusion_maps::internal::decompose_kernel_matrix(
+    SparseMatrix kernel_matrix, const Matrix *const data,
+    const std::size_t n_components, const Options &options,
+    const std::function<double()> &rng) {
+  Stats *const stats = options.stats;
+
+  // Optionally, reorder the data points for locality.
+
+  std::vector<std::size_t> perm;
+  if (options.reordering != Reordering::NONE) {
+    if (options.reordering == Reordering::MORTON && !data) {
+      throw std::invalid_argument("Morton reordering needs dense data");
+    }
+    report(options.monitor, Stage::REORDERING);
+    ScopedTimer timer(stats ? &stats->reordering_time : nullptr);
+    perm = options.reordering == Reordering::RCM
+               ? reverse_cuthill_mckee(kernel_matrix)
+               : morton_order(*data);
+    kernel_matrix = permute(kernel_matrix, perm);
+  }
 
   // Step 2: Compute the "symmetrised" diffusion matrix.
 
-  const auto invsqrt_row_sum =
-      compute_symmetrised_diffusion_matrix(kernel_matrix);
+  report(options.monitor, Stage::NORMALISATION);
+  Vector invsqrt_row_sum;
+  {
+    ScopedTimer timer(stats ? &stats->normalisation_time : nullptr);
+    invsqrt_row_sum =
+        compute_symmetrised_diffusion_matrix(kernel_matrix, options.alpha);
+  }
+  if (stats) {
+    // The row sums and their inverse square roots, and the density estimates
+    // of the α-normalisation.
+    stats->n_spmv += options.alpha != 0 ? 2 : 1;
+    stats->record_bytes(kernel_matrix.n_bytes() +
+                        2 * kernel_matrix.n_rows() * sizeof(double));
+  }
 
-  // Step 3: Compute the eigenvalues and eigenvectors of the diffusion matrix.
+  // Step 3.
 
-  const auto [eigenvalues, eigenvectors] =
-      internal::eigsh(kernel_matrix, n_components + 1, eig_solver_tol,
-                      eig_solver_max_iter, rng);
+  return decompose_permuted(kernel_matrix, std::move(invsqrt_row_sum), perm,
+                            n_components, options, rng);
+}
 
-  // Step 4: Compute the diffusion maps.
+diffusion_maps::Decomposition
+diffusion_maps::internal::decompose_kernel_triplets(
+    const std::size_t n_samples, std::vector<SparseMatrix::Triplet> &triplets,
+    const std::uint64_t n_kernel_evals, const Matrix *const data,
+    const std::size_t n_components, const Options &options,
+    const std::function<double()> &rng) {
+  Stats *const stats = options.stats;
 
-  const std::size_t n_eigenvalues = eigenvalues.size();
-  Matrix diffusion_maps(n_samples, n_eigenvalues == 0 ? 0 : n_eigenvalues - 1);
+  // The reverse Cuthill-McKee ordering is found from the kernel matrix.
 
-  if (n_eigenvalues != 0) {
-    for (std::size_t i = 0; i < n_samples; ++i) {
-      for (std::size_t j = 0; j < n_eigenvalues - 1; ++j) {
-        // We drop the first eigenpair because the eigenvector is constant in
-        // all dimensions.
+  if (options.reordering == Reordering::RCM) {
+    SparseMatrix kernel_matrix;
+    {
+      ScopedTimer timer(stats ? &stats->kernel_time : nullptr);
+      kernel_matrix =
+          assemble_kernel_matrix(n_samples, triplets, n_kernel_evals, stats);
+    }
+    return decompose_kernel_matrix(std::move(kernel_matrix), data,
+                                   n_components, options, rng);
+  }
+
+  // Optionally, reorder the data points for locality, by relabelling the
+  // triplets.
+
+  std::vector<std::size_t> perm;
+  if (options.reordering == Reordering::MORTON) {
+    if (!data) {
+      throw std::invalid_argument("Morton reordering needs dense data");
+    }
+    report(options.monitor, Stage::REORDERING);
+    ScopedTimer timer(stats ? &stats->reordering_time : nullptr);
+    perm = morton_order(*data);
+    std::vector<std::size_t> new_ixs(n_samples);
+    for (std::size_t k = 0; k < n_samples; ++k) {
+      new_ixs[perm[k]] = k;
+    }
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t t = 0; t < triplets.size(); ++t) {
+      triplets[t].row = new_ixs[triplets[t].row];
+      triplets[t].col = new_ixs[triplets[t].col];
+    }
+  }
+
+  // Step 2: Assemble the "symmetrised" diffusion matrix.
+
+  report(options.monitor, Stage::NORMALISATION);
+  SparseMatrix diffusion_matrix;
+  Vector invsqrt_row_sum;
+  {
+    ScopedTimer timer(stats ? &stats->normalisation_time : nullptr);
+    diffusion_matrix = assemble_symmetrised_diffusion_matrix(
+        n_samples, triplets, options.alpha, invsqrt_row_sum, n_kernel_evals,
+        stats);
+  }
+
+  // Step 3.
+
+  return decompose_permuted(diffusion_matrix, std::move(invsqrt_row_sum), perm,
+                            n_components, options, rng);
+}
+
+diffusion_maps::Decomposition diffusion_maps::internal::decompose(
+    const SparseMatrix &diffusion_matrix, Vector invsqrt_row_sum,
+    const std::size_t n_components, const Options &options,
+    const std::function<double()> &rng) {
+  check_arguments(diffusion_matrix.n_rows(), n_components, options);
+
+  // Plan the fit first, if asked to, from the exact number of non-zero
+  // elements.
+
+  if (options.memory_budget > 0 || options.auto_plan || options.plan) {
+    return decompose(
+        diffusion_matrix, std::move(invsqrt_row_sum), n_components,
+        apply_plan(
+            plan_from_diffusion_matrix(diffusion_matrix, n_components, options),
+            options),
+        rng);
+  }
 
-        const double lambda = eigenvalues[j + 1];
-        const double psi_i = invsqrt_row_sum[i] * eigenvectors[j + 1][i];
-        diffusion_maps(i, j) = std::pow(lambda, diffusion_time) * psi_i;
+  WarmStart *const warm_start = options.warm_start;
+  Stats *const stats = options.stats;
+  Monitor *const monitor = options.monitor;
+  report(monitor, Stage::EIG_SOLVER);
+  ScopedTimer timer(stats ? &stats->eig_solver_time : nullptr);
+
+  // Step 3: Compute the eigenvalues and eigenvectors of the diffusion matrix,
+  // after expanding it into a dense matrix for the dense solver, or
+  // converting it to the requested storage format for the others.
+
+  if (options.eig_solver == EigSolver::DENSE) {
+    const std::size_t n_samples = diffusion_matrix.n_rows();
+    const std::size_t *const row_ixs = diffusion_matrix.row_ixs();
+    const std::size_t *const col_ixs = diffusion_matrix.col_ixs();
+    const double *const values = diffusion_matrix.data();
+    Matrix dense_matrix(n_samples, n_samples);
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        dense_matrix(i, col_ixs[ir]) = values[ir];
       }
     }
+    if (stats) {
+      stats->n_nz = diffusion_matrix.n_nz();
+    }
+    return decompose_dense(dense_matrix, std::move(invsqrt_row_sum),
+                           n_components, options, diffusion_matrix.n_bytes());
   }
 
-  return diffusion_maps;
+  std::optional<SellMatrix> sell_matrix;
+  std::optional<CompressedMatrix> compressed_matrix;
+  const LinearOperator *converted_matrix = nullptr;
+  switch (options.matrix_format) {
+  case MatrixFormat::CSR:
+    break;
+  case MatrixFormat::SELL:
+    converted_matrix = &sell_matrix.emplace(diffusion_matrix);
+    break;
+  case MatrixFormat::COMPRESSED_FLOAT:
+    converted_matrix =
+        &compressed_matrix.emplace(diffusion_matrix, ValuePrecision::FLOAT);
+    break;
+  case MatrixFormat::COMPRESSED_BFLOAT16:
+    converted_matrix =
+        &compressed_matrix.emplace(diffusion_matrix, ValuePrecision::BFLOAT16);
+    break;
+  }
+  const LinearOperator &a =
+      converted_matrix ? *converted_matrix : diffusion_matrix;
+
+  const unsigned n_eigenpairs = n_components + 1;
+  const Vector *const x0s =
+      warm_start ? warm_start->eigenvectors.data() : nullptr;
+  const std::size_t n_x0s = warm_start ? warm_start->eigenvectors.size() : 0;
+  std::vector<unsigned> n_iters;
+
+  std::vector<double> eigenvalues;
+  Matrix eigenvectors;
+  switch (options.eig_solver) {
+  case EigSolver::POWER_METHOD:
+    std::tie(eigenvalues, eigenvectors) = internal::eigsh(
+        a, n_eigenpairs, options.eig_solver_tol, options.eig_solver_max_iter,
+        rng, x0s, n_x0s, &n_iters, stats, monitor);
+    break;
+  case EigSolver::RANDOMIZED:
+    std::tie(eigenvalues, eigenvectors) = internal::randomized_eigsh(
+        a, n_eigenpairs, options.randomized_oversampling,
+        options.randomized_n_power_iters, rng, x0s, n_x0s, stats, monitor);
+    // The randomised solver always takes the same number of passes.
+    n_iters.assign(eigenvalues.size(), options.randomized_n_power_iters + 2);
+    break;
+  case EigSolver::CHEBYSHEV:
+    std::tie(eigenvalues, eigenvectors) = internal::chebyshev_eigsh(
+        a, n_eigenpairs, options.eig_solver_tol, options.eig_solver_max_iter,
+        options.chebyshev_degree, rng, x0s, n_x0s, &n_iters, stats, monitor);
+    break;
+  case EigSolver::DENSE:
+    // Handled above.
+    break;
+  }
+
+  if (stats) {
+    // The matrix, the inverse square roots of the row sums, the eigenvectors
+    // and the working vectors of the solver.
+    const std::size_t n_vectors =
+        n_solver_vectors(diffusion_matrix.n_rows(), n_eigenpairs, options);
+    stats->n_nz = diffusion_matrix.n_nz();
+    stats->record_bytes(diffusion_matrix.n_bytes() +
+                        (converted_matrix ? converted_matrix->n_bytes() : 0) +
+                        (n_vectors + 1) * diffusion_matrix.n_rows() *
+                            sizeof(double));
+  }
+
+  return make_decomposition(std::move(eigenvalues), std::move(eigenvectors),
+                            std::move(n_iters), std::move(invsqrt_row_sum),
+                            warm_start);
+}
+
+diffusion_maps::Matrix diffusion_maps::internal::diffusion_maps(
+    const Matrix &data, const std::size_t n_components,
+    const std::function<double(const Vector &, const Vector &)> &kernel,
+    const double diffusion_time, const Options &options,
+    const std::function<double()> &rng) {
+  if (diffusion_time < 0) {
+    throw std::invalid_argument("diffusion time must be non-negative");
+  }
+
+  // Steps 1 to 3.
+
+  const Decomposition decomposition =
+      decompose(data, n_components, kernel, options, rng);
+
+  // Step 4: Compute the diffusion maps.
+
+  report(options.monitor, Stage::EMBEDDING);
+  ScopedTimer timer(options.stats ? &options.stats->embedding_time : nullptr);
+  if (options.stats) {
+    options.stats->record_bytes(decomposition.n_samples() *
+                                decomposition.n_components() * sizeof(double));
+  }
+  return decomposition.embed(diffusion_time);
 }
@@ -1,27 +1,285 @@
 #include "diffusion_maps/internal/eig_solver.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
 #include <random>
 #include <stdexcept>
+#include <utility>
+
+#include "diffusion_maps/internal/reduction.hpp"
+
+/// \brief Orthonormalises the columns of a matrix in-place.
+///
+/// Classical Gram-Schmidt is applied twice to each column ("twice is enough"),
+/// which keeps the columns orthogonal to working precision. Columns that are
+/// numerically linearly dependent on the previous ones are set to zero.
+///
+/// \param[in,out] m The matrix.
+static void orthonormalise_columns(diffusion_maps::Matrix &m) {
+  const std::size_t n_rows = m.n_rows(), n_cols = m.n_cols();
+  std::vector<double> h(n_cols);
+
+  for (std::size_t c = 0; c < n_cols; ++c) {
+    double orig_sq_norm = 0;
+    for (std::size_t r = 0; r < n_rows; ++r) {
+      orig_sq_norm += m(r, c) * m(r, c);
+    }
+
+    for (int pass = 0; pass < 2; ++pass) {
+      for (std::size_t p = 0; p < c; ++p) {
+        h[p] = 0;
+        for (std::size_t r = 0; r < n_rows; ++r) {
+          h[p] += m(r, p) * m(r, c);
+        }
+      }
+      for (std::size_t r = 0; r < n_rows; ++r) {
+        for (std::size_t p = 0; p < c; ++p) {
+          m(r, c) -= h[p] * m(r, p);
+        }
+      }
+    }
+
+    double sq_norm = 0;
+    for (std::size_t r = 0; r < n_rows; ++r) {
+      sq_norm += m(r, c) * m(r, c);
+    }
+
+    // Drop the column if almost nothing is left after the projection.
+    const double scale = sq_norm > 1e-24 * orig_sq_norm && sq_norm > 0
+                             ? 1 / std::sqrt(sq_norm)
+                             : 0;
+    for (std::size_t r = 0; r < n_rows; ++r) {
+      m(r, c) *= scale;
+    }
+  }
+}
+
+/// \brief Computes all the eigenvalues and eigenvectors of a small dense
+///        symmetric matrix using the cyclic Jacobi method.
+///
+/// \param[in,out] a The matrix. It is destroyed on return.
+/// \return The eigenvalues and a matrix whose columns are the corresponding
+///         eigenvectors.
+static std::pair<std::vector<double>, diffusion_maps::Matrix>
+jacobi_eigh(diffusion_maps::Matrix &a) {
+  const std::size_t n = a.n_rows();
+
+  diffusion_maps::Matrix v(n, n);
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t j = 0; j < n; ++j) {
+      v(i, j) = i == j;
+    }
+  }
+
+  constexpr unsigned max_sweeps = 100;
+  for (unsigned sweep = 0; sweep < max_sweeps; ++sweep) {
+    double off = 0, total = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      for (std::size_t j = 0; j < n; ++j) {
+        total += a(i, j) * a(i, j);
+        if (i != j) {
+          off += a(i, j) * a(i, j);
+        }
+      }
+    }
+    if (off <= 1e-30 * total) {
+      break;
+    }
+
+    for (std::size_t p = 0; p < n; ++p) {
+      for (std::size_t q = p + 1; q < n; ++q) {
+        if (a(p, q) == 0) {
+          continue;
+        }
+
+        // Choose the rotation that annihilates a(p, q).
+        const double theta = (a(q, q) - a(p, p)) / (2 * a(p, q));
+        const double t = (theta >= 0 ? 1 : -1) /
+                         (std::abs(theta) + std::sqrt(theta * theta + 1));
+        const double c = 1 / std::sqrt(t * t + 1), s = t * c;
+
+        for (std::size_t k = 0; k < n; ++k) {
+          const double akp = a(k, p), akq = a(k, q);
+          a(k, p) = c * akp - s * akq;
+          a(k, q) = s * akp + c * akq;
+        }
+        for (std::size_t k = 0; k < n; ++k) {
+          const double apk = a(p, k), aqk = a(q, k);
+          a(p, k) = c * apk - s * aqk;
+          a(q, k) = s * apk + c * aqk;
+        }
+        for (std::size_t k = 0; k < n; ++k) {
+          const double vkp = v(k, p), vkq = v(k, q);
+          v(k, p) = c * vkp - s * vkq;
+          v(k, q) = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+
+  std::vector<double> eigenvalues(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    eigenvalues[i] = a(i, i);
+  }
+
+  return std::make_pair(eigenvalues, std::move(v));
+}
+
+/// \brief Computes the residual of an eigenpair.
+///
+/// \param[in] a The matrix.
+/// \param[in] eigenvalue The eigenvalue.
+/// \param[in] eigenvector The eigenvector.
+/// \return ‖A v - λ v‖.
+static double residual(const diffusion_maps::LinearOperator &a,
+                       const double eigenvalue,
+                       const diffusion_maps::Vector &eigenvector) {
+  return (a * eigenvector - eigenvector * eigenvalue).l2_norm();
+}
+
+/// The number of rows of a block of vectors processed at a time, so that the
+/// part of the vector they are combined with stays in the L1 cache.
+constexpr std::size_t ROW_CHUNK_SIZE = 512;
+
+/// \brief Adds up the per-chunk partial components computed by project_out().
+///
+/// The chunks are added in order, so that the components do not depend on
+/// the number of threads.
+///
+/// \param[in] partial The partial components, \p n_cols per chunk.
+/// \param[in] n_chunks The number of chunks.
+/// \param[in] n_cols The number of components.
+/// \param[out] h The components.
+static void sum_chunks(const std::vector<double> &partial,
+                       const std::size_t n_chunks, const std::size_t n_cols,
+                       double *const h) {
+  std::fill_n(h, n_cols, 0.0);
+  for (std::size_t chunk = 0; chunk < n_chunks; ++chunk) {
+    const double *const p = partial.data() + chunk * n_cols;
+    for (std::size_t c = 0; c < n_cols; ++c) {
+      h[c] += p[c];
+    }
+  }
+}
+
+/// \brief Removes from a vector its components along the first columns of a
+///        column-major block of orthonormal vectors.
+///
+/// Classical Gram-Schmidt is applied twice (CGS2), which, unlike a single
+/// pass, keeps the vector orthogonal to the block to working precision. All
+/// the components of a pass are computed together, so that the block and the
+/// vector are each read three times whatever the number of columns: once for
+/// the first components, once to remove them while computing the second ones,
+/// and once to remove the second ones. The rows are processed in chunks, in
+/// parallel, and within a chunk, column by column.
+///
+/// \param[in] block The block.
+/// \param[in] n_cols The number of columns of the block to project out.
+/// \param[in,out] y The vector.
+/// \param[out] h The components of \p y, of at least 2 \p n_cols elements.
+/// \param[out] partial Workspace of at least \p n_cols elements per chunk of
+///                     ROW_CHUNK_SIZE rows of \p y.
+static void project_out(const diffusion_maps::Matrix &block,
+                        const std::size_t n_cols, diffusion_maps::Vector &y,
+                        std::vector<double> &h, std::vector<double> &partial) {
+  const std::size_t n = y.size(), stride = block.col_stride();
+  const std::size_t n_chunks = (n + ROW_CHUNK_SIZE - 1) / ROW_CHUNK_SIZE;
+  const double *const b = block.data();
+  double *const v = y.data();
+  double *const h1 = h.data(), *const h2 = h.data() + n_cols;
+
+  // The partial components of the chunk starting at row start.
+  const auto dot_chunk = [&](const std::size_t start, const std::size_t stop) {
+    double *const p = partial.data() + start / ROW_CHUNK_SIZE * n_cols;
+    for (std::size_t c = 0; c < n_cols; ++c) {
+      const double *const col = b + c * stride;
+      double sum = 0;
+      for (std::size_t r = start; r < stop; ++r) {
+        sum += col[r] * v[r];
+      }
+      p[c] = sum;
+    }
+  };
+  const auto subtract_chunk = [&](const std::size_t start,
+                                  const std::size_t stop,
+                                  const double *const hc) {
+    for (std::size_t c = 0; c < n_cols; ++c) {
+      const double *const col = b + c * stride;
+      for (std::size_t r = start; r < stop; ++r) {
+        v[r] -= hc[c] * col[r];
+      }
+    }
+  };
+
+#ifdef PAR
+#pragma omp parallel for schedule(static)
+#endif
+  for (std::size_t chunk = 0; chunk < n_chunks; ++chunk) {
+    const std::size_t start = chunk * ROW_CHUNK_SIZE;
+    dot_chunk(start, std::min(start + ROW_CHUNK_SIZE, n));
+  }
+  sum_chunks(partial, n_chunks, n_cols, h1);
+
+#ifdef PAR
+#pragma omp parallel for schedule(static)
+#endif
+  for (std::size_t chunk = 0; chunk < n_chunks; ++chunk) {
+    const std::size_t start = chunk * ROW_CHUNK_SIZE;
+    const std::size_t stop = std::min(start + ROW_CHUNK_SIZE, n);
+    subtract_chunk(start, stop, h1);
+    dot_chunk(start, stop);
+  }
+  sum_chunks(partial, n_chunks, n_cols, h2);
+
+#ifdef PAR
+#pragma omp parallel for schedule(static)
+#endif
+  for (std::size_t chunk = 0; chunk < n_chunks; ++chunk) {
+    const std::size_t start = chunk * ROW_CHUNK_SIZE;
+    subtract_chunk(start, std::min(start + ROW_CHUNK_SIZE, n), h2);
+  }
+}
 
 std::optional<std::pair<double, diffusion_maps::Vector>>
 diffusion_maps::internal::symmetric_power_method(
-    const SparseMatrix &a, const Vector &x0, const Vector *const betas,
-    const std::size_t n_betas, const double tol, const unsigned max_iters) {
+    const LinearOperator &a, const Vector &x0, const Matrix *const betas,
+    const std::size_t n_betas, const double tol, const unsigned max_iters,
+    unsigned *const n_iters,
+    const std::function<void(unsigned, double)> *const on_iteration) {
   if (a.n_rows() != a.n_cols()) { // a is not square.
     throw std::invalid_argument("matrix is not square");
   }
   if (x0.size() != a.n_rows()) { // x0 cannot be multiplied by a.
     throw std::invalid_argument("incompatible dimensions");
   }
+  if (n_betas > 0 &&
+      (!betas || betas->n_rows() != a.n_rows() || betas->n_cols() < n_betas ||
+       betas->row_stride() != 1)) {
+    throw std::invalid_argument("incompatible dimensions");
+  }
 
+  const std::size_t n = a.n_rows();
   Vector x = x0 / x0.l2_norm();
+  Vector y(n);
+  std::vector<double> h(2 * n_betas);
+  std::vector<double> partial(n_betas *
+                              ((n + ROW_CHUNK_SIZE - 1) / ROW_CHUNK_SIZE));
+  if (n_iters) {
+    *n_iters = 0;
+  }
 
   for (unsigned k = 0; k < max_iters; ++k) {
-    Vector y = a * x;
+    if (n_iters) {
+      ++*n_iters;
+    }
+
+    a.multiply(x, y);
 
     // Orthogonalise y against betas.
-    for (std::size_t i = 0; i < n_betas; ++i) {
-      y -= betas[i] * betas[i].dot(y);
+    if (n_betas > 0) {
+      project_out(*betas, n_betas, y, h, partial);
     }
 
     const double mu = x.dot(y);
@@ -31,55 +289,456 @@ diffusion_maps::internal::symmetric_power_method(
       return std::make_pair(0, x);
     }
 
-    y /= l2_norm_y;
-    const double err = (x - y).l2_norm();
-    x = y;
-    if (err < tol) { // Success.
-      return std::make_pair(mu, x);
+    // Normalise y and measure how far it moved, in one pass.
+    double *const yd = y.data();
+    const double *const xd = x.data();
+    const double sq_err =
+        deterministic_sum(n, [xd, yd, l2_norm_y](const std::size_t i) {
+          yd[i] /= l2_norm_y;
+          const double d = xd[i] - yd[i];
+          return d * d;
+        });
+    std::swap(x, y);
+    if (on_iteration) {
+      (*on_iteration)(k + 1, std::sqrt(sq_err));
+    }
+    if (std::sqrt(sq_err) < tol) { // Success.
+      return std::make_pair(mu, std::move(x));
     }
   }
 
   return std::nullopt; // Failed to converge.
 }
 
-std::pair<std::vector<double>, std::vector<diffusion_maps::Vector>>
-diffusion_maps::internal::eigsh(const SparseMatrix &a, const unsigned k,
+std::pair<std::vector<double>, diffusion_maps::Matrix>
+diffusion_maps::internal::eigsh(const LinearOperator &a, const unsigned k,
                                 const double tol, const unsigned max_iters,
-                                const std::function<double()> &rng) {
+                                const std::function<double()> &rng,
+                                const Vector *const x0s,
+                                const std::size_t n_x0s,
+                                std::vector<unsigned> *const n_iters,
+                                Stats *const stats,
+                                const Monitor *const monitor) {
   if (a.n_rows() != a.n_cols()) { // a is not square.
     throw std::invalid_argument("matrix is not square");
   }
   if (k > a.n_rows()) { // k cannot be larger than the number of rows.
     throw std::invalid_argument("k cannot be larger than the number of rows");
   }
+  for (std::size_t i = 0; i < n_x0s; ++i) {
+    if (x0s[i].size() != a.n_rows()) {
+      throw std::invalid_argument("incompatible dimensions");
+    }
+  }
 
+  const std::size_t n = a.n_rows();
   std::vector<double> eigenvalues;
-  std::vector<Vector> eigenvectors;
+  Matrix eigenvectors(n, k, Layout::COLUMN_MAJOR);
   eigenvalues.reserve(k);
-  eigenvectors.reserve(k);
+  if (n_iters) {
+    n_iters->clear();
+  }
 
   for (std::size_t i = 0; i < k; ++i) {
-    // Generate the initial guess for the eigenvector.
+    // Generate the initial guess for the eigenvector, unless one is given.
 
-    Vector x0(a.n_rows());
-    for (std::size_t i = 0; i < x0.size(); ++i) {
-      x0[i] = rng();
+    Vector x0;
+    if (i < n_x0s && x0s[i].l2_norm() != 0) {
+      x0 = x0s[i];
+    } else {
+      x0 = Vector(n);
+      for (std::size_t i = 0; i < x0.size(); ++i) {
+        x0[i] = rng();
+      }
     }
 
     // Use the symmetric power method to find the i-th eigenvalue and
     // eigenvector.
 
-    const auto eig_pair = symmetric_power_method(
-        a, x0, eigenvectors.data(), eigenvectors.size(), tol, max_iters);
+    Progress progress;
+    progress.stage = Stage::EIG_SOLVER;
+    progress.eigenpair = i;
+    const std::function<void(unsigned, double)> on_iteration =
+        [monitor, &progress](const unsigned iteration, const double error) {
+          progress.iteration = iteration;
+          progress.error = error;
+          monitor->report(progress);
+        };
+
+    unsigned n_iters_i;
+    const auto eig_pair =
+        symmetric_power_method(a, x0, &eigenvectors, i, tol, max_iters,
+                               &n_iters_i, monitor ? &on_iteration : nullptr);
+    if (n_iters) {
+      n_iters->push_back(n_iters_i);
+    }
+    if (stats) {
+      stats->n_spmv += n_iters_i;
+      stats->n_iters.push_back(n_iters_i);
+    }
 
     // Stop if the eigenvalue is not found.
     if (!eig_pair) {
       break;
     }
 
+    if (stats) {
+      ++stats->n_spmv;
+      stats->residuals.push_back(
+          residual(a, eig_pair->first, eig_pair->second));
+    }
+
     eigenvalues.push_back(eig_pair->first);
-    eigenvectors.push_back(eig_pair->second);
+    std::copy_n(eig_pair->second.data(), n,
+                eigenvectors.data() + i * eigenvectors.col_stride());
+  }
+
+  eigenvectors.truncate_cols(eigenvalues.size());
+  return std::make_pair(std::move(eigenvalues), std::move(eigenvectors));
+}
+
+std::pair<std::vector<double>, diffusion_maps::Matrix>
+diffusion_maps::internal::randomized_eigsh(const LinearOperator &a,
+                                           const unsigned k,
+                                           const unsigned oversampling,
+                                           const unsigned n_power_iters,
+                                           const std::function<double()> &rng,
+                                           const Vector *const x0s,
+                                           const std::size_t n_x0s,
+                                           Stats *const stats,
+                                           const Monitor *const monitor) {
+  if (a.n_rows() != a.n_cols()) { // a is not square.
+    throw std::invalid_argument("matrix is not square");
+  }
+  if (k > a.n_rows()) { // k cannot be larger than the number of rows.
+    throw std::invalid_argument("k cannot be larger than the number of rows");
+  }
+  for (std::size_t i = 0; i < n_x0s; ++i) {
+    if (x0s[i].size() != a.n_rows()) {
+      throw std::invalid_argument("incompatible dimensions");
+    }
+  }
+
+  const std::size_t n = a.n_rows();
+  const std::size_t l = std::min<std::size_t>(std::size_t{k} + oversampling, n);
+
+  // Stage A: Find an orthonormal basis of the dominant subspace.
+
+  Matrix omega(n, l);
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t j = 0; j < l; ++j) {
+      omega(i, j) = j < n_x0s ? x0s[j][i] : rng();
+    }
+  }
+
+  Progress progress;
+  progress.stage = Stage::EIG_SOLVER;
+
+  Matrix q = a * omega;
+  orthonormalise_columns(q);
+  for (unsigned iter = 0; iter < n_power_iters; ++iter) {
+    progress.iteration = iter + 1;
+    report(monitor, progress);
+    q = a * q;
+    orthonormalise_columns(q);
+  }
+
+  // Stage B: Rayleigh-Ritz projection onto the subspace.
+
+  const Matrix aq = a * q;
+  Matrix b(l, l);
+  for (std::size_t i = 0; i < l; ++i) {
+    for (std::size_t j = 0; j < l; ++j) {
+      b(i, j) = 0;
+    }
+  }
+  for (std::size_t r = 0; r < n; ++r) {
+    for (std::size_t i = 0; i < l; ++i) {
+      for (std::size_t j = 0; j < l; ++j) {
+        b(i, j) += q(r, i) * aq(r, j);
+      }
+    }
+  }
+  for (std::size_t i = 0; i < l; ++i) {
+    for (std::size_t j = i + 1; j < l; ++j) {
+      b(i, j) = b(j, i) = (b(i, j) + b(j, i)) / 2;
+    }
+  }
+
+  const auto [ritz_values, ritz_vectors] = jacobi_eigh(b);
+
+  std::vector<std::size_t> order(l);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&ritz_values = ritz_values](std::size_t i, std::size_t j) {
+                     return std::abs(ritz_values[i]) > std::abs(ritz_values[j]);
+                   });
+
+  // Lift the dominant Ritz vectors back to the original space.
+
+  std::vector<double> eigenvalues;
+  Matrix eigenvectors(n, k, Layout::COLUMN_MAJOR);
+  eigenvalues.reserve(k);
+
+  for (std::size_t i = 0; i < k; ++i) {
+    const std::size_t c = order[i];
+    for (std::size_t r = 0; r < n; ++r) {
+      for (std::size_t p = 0; p < l; ++p) {
+        eigenvectors(r, i) += q(r, p) * ritz_vectors(p, c);
+      }
+    }
+
+    if (stats) {
+      stats->n_iters.push_back(n_power_iters + 2);
+      stats->residuals.push_back(
+          residual(a, ritz_values[c], eigenvectors.col(i)));
+    }
+
+    eigenvalues.push_back(ritz_values[c]);
+  }
+
+  if (stats) {
+    stats->n_spmv += l * (n_power_iters + 2) + k;
+  }
+
+  return std::make_pair(std::move(eigenvalues), std::move(eigenvectors));
+}
+
+/// \brief Rotates an orthonormal block onto the Ritz vectors of a symmetric
+///        matrix.
+///
+/// \param[in] a The matrix.
+/// \param[in,out] x The orthonormal block, one vector per column. Replaced by
+///                  the Ritz vectors, in descending order of Ritz value.
+/// \param[out] ax Set to A x for the rotated block.
+/// \return The Ritz values, in descending order.
+static std::vector<double>
+rayleigh_ritz(const diffusion_maps::LinearOperator &a,
+              diffusion_maps::Matrix &x, diffusion_maps::Matrix &ax) {
+  const std::size_t n = x.n_rows(), l = x.n_cols();
+  ax = a * x;
+
+  diffusion_maps::Matrix b(l, l);
+  for (std::size_t i = 0; i < l; ++i) {
+    for (std::size_t j = 0; j < l; ++j) {
+      b(i, j) = 0;
+    }
+  }
+  for (std::size_t r = 0; r < n; ++r) {
+    for (std::size_t i = 0; i < l; ++i) {
+      for (std::size_t j = 0; j < l; ++j) {
+        b(i, j) += x(r, i) * ax(r, j);
+      }
+    }
+  }
+  for (std::size_t i = 0; i < l; ++i) {
+    for (std::size_t j = i + 1; j < l; ++j) {
+      b(i, j) = b(j, i) = (b(i, j) + b(j, i)) / 2;
+    }
+  }
+
+  const auto [ritz_values, ritz_vectors] = jacobi_eigh(b);
+
+  std::vector<std::size_t> order(l);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&ritz_values = ritz_values](std::size_t i, std::size_t j) {
+                     return ritz_values[i] > ritz_values[j];
+                   });
+
+  // Both x and A x are rotated, since A (x V) = (A x) V.
+
+  std::vector<double> row(l);
+  for (diffusion_maps::Matrix *m : {&x, &ax}) {
+    for (std::size_t r = 0; r < n; ++r) {
+      for (std::size_t i = 0; i < l; ++i) {
+        row[i] = 0;
+        for (std::size_t p = 0; p < l; ++p) {
+          row[i] += (*m)(r, p) * ritz_vectors(p, order[i]);
+        }
+      }
+      for (std::size_t i = 0; i < l; ++i) {
+        (*m)(r, i) = row[i];
+      }
+    }
+  }
+
+  std::vector<double> sorted_values(l);
+  for (std::size_t i = 0; i < l; ++i) {
+    sorted_values[i] = ritz_values[order[i]];
+  }
+  return sorted_values;
+}
+
+std::pair<std::vector<double>, diffusion_maps::Matrix>
+diffusion_maps::internal::chebyshev_eigsh(
+    const LinearOperator &a, const unsigned k, const double tol,
+    const unsigned max_iters, const unsigned degree,
+    const std::function<double()> &rng, const Vector *const x0s,
+    const std::size_t n_x0s, std::vector<unsigned> *const n_iters,
+    Stats *const stats, const Monitor *const monitor) {
+  if (a.n_rows() != a.n_cols()) { // a is not square.
+    throw std::invalid_argument("matrix is not square");
+  }
+  if (k > a.n_rows()) { // k cannot be larger than the number of rows.
+    throw std::invalid_argument("k cannot be larger than the number of rows");
+  }
+  if (degree == 0) {
+    throw std::invalid_argument("degree must be positive");
+  }
+  for (std::size_t i = 0; i < n_x0s; ++i) {
+    if (x0s[i].size() != a.n_rows()) {
+      throw std::invalid_argument("incompatible dimensions");
+    }
+  }
+
+  const std::size_t n = a.n_rows();
+  const std::size_t l =
+      std::min<std::size_t>(std::size_t{k} + std::max(k, 4u), n);
+  std::uint64_t n_spmv = 0;
+
+  // Start from the initial guesses, or random vectors where there are none.
+
+  Matrix x(n, l);
+  for (std::size_t j = 0; j < l; ++j) {
+    const bool guess = j < n_x0s && x0s[j].l2_norm() != 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      x(i, j) = guess ? x0s[j][i] : rng();
+    }
+  }
+  orthonormalise_columns(x);
+
+  Matrix ax(n, l);
+  std::vector<double> ritz_values = rayleigh_ritz(a, x, ax);
+  n_spmv += l;
+
+  // The iteration at which each wanted eigenpair first met the tolerance, and
+  // the last residual of each eigenpair.
+  std::vector<unsigned> converged_at(k, max_iters + 1);
+  std::vector<double> residuals(k, 0);
+  std::size_t n_converged = 0;
+  Progress progress;
+  progress.stage = Stage::EIG_SOLVER;
+
+  for (unsigned iter = 0;; ++iter) {
+    for (std::size_t i = 0; i < k; ++i) {
+      if (converged_at[i] > max_iters) {
+        double sq_norm = 0;
+        for (std::size_t r = 0; r < n; ++r) {
+          const double d = ax(r, i) - ritz_values[i] * x(r, i);
+          sq_norm += d * d;
+        }
+        residuals[i] = std::sqrt(sq_norm);
+        if (residuals[i] < tol) {
+          converged_at[i] = iter;
+        }
+      }
+    }
+    n_converged = 0;
+    while (n_converged < k && converged_at[n_converged] <= max_iters) {
+      ++n_converged;
+    }
+    if (iter > 0) {
+      progress.eigenpair = n_converged;
+      progress.iteration = iter;
+      progress.error = n_converged < k ? residuals[n_converged] : 0;
+      report(monitor, progress);
+    }
+    if (n_converged == k || iter == max_iters) {
+      break;
+    }
+
+    // Damp the unwanted interval [-1, cut] with the Chebyshev polynomial of
+    // the given degree, scaled to 1 at the largest Ritz value so that the
+    // block neither overflows nor underflows. The spectrum of the
+    // "symmetrised" diffusion matrix lies in [-1, 1], and cut is the smallest
+    // Ritz value of the block, below which the unwanted eigenvalues lie.
+    //
+    // With C = (A - c I) / e, the three-term recurrence Tᵢ₊₁ = 2 C Tᵢ - Tᵢ₋₁
+    // becomes, for the scaled polynomials, Yᵢ₊₁ = 2 σᵢ₊₁ / e (A - c I) Yᵢ -
+    // σᵢ σᵢ₊₁ Yᵢ₋₁ (Zhou and Saad, 2007).
+    //
+    // If the block reaches the bottom of the spectrum, as it can when the
+    // graph has a bipartite component, the interval is empty and the
+    // recurrence would divide by zero. It is then widened below cut instead,
+    // where there are no eigenvalues, so that the polynomial grows over the
+    // whole spectrum and still favours the largest eigenvalues.
+
+    const double cut = ritz_values[l - 1];
+    double lower = std::min(-1.0, cut);
+    if (!(cut - lower > 0)) {
+      lower = cut - 1;
+    }
+    const double e = (cut - lower) / 2, c = (cut + lower) / 2;
+    const double top = ritz_values[0] > cut ? ritz_values[0] : cut + e;
+    const double sigma1 = e / (top - c);
+
+    Matrix y = a * x;
+    for (std::size_t r = 0; r < n; ++r) {
+      for (std::size_t j = 0; j < l; ++j) {
+        y(r, j) = (y(r, j) - c * x(r, j)) * (sigma1 / e);
+      }
+    }
+    double sigma = sigma1;
+    for (unsigned d = 1; d < degree; ++d) {
+      const double sigma_next = 1 / (2 / sigma1 - sigma);
+      Matrix y_next = a * y;
+      for (std::size_t r = 0; r < n; ++r) {
+        for (std::size_t j = 0; j < l; ++j) {
+          y_next(r, j) = (y_next(r, j) - c * y(r, j)) * (2 * sigma_next / e) -
+                         sigma * sigma_next * x(r, j);
+        }
+      }
+      x = std::move(y);
+      y = std::move(y_next);
+      sigma = sigma_next;
+    }
+    x = std::move(y);
+    n_spmv += std::uint64_t{l} * degree;
+
+    orthonormalise_columns(x);
+    ritz_values = rayleigh_ritz(a, x, ax);
+    n_spmv += l;
+  }
+
+  // Return the eigenpairs up to the first one that did not converge, like
+  // eigsh().
+
+  std::vector<double> eigenvalues;
+  Matrix eigenvectors(n, n_converged, Layout::COLUMN_MAJOR);
+  eigenvalues.reserve(n_converged);
+  if (n_iters) {
+    n_iters->clear();
+  }
+
+  for (std::size_t i = 0; i < std::min<std::size_t>(n_converged + 1, k); ++i) {
+    const unsigned n_iters_i = std::min(converged_at[i], max_iters);
+    if (n_iters) {
+      n_iters->push_back(n_iters_i);
+    }
+    if (stats) {
+      stats->n_iters.push_back(n_iters_i);
+    }
+    if (i == n_converged) {
+      break;
+    }
+
+    double sq_norm = 0;
+    for (std::size_t r = 0; r < n; ++r) {
+      eigenvectors(r, i) = x(r, i);
+      const double d = ax(r, i) - ritz_values[i] * x(r, i);
+      sq_norm += d * d;
+    }
+    if (stats) {
+      stats->residuals.push_back(std::sqrt(sq_norm));
+    }
+
+    eigenvalues.push_back(ritz_values[i]);
+  }
+
+  if (stats) {
+    stats->n_spmv += n_spmv;
   }
 
-  return std::make_pair(eigenvalues, eigenvectors);
+  return std::make_pair(std::move(eigenvalues), std::move(eigenvectors));
 }
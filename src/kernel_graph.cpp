@@ -0,0 +1,251 @@
+#include "diffusion_maps/kernel_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "diffusion_maps/allocation.hpp"
+
+diffusion_maps::KernelGraph::KernelGraph(const std::size_t n_features,
+                                         const kernel::Gaussian &kernel,
+                                         const double kernel_epsilon)
+    : _n_features(n_features), _kernel(kernel),
+      _kernel_epsilon(kernel_epsilon), _size(0) {
+  if (!(kernel_epsilon > 0 && kernel_epsilon < 1)) {
+    throw std::invalid_argument("kernel epsilon must be in (0, 1)");
+  }
+  if (!(kernel.gamma > 0)) {
+    throw std::invalid_argument("kernel parameter must be positive");
+  }
+
+  // exp(-γ r²) = ε.
+  _radius = std::sqrt(-std::log(kernel_epsilon) / kernel.gamma);
+}
+
+diffusion_maps::KernelGraph::Cell
+diffusion_maps::KernelGraph::cell_of(const Vector &point) const {
+  Cell cell{};
+  for (std::size_t d = 0; d < std::min(_n_features, MAX_GRID_DIMS); ++d) {
+    cell[d] = static_cast<std::int64_t>(std::floor(point[d] / _radius));
+  }
+  return cell;
+}
+
+std::size_t diffusion_maps::KernelGraph::insert(const Vector &point) {
+  if (point.size() != _n_features) {
+    throw std::invalid_argument("incorrect number of features");
+  }
+
+  // Allocate an ID.
+
+  std::size_t id;
+  if (_free_ids.empty()) {
+    id = _nodes.size();
+    _nodes.emplace_back();
+  } else {
+    id = _free_ids.back();
+    _free_ids.pop_back();
+  }
+
+  Node &node = _nodes[id];
+  node.live = true;
+  node.point = point;
+  node.cell = cell_of(point);
+  node.neighbours.clear();
+  node.row_sum = 0;
+
+  // Evaluate the kernel against the points in the neighbouring cells, in
+  // 3^(grid dimensions) cells in total.
+
+  const std::size_t grid_dims = std::min(_n_features, MAX_GRID_DIMS);
+  std::size_t n_cells = 1;
+  for (std::size_t d = 0; d < grid_dims; ++d) {
+    n_cells *= 3;
+  }
+
+  for (std::size_t c = 0; c < n_cells; ++c) {
+    Cell cell = node.cell;
+    for (std::size_t d = 0, rest = c; d < grid_dims; ++d, rest /= 3) {
+      cell[d] += static_cast<std::int64_t>(rest % 3) - 1;
+    }
+
+    const auto it = _grid.find(cell);
+    if (it == _grid.end()) {
+      continue;
+    }
+
+    for (const std::size_t other_id : it->second) {
+      Node &other = _nodes[other_id];
+      const double value = _kernel(point, other.point);
+      if (std::abs(value) > _kernel_epsilon) {
+        node.neighbours.emplace_back(other_id, value);
+        node.row_sum += value;
+
+        other.neighbours.insert(
+            std::lower_bound(other.neighbours.begin(), other.neighbours.end(),
+                             std::make_pair(id, 0.0)),
+            std::make_pair(id, value));
+        other.row_sum += value;
+        other.invsqrt_row_sum = 1.0 / std::sqrt(other.row_sum);
+      }
+    }
+  }
+
+  // The diagonal element.
+
+  const double self_value = _kernel(point, point);
+  if (std::abs(self_value) > _kernel_epsilon) {
+    node.neighbours.emplace_back(id, self_value);
+    node.row_sum += self_value;
+  }
+  node.invsqrt_row_sum = 1.0 / std::sqrt(node.row_sum);
+
+  std::sort(node.neighbours.begin(), node.neighbours.end());
+
+  _grid[node.cell].push_back(id);
+  ++_size;
+
+  return id;
+}
+
+void diffusion_maps::KernelGraph::remove(const std::size_t id) {
+  if (!contains(id)) {
+    throw std::out_of_range("no point with the given ID");
+  }
+
+  Node &node = _nodes[id];
+
+  // Remove the point from the rows of its neighbours.
+
+  for (const auto &[other_id, value] : node.neighbours) {
+    if (other_id == id) {
+      continue;
+    }
+
+    Node &other = _nodes[other_id];
+    const auto it =
+        std::lower_bound(other.neighbours.begin(), other.neighbours.end(),
+                         std::make_pair(id, -HUGE_VAL));
+    other.neighbours.erase(it);
+    other.row_sum -= value;
+    other.invsqrt_row_sum = 1.0 / std::sqrt(other.row_sum);
+  }
+
+  // Remove the point from the grid.
+
+  const auto cell_it = _grid.find(node.cell);
+  auto &cell_ids = cell_it->second;
+  cell_ids.erase(std::find(cell_ids.begin(), cell_ids.end(), id));
+  if (cell_ids.empty()) {
+    _grid.erase(cell_it);
+  }
+
+  node.live = false;
+  node.point = Vector();
+  node.neighbours.clear();
+  node.neighbours.shrink_to_fit();
+  node.row_sum = 0;
+  node.invsqrt_row_sum = 0;
+
+  _free_ids.push_back(id);
+  --_size;
+}
+
+const diffusion_maps::Vector &
+diffusion_maps::KernelGraph::point(const std::size_t id) const {
+  if (!contains(id)) {
+    throw std::out_of_range("no point with the given ID");
+  }
+  return _nodes[id].point;
+}
+
+std::size_t diffusion_maps::KernelGraph::degree(const std::size_t id) const {
+  if (!contains(id)) {
+    throw std::out_of_range("no point with the given ID");
+  }
+  return _nodes[id].neighbours.size();
+}
+
+double diffusion_maps::KernelGraph::row_sum(const std::size_t id) const {
+  if (!contains(id)) {
+    throw std::out_of_range("no point with the given ID");
+  }
+  return _nodes[id].row_sum;
+}
+
+double
+diffusion_maps::KernelGraph::invsqrt_row_sum(const std::size_t id) const {
+  if (!contains(id)) {
+    throw std::out_of_range("no point with the given ID");
+  }
+  return _nodes[id].invsqrt_row_sum;
+}
+
+std::vector<std::size_t> diffusion_maps::KernelGraph::ids() const {
+  std::vector<std::size_t> result;
+  result.reserve(_size);
+  for (std::size_t id = 0; id < _nodes.size(); ++id) {
+    if (_nodes[id].live) {
+      result.push_back(id);
+    }
+  }
+  return result;
+}
+
+diffusion_maps::SparseMatrix diffusion_maps::KernelGraph::export_matrix(
+    const std::vector<std::size_t> &row_ids, const Vector *const scale) const {
+  // Map IDs to rows. IDs are in ascending order, so the neighbours, which are
+  // sorted by ID, are also sorted by row.
+
+  const std::size_t n_rows = row_ids.size();
+  std::vector<std::size_t> rows(_nodes.size());
+  auto row_ixs = internal::allocate_array<std::size_t>(n_rows + 1);
+  std::size_t n_nz = 0;
+  for (std::size_t r = 0; r < n_rows; ++r) {
+    rows[row_ids[r]] = r;
+    row_ixs[r] = n_nz;
+    n_nz += _nodes[row_ids[r]].neighbours.size();
+  }
+  row_ixs[n_rows] = n_nz;
+
+  // Write the rows into the arrays, by rows with the allocation policy.
+
+  auto data = internal::allocate_array<double>(n_nz);
+  auto col_ixs = internal::allocate_array<std::size_t>(n_nz);
+  [[maybe_unused]] const bool parallel = internal::first_touch_in_parallel(
+      n_nz * (sizeof(double) + sizeof(std::size_t)));
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+  for (std::size_t r = 0; r < n_rows; ++r) {
+    std::size_t ix = row_ixs[r];
+    for (const auto &[other_id, value] : _nodes[row_ids[r]].neighbours) {
+      const std::size_t c = rows[other_id];
+      col_ixs[ix] = c;
+      data[ix] = scale ? value * (*scale)[r] * (*scale)[c] : value;
+      ++ix;
+    }
+  }
+
+  return SparseMatrix(n_rows, n_rows, std::move(data), std::move(col_ixs),
+                      std::move(row_ixs));
+}
+
+diffusion_maps::SparseMatrix
+diffusion_maps::KernelGraph::kernel_matrix() const {
+  return export_matrix(ids(), nullptr);
+}
+
+std::pair<diffusion_maps::SparseMatrix, diffusion_maps::Vector>
+diffusion_maps::KernelGraph::symmetrised_diffusion_matrix() const {
+  const std::vector<std::size_t> row_ids = ids();
+
+  Vector invsqrt_row_sum(row_ids.size());
+  for (std::size_t r = 0; r < row_ids.size(); ++r) {
+    invsqrt_row_sum[r] = _nodes[row_ids[r]].invsqrt_row_sum;
+  }
+
+  SparseMatrix diffusion_matrix = export_matrix(row_ids, &invsqrt_row_sum);
+  return std::make_pair(std::move(diffusion_matrix),
+                        std::move(invsqrt_row_sum));
+}
@@ -0,0 +1,328 @@
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+diffusion_maps::SparseMatrix diffusion_maps::internal::assemble_kernel_matrix(
+    const std::size_t n_samples,
+    std::vector<diffusion_maps::SparseMatrix::Triplet> &triplets,
+    const std::uint64_t n_kernel_evals, Stats *const stats) {
+  diffusion_maps::SparseMatrix kernel_matrix(n_samples, n_samples, triplets);
+
+  if (stats) {
+    // Only the upper triangle is evaluated, at most.
+    const std::uint64_t n_pairs = std::uint64_t{n_samples} * n_samples;
+    stats->n_kernel_evals += n_kernel_evals;
+    stats->n_kernel_evals_skipped += n_pairs - n_kernel_evals;
+    stats->record_bytes(triplets.capacity() *
+                            sizeof(diffusion_maps::SparseMatrix::Triplet) +
+                        kernel_matrix.n_bytes());
+  }
+
+  return kernel_matrix;
+}
+
+std::vector<diffusion_maps::SparseMatrix::Triplet>
+diffusion_maps::internal::compute_kernel_triplets(
+    const diffusion_maps::Matrix &data,
+    const std::function<double(const diffusion_maps::Vector &,
+                               const diffusion_maps::Vector &)> &kernel,
+    const double epsilon, Stats *const stats,
+    const diffusion_maps::Precision precision) {
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  if (visit_gaussian_kernel(kernel, [&](const auto &gaussian) {
+        triplets =
+            compute_kernel_triplets(data, gaussian, epsilon, stats, precision);
+      })) {
+    return triplets;
+  }
+
+  return collect_symmetric_triplets(
+      data.n_rows(), [&](const std::size_t i, const std::size_t j) {
+        const double value = kernel(data.row(i), data.row(j));
+        return std::abs(value) > epsilon ? value : 0.0;
+      });
+}
+
+diffusion_maps::SparseMatrix diffusion_maps::internal::compute_kernel_matrix(
+    const diffusion_maps::Matrix &data,
+    const std::function<double(const diffusion_maps::Vector &,
+                               const diffusion_maps::Vector &)> &kernel,
+    const double epsilon, Stats *const stats,
+    const diffusion_maps::Precision precision) {
+  const std::size_t n_samples = data.n_rows();
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets =
+      compute_kernel_triplets(data, kernel, epsilon, stats, precision);
+  return assemble_kernel_matrix(
+      n_samples, triplets, (std::uint64_t{n_samples} * (n_samples + 1)) / 2,
+      stats);
+}
+
+diffusion_maps::Vector
+diffusion_maps::internal::compute_symmetrised_diffusion_matrix(
+    diffusion_maps::SparseMatrix &kernel_matrix, const double alpha) {
+  if (alpha != 0) {
+    // Divide by the kernel density estimates to the power of α.
+
+    const diffusion_maps::Vector q_pow_alpha =
+        (kernel_matrix * diffusion_maps::Vector(kernel_matrix.n_rows(), 1))
+            .pow(-alpha);
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < kernel_matrix.n_rows(); ++i) {
+      for (std::size_t ir = kernel_matrix.row_ixs()[i];
+           ir < kernel_matrix.row_ixs()[i + 1]; ++ir) {
+        const std::size_t j = kernel_matrix.col_ixs()[ir];
+        kernel_matrix.data()[ir] *= q_pow_alpha[i] * q_pow_alpha[j];
+      }
+    }
+  }
+
+  const diffusion_maps::Vector invsqrt_row_sum =
+      (kernel_matrix * diffusion_maps::Vector(kernel_matrix.n_rows(), 1))
+          .inv_sqrt();
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t i = 0; i < kernel_matrix.n_rows(); ++i) {
+    for (std::size_t ir = kernel_matrix.row_ixs()[i];
+         ir < kernel_matrix.row_ixs()[i + 1]; ++ir) {
+      const std::size_t j = kernel_matrix.col_ixs()[ir];
+      double &v = kernel_matrix.data()[ir];
+
+      v *= invsqrt_row_sum[i] * invsqrt_row_sum[j];
+    }
+  }
+
+  return invsqrt_row_sum;
+}
+
+diffusion_maps::SparseMatrix
+diffusion_maps::internal::assemble_symmetrised_diffusion_matrix(
+    const std::size_t n_samples,
+    std::vector<diffusion_maps::SparseMatrix::Triplet> &triplets,
+    const double alpha, diffusion_maps::Vector &invsqrt_row_sum,
+    const std::uint64_t n_kernel_evals, Stats *const stats) {
+  using Triplet = diffusion_maps::SparseMatrix::Triplet;
+
+  // Sort the triplets by row and column indices, and find the rows.
+
+  std::sort(triplets.begin(), triplets.end());
+  const std::size_t n_nz = triplets.size();
+  auto row_ixs = allocate_array<std::size_t>(n_samples + 1);
+  for (std::size_t i = 0, t = 0; i < n_samples; ++i) {
+    row_ixs[i] = t;
+    while (t < n_nz && triplets[t].row == i) {
+      ++t;
+    }
+  }
+  row_ixs[n_samples] = n_nz;
+
+  // The row sums of the kernel matrix, then optionally of the α-normalised
+  // kernel matrix, in the order of the columns.
+
+  const Triplet *const sorted = triplets.data();
+  const std::size_t *const rows = row_ixs.get();
+  const auto row_sums = [n_samples, sorted, rows](const auto &value) {
+    diffusion_maps::Vector sums(n_samples);
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      double sum = 0;
+      for (std::size_t t = rows[i]; t < rows[i + 1]; ++t) {
+        sum += value(sorted[t]);
+      }
+      sums[i] = sum;
+    }
+    return sums;
+  };
+
+  diffusion_maps::Vector q_pow_alpha;
+  if (alpha != 0) {
+    q_pow_alpha =
+        row_sums([](const Triplet &triplet) { return triplet.value; })
+            .pow(-alpha);
+    const double *const qa = q_pow_alpha.data();
+    invsqrt_row_sum = row_sums([qa](const Triplet &triplet) {
+                        return triplet.value * (qa[triplet.row] *
+                                                qa[triplet.col]);
+                      }).inv_sqrt();
+  } else {
+    invsqrt_row_sum =
+        row_sums([](const Triplet &triplet) { return triplet.value; })
+            .inv_sqrt();
+  }
+
+  // Write the scaled values into the arrays, by rows with the allocation
+  // policy.
+
+  auto data = allocate_array<double>(n_nz);
+  auto col_ixs = allocate_array<std::size_t>(n_nz);
+  const double *const qa = alpha != 0 ? q_pow_alpha.data() : nullptr;
+  const double *const invsqrt = invsqrt_row_sum.data();
+  [[maybe_unused]] const bool parallel =
+      first_touch_in_parallel(n_nz * (sizeof(double) + sizeof(std::size_t)));
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t t = rows[i]; t < rows[i + 1]; ++t) {
+      const std::size_t j = sorted[t].col;
+      const double value =
+          qa ? sorted[t].value * (qa[i] * qa[j]) : sorted[t].value;
+      data[t] = value * (invsqrt[i] * invsqrt[j]);
+      col_ixs[t] = j;
+    }
+  }
+
+  diffusion_maps::SparseMatrix diffusion_matrix(
+      n_samples, n_samples, std::move(data), std::move(col_ixs),
+      std::move(row_ixs));
+
+  if (stats) {
+    const std::uint64_t n_pairs = std::uint64_t{n_samples} * n_samples;
+    stats->n_kernel_evals += n_kernel_evals;
+    stats->n_kernel_evals_skipped += n_pairs - n_kernel_evals;
+    stats->record_bytes(triplets.capacity() * sizeof(Triplet) +
+                        diffusion_matrix.n_bytes() +
+                        (alpha != 0 ? 2 : 1) * n_samples * sizeof(double));
+  }
+
+  return diffusion_matrix;
+}
+
+diffusion_maps::Matrix diffusion_maps::internal::compute_dense_kernel_matrix(
+    const diffusion_maps::Matrix &data,
+    const std::function<double(const diffusion_maps::Vector &,
+                               const diffusion_maps::Vector &)> &kernel,
+    const double epsilon, Stats *const stats) {
+  const std::size_t n_samples = data.n_rows();
+  diffusion_maps::Matrix kernel_matrix(n_samples, n_samples);
+  double *const k = kernel_matrix.data();
+
+  // Fill the tiles of the upper triangle, and mirror them.
+
+  const std::size_t n_blocks =
+      (n_samples + PAIR_TILE_SIZE - 1) / PAIR_TILE_SIZE;
+  const auto fill = [n_samples, n_blocks, k](const auto &element) {
+#ifdef PAR
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (std::size_t bi = 0; bi < n_blocks; ++bi) {
+      const std::size_t i_end = std::min((bi + 1) * PAIR_TILE_SIZE, n_samples);
+      for (std::size_t bj = bi; bj < n_blocks; ++bj) {
+        const std::size_t j_end =
+            std::min((bj + 1) * PAIR_TILE_SIZE, n_samples);
+        for (std::size_t i = bi * PAIR_TILE_SIZE; i < i_end; ++i) {
+          for (std::size_t j = std::max(i, bj * PAIR_TILE_SIZE); j < j_end;
+               ++j) {
+            const double value = element(i, j);
+            k[i * n_samples + j] = value;
+            k[j * n_samples + i] = value;
+          }
+        }
+      }
+    }
+  };
+
+  std::size_t points_bytes = 0;
+  if (!visit_gaussian_kernel(kernel, [&](const auto &gaussian) {
+        const std::size_t n_features = data.n_cols();
+        const diffusion_maps::Matrix points =
+            prepare_points(data, gaussian.metric);
+        const double *const x = points.data();
+        const double max_distance = max_kernel_distance(gaussian, epsilon);
+        fill([&](const std::size_t i, const std::size_t j) {
+          const double distance =
+              j == i ? 0
+                     : gaussian.metric.distance(x + i * n_features,
+                                                x + j * n_features, n_features);
+          if (!(distance < max_distance)) {
+            return 0.0;
+          }
+          const double value = std::exp(-gaussian.gamma * distance);
+          return value > epsilon ? value : 0.0;
+        });
+        points_bytes = n_samples * n_features * sizeof(double);
+      })) {
+    fill([&](const std::size_t i, const std::size_t j) {
+      const double value = kernel(data.row(i), data.row(j));
+      return std::abs(value) > epsilon ? value : 0.0;
+    });
+  }
+
+  if (stats) {
+    std::size_t n_nz = 0;
+#ifdef PAR
+#pragma omp parallel for reduction(+ : n_nz)
+#endif
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      for (std::size_t j = 0; j < n_samples; ++j) {
+        n_nz += k[i * n_samples + j] != 0;
+      }
+    }
+    const std::uint64_t n_pairs = std::uint64_t{n_samples} * n_samples;
+    const std::uint64_t n_kernel_evals =
+        (std::uint64_t{n_samples} * (n_samples + 1)) / 2;
+    stats->n_kernel_evals += n_kernel_evals;
+    stats->n_kernel_evals_skipped += n_pairs - n_kernel_evals;
+    stats->n_nz = n_nz;
+    stats->record_bytes(points_bytes + n_pairs * sizeof(double));
+  }
+
+  return kernel_matrix;
+}
+
+diffusion_maps::Vector
+diffusion_maps::internal::compute_symmetrised_diffusion_matrix(
+    diffusion_maps::Matrix &kernel_matrix, const double alpha) {
+  const std::size_t n = kernel_matrix.n_rows();
+  double *const k = kernel_matrix.data();
+  const auto row_sums = [n, k]() {
+    diffusion_maps::Vector sums(n);
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < n; ++i) {
+      double sum = 0;
+      for (std::size_t j = 0; j < n; ++j) {
+        sum += k[i * n + j];
+      }
+      sums[i] = sum;
+    }
+    return sums;
+  };
+
+  if (alpha != 0) {
+    // Divide by the kernel density estimates to the power of α.
+
+    const diffusion_maps::Vector q_pow_alpha = row_sums().pow(-alpha);
+#ifdef PAR
+#pragma omp parallel for
+#endif
+    for (std::size_t i = 0; i < n; ++i) {
+      for (std::size_t j = 0; j < n; ++j) {
+        k[i * n + j] *= q_pow_alpha[i] * q_pow_alpha[j];
+      }
+    }
+  }
+
+  const diffusion_maps::Vector invsqrt_row_sum = row_sums().inv_sqrt();
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t j = 0; j < n; ++j) {
+      k[i * n + j] *= invsqrt_row_sum[i] * invsqrt_row_sum[j];
+    }
+  }
+
+  return invsqrt_row_sum;
+}
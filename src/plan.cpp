@@ -0,0 +1,386 @@
+#include "diffusion_maps/plan.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#ifdef PAR
+#include <omp.h>
+#endif
+
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/sell_matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+
+/// \brief The name of a storage format, as in the Python module.
+///
+/// \param[in] format The storage format.
+/// \return The name.
+static const char *format_name(const diffusion_maps::MatrixFormat format) {
+  switch (format) {
+  case diffusion_maps::MatrixFormat::CSR:
+    return "csr";
+  case diffusion_maps::MatrixFormat::SELL:
+    return "sell";
+  case diffusion_maps::MatrixFormat::COMPRESSED_FLOAT:
+    return "compressed_float";
+  case diffusion_maps::MatrixFormat::COMPRESSED_BFLOAT16:
+    return "compressed_bf16";
+  }
+  return "";
+}
+
+/// \brief The name of an eigendecomposition solver, as in the Python module.
+///
+/// \param[in] eig_solver The eigendecomposition solver.
+/// \return The name.
+static const char *solver_name(const diffusion_maps::EigSolver eig_solver) {
+  switch (eig_solver) {
+  case diffusion_maps::EigSolver::POWER_METHOD:
+    return "power_method";
+  case diffusion_maps::EigSolver::RANDOMIZED:
+    return "randomized";
+  case diffusion_maps::EigSolver::CHEBYSHEV:
+    return "chebyshev";
+  case diffusion_maps::EigSolver::DENSE:
+    return "dense";
+  }
+  return "";
+}
+
+/// \brief Estimates the peak memory held by the large buffers of a fit, as
+///        recorded in Stats::peak_bytes.
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in] points_bytes The bytes held by the data points while the kernel
+///                         matrix is computed, or 0 if the diffusion matrix is
+///                         given.
+/// \param[in] dense_data Whether the data points are dense, in which case the
+///                       dense solver computes the dense matrix directly.
+/// \param[in] n_nz The number of non-zero elements of the kernel matrix.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options of the fit.
+/// \return The peak memory in bytes.
+static std::size_t estimate_peak_bytes(const std::size_t n_samples,
+                                       const std::size_t points_bytes,
+                                       const bool dense_data,
+                                       const std::uint64_t n_nz,
+                                       const std::size_t n_components,
+                                       const diffusion_maps::Options &options) {
+  const std::size_t index_bytes = sizeof(std::size_t);
+  const std::size_t csr_bytes =
+      n_nz * (sizeof(double) + index_bytes) + (n_samples + 1) * index_bytes;
+
+  // The triplets and the CSR arrays, with the row sums of the normalisation,
+  // unless the diffusion matrix is given.
+  const std::size_t assembly_bytes =
+      points_bytes > 0
+          ? 2 * n_nz * sizeof(diffusion_maps::SparseMatrix::Triplet) +
+                csr_bytes +
+                (options.alpha != 0 ? 2 : 1) * n_samples * sizeof(double)
+          : 0;
+
+  // The CSR arrays, the converted matrix and the vectors of the solver.
+  std::size_t converted_bytes = 0;
+  switch (options.matrix_format) {
+  case diffusion_maps::MatrixFormat::CSR:
+    break;
+  case diffusion_maps::MatrixFormat::SELL:
+    converted_bytes =
+        n_nz * (sizeof(double) + index_bytes) +
+        (n_samples + n_samples / diffusion_maps::SellMatrix::CHUNK_SIZE + 1) *
+            index_bytes;
+    break;
+  case diffusion_maps::MatrixFormat::COMPRESSED_FLOAT:
+  case diffusion_maps::MatrixFormat::COMPRESSED_BFLOAT16:
+    // One gap word per element, and three indices per row.
+    converted_bytes =
+        n_nz * ((options.matrix_format ==
+                         diffusion_maps::MatrixFormat::COMPRESSED_FLOAT
+                     ? sizeof(float)
+                     : sizeof(std::uint16_t)) +
+                sizeof(std::uint16_t)) +
+        3 * (n_samples + 1) * index_bytes;
+    break;
+  }
+  const std::size_t n_vectors = diffusion_maps::internal::n_solver_vectors(
+      n_samples, static_cast<unsigned>(n_components + 1), options);
+  const std::size_t solver_bytes = csr_bytes + converted_bytes +
+                                   (n_vectors + 1) * n_samples * sizeof(double);
+
+  if (options.eig_solver == diffusion_maps::EigSolver::DENSE) {
+    const std::size_t dense_bytes = n_samples * n_samples * sizeof(double);
+    const std::size_t dense_solver_bytes =
+        dense_bytes + (n_vectors + 1) * n_samples * sizeof(double);
+    if (dense_data && options.self_tuning_neighbours == 0) {
+      return std::max(points_bytes + dense_bytes, dense_solver_bytes);
+    }
+    return std::max(
+        {assembly_bytes, csr_bytes + dense_solver_bytes, points_bytes});
+  }
+  return std::max({assembly_bytes, solver_bytes, points_bytes});
+}
+
+std::string diffusion_maps::Plan::to_string() const {
+  std::ostringstream out;
+  out << "n_samples=" << n_samples << " n_nz=" << n_nz
+      << " density=" << density << " n_pairs_sampled=" << n_pairs_sampled
+      << (exhaustive ? " (exhaustive)" : "") << " peak_bytes=" << peak_bytes
+      << " kernel_time=" << kernel_time
+      << "s matrix_format=" << format_name(matrix_format)
+      << " eig_solver=" << solver_name(eig_solver);
+  return out.str();
+}
+
+/// \brief Starts the plan of a fit from a sample of the pairs of data points,
+///        see plan().
+///
+/// \param[in] n_samples The number of data points.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options of the fit.
+/// \return The plan, with the number of data points and whether the sample
+///         is exhaustive.
+/// \exception std::invalid_argument If \p n_components is greater than the
+///                                  number of data points minus 1, or if the
+///                                  planner samples no pairs.
+static diffusion_maps::Plan start_plan(const std::size_t n_samples,
+                                       const std::size_t n_components,
+                                       const diffusion_maps::Options &options) {
+  diffusion_maps::internal::check_arguments(n_samples, n_components, options);
+  if (options.plan_n_pairs == 0) {
+    throw std::invalid_argument("the planner must sample at least one pair");
+  }
+
+  diffusion_maps::Plan result;
+  result.n_samples = n_samples;
+  result.exhaustive =
+      std::uint64_t{n_samples} * (n_samples - 1) / 2 <= options.plan_n_pairs;
+  return result;
+}
+
+/// \brief Estimates the density and the number of non-zero elements of the
+///        kernel matrix, and the time of the kernel stage, from the sampled
+///        pairs of data points, see plan().
+///
+/// \tparam F The type of the predicate.
+/// \param[in,out] result The plan, from start_plan().
+/// \param[in] options The options of the fit.
+/// \param[in] above The predicate that tells whether the kernel of the i-th
+///                  and the j-th data points is above the kernel epsilon.
+template <typename F>
+static void sample_pairs(diffusion_maps::Plan &result,
+                         const diffusion_maps::Options &options,
+                         const F &above) {
+  const std::size_t n_samples = result.n_samples;
+  const std::uint64_t n_distinct =
+      std::uint64_t{n_samples} * (n_samples - 1) / 2;
+
+  // Count the sampled pairs whose kernel is above the epsilon, and time them.
+
+  std::uint64_t n_above = 0;
+  const auto start = std::chrono::steady_clock::now();
+  if (result.exhaustive) {
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      for (std::size_t j = i + 1; j < n_samples; ++j) {
+        n_above += above(i, j);
+      }
+    }
+    result.n_pairs_sampled = n_distinct;
+  } else {
+    std::default_random_engine engine;
+    std::uniform_int_distribution<std::size_t> first(0, n_samples - 1);
+    std::uniform_int_distribution<std::size_t> second(0, n_samples - 2);
+    for (unsigned k = 0; k < options.plan_n_pairs; ++k) {
+      const std::size_t i = first(engine);
+      std::size_t j = second(engine);
+      j += j >= i;
+      n_above += above(i, j);
+    }
+    result.n_pairs_sampled = options.plan_n_pairs;
+  }
+  const double sample_time =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+          .count();
+
+  result.density = result.n_pairs_sampled > 0
+                       ? static_cast<double>(n_above) / result.n_pairs_sampled
+                       : 0;
+  result.n_nz = n_samples + static_cast<std::uint64_t>(std::llround(
+                                result.density * 2 * n_distinct));
+
+  // The kernel stage evaluates the upper triangle with all the threads.
+
+  int n_threads = 1;
+#ifdef PAR
+  n_threads = omp_get_max_threads();
+#endif
+  const double n_pairs = static_cast<double>(n_distinct + n_samples);
+  result.kernel_time =
+      result.n_pairs_sampled > 0
+          ? sample_time / result.n_pairs_sampled * n_pairs / n_threads
+          : 0;
+}
+
+/// \brief Chooses the storage format and the solver of a plan, and estimates
+///        its peak memory, see plan().
+///
+/// \param[in,out] result The plan, with the estimates of the kernel matrix.
+/// \param[in] points_bytes The bytes held by the data points while the kernel
+///                         matrix is computed, or 0 if the diffusion matrix is
+///                         given.
+/// \param[in] dense_data Whether the data points are dense.
+/// \param[in] n_components The dimension of the projected subspace.
+/// \param[in] options The options of the fit.
+static void choose(diffusion_maps::Plan &result,
+                   const std::size_t points_bytes, const bool dense_data,
+                   const std::size_t n_components,
+                   const diffusion_maps::Options &options) {
+  using diffusion_maps::EigSolver;
+  using diffusion_maps::MatrixFormat;
+  const std::size_t n_samples = result.n_samples;
+
+  // Choose the storage format and the solver, falling back to the leaner ones
+  // while the estimate exceeds the budget.
+
+  diffusion_maps::Options planned = options;
+  const auto estimate = [&]() {
+    return estimate_peak_bytes(n_samples, points_bytes, dense_data,
+                               result.n_nz, n_components, planned);
+  };
+  if (options.auto_plan) {
+    const std::size_t csr_bytes =
+        result.n_nz * (sizeof(double) + sizeof(std::size_t));
+    const bool in_cache = csr_bytes <= diffusion_maps::PLAN_IN_CACHE_BYTES;
+    const EigSolver sparse_solver =
+        in_cache ? EigSolver::POWER_METHOD : EigSolver::CHEBYSHEV;
+    const bool dense =
+        result.density >= diffusion_maps::PLAN_DENSE_DENSITY &&
+        n_samples <= diffusion_maps::PLAN_DENSE_MAX_SAMPLES;
+    const auto over_budget = [&]() {
+      return options.memory_budget > 0 && estimate() > options.memory_budget;
+    };
+    planned.matrix_format =
+        in_cache ? MatrixFormat::CSR : MatrixFormat::COMPRESSED_FLOAT;
+    planned.eig_solver = dense ? EigSolver::DENSE : sparse_solver;
+    if (over_budget() && dense) {
+      planned.eig_solver = sparse_solver;
+    }
+    if (over_budget()) {
+      planned.matrix_format = MatrixFormat::CSR;
+    }
+    if (over_budget()) {
+      planned.eig_solver = EigSolver::POWER_METHOD;
+    }
+  }
+  result.matrix_format = planned.matrix_format;
+  result.eig_solver = planned.eig_solver;
+  result.peak_bytes = estimate();
+}
+
+diffusion_maps::Plan diffusion_maps::plan(
+    const Matrix &data, const std::size_t n_components,
+    const std::function<double(const Vector &, const Vector &)> &kernel,
+    const Options &options) {
+  Plan result = start_plan(data.n_rows(), n_components, options);
+
+  const double epsilon = options.kernel_epsilon;
+  if (!internal::visit_gaussian_kernel(kernel, [&](const auto &gaussian) {
+        const std::size_t n_features = data.n_cols();
+        const Matrix points = internal::prepare_points(data, gaussian.metric);
+        const double *const x = points.data();
+        const double max_distance =
+            internal::max_kernel_distance(gaussian, epsilon);
+        sample_pairs(result, options,
+                     [&](const std::size_t i, const std::size_t j) {
+                       const double distance = gaussian.metric.distance(
+                           x + i * n_features, x + j * n_features, n_features);
+                       return distance < max_distance &&
+                              std::exp(-gaussian.gamma * distance) > epsilon;
+                     });
+      })) {
+    sample_pairs(result, options,
+                 [&](const std::size_t i, const std::size_t j) {
+                   return std::abs(kernel(data.row(i), data.row(j))) >
+                          epsilon;
+                 });
+  }
+
+  choose(result, data.n_rows() * data.n_cols() * sizeof(double), true,
+         n_components, options);
+  return result;
+}
+
+diffusion_maps::Plan diffusion_maps::internal::plan_from_pairs(
+    const std::size_t n_samples, const std::size_t points_bytes,
+    const std::size_t n_components,
+    const std::function<bool(std::size_t, std::size_t)> &above,
+    const Options &options) {
+  Plan result = start_plan(n_samples, n_components, options);
+  sample_pairs(result, options, above);
+  choose(result, points_bytes, false, n_components, options);
+  return result;
+}
+
+diffusion_maps::Plan diffusion_maps::internal::plan_from_diffusion_matrix(
+    const SparseMatrix &diffusion_matrix, const std::size_t n_components,
+    const Options &options) {
+  const std::size_t n_samples = diffusion_matrix.n_rows();
+  check_arguments(n_samples, n_components, options);
+
+  // The non-zero elements are known, and the kernel stage is already done.
+
+  Plan result;
+  result.n_samples = n_samples;
+  result.exhaustive = true;
+  result.n_nz = diffusion_matrix.n_nz();
+  const std::uint64_t n_off_diagonal =
+      std::uint64_t{n_samples} * (n_samples - 1);
+  result.density =
+      n_off_diagonal > 0 && result.n_nz > n_samples
+          ? static_cast<double>(result.n_nz - n_samples) / n_off_diagonal
+          : 0;
+  choose(result, 0, false, n_components, options);
+  return result;
+}
+
+diffusion_maps::Options diffusion_maps::internal::plan_fit(
+    const std::size_t n_samples, const std::size_t points_bytes,
+    const std::size_t n_components,
+    const std::function<bool(std::size_t, std::size_t)> &above,
+    const Options &options) {
+  return apply_plan(
+      plan_from_pairs(n_samples, points_bytes, n_components, above, options),
+      options);
+}
+
+diffusion_maps::Options
+diffusion_maps::internal::apply_plan(const Plan &plan,
+                                     const Options &options) {
+  if (options.plan) {
+    *options.plan = plan;
+  }
+  check_memory_budget(plan, options.memory_budget);
+
+  Options planned = options.auto_plan ? plan.apply(options) : options;
+  planned.memory_budget = 0;
+  planned.auto_plan = false;
+  planned.plan = nullptr;
+  return planned;
+}
+
+void diffusion_maps::internal::check_memory_budget(
+    const Plan &plan, const std::size_t memory_budget) {
+  if (memory_budget > 0 && plan.peak_bytes > memory_budget) {
+    throw std::invalid_argument(
+        "the estimated peak memory of " + std::to_string(plan.peak_bytes) +
+        " bytes, for about " + std::to_string(plan.n_nz) +
+        " non-zero elements in the kernel matrix, exceeds the memory budget "
+        "of " +
+        std::to_string(memory_budget) +
+        " bytes; a narrower kernel or a larger kernel epsilon gives a sparser "
+        "kernel matrix");
+  }
+}
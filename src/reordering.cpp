@@ -0,0 +1,214 @@
+#include "diffusion_maps/internal/reordering.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+
+#include "diffusion_maps/allocation.hpp"
+
+std::vector<std::size_t>
+diffusion_maps::internal::reverse_cuthill_mckee(const SparseMatrix &a) {
+  if (a.n_rows() != a.n_cols()) {
+    throw std::invalid_argument("matrix is not square");
+  }
+
+  const std::size_t n = a.n_rows();
+  const std::size_t *const row_ixs = a.row_ixs();
+  const std::size_t *const col_ixs = a.col_ixs();
+
+  std::vector<std::size_t> degree(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    degree[i] = row_ixs[i + 1] - row_ixs[i];
+  }
+
+  // Start each component from a vertex of minimum degree, which tends to be on
+  // the periphery of the graph.
+
+  std::vector<std::size_t> by_degree(n);
+  std::iota(by_degree.begin(), by_degree.end(), 0);
+  std::stable_sort(by_degree.begin(), by_degree.end(),
+                   [&degree](const std::size_t i, const std::size_t j) {
+                     return degree[i] < degree[j];
+                   });
+
+  std::vector<std::size_t> order;
+  order.reserve(n);
+  std::vector<bool> visited(n);
+  std::vector<std::size_t> neighbours;
+
+  for (const std::size_t start : by_degree) {
+    if (visited[start]) {
+      continue;
+    }
+    visited[start] = true;
+    order.push_back(start);
+
+    // Breadth-first search, using the order itself as the queue.
+
+    for (std::size_t head = order.size() - 1; head < order.size(); ++head) {
+      const std::size_t i = order[head];
+      neighbours.clear();
+      for (std::size_t ir = row_ixs[i]; ir < row_ixs[i + 1]; ++ir) {
+        const std::size_t j = col_ixs[ir];
+        if (!visited[j]) {
+          visited[j] = true;
+          neighbours.push_back(j);
+        }
+      }
+      std::stable_sort(neighbours.begin(), neighbours.end(),
+                       [&degree](const std::size_t i, const std::size_t j) {
+                         return degree[i] < degree[j];
+                       });
+      order.insert(order.end(), neighbours.begin(), neighbours.end());
+    }
+  }
+
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+std::vector<std::size_t>
+diffusion_maps::internal::morton_order(const Matrix &data) {
+  const std::size_t n = data.n_rows();
+  const std::size_t n_dims = std::min<std::size_t>(data.n_cols(), 63);
+  if (n_dims == 0) {
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    return order;
+  }
+  const unsigned bits = std::min<unsigned>(21, 63 / n_dims);
+  const double max_cell = static_cast<double>((std::uint64_t{1} << bits) - 1);
+
+  // The bounding box of the points.
+
+  std::vector<double> lo(n_dims, std::numeric_limits<double>::infinity());
+  std::vector<double> hi(n_dims, -std::numeric_limits<double>::infinity());
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t d = 0; d < n_dims; ++d) {
+      lo[d] = std::min(lo[d], data(i, d));
+      hi[d] = std::max(hi[d], data(i, d));
+    }
+  }
+
+  // Interleave the bits of the quantised coordinates, most significant first.
+
+  std::vector<std::pair<std::uint64_t, std::size_t>> codes(n);
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t i = 0; i < n; ++i) {
+    std::uint64_t code = 0;
+    std::uint64_t cells[63];
+    for (std::size_t d = 0; d < n_dims; ++d) {
+      const double extent = hi[d] - lo[d];
+      cells[d] = extent > 0 ? static_cast<std::uint64_t>(
+                                  (data(i, d) - lo[d]) / extent * max_cell)
+                            : 0;
+    }
+    for (unsigned b = bits; b-- > 0;) {
+      for (std::size_t d = 0; d < n_dims; ++d) {
+        code = code << 1 | (cells[d] >> b & 1);
+      }
+    }
+    codes[i] = {code, i};
+  }
+
+  std::sort(codes.begin(), codes.end());
+
+  std::vector<std::size_t> order(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    order[i] = codes[i].second;
+  }
+  return order;
+}
+
+diffusion_maps::SparseMatrix
+diffusion_maps::internal::permute(const SparseMatrix &a,
+                                  const std::vector<std::size_t> &perm) {
+  if (a.n_rows() != a.n_cols()) {
+    throw std::invalid_argument("matrix is not square");
+  }
+  if (perm.size() != a.n_rows()) {
+    throw std::invalid_argument("incompatible dimensions");
+  }
+
+  const std::size_t n = a.n_rows();
+  std::vector<std::size_t> inv_perm(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    inv_perm[perm[i]] = i;
+  }
+
+  auto data = allocate_array<double>(a.n_nz());
+  auto col_ixs = allocate_array<std::size_t>(a.n_nz());
+  auto row_ixs = allocate_array<std::size_t>(n + 1);
+
+  row_ixs[0] = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    const std::size_t old_i = perm[i];
+    const std::size_t row_size = a.row_ixs()[old_i + 1] - a.row_ixs()[old_i];
+    row_ixs[i + 1] = row_ixs[i] + row_size;
+  }
+
+  // Write the permuted rows into the arrays, by rows with the allocation
+  // policy.
+
+  [[maybe_unused]] const bool parallel = first_touch_in_parallel(
+      a.n_nz() * (sizeof(double) + sizeof(std::size_t)));
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+  for (std::size_t i = 0; i < n; ++i) {
+    const std::size_t old_i = perm[i];
+    std::vector<std::pair<std::size_t, double>> row;
+    row.reserve(row_ixs[i + 1] - row_ixs[i]);
+    for (std::size_t ir = a.row_ixs()[old_i]; ir < a.row_ixs()[old_i + 1];
+         ++ir) {
+      row.emplace_back(inv_perm[a.col_ixs()[ir]], a.data()[ir]);
+    }
+    std::sort(row.begin(), row.end());
+
+    for (std::size_t k = 0; k < row.size(); ++k) {
+      col_ixs[row_ixs[i] + k] = row[k].first;
+      data[row_ixs[i] + k] = row[k].second;
+    }
+  }
+
+  return SparseMatrix(n, n, std::move(data), std::move(col_ixs),
+                      std::move(row_ixs));
+}
+
+diffusion_maps::Vector
+diffusion_maps::internal::permute(const Vector &v,
+                                  const std::vector<std::size_t> &perm) {
+  Vector result(perm.size());
+  for (std::size_t i = 0; i < perm.size(); ++i) {
+    result[i] = v[perm[i]];
+  }
+  return result;
+}
+
+diffusion_maps::Vector
+diffusion_maps::internal::unpermute(const Vector &v,
+                                    const std::vector<std::size_t> &perm) {
+  Vector result(perm.size());
+  for (std::size_t i = 0; i < perm.size(); ++i) {
+    result[perm[i]] = v[i];
+  }
+  return result;
+}
+
+diffusion_maps::Matrix
+diffusion_maps::internal::unpermute(const Matrix &m,
+                                    const std::vector<std::size_t> &perm) {
+  Matrix result(perm.size(), m.n_cols(), Layout::COLUMN_MAJOR);
+  for (std::size_t j = 0; j < m.n_cols(); ++j) {
+    for (std::size_t i = 0; i < perm.size(); ++i) {
+      result(perm[i], j) = m(i, j);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,183 @@
+#include "diffusion_maps/sell_matrix.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+#if defined(__AVX512F__) || (defined(__AVX2__) && defined(__FMA__))
+#include <immintrin.h>
+#endif
+
+diffusion_maps::SellMatrix::SellMatrix(const SparseMatrix &a,
+                                       const std::size_t sigma)
+    : _n_rows(a.n_rows()), _n_cols(a.n_cols()), _n_nz(a.n_nz()),
+      _sigma(sigma) {
+  if (sigma == 0) {
+    throw std::invalid_argument("sigma must be positive");
+  }
+
+  const std::size_t *const row_ixs = a.row_ixs();
+  const auto row_length = [row_ixs](const std::size_t i) {
+    return row_ixs[i + 1] - row_ixs[i];
+  };
+
+  // Sort the rows within each window by descending length. The sort is stable
+  // so that rows of equal length keep their order.
+
+  const std::size_t n_chunks = (_n_rows + CHUNK_SIZE - 1) / CHUNK_SIZE;
+  _row_perm.resize(n_chunks * CHUNK_SIZE);
+  std::iota(_row_perm.begin(), _row_perm.begin() + _n_rows, 0);
+  for (std::size_t start = 0; start < _n_rows; start += sigma) {
+    const std::size_t stop = std::min(start + sigma, _n_rows);
+    std::stable_sort(_row_perm.begin() + start, _row_perm.begin() + stop,
+                     [&row_length](const std::size_t i, const std::size_t j) {
+                       return row_length(i) > row_length(j);
+                     });
+  }
+
+  // The slots after the last row are empty rows of the last chunk. They point
+  // past the end so that their results are discarded.
+
+  std::fill(_row_perm.begin() + _n_rows, _row_perm.end(), _n_rows);
+
+  // Each chunk is as wide as its longest row.
+
+  _chunk_ixs.resize(n_chunks + 1);
+  _chunk_ixs[0] = 0;
+  for (std::size_t c = 0; c < n_chunks; ++c) {
+    std::size_t width = 0;
+    for (std::size_t lane = 0; lane < CHUNK_SIZE; ++lane) {
+      const std::size_t i = _row_perm[c * CHUNK_SIZE + lane];
+      if (i < _n_rows) {
+        width = std::max(width, row_length(i));
+      }
+    }
+    _chunk_ixs[c + 1] = _chunk_ixs[c] + width * CHUNK_SIZE;
+  }
+
+  _data.assign(_chunk_ixs[n_chunks], 0);
+  _col_ixs.assign(_chunk_ixs[n_chunks], 0);
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t c = 0; c < n_chunks; ++c) {
+    for (std::size_t lane = 0; lane < CHUNK_SIZE; ++lane) {
+      const std::size_t i = _row_perm[c * CHUNK_SIZE + lane];
+      if (i >= _n_rows) {
+        continue;
+      }
+      for (std::size_t j = 0; j < row_length(i); ++j) {
+        const std::size_t ix = _chunk_ixs[c] + j * CHUNK_SIZE + lane;
+        _data[ix] = a.data()[row_ixs[i] + j];
+        _col_ixs[ix] = a.col_ixs()[row_ixs[i] + j];
+      }
+    }
+  }
+}
+
+diffusion_maps::Vector
+diffusion_maps::SellMatrix::operator*(const Vector &v) const {
+  Vector result(_n_rows);
+  multiply(v, result);
+  return result;
+}
+
+void diffusion_maps::SellMatrix::multiply(const Vector &v,
+                                          Vector &result) const {
+  if (_n_cols != v.size() || _n_rows != result.size())
+    throw std::invalid_argument("incompatible dimensions");
+
+  const std::size_t n_chunks = _chunk_ixs.size() - 1;
+  const double *const x = v.data();
+  const double *const data = _data.data();
+  const std::size_t *const col_ixs = _col_ixs.data();
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t c = 0; c < n_chunks; ++c) {
+    alignas(64) double sums[CHUNK_SIZE];
+
+#if defined(__AVX512F__)
+    __m512d acc = _mm512_setzero_pd();
+    for (std::size_t ix = _chunk_ixs[c]; ix < _chunk_ixs[c + 1];
+         ix += CHUNK_SIZE) {
+      const __m512i cols = _mm512_loadu_si512(col_ixs + ix);
+      // The masked gather with a zero source is the same as the unmasked one,
+      // but does not trip GCC's uninitialised-variable warning.
+      const __m512d xs = _mm512_mask_i64gather_pd(
+          _mm512_setzero_pd(), 0xff, cols, x, sizeof(double));
+      acc = _mm512_fmadd_pd(_mm512_loadu_pd(data + ix), xs, acc);
+    }
+    _mm512_store_pd(sums, acc);
+#elif defined(__AVX2__) && defined(__FMA__)
+    __m256d acc_lo = _mm256_setzero_pd(), acc_hi = _mm256_setzero_pd();
+    for (std::size_t ix = _chunk_ixs[c]; ix < _chunk_ixs[c + 1];
+         ix += CHUNK_SIZE) {
+      const __m256i cols_lo = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(col_ixs + ix));
+      const __m256i cols_hi = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i *>(col_ixs + ix + 4));
+      acc_lo = _mm256_fmadd_pd(
+          _mm256_loadu_pd(data + ix),
+          _mm256_i64gather_pd(x, cols_lo, sizeof(double)), acc_lo);
+      acc_hi = _mm256_fmadd_pd(
+          _mm256_loadu_pd(data + ix + 4),
+          _mm256_i64gather_pd(x, cols_hi, sizeof(double)), acc_hi);
+    }
+    _mm256_store_pd(sums, acc_lo);
+    _mm256_store_pd(sums + 4, acc_hi);
+#else
+    std::fill_n(sums, CHUNK_SIZE, 0.0);
+    for (std::size_t ix = _chunk_ixs[c]; ix < _chunk_ixs[c + 1];
+         ix += CHUNK_SIZE) {
+      for (std::size_t lane = 0; lane < CHUNK_SIZE; ++lane) {
+        sums[lane] += data[ix + lane] * x[col_ixs[ix + lane]];
+      }
+    }
+#endif
+
+    for (std::size_t lane = 0; lane < CHUNK_SIZE; ++lane) {
+      const std::size_t i = _row_perm[c * CHUNK_SIZE + lane];
+      if (i < _n_rows) {
+        result[i] = sums[lane];
+      }
+    }
+  }
+}
+
+diffusion_maps::Matrix
+diffusion_maps::SellMatrix::operator*(const Matrix &m) const {
+  if (_n_cols != m.n_rows())
+    throw std::invalid_argument("incompatible dimensions");
+
+  const std::size_t n_cols = m.n_cols();
+  Matrix result(_n_rows, n_cols);
+  const std::size_t n_chunks = _chunk_ixs.size() - 1;
+
+#ifdef PAR
+#pragma omp parallel for
+#endif
+  for (std::size_t c = 0; c < n_chunks; ++c) {
+    for (std::size_t lane = 0; lane < CHUNK_SIZE; ++lane) {
+      const std::size_t i = _row_perm[c * CHUNK_SIZE + lane];
+      if (i >= _n_rows) {
+        continue;
+      }
+      for (std::size_t k = 0; k < n_cols; ++k) {
+        result(i, k) = 0;
+      }
+      for (std::size_t ix = _chunk_ixs[c] + lane; ix < _chunk_ixs[c + 1];
+           ix += CHUNK_SIZE) {
+        const double value = _data[ix];
+        const std::size_t col = _col_ixs[ix];
+        for (std::size_t k = 0; k < n_cols; ++k) {
+          result(i, k) += value * m(col, k);
+        }
+      }
+    }
+  }
+
+  return result;
+}
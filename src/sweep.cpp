@@ -0,0 +1,213 @@
+#include "diffusion_maps/sweep.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include "diffusion_maps/allocation.hpp"
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/metric.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+/// \brief Computes the squared distances between all pairs of data points
+///        within a cutoff distance.
+///
+/// The pairs are visited in tiles by collect_symmetric_triplets(), which drops
+/// zero elements, so a zero distance, as on the diagonal, is stored as the
+/// smallest positive double instead. Its kernel is still exactly 1.
+///
+/// \param[in] data The data matrix where each row is a data point.
+/// \param[in] sq_cutoff The square of the cutoff distance.
+/// \return The sparse matrix of the squared distances, including the diagonal.
+static diffusion_maps::SparseMatrix
+compute_sq_distance_graph(const diffusion_maps::Matrix &data,
+                          const double sq_cutoff) {
+  const std::size_t n_samples = data.n_rows();
+  const std::size_t n_features = data.n_cols();
+  const diffusion_maps::metric::SqEuclidean metric;
+  const diffusion_maps::Matrix points =
+      diffusion_maps::internal::prepare_points(data, metric);
+  const double *const x = points.data();
+  constexpr double zero_distance = std::numeric_limits<double>::denorm_min();
+
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets =
+      diffusion_maps::internal::collect_symmetric_triplets(
+          n_samples, [&](const std::size_t i, const std::size_t j) {
+            const double sq_distance =
+                j == i ? 0
+                       : metric.distance(x + i * n_features,
+                                         x + j * n_features, n_features);
+            if (!(sq_distance <= sq_cutoff)) {
+              return 0.0;
+            }
+            return sq_distance > 0 ? sq_distance : zero_distance;
+          });
+
+  return diffusion_maps::SparseMatrix(n_samples, n_samples, triplets);
+}
+
+/// \brief Derives the kernel matrix of the Gaussian kernel from the squared
+///        distances.
+///
+/// \param[in] sq_distance_graph The squared distances, computed with a cutoff
+///                              no tighter than that of \p setting.
+/// \param[in] setting The setting of the hyperparameters.
+/// \return The kernel matrix. It has the same non-zero elements as the one
+///         compute_kernel_matrix() computes with the same setting.
+static diffusion_maps::SparseMatrix
+derive_kernel_matrix(const diffusion_maps::SparseMatrix &sq_distance_graph,
+                     const diffusion_maps::SweepSetting &setting) {
+  const std::size_t n_rows = sq_distance_graph.n_rows();
+  const std::size_t *const src_row_ixs = sq_distance_graph.row_ixs();
+  const std::size_t *const src_col_ixs = sq_distance_graph.col_ixs();
+  const double *const src_data = sq_distance_graph.data();
+
+  // Evaluate the kernel on the cached distances, then drop the elements below
+  // the kernel epsilon of this setting. The elements kept in each row are
+  // counted first, so that the arrays can be written by rows with the
+  // allocation policy.
+
+  auto row_ixs = diffusion_maps::internal::allocate_array<std::size_t>(
+      n_rows + 1);
+  row_ixs[0] = 0;
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    std::size_t row_n_nz = 0;
+    for (std::size_t ir = src_row_ixs[i]; ir < src_row_ixs[i + 1]; ++ir) {
+      row_n_nz += std::exp(-setting.gamma * src_data[ir]) >
+                  setting.kernel_epsilon;
+    }
+    row_ixs[i + 1] = row_ixs[i] + row_n_nz;
+  }
+  const std::size_t n_nz = row_ixs[n_rows];
+
+  auto data = diffusion_maps::internal::allocate_array<double>(n_nz);
+  auto col_ixs = diffusion_maps::internal::allocate_array<std::size_t>(n_nz);
+  [[maybe_unused]] const bool parallel =
+      diffusion_maps::internal::first_touch_in_parallel(
+          n_nz * (sizeof(double) + sizeof(std::size_t)));
+#ifdef PAR
+#pragma omp parallel for schedule(static) if (parallel)
+#endif
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    std::size_t ix = row_ixs[i];
+    for (std::size_t ir = src_row_ixs[i]; ir < src_row_ixs[i + 1]; ++ir) {
+      const double value = std::exp(-setting.gamma * src_data[ir]);
+      if (value > setting.kernel_epsilon) {
+        data[ix] = value;
+        col_ixs[ix] = src_col_ixs[ir];
+        ++ix;
+      }
+    }
+  }
+
+  return diffusion_maps::SparseMatrix(n_rows, n_rows, std::move(data),
+                                      std::move(col_ixs), std::move(row_ixs));
+}
+
+std::vector<diffusion_maps::SweepResult> diffusion_maps::internal::sweep(
+    const Matrix &data, const std::size_t n_components,
+    const std::vector<SweepSetting> &settings, const Options &options,
+    const std::vector<std::uint_fast32_t> &seeds) {
+  const std::size_t n_samples = data.n_rows();
+
+  // The warm start, the stats, the monitor and the plan are ignored, see
+  // sweep().
+
+  Options fit_options = options;
+  fit_options.warm_start = nullptr;
+  fit_options.stats = nullptr;
+  fit_options.monitor = nullptr;
+  fit_options.plan = nullptr;
+  check_arguments(n_samples, n_components, fit_options);
+  if (options.self_tuning_neighbours != 0) {
+    throw std::invalid_argument(
+        "a sweep does not support self-tuning bandwidths");
+  }
+  if (options.reordering != Reordering::NONE) {
+    throw std::invalid_argument("a sweep does not reorder the data points");
+  }
+  if (options.kernel_precision != Precision::DOUBLE) {
+    throw std::invalid_argument(
+        "a sweep computes the distances in double precision");
+  }
+
+  // The loosest cutoff distance: exp(-γ r²) = ε.
+
+  double sq_cutoff = 0;
+  for (const SweepSetting &setting : settings) {
+    if (!(setting.gamma > 0)) {
+      throw std::invalid_argument("kernel parameter must be positive");
+    }
+    if (!(setting.kernel_epsilon > 0 && setting.kernel_epsilon < 1)) {
+      throw std::invalid_argument("kernel epsilon must be in (0, 1)");
+    }
+    sq_cutoff = std::max(sq_cutoff,
+                         -std::log(setting.kernel_epsilon) / setting.gamma);
+  }
+
+  // Leave some slack for rounding. The elements beyond the cutoff of each
+  // setting are dropped when its kernel matrix is derived.
+
+  const SparseMatrix sq_distance_graph =
+      compute_sq_distance_graph(data, sq_cutoff * (1 + 1e-9));
+
+  // Request one extra eigenpair for the eigengap when possible.
+
+  const std::size_t n_solved_components =
+      std::min(n_components + 1, n_samples - 1);
+
+  std::vector<SweepResult> results(settings.size());
+  std::vector<std::exception_ptr> exceptions(settings.size());
+
+#ifdef PAR
+#pragma omp parallel for schedule(dynamic)
+#endif
+  for (std::size_t s = 0; s < settings.size(); ++s) {
+    try {
+      SweepResult &result = results[s];
+      result.setting = settings[s];
+
+      SparseMatrix diffusion_matrix =
+          derive_kernel_matrix(sq_distance_graph, settings[s]);
+      result.n_nz = diffusion_matrix.n_nz();
+      Vector invsqrt_row_sum =
+          compute_symmetrised_diffusion_matrix(diffusion_matrix, options.alpha);
+
+      std::default_random_engine engine(seeds[s]);
+      std::normal_distribution dist;
+      result.decomposition = decompose(
+          diffusion_matrix, std::move(invsqrt_row_sum), n_solved_components,
+          fit_options, [&engine, &dist]() { return dist(engine); });
+
+      // Compute the eigengap, then drop the extra eigenpair.
+
+      std::vector<double> &eigenvalues = result.decomposition.eigenvalues;
+      result.eigengap =
+          eigenvalues.size() > n_components + 1
+              ? (eigenvalues[n_components] - eigenvalues[n_components + 1]) /
+                    eigenvalues[n_components]
+              : std::numeric_limits<double>::quiet_NaN();
+      if (eigenvalues.size() > n_components + 1) {
+        eigenvalues.resize(n_components + 1);
+        result.decomposition.eigenvectors.truncate_cols(n_components + 1);
+      }
+    } catch (...) {
+      exceptions[s] = std::current_exception();
+    }
+  }
+
+  // Report the failure of the first setting, whatever the scheduling.
+
+  for (const std::exception_ptr &exception : exceptions) {
+    if (exception) {
+      std::rethrow_exception(exception);
+    }
+  }
+
+  return results;
+}
@@ -0,0 +1,116 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/batch.hpp"
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+
+#define PI 3.14159265358979323846
+
+/// Samples a noisy helix.
+static diffusion_maps::Matrix make_helix(const std::size_t n_samples,
+                                         std::default_random_engine &rng) {
+  std::normal_distribution noise(0., 0.01);
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t) + noise(rng);
+    helix(i, 1) = std::sin(t) + noise(rng);
+    helix(i, 2) = t / (4 * PI) - 1 + noise(rng);
+  }
+  return helix;
+}
+
+Test(batch, decompose_batch_helices) {
+  // Data: helices of different sizes
+  // Dimensions after reduction: 2
+  // Expected result: the same eigendecompositions and embeddings as the
+  //                  individual fits with the seeds drawn by the batch
+
+  std::default_random_engine data_rng(42);
+  std::vector<diffusion_maps::Matrix> datasets;
+  for (const std::size_t n_samples : {80, 200, 120, 160, 100}) {
+    datasets.push_back(make_helix(n_samples, data_rng));
+  }
+  const std::vector<diffusion_maps::BatchKernel> kernels = {
+      diffusion_maps::kernel::Gaussian(50)};
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+
+  std::default_random_engine rng(7);
+  std::default_random_engine seed_rng = rng;
+  const auto decompositions =
+      diffusion_maps::decompose_batch(datasets, 2, kernels, rng, options);
+  cr_assert_eq(decompositions.size(), datasets.size(),
+               "Number of results %zu is incorrect", decompositions.size());
+
+  const std::vector<std::uint_fast32_t> seeds =
+      diffusion_maps::internal::draw_batch_seeds(datasets.size(), seed_rng);
+  for (std::size_t d = 0; d < datasets.size(); ++d) {
+    std::default_random_engine fit_rng(seeds[d]);
+    const auto expected = diffusion_maps::decompose(datasets[d], 2, kernels[0],
+                                                    fit_rng, options);
+    const auto &decomposition = decompositions[d];
+    cr_assert_eq(decomposition.n_samples(), datasets[d].n_rows());
+    cr_assert_eq(decomposition.eigenvalues.size(),
+                 expected.eigenvalues.size());
+    for (std::size_t k = 0; k < expected.eigenvalues.size(); ++k) {
+      cr_assert_eq(decomposition.eigenvalues[k], expected.eigenvalues[k],
+                   "Eigenvalue %zu of dataset %zu differs", k, d);
+      for (std::size_t i = 0; i < datasets[d].n_rows(); ++i) {
+        cr_assert_eq(decomposition.eigenvectors(i, k),
+                     expected.eigenvectors(i, k),
+                     "Eigenvector %zu of dataset %zu differs", k, d);
+      }
+    }
+  }
+
+  // The embeddings are those of the individual fits as well.
+
+  std::default_random_engine embed_rng(7);
+  const auto embeddings = diffusion_maps::diffusion_maps_batch(
+      datasets, 2, kernels, 1, embed_rng, options);
+  for (std::size_t d = 0; d < datasets.size(); ++d) {
+    const auto expected = decompositions[d].embed(1);
+    cr_assert_eq(embeddings[d].n_rows(), expected.n_rows());
+    cr_assert_eq(embeddings[d].n_cols(), expected.n_cols());
+    for (std::size_t i = 0; i < expected.n_rows(); ++i) {
+      for (std::size_t j = 0; j < expected.n_cols(); ++j) {
+        cr_assert_eq(embeddings[d](i, j), expected(i, j),
+                     "Embedding of dataset %zu differs", d);
+      }
+    }
+  }
+}
+
+Test(batch, batch_errors) {
+  // Data: helices, one of which is too small for the number of components
+  // Expected result: std::invalid_argument
+
+  std::default_random_engine rng(42);
+  std::vector<diffusion_maps::Matrix> datasets;
+  for (const std::size_t n_samples : {50, 2, 60}) {
+    datasets.push_back(make_helix(n_samples, rng));
+  }
+  const diffusion_maps::BatchKernel kernel =
+      diffusion_maps::kernel::Gaussian(50);
+
+  cr_assert_throw(
+      diffusion_maps::decompose_batch(datasets, 2, {kernel, kernel}, rng),
+      std::invalid_argument);
+  cr_assert_throw(diffusion_maps::decompose_batch(datasets, 2, {kernel}, rng),
+                  std::invalid_argument);
+  datasets.erase(datasets.begin() + 1);
+  cr_assert_throw(
+      diffusion_maps::diffusion_maps_batch(datasets, 2, {kernel}, -1, rng),
+      std::invalid_argument);
+  cr_assert(diffusion_maps::decompose_batch({}, 2, {kernel}, rng).empty(),
+            "An empty batch has results");
+}
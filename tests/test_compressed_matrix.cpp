@@ -0,0 +1,170 @@
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/compressed_matrix.hpp"
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+#define PI 3.14159265358979323846
+
+Test(compressed_matrix, compressed_matrix_random) {
+  // Data: a random sparse matrix with empty rows, and gaps between column
+  //       indices of all sizes, including ones that need escaped words
+  // Expected result: the matrix decompresses to the same column indices and
+  //                  rounded values, and the products are the same as with
+  //                  the CSR format, up to the rounding of the values
+
+  const std::size_t n_rows = 41, n_cols = 200000;
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(-1, 1);
+  std::uniform_int_distribution<std::size_t> length_dist(0, 20);
+  std::uniform_int_distribution<std::size_t> small_gap_dist(1, 40);
+  std::uniform_int_distribution<std::size_t> large_gap_dist(1, 70000);
+
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    const std::size_t length = i % 5 == 0 ? 0 : length_dist(rng);
+    std::size_t j = small_gap_dist(rng);
+    for (std::size_t k = 0; k < length && j < n_cols; ++k) {
+      triplets.push_back({i, j, dist(rng)});
+      j += k % 4 == 3 ? large_gap_dist(rng) : small_gap_dist(rng);
+    }
+  }
+  const diffusion_maps::SparseMatrix csr(n_rows, n_cols, triplets);
+  std::size_t n_gaps = 0;
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    const std::size_t length = csr.row_ixs()[i + 1] - csr.row_ixs()[i];
+    n_gaps += length > 0 ? length - 1 : 0;
+  }
+
+  diffusion_maps::Vector v(n_cols);
+  diffusion_maps::Matrix m(n_cols, 3);
+  for (std::size_t i = 0; i < n_cols; ++i) {
+    v[i] = dist(rng);
+    for (std::size_t k = 0; k < 3; ++k) {
+      m(i, k) = dist(rng);
+    }
+  }
+
+  const std::vector<std::pair<diffusion_maps::ValuePrecision, double>>
+      precisions = {{diffusion_maps::ValuePrecision::DOUBLE, 0},
+                    {diffusion_maps::ValuePrecision::FLOAT, 1e-7},
+                    {diffusion_maps::ValuePrecision::BFLOAT16, 4e-3}};
+  for (const auto &[precision, tol] : precisions) {
+    const diffusion_maps::CompressedMatrix compressed(csr, precision);
+    cr_assert_eq(compressed.n_rows(), n_rows);
+    cr_assert_eq(compressed.n_cols(), n_cols);
+    cr_assert_eq(compressed.n_nz(), csr.n_nz());
+    cr_assert_gt(compressed.n_gap_words(), n_gaps, "No gap was escaped");
+
+    const diffusion_maps::SparseMatrix decompressed = compressed.decompress();
+    cr_assert_eq(decompressed.n_nz(), csr.n_nz());
+    for (std::size_t i = 0; i <= n_rows; ++i) {
+      cr_assert_eq(decompressed.row_ixs()[i], csr.row_ixs()[i]);
+    }
+    for (std::size_t ir = 0; ir < csr.n_nz(); ++ir) {
+      cr_assert_eq(decompressed.col_ixs()[ir], csr.col_ixs()[ir],
+                   "Column index %zu is incorrect", ir);
+      cr_assert_leq(std::abs(decompressed.data()[ir] - csr.data()[ir]),
+                    tol * std::abs(csr.data()[ir]), "Value %zu is incorrect",
+                    ir);
+    }
+
+    // The products are those of the rounded values.
+
+    const diffusion_maps::Vector expected_v = decompressed * v;
+    const diffusion_maps::Matrix expected_m = decompressed * m;
+    const diffusion_maps::Vector result_v = compressed * v;
+    const diffusion_maps::Matrix result_m = compressed * m;
+    for (std::size_t i = 0; i < n_rows; ++i) {
+      cr_assert_float_eq(result_v[i], expected_v[i], 1e-12,
+                         "Element %zu is incorrect", i);
+      for (std::size_t k = 0; k < 3; ++k) {
+        cr_assert_float_eq(result_m(i, k), expected_m(i, k), 1e-12,
+                           "Element (%zu, %zu) is incorrect", i, k);
+      }
+    }
+  }
+
+  // A gap of more than 30 bits takes three words.
+
+  const std::size_t wide = std::size_t{1} << 40;
+  std::vector<diffusion_maps::SparseMatrix::Triplet> wide_triplets = {
+      {0, 3, 1}, {0, wide - 2, 2}, {1, wide - 1, 3}};
+  const diffusion_maps::CompressedMatrix wide_compressed(
+      diffusion_maps::SparseMatrix(2, wide, wide_triplets));
+  cr_assert_eq(wide_compressed.n_gap_words(), 3);
+  const diffusion_maps::SparseMatrix wide_decompressed =
+      wide_compressed.decompress();
+  cr_assert_eq(wide_decompressed.col_ixs()[0], 3);
+  cr_assert_eq(wide_decompressed.col_ixs()[1], wide - 2);
+  cr_assert_eq(wide_decompressed.col_ixs()[2], wide - 1);
+}
+
+Test(compressed_matrix, to_bfloat16) {
+  // Data: values at and between bfloat16 numbers
+  // Expected result: rounding to the nearest, with ties to even
+
+  using diffusion_maps::internal::from_bfloat16;
+  using diffusion_maps::internal::to_bfloat16;
+
+  cr_assert_eq(from_bfloat16(to_bfloat16(1)), 1.f);
+  cr_assert_eq(from_bfloat16(to_bfloat16(-0.5)), -0.5f);
+  cr_assert_eq(from_bfloat16(to_bfloat16(0)), 0.f);
+  // 1 + 2⁻⁸ is halfway between 1 and 1 + 2⁻⁷, and rounds to the even 1.
+  cr_assert_eq(from_bfloat16(to_bfloat16(1 + 1. / 256)), 1.f);
+  // 1 + 3·2⁻⁸ is halfway between 1 + 2⁻⁷ and 1 + 2⁻⁶, and rounds to the even
+  // 1 + 2⁻⁶.
+  cr_assert_eq(from_bfloat16(to_bfloat16(1 + 3. / 256)), 1 + 1.f / 64);
+  cr_assert_eq(from_bfloat16(to_bfloat16(1 + 1.5 / 256)), 1 + 1.f / 128);
+}
+
+Test(compressed_matrix, diffusion_maps_helix_compressed) {
+  // Data: helix
+  // Dimensions after reduction: 1
+  // Expected result: about the same embedding as with the CSR format, within
+  //                  the rounding of the values
+
+  const std::size_t n_samples = 200;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (4 * PI) - 1;
+  }
+
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+
+  std::default_random_engine csr_rng(0);
+  const auto expected = diffusion_maps::diffusion_maps(
+      helix, 1, diffusion_maps::kernel::Gaussian(50), 1, csr_rng, options);
+
+  const std::vector<std::pair<diffusion_maps::MatrixFormat, double>> formats =
+      {{diffusion_maps::MatrixFormat::COMPRESSED_FLOAT, 1e-4},
+       {diffusion_maps::MatrixFormat::COMPRESSED_BFLOAT16, 1e-2}};
+  for (const auto &[format, tol] : formats) {
+    options.matrix_format = format;
+    std::default_random_engine rng(0);
+    const auto result = diffusion_maps::diffusion_maps(
+        helix, 1, diffusion_maps::kernel::Gaussian(50), 1, rng, options);
+
+    // The eigenvectors are only defined up to sign.
+
+    const double sign = result(0, 0) * expected(0, 0) < 0 ? -1 : 1;
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      cr_assert_float_eq(sign * result(i, 0), expected(i, 0), tol,
+                         "Element %zu is incorrect", i);
+    }
+  }
+}
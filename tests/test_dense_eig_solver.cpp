@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <utility>
+#include <vector>
+
+#ifdef PAR
+#include <omp.h>
+#endif
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/internal/dense_eig_solver.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/plan.hpp"
+#include "diffusion_maps/stats.hpp"
+
+#define PI 3.14159265358979323846
+
+/// \brief Builds the symmetric matrix P D Pᵀ, where P is a product of random
+///        Householder reflections.
+static diffusion_maps::Matrix
+make_symmetric(const std::vector<double> &eigenvalues,
+               std::default_random_engine &rng) {
+  const std::size_t n = eigenvalues.size();
+  std::normal_distribution dist;
+  diffusion_maps::Matrix a(n, n);
+  for (std::size_t i = 0; i < n; ++i) {
+    a(i, i) = eigenvalues[i];
+  }
+
+  // A ← (I - 2 u uᵀ) A (I - 2 u uᵀ) for a few unit vectors u.
+  std::vector<double> u(n), au(n);
+  for (int r = 0; r < 3; ++r) {
+    double sq_norm = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      u[i] = dist(rng);
+      sq_norm += u[i] * u[i];
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      u[i] /= std::sqrt(sq_norm);
+    }
+    double uau = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      au[i] = 0;
+      for (std::size_t j = 0; j < n; ++j) {
+        au[i] += a(i, j) * u[j];
+      }
+      uau += u[i] * au[i];
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      for (std::size_t j = 0; j < n; ++j) {
+        a(i, j) +=
+            -2 * u[i] * au[j] - 2 * au[i] * u[j] + 4 * uau * u[i] * u[j];
+      }
+    }
+  }
+  return a;
+}
+
+Test(dense_eig_solver, dense_eigsh_clustered) {
+  // Matrix: P D Pᵀ of 150 rows, over several panels of the reduction, where
+  //         D = diag(1, 0.999, 0.999, 0.998, then evenly spaced from 0.9 down
+  //         to -0.5)
+  // Expected result: the 5 largest eigenvalues, and orthonormal eigenvectors
+  //                  with small residuals, including for the double
+  //                  eigenvalue
+
+  const std::size_t n = 150;
+  const unsigned k = 5;
+  std::vector<double> diagonal(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    diagonal[i] = i < 4 ? std::vector<double>{1, 0.999, 0.999, 0.998}[i]
+                        : 0.9 - 1.4 * (i - 4) / (n - 5.);
+  }
+  std::shuffle(diagonal.begin(), diagonal.end(),
+               std::default_random_engine(1));
+  std::default_random_engine rng(0);
+  const diffusion_maps::Matrix a = make_symmetric(diagonal, rng);
+  diffusion_maps::Matrix copy(n, n);
+  std::copy(a.data(), a.data() + n * n, copy.data());
+
+  diffusion_maps::Stats stats;
+  const auto [eigenvalues, eigenvectors] =
+      diffusion_maps::internal::dense_eigsh(copy, k, &stats);
+
+  std::sort(diagonal.rbegin(), diagonal.rend());
+  cr_assert_eq(eigenvalues.size(), k);
+  cr_assert_eq(eigenvectors.n_rows(), n);
+  cr_assert_eq(eigenvectors.n_cols(), k);
+  cr_assert_eq(stats.residuals.size(), k);
+  for (std::size_t c = 0; c < k; ++c) {
+    cr_assert_float_eq(eigenvalues[c], diagonal[c], 1e-12,
+                       "%zu-th calculated eigenvalue %lf does not match "
+                       "expected eigenvalue %lf",
+                       c, eigenvalues[c], diagonal[c]);
+    cr_assert_lt(stats.residuals[c], 1e-12);
+
+    double sq_residual = 0;
+    for (std::size_t i = 0; i < n; ++i) {
+      double r = -eigenvalues[c] * eigenvectors(i, c);
+      for (std::size_t j = 0; j < n; ++j) {
+        r += a(i, j) * eigenvectors(j, c);
+      }
+      sq_residual += r * r;
+    }
+    cr_assert_lt(std::sqrt(sq_residual), 1e-12,
+                 "%zu-th eigenpair has a residual of %g", c,
+                 std::sqrt(sq_residual));
+
+    for (std::size_t d = 0; d <= c; ++d) {
+      double product = 0;
+      for (std::size_t i = 0; i < n; ++i) {
+        product += eigenvectors(i, c) * eigenvectors(i, d);
+      }
+      cr_assert_float_eq(product, c == d, 1e-12,
+                         "Eigenvectors %zu and %zu are not orthonormal", c, d);
+    }
+  }
+
+  cr_assert_throw(diffusion_maps::internal::dense_eigsh(copy, n + 1),
+                  std::invalid_argument);
+}
+
+Test(dense_eig_solver, dense_eigsh_thread_count) {
+  // Matrix: random symmetric, 64 × 64, two panels of the reduction, so that
+  //         the trailing update of the first one runs in parallel
+  // Expected result: the same eigenpairs, bit for bit, with any number of
+  //                  threads
+
+  const std::size_t n = 2 * diffusion_maps::internal::TRIDIAGONAL_PANEL_SIZE;
+  const unsigned k = 3;
+  std::default_random_engine rng(0);
+  std::uniform_real_distribution<double> dist(0, 1);
+  diffusion_maps::Matrix a(n, n);
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t j = i; j < n; ++j) {
+      a(i, j) = a(j, i) = dist(rng);
+    }
+  }
+
+  std::vector<double> expected_eigenvalues;
+  diffusion_maps::Matrix expected_eigenvectors;
+  for (int n_threads = 1; n_threads <= 4; ++n_threads) {
+#ifdef PAR
+    omp_set_num_threads(n_threads);
+#endif
+    diffusion_maps::Matrix copy(n, n);
+    std::copy(a.data(), a.data() + n * n, copy.data());
+    auto [eigenvalues, eigenvectors] =
+        diffusion_maps::internal::dense_eigsh(copy, k);
+    if (n_threads == 1) {
+      expected_eigenvalues = std::move(eigenvalues);
+      expected_eigenvectors = std::move(eigenvectors);
+      continue;
+    }
+    cr_assert(eigenvalues == expected_eigenvalues,
+              "Eigenvalues differ with %d threads", n_threads);
+    cr_assert(std::equal(eigenvectors.data(), eigenvectors.data() + n * k,
+                         expected_eigenvectors.data()),
+              "Eigenvectors differ with %d threads", n_threads);
+  }
+}
+
+Test(dense_eig_solver, diffusion_maps_helix_dense) {
+  // Data: helix, with a wide kernel that connects most pairs
+  // Dimensions after reduction: 2
+  // Expected result: the same embedding as with the Chebyshev solver, from the
+  //                  data and from the kernel graph paths alike, and the
+  //                  planner chooses the dense solver
+
+  const std::size_t n_samples = 300;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 4 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (2 * PI) - 1;
+  }
+  const diffusion_maps::kernel::Gaussian kernel(2);
+
+  diffusion_maps::Options options;
+  options.eig_solver_tol = 1e-12;
+  options.eig_solver = diffusion_maps::EigSolver::CHEBYSHEV;
+  std::default_random_engine rng(0);
+  const diffusion_maps::Decomposition expected =
+      diffusion_maps::decompose(helix, 2, kernel, rng, options);
+
+  diffusion_maps::Stats stats;
+  diffusion_maps::Plan plan;
+  options.auto_plan = true;
+  options.plan = &plan;
+  options.stats = &stats;
+  const diffusion_maps::Decomposition result =
+      diffusion_maps::decompose(helix, 2, kernel, rng, options);
+  cr_assert_eq(plan.eig_solver, diffusion_maps::EigSolver::DENSE);
+  cr_assert_gt(stats.n_nz, n_samples * n_samples / 2);
+  cr_assert_eq(stats.n_spmv, 0);
+
+  // Self-tuning bandwidths expand the sparse diffusion matrix instead.
+
+  diffusion_maps::Options self_tuning_options;
+  self_tuning_options.eig_solver_tol = 1e-12;
+  self_tuning_options.self_tuning_neighbours = 20;
+  self_tuning_options.eig_solver = diffusion_maps::EigSolver::CHEBYSHEV;
+  const diffusion_maps::Decomposition expected_self_tuning =
+      diffusion_maps::decompose(helix, 2, kernel, rng, self_tuning_options);
+  self_tuning_options.eig_solver = diffusion_maps::EigSolver::DENSE;
+  const diffusion_maps::Decomposition result_self_tuning =
+      diffusion_maps::decompose(helix, 2, kernel, rng, self_tuning_options);
+
+  const std::vector<std::pair<const diffusion_maps::Decomposition *,
+                              const diffusion_maps::Decomposition *>>
+      pairs = {{&expected, &result},
+               {&expected_self_tuning, &result_self_tuning}};
+  for (const auto &[reference, dense] : pairs) {
+    cr_assert_eq(dense->eigenvalues.size(), 3);
+    for (std::size_t c = 0; c < 3; ++c) {
+      cr_assert_float_eq(dense->eigenvalues[c], reference->eigenvalues[c],
+                         1e-10, "Eigenvalue %zu is incorrect", c);
+
+      // The eigenvectors are only defined up to sign.
+
+      double product = 0;
+      for (std::size_t i = 0; i < n_samples; ++i) {
+        product += dense->eigenvectors(i, c) * reference->eigenvectors(i, c);
+      }
+      cr_assert_float_eq(std::abs(product), 1, 1e-8,
+                         "Eigenvector %zu is incorrect", c);
+    }
+  }
+}
@@ -1,12 +1,18 @@
 #include <cmath>
 #include <functional>
+#include <optional>
 #include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <criterion/criterion.h>
 
 #include "diffusion_maps/diffusion_maps.hpp"
 #include "diffusion_maps/kernel.hpp"
 #include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/monitor.hpp"
 
 #define PI 3.14159265358979323846
 
@@ -51,3 +57,325 @@ Test(diffusion_maps, diffusion_maps_helix) {
     cr_assert(cmp(result(i, 0), result(i + 1, 0)), "Result is not monotonic");
   }
 }
+
+Test(diffusion_maps, diffusion_maps_helix_warm_start) {
+  // Data: helix, then the same helix shifted along its axis by a small amount
+  //       with its first point removed and a new point appended
+  // Dimensions after reduction: 1
+  // Expected result: a straight line, with the refit taking fewer iterations
+
+  const std::size_t n_samples = 200;
+  const auto make_helix = [](const double offset) {
+    diffusion_maps::Matrix helix(n_samples, 3);
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      const double t = 8 * PI * ((i + offset) / (n_samples - 1.));
+      helix(i, 0) = std::cos(t);
+      helix(i, 1) = std::sin(t);
+      helix(i, 2) = t / (4 * PI) - 1;
+    }
+    return helix;
+  };
+
+  std::default_random_engine rng(std::random_device{}());
+  diffusion_maps::WarmStart warm_start;
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+  options.warm_start = &warm_start;
+
+  // Cold fit.
+
+  diffusion_maps::diffusion_maps(make_helix(0), 1,
+                                 diffusion_maps::kernel::Gaussian(50), 1, rng,
+                                 options);
+
+  cr_assert_eq(warm_start.eigenvectors.size(), 2,
+               "Number of stored eigenvectors %zu is incorrect",
+               warm_start.eigenvectors.size());
+  cr_assert_eq(warm_start.n_iters_saved(), 0,
+               "A cold fit should not save any iterations");
+
+  // Warm refit. Point i of the new data is point i + 1 of the old data, and
+  // the last point is new.
+
+  std::vector<std::optional<std::size_t>> prev_ixs(n_samples);
+  for (std::size_t i = 0; i + 1 < n_samples; ++i) {
+    prev_ixs[i] = i + 1;
+  }
+
+  // A bad index leaves the eigenvectors unchanged.
+
+  const std::vector<diffusion_maps::Vector> eigenvectors =
+      warm_start.eigenvectors;
+  std::vector<std::optional<std::size_t>> bad_prev_ixs = prev_ixs;
+  bad_prev_ixs.push_back(n_samples);
+  cr_assert_throw(warm_start.remap(bad_prev_ixs), std::out_of_range);
+  for (std::size_t k = 0; k < eigenvectors.size(); ++k) {
+    cr_assert_eq(warm_start.eigenvectors[k].size(), n_samples,
+                 "A failed remap changed the eigenvectors");
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      cr_assert_eq(warm_start.eigenvectors[k][i], eigenvectors[k][i],
+                   "A failed remap changed the eigenvectors");
+    }
+  }
+
+  warm_start.remap(prev_ixs);
+
+  const auto result = diffusion_maps::diffusion_maps(
+      make_helix(1.01), 1, diffusion_maps::kernel::Gaussian(50), 1, rng,
+      options);
+
+  cr_assert_gt(warm_start.n_iters_saved(), 0,
+               "Warm start does not save any iterations");
+
+  // Check that result is monotonic.
+
+  auto cmp = result(0, 0) < result(1, 0)
+                 ? std::function<bool(double, double)>(std::less<double>())
+                 : std::function<bool(double, double)>(std::greater<double>());
+  for (std::size_t i = 0; i < n_samples - 1; ++i) {
+    cr_assert(cmp(result(i, 0), result(i + 1, 0)), "Result is not monotonic");
+  }
+}
+
+Test(diffusion_maps, diffusion_maps_multiple_times) {
+  // Data: helix
+  // Dimensions after reduction: 2
+  // Expected result: the embeddings for several diffusion times from a single
+  //                  decomposition are the diffusion-time-0 embedding with
+  //                  each column scaled by the eigenvalue to the power of the
+  //                  diffusion time
+
+  const std::size_t n_samples = 200;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (4 * PI) - 1;
+  }
+
+  std::default_random_engine rng(std::random_device{}());
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+  const auto decomposition = diffusion_maps::decompose(
+      helix, 2, diffusion_maps::kernel::Gaussian(50), rng, options);
+
+  cr_assert_eq(decomposition.n_samples(), n_samples,
+               "Number of data points %zu is incorrect",
+               decomposition.n_samples());
+  cr_assert_eq(decomposition.n_components(), 2,
+               "Number of dimensions %zu is incorrect",
+               decomposition.n_components());
+
+  const std::vector<double> diffusion_times = {0, 0.5, 1, 4};
+  const auto results = decomposition.embed(diffusion_times);
+  cr_assert_eq(results.size(), diffusion_times.size(),
+               "Number of embeddings %zu is incorrect", results.size());
+
+  for (std::size_t k = 0; k < diffusion_times.size(); ++k) {
+    for (std::size_t j = 0; j < 2; ++j) {
+      const double scale =
+          std::pow(decomposition.eigenvalues[j + 1], diffusion_times[k]);
+      for (std::size_t i = 0; i < n_samples; ++i) {
+        cr_assert_float_eq(results[k](i, j), scale * results[0](i, j), 1e-12,
+                           "Element (%zu, %zu) at time %g is incorrect", i, j,
+                           diffusion_times[k]);
+      }
+    }
+  }
+
+  // The same eigenvectors stored row-major give the same embedding.
+
+  diffusion_maps::Decomposition row_major;
+  row_major.eigenvalues = decomposition.eigenvalues;
+  row_major.invsqrt_row_sum = decomposition.invsqrt_row_sum;
+  row_major.eigenvectors = diffusion_maps::Matrix(
+      n_samples, 3, diffusion_maps::Layout::ROW_MAJOR);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t j = 0; j < 3; ++j) {
+      row_major.eigenvectors(i, j) = decomposition.eigenvectors(i, j);
+    }
+  }
+  const diffusion_maps::Matrix row_major_result = row_major.embed(1);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t j = 0; j < 2; ++j) {
+      cr_assert_eq(row_major_result(i, j), results[2](i, j),
+                   "Element (%zu, %zu) is incorrect with row-major "
+                   "eigenvectors",
+                   i, j);
+    }
+  }
+
+  cr_assert_throw(decomposition.embed(-1), std::invalid_argument);
+}
+
+Test(diffusion_maps, diffusion_maps_stats) {
+  // Data: helix
+  // Dimensions after reduction: 1
+  // Expected result: the counters match the size of the problem and the
+  //                  residuals are small
+
+  const std::size_t n_samples = 200;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (4 * PI) - 1;
+  }
+
+  std::default_random_engine rng(std::random_device{}());
+  diffusion_maps::Stats stats;
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+  options.stats = &stats;
+  const auto result = diffusion_maps::diffusion_maps(
+      helix, 1, diffusion_maps::kernel::Gaussian(50), 1, rng, options);
+
+  cr_assert_eq(result.n_cols(), 1, "Number of dimensions %zu is incorrect",
+               result.n_cols());
+
+  cr_assert(stats.kernel_time > 0 && stats.normalisation_time > 0 &&
+                stats.eig_solver_time > 0 && stats.embedding_time >= 0,
+            "Stage times are not recorded");
+  cr_assert_eq(stats.n_kernel_evals, n_samples * (n_samples + 1) / 2);
+  cr_assert_eq(stats.n_kernel_evals_skipped, n_samples * (n_samples - 1) / 2);
+  cr_assert_gt(stats.n_nz, n_samples);
+  cr_assert_gt(stats.peak_bytes, stats.n_nz * sizeof(double));
+
+  cr_assert_eq(stats.n_iters.size(), 2, "Number of eigenpairs %zu is incorrect",
+               stats.n_iters.size());
+  cr_assert_eq(stats.residuals.size(), 2);
+  cr_assert_eq(stats.n_spmv, stats.n_iters[0] + stats.n_iters[1] + 2,
+               "Number of SpMVs %llu is incorrect",
+               static_cast<unsigned long long>(stats.n_spmv));
+  for (const double residual : stats.residuals) {
+    cr_assert_lt(residual, 1e-4, "Residual %g is too large", residual);
+  }
+
+  stats.reset();
+  cr_assert_eq(stats.n_spmv, 0);
+  cr_assert(stats.n_iters.empty());
+}
+
+/// Whether decompose_async() accepts a data matrix of type T.
+template <typename T, typename = void>
+struct accepts_async_data : std::false_type {};
+
+template <typename T>
+struct accepts_async_data<
+    T, std::void_t<decltype(diffusion_maps::decompose_async(
+           std::declval<T>(), 1, diffusion_maps::kernel::Gaussian(1),
+           std::default_random_engine()))>> : std::true_type {};
+
+// The fit reads the data matrix on another thread, so temporaries, which
+// would be destroyed first, are rejected.
+static_assert(accepts_async_data<const diffusion_maps::Matrix &>::value);
+static_assert(!accepts_async_data<diffusion_maps::Matrix>::value);
+
+Test(diffusion_maps, diffusion_maps_async_progress) {
+  // Data: helix
+  // Dimensions after reduction: 1
+  // Expected result: the same embedding as the synchronous fit, with the
+  //                  stages reported in order and every iteration of the
+  //                  solver reported
+
+  const std::size_t n_samples = 200;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (4 * PI) - 1;
+  }
+
+  diffusion_maps::Stats stats;
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+  options.stats = &stats;
+
+  std::default_random_engine rng(0);
+  const auto expected = diffusion_maps::diffusion_maps(
+      helix, 1, diffusion_maps::kernel::Gaussian(50), 1, rng, options);
+  stats.reset();
+
+  // The callback runs on the thread of the fit, and the reports are read
+  // after get(), which synchronises with it.
+  std::vector<diffusion_maps::Progress> reports;
+  auto fit = diffusion_maps::diffusion_maps_async(
+      helix, 1, diffusion_maps::kernel::Gaussian(50), 1,
+      std::default_random_engine(0), options,
+      [&reports](const diffusion_maps::Progress &progress) {
+        reports.push_back(progress);
+      });
+  const auto result = fit.get();
+
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    cr_assert_float_eq(result(i, 0), expected(i, 0), 1e-12,
+                       "Element %zu is incorrect", i);
+  }
+
+  using diffusion_maps::Stage;
+  std::vector<Stage> stages;
+  unsigned n_iters[2] = {0, 0};
+  for (const auto &progress : reports) {
+    if (stages.empty() || stages.back() != progress.stage) {
+      stages.push_back(progress.stage);
+    }
+    if (progress.stage == Stage::EIG_SOLVER && progress.iteration > 0) {
+      cr_assert_lt(progress.eigenpair, 2);
+      cr_assert_eq(progress.iteration, n_iters[progress.eigenpair] + 1,
+                   "Iteration %u of eigenpair %zu is not reported",
+                   n_iters[progress.eigenpair] + 1, progress.eigenpair);
+      cr_assert(progress.error >= 0, "Error is not reported");
+      n_iters[progress.eigenpair] = progress.iteration;
+    }
+  }
+  const std::vector<Stage> expected_stages = {
+      Stage::KERNEL, Stage::NORMALISATION, Stage::EIG_SOLVER,
+      Stage::EMBEDDING};
+  cr_assert(stages == expected_stages, "Stages are not reported in order");
+  cr_assert_eq(n_iters[0], stats.n_iters[0]);
+  cr_assert_eq(n_iters[1], stats.n_iters[1]);
+}
+
+Test(diffusion_maps, diffusion_maps_async_cancel) {
+  // Data: helix
+  // Dimensions after reduction: 1
+  // Expected result: a fit cancelled at its first iteration throws Cancelled
+  //                  at the next iteration boundary
+
+  const std::size_t n_samples = 200;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (4 * PI) - 1;
+  }
+
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+
+  unsigned n_iters = 0;
+  diffusion_maps::Monitor monitor([&](const diffusion_maps::Progress &p) {
+    if (p.stage == diffusion_maps::Stage::EIG_SOLVER && p.iteration > 0) {
+      ++n_iters;
+      monitor.cancel();
+    }
+  });
+  options.monitor = &monitor;
+  std::default_random_engine rng(0);
+  cr_assert_throw(
+      diffusion_maps::diffusion_maps(
+          helix, 1, diffusion_maps::kernel::Gaussian(50), 1, rng, options),
+      diffusion_maps::Cancelled);
+  cr_assert_eq(n_iters, 1, "The fit ran %u iterations after cancellation",
+               n_iters - 1);
+
+  auto fit = diffusion_maps::diffusion_maps_async(
+      helix, 1, diffusion_maps::kernel::Gaussian(50), 1,
+      std::default_random_engine(0), options);
+  fit.cancel();
+  cr_assert_throw(fit.get(), diffusion_maps::Cancelled);
+}
@@ -1,6 +1,11 @@
-from diffusion_maps import diffusion_maps
+from diffusion_maps import (Cancelled, WarmStart, decompose, diffusion_maps,
+                            diffusion_maps_async, diffusion_maps_batch, plan,
+                            sweep)
+
+import asyncio
 
 import numpy as np
+import pytest
 
 
 def test_diffusion_maps_helix():
@@ -28,3 +33,338 @@ def test_diffusion_maps_helix():
 
     diff = np.diff(result)
     assert np.all(diff >= 0) or np.all(diff <= 0)
+
+
+def test_diffusion_maps_helix_warm_start():
+    """Tests warm-starting a refit of diffusion maps on a shifted helix."""
+
+    n_samples = 200
+
+    def make_helix(offset):
+        t = 8 * np.pi * (np.arange(n_samples) + offset) / (n_samples - 1)
+        return np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    warm_start = WarmStart()
+
+    # Cold fit.
+
+    diffusion_maps(make_helix(0), n_components=1, kernel='gaussian', sigma=0.1,
+                   diffusion_time=1, eig_solver_max_iter=1000000,
+                   warm_start=warm_start)
+
+    assert warm_start.n_iters_saved() == 0
+
+    # Warm refit. Point i of the new data is point i + 1 of the old data, and
+    # the last point is new.
+
+    warm_start.remap(list(range(1, n_samples)) + [None])
+    result = diffusion_maps(make_helix(1.01), n_components=1, kernel='gaussian',
+                            sigma=0.1, diffusion_time=1,
+                            eig_solver_max_iter=1000000, warm_start=warm_start)
+
+    assert warm_start.n_iters_saved() > 0
+
+    # Check that result is monotonic.
+
+    diff = np.diff(result, axis=0)
+    assert np.all(diff >= 0) or np.all(diff <= 0)
+
+
+def test_diffusion_maps_multiple_times():
+    """Tests diffusion maps for several diffusion times on a helix."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    decomposition = decompose(helix, n_components=2, kernel='gaussian',
+                              sigma=0.1, rng_seed=0,
+                              eig_solver_max_iter=1000000)
+    results = diffusion_maps(helix, n_components=2, kernel='gaussian',
+                             sigma=0.1, diffusion_time=[0, 1, 4], rng_seed=0,
+                             eig_solver_max_iter=1000000)
+
+    assert len(results) == 3
+    for diffusion_time, result in zip([0, 1, 4], results):
+        np.testing.assert_allclose(result, decomposition.embed(diffusion_time))
+    np.testing.assert_allclose(
+        results[2],
+        results[0] * np.array(decomposition.eigenvalues[1:])**4)
+
+
+def test_sweep_helix():
+    """Tests a hyperparameter sweep on a helix."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    results = sweep(helix, n_components=1, gamma=[50, 100],
+                    kernel_epsilon=[1e-6, 1e-4], eig_solver_max_iter=1000000)
+
+    assert [(r.setting.gamma, r.setting.kernel_epsilon) for r in results] == \
+        [(50, 1e-6), (50, 1e-4), (100, 1e-6), (100, 1e-4)]
+    for result in results:
+        assert 0 < result.eigengap < 1
+        diff = np.diff(result.decomposition.embed(1), axis=0)
+        assert np.all(diff >= 0) or np.all(diff <= 0)
+
+
+def test_diffusion_maps_stats():
+    """Tests the timings and counters of diffusion maps on a helix."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    result, stats = diffusion_maps(helix, n_components=1, kernel='gaussian',
+                                   sigma=0.1, diffusion_time=1,
+                                   eig_solver_max_iter=1000000,
+                                   return_stats=True)
+
+    assert result.shape == (n_samples, 1)
+    assert stats['n_kernel_evals'] == n_samples * (n_samples + 1) // 2
+    assert stats['n_nz'] > n_samples
+    assert len(stats['n_iters']) == 2
+    assert stats['n_spmv'] == sum(stats['n_iters']) + 2
+    assert all(r < 1e-4 for r in stats['residuals'])
+
+
+def test_diffusion_maps_async():
+    """Tests polling, awaiting and cancelling fits of diffusion maps on a
+    helix on another thread."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+    kwargs = dict(n_components=1, kernel='gaussian', sigma=0.1,
+                  diffusion_time=1, rng_seed=0, eig_solver_max_iter=1000000)
+
+    expected = diffusion_maps(helix, **kwargs)
+
+    fit = diffusion_maps_async(helix, **kwargs)
+    result = fit.result()
+    assert fit.done()
+    assert fit.progress()['stage'] == 'embedding'
+    np.testing.assert_allclose(result, expected, atol=1e-12)
+
+    async def run():
+        return await diffusion_maps_async(helix, **kwargs)
+
+    np.testing.assert_allclose(asyncio.run(run()), expected, atol=1e-12)
+
+    # The warm start and the stats are written back when the result is
+    # retrieved, and not at all if the fit fails.
+    warm_start = WarmStart()
+    fit = diffusion_maps_async(helix, warm_start=warm_start,
+                               return_stats=True, **kwargs)
+    result, stats = fit.result()
+    np.testing.assert_allclose(result, expected, atol=1e-12)
+    assert not warm_start.empty()
+    assert stats['n_spmv'] > 0
+
+    warm_start = WarmStart()
+    fit = diffusion_maps_async(helix, warm_start=warm_start, **kwargs)
+    fit.cancel()
+    with pytest.raises(Cancelled):
+        fit.result()
+    assert warm_start.empty()
+
+
+def test_diffusion_maps_batch():
+    """Tests fitting diffusion maps on a batch of helices of different
+    sizes."""
+
+    helices = []
+    for n_samples in (100, 300, 200):
+        t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+        helices.append(np.column_stack((np.cos(t), np.sin(t),
+                                        t / (4 * np.pi) - 1)))
+    kwargs = dict(n_components=1, kernel='gaussian', sigma=0.1,
+                  diffusion_time=1, rng_seed=0, eig_solver_max_iter=1000000)
+
+    results = diffusion_maps_batch(helices, **kwargs)
+    assert len(results) == len(helices)
+    for helix, result in zip(helices, results):
+        assert result.shape == (helix.shape[0], 1)
+        diff = np.diff(result[:, 0])
+        assert np.all(diff >= 0) or np.all(diff <= 0)
+
+    # The results do not depend on the scheduling of the fits.
+    for result, again in zip(results, diffusion_maps_batch(helices, **kwargs)):
+        np.testing.assert_array_equal(result, again)
+
+    with pytest.raises(ValueError):
+        diffusion_maps_batch(helices + [helices[0][:1]], **kwargs)
+
+
+def test_diffusion_maps_helix_reordered():
+    """Tests diffusion maps on a helix with the data points reordered."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    for reordering in ('rcm', 'morton'):
+        result = diffusion_maps(helix, n_components=1, kernel='gaussian',
+                                sigma=0.1, diffusion_time=1,
+                                eig_solver_max_iter=1000000,
+                                reordering=reordering)
+
+        assert result.shape == (n_samples, 1)
+
+        # The result is in the original order, so it is monotonic.
+
+        diff = np.diff(result[:, 0])
+        assert np.all(diff >= 0) or np.all(diff <= 0)
+
+
+def test_diffusion_maps_helix_sell():
+    """Tests diffusion maps on a helix with the SELL-C-σ matrix format."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    kwargs = dict(n_components=1, kernel='gaussian', sigma=0.1,
+                  diffusion_time=1, rng_seed=0, eig_solver_max_iter=1000000)
+    expected = diffusion_maps(helix, **kwargs)
+    result = diffusion_maps(helix, matrix_format='sell', **kwargs)
+
+    # The eigenvectors are only defined up to sign.
+
+    sign = np.sign(result[0, 0] * expected[0, 0])
+    np.testing.assert_allclose(sign * result, expected, atol=1e-4)
+
+
+def test_diffusion_maps_helix_chebyshev():
+    """Tests diffusion maps on a helix with the Chebyshev-filtered solver."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    kwargs = dict(n_components=1, kernel='gaussian', sigma=0.1,
+                  diffusion_time=1, eig_solver_max_iter=1000000,
+                  return_stats=True)
+    _, power_stats = diffusion_maps(helix, **kwargs)
+    result, stats = diffusion_maps(helix, eig_solver='chebyshev', **kwargs)
+
+    assert result.shape == (n_samples, 1)
+    diff = np.diff(result[:, 0])
+    assert np.all(diff >= 0) or np.all(diff <= 0)
+
+    # The filter needs far fewer sparse matrix-vector products.
+
+    assert stats['n_spmv'] < power_stats['n_spmv']
+
+
+def test_diffusion_maps_helix_nonuniform():
+    """Tests diffusion maps on a non-uniformly sampled helix with
+    α-normalisation and self-tuning bandwidths."""
+
+    n_samples = 400
+    s = np.arange(n_samples) / (n_samples - 1)
+    t = 8 * np.pi * s * s
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    result = diffusion_maps(helix, n_components=1, kernel='gaussian', gamma=70,
+                            diffusion_time=1, eig_solver_max_iter=1000000,
+                            alpha=1.0, self_tuning_neighbours=7)
+
+    assert result.shape == (n_samples, 1)
+    diff = np.diff(result[:, 0])
+    assert np.all(diff >= 0) or np.all(diff <= 0)
+
+    with pytest.raises(ValueError):
+        diffusion_maps(helix, n_components=1, kernel='gaussian', gamma=70,
+                       diffusion_time=1, alpha=2.0)
+
+
+def test_diffusion_maps_cosine_metric():
+    """Tests that diffusion maps with the cosine metric do not depend on the
+    length of the data points."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+    lengths = np.random.default_rng(0).uniform(0.5, 2, size=(n_samples, 1))
+
+    kwargs = dict(n_components=1, kernel='gaussian', gamma=50,
+                  metric='cosine', diffusion_time=1, rng_seed=0,
+                  eig_solver_max_iter=1000000)
+    expected = diffusion_maps(helix, **kwargs)
+    result = diffusion_maps(lengths * helix, **kwargs)
+
+    np.testing.assert_allclose(result, expected, atol=1e-6)
+
+    with pytest.raises(ValueError):
+        diffusion_maps(helix, n_components=1, kernel='gaussian',
+                       metric='hamming', diffusion_time=1)
+
+
+def test_diffusion_maps_sparse():
+    """Tests that diffusion maps of sparse data are the same as those of the
+    dense data."""
+
+    scipy_sparse = pytest.importorskip('scipy.sparse')
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+    helix[np.abs(helix) < 0.3] = 0
+
+    kwargs = dict(n_components=1, kernel='gaussian', gamma=50,
+                  diffusion_time=1, rng_seed=0, eig_solver_max_iter=1000000)
+    expected = diffusion_maps(helix, **kwargs)
+    result = diffusion_maps(scipy_sparse.csr_matrix(helix), **kwargs)
+
+    # The eigenvectors are only defined up to sign.
+    sign = np.sign(result[0, 0] * expected[0, 0])
+    np.testing.assert_allclose(sign * result, expected, atol=1e-6)
+
+    with pytest.raises(ValueError):
+        diffusion_maps(scipy_sparse.csr_matrix(helix), reordering='morton',
+                       **kwargs)
+
+    # scipy.sparse does not check the indices, so malformed arrays must be
+    # rejected before the kernel reads through them.
+    bad_column = scipy_sparse.csr_matrix(helix)
+    bad_column.indices[0] = helix.shape[1]
+    bad_row = scipy_sparse.csr_matrix(helix)
+    bad_row.indptr[1] = bad_row.indptr[2] + 1
+    # The rows are merged by their column indices, so they must be sorted and
+    # unique.
+    first = int(np.argmax(np.diff(scipy_sparse.csr_matrix(helix).indptr) >= 2))
+    unsorted = scipy_sparse.csr_matrix(helix)
+    start = unsorted.indptr[first]
+    unsorted.indices[[start, start + 1]] = unsorted.indices[[start + 1, start]]
+    duplicate = scipy_sparse.csr_matrix(helix)
+    duplicate.indices[start + 1] = duplicate.indices[start]
+    for bad in (bad_column, bad_row, unsorted, duplicate):
+        bad.has_canonical_format = True
+        with pytest.raises(ValueError):
+            diffusion_maps(bad, **kwargs)
+
+
+def test_plan():
+    """Tests that the plan of a fit matches its counters, and that a fit over
+    its memory budget does not start."""
+
+    n_samples = 200
+    t = 8 * np.pi * np.arange(n_samples) / (n_samples - 1)
+    helix = np.column_stack((np.cos(t), np.sin(t), t / (4 * np.pi) - 1))
+
+    kwargs = dict(n_components=1, kernel='gaussian', gamma=50)
+    fit_plan = plan(helix, auto_plan=True, **kwargs)
+    assert fit_plan['exhaustive']
+    assert fit_plan['matrix_format'] == 'csr'
+    assert fit_plan['eig_solver'] == 'power_method'
+
+    _, stats = diffusion_maps(helix, diffusion_time=1, rng_seed=0,
+                              auto_plan=True, return_stats=True, **kwargs)
+    assert stats['n_nz'] == fit_plan['n_nz']
+
+    with pytest.raises(ValueError):
+        diffusion_maps(helix, diffusion_time=1,
+                       memory_budget=fit_plan['peak_bytes'] // 2, **kwargs)
@@ -4,10 +4,16 @@
 #include <random>
 #include <vector>
 
+#ifdef PAR
+#include <omp.h>
+#endif
+
 #include <criterion/criterion.h>
 
 #include "diffusion_maps/internal/eig_solver.hpp"
+#include "diffusion_maps/matrix.hpp"
 #include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/stats.hpp"
 #include "diffusion_maps/vector.hpp"
 
 Test(eig_solver, symmetric_power_method_simple) {
@@ -49,6 +55,93 @@ Test(eig_solver, symmetric_power_method_simple) {
       tol, "Calculated eigenvector is incorrect");
 }
 
+Test(eig_solver, symmetric_power_method_deflation) {
+  // Matrix: diagonal of 1300 elements, 10, 9, 8, 4, then 1
+  // Previous eigenvectors: e₀, e₁ and e₂, as a column-major block
+  // Expected result: eigenvalue 4, and an eigenvector orthogonal to the
+  //                  previous ones to working precision, over several chunks
+  //                  of rows
+
+  const std::size_t n = 1300, n_betas = 3;
+  const double diagonal[] = {10, 9, 8, 4};
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    triplets.push_back({i, i, i < 4 ? diagonal[i] : 1});
+  }
+  const diffusion_maps::SparseMatrix matrix(n, n, triplets);
+
+  diffusion_maps::Matrix betas(n, n_betas,
+                               diffusion_maps::Layout::COLUMN_MAJOR);
+  for (std::size_t j = 0; j < n_betas; ++j) {
+    betas(j, j) = 1;
+  }
+
+  // Start mostly along the previous eigenvectors.
+  std::default_random_engine rng(0);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  diffusion_maps::Vector x0(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x0[i] = i < n_betas ? 1000 : dist(rng);
+  }
+
+  const double tol = 1e-10;
+  const auto result = diffusion_maps::internal::symmetric_power_method(
+      matrix, x0, &betas, n_betas, tol, 1000);
+
+  cr_assert(result.has_value(), "Fail to converge");
+  const auto &[eigenvalue, eigenvector] = *result;
+  cr_assert_float_eq(eigenvalue, 4, 1e-9, "Eigenvalue %lf is incorrect",
+                     eigenvalue);
+  for (std::size_t j = 0; j < n_betas; ++j) {
+    cr_assert_lt(std::abs(eigenvector.dot(betas.col(j))), 1e-14,
+                 "Eigenvector is not orthogonal to eigenvector %zu", j);
+  }
+}
+
+Test(eig_solver, symmetric_power_method_thread_count) {
+  // Matrix: random tridiagonal of 50000 rows, with a dominant first element
+  // Expected result: the same eigenpair, bit for bit, with any number of
+  //                  threads
+
+  const std::size_t n = 50000;
+  std::default_random_engine rng(0);
+  std::uniform_real_distribution<double> dist(0, 1);
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    triplets.push_back({i, i, i == 0 ? 2 : dist(rng)});
+    if (i + 1 < n) {
+      const double value = 0.01 * dist(rng);
+      triplets.push_back({i, i + 1, value});
+      triplets.push_back({i + 1, i, value});
+    }
+  }
+  const diffusion_maps::SparseMatrix matrix(n, n, triplets);
+
+  diffusion_maps::Vector x0(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x0[i] = dist(rng);
+  }
+
+  std::optional<std::pair<double, diffusion_maps::Vector>> expected;
+  for (int n_threads = 1; n_threads <= 4; ++n_threads) {
+#ifdef PAR
+    omp_set_num_threads(n_threads);
+#endif
+    auto result = diffusion_maps::internal::symmetric_power_method(
+        matrix, x0, nullptr, 0, 1e-12, 1000);
+    cr_assert(result.has_value(), "Fail to converge");
+    if (!expected) {
+      expected = std::move(result);
+      continue;
+    }
+    cr_assert(result->first == expected->first,
+              "Eigenvalue differs with %d threads", n_threads);
+    cr_assert(std::equal(result->second.data(), result->second.data() + n,
+                         expected->second.data()),
+              "Eigenvector differs with %d threads", n_threads);
+  }
+}
+
 Test(eig_solver, eigsh_simple) {
   // Matrix:
   //  4 -1  1
@@ -72,7 +165,55 @@ Test(eig_solver, eigsh_simple) {
       diffusion_maps::internal::eigsh(matrix, k, tol, max_iters, rng);
 
   cr_assert_eq(eigenvalues.size(), k, "eigsh does not find all eigenvalues");
-  cr_assert_eq(eigenvectors.size(), k, "eigsh does not find all eigenvectors");
+  cr_assert_eq(eigenvectors.n_cols(), k,
+               "eigsh does not find all eigenvectors");
+
+  const std::vector<std::pair<double, diffusion_maps::Vector>> expected_result =
+      {{6, diffusion_maps::Vector{1, -1, 1} / std::sqrt(3)},
+       {3, diffusion_maps::Vector{-2, -1, 1} / std::sqrt(6)},
+       {1, diffusion_maps::Vector{0, 1, 1} / std::sqrt(2)}};
+
+  for (std::size_t i = 0; i < k; ++i) {
+    const double eigenvalue = eigenvalues[i];
+    const diffusion_maps::Vector eigenvector = eigenvectors.col(i);
+    const auto [expected_eigenvalue, expected_eigenvector] = expected_result[i];
+    cr_assert_float_eq(eigenvalue, expected_eigenvalue, tol,
+                       "%zu-th calculated eigenvalue %lf does not match "
+                       "expected eigenvalue %lf",
+                       i, eigenvalue, expected_eigenvalue);
+    cr_assert_lt(std::min((eigenvector - expected_eigenvector).l2_norm(),
+                          (eigenvector - (-expected_eigenvector)).l2_norm()),
+                 tol, "%zu-th calculated eigenvector is incorrect", i);
+  }
+}
+
+Test(eig_solver, randomized_eigsh_simple) {
+  // Matrix:
+  //  4 -1  1
+  // -1  3 -2
+  //  1 -2  3
+  //
+  // Eigenvalues:  6          3           1
+  // Eigenvectors: (1, -1, 1) (-2, -1, 1) (0, 1, 1)
+
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets = {
+      {0, 0, 4},  {0, 1, -1}, {0, 2, 1},  {1, 0, -1}, {1, 1, 3},
+      {1, 2, -2}, {2, 0, 1},  {2, 1, -2}, {2, 2, 3}};
+  diffusion_maps::SparseMatrix matrix(3, 3, triplets);
+
+  const unsigned k = 3;
+  const double tol = 1e-9;
+
+  std::default_random_engine rng(std::random_device{}());
+  std::normal_distribution dist;
+  const auto [eigenvalues, eigenvectors] =
+      diffusion_maps::internal::randomized_eigsh(
+          matrix, k, 2, 1, [&rng, &dist]() { return dist(rng); });
+
+  cr_assert_eq(eigenvalues.size(), k,
+               "randomized_eigsh does not find all eigenvalues");
+  cr_assert_eq(eigenvectors.n_cols(), k,
+               "randomized_eigsh does not find all eigenvectors");
 
   const std::vector<std::pair<double, diffusion_maps::Vector>> expected_result =
       {{6, diffusion_maps::Vector{1, -1, 1} / std::sqrt(3)},
@@ -81,7 +222,7 @@ Test(eig_solver, eigsh_simple) {
 
   for (std::size_t i = 0; i < k; ++i) {
     const double eigenvalue = eigenvalues[i];
-    const diffusion_maps::Vector eigenvector = eigenvectors[i];
+    const diffusion_maps::Vector eigenvector = eigenvectors.col(i);
     const auto [expected_eigenvalue, expected_eigenvector] = expected_result[i];
     cr_assert_float_eq(eigenvalue, expected_eigenvalue, tol,
                        "%zu-th calculated eigenvalue %lf does not match "
@@ -92,3 +233,196 @@ Test(eig_solver, eigsh_simple) {
                  tol, "%zu-th calculated eigenvector is incorrect", i);
   }
 }
+
+Test(eig_solver, randomized_eigsh_decaying_spectrum) {
+  // Matrix: diag(1, 0.5, 0.25, ...), 100 × 100
+  //
+  // Dominant eigenvalues:  1    0.5  0.25 ...
+  // Dominant eigenvectors: e₀   e₁   e₂   ...
+
+  const std::size_t n = 100;
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    triplets.push_back({i, i, std::pow(0.5, i)});
+  }
+  diffusion_maps::SparseMatrix matrix(n, n, triplets);
+
+  const unsigned k = 4;
+  const double tol = 1e-6;
+
+  std::default_random_engine rng(std::random_device{}());
+  std::normal_distribution dist;
+  const auto [eigenvalues, eigenvectors] =
+      diffusion_maps::internal::randomized_eigsh(
+          matrix, k, 10, 2, [&rng, &dist]() { return dist(rng); });
+
+  cr_assert_eq(eigenvalues.size(), k,
+               "randomized_eigsh does not find all eigenvalues");
+
+  for (std::size_t i = 0; i < k; ++i) {
+    const double expected_eigenvalue = std::pow(0.5, i);
+    cr_assert_float_eq(eigenvalues[i], expected_eigenvalue, tol,
+                       "%zu-th calculated eigenvalue %lf does not match "
+                       "expected eigenvalue %lf",
+                       i, eigenvalues[i], expected_eigenvalue);
+    cr_assert_float_eq(std::abs(eigenvectors(i, i)), 1, tol,
+                       "%zu-th calculated eigenvector is incorrect", i);
+  }
+}
+
+Test(eig_solver, eigsh_warm_start) {
+  // Matrix:
+  //  4 -1  1
+  // -1  3 -2
+  //  1 -2  3
+  //
+  // Eigenvalues: 6 3 1
+  //
+  // Starting from the eigenvectors found by a cold run, a warm run should find
+  // the same eigenpairs in fewer iterations.
+
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets = {
+      {0, 0, 4},  {0, 1, -1}, {0, 2, 1},  {1, 0, -1}, {1, 1, 3},
+      {1, 2, -2}, {2, 0, 1},  {2, 1, -2}, {2, 2, 3}};
+  diffusion_maps::SparseMatrix matrix(3, 3, triplets);
+
+  const unsigned k = 3;
+  const double tol = 1e-9;
+  const unsigned max_iters = 100;
+
+  std::default_random_engine rng(std::random_device{}());
+  std::vector<unsigned> cold_n_iters, warm_n_iters;
+  const auto [cold_eigenvalues, cold_eigenvectors] =
+      diffusion_maps::internal::eigsh(matrix, k, tol, max_iters, rng, nullptr,
+                                      0, &cold_n_iters);
+  std::vector<diffusion_maps::Vector> x0s;
+  for (std::size_t i = 0; i < cold_eigenvectors.n_cols(); ++i) {
+    x0s.push_back(cold_eigenvectors.col(i));
+  }
+  const auto [warm_eigenvalues, warm_eigenvectors] =
+      diffusion_maps::internal::eigsh(matrix, k, tol, max_iters, rng,
+                                      x0s.data(), x0s.size(), &warm_n_iters);
+
+  cr_assert_eq(cold_n_iters.size(), k);
+  cr_assert_eq(warm_n_iters.size(), k);
+  cr_assert_eq(warm_eigenvalues.size(), k,
+               "eigsh does not find all eigenvalues");
+
+  unsigned cold_total = 0, warm_total = 0;
+  for (std::size_t i = 0; i < k; ++i) {
+    cr_assert_float_eq(warm_eigenvalues[i], cold_eigenvalues[i], tol,
+                       "%zu-th warm-started eigenvalue %lf does not match "
+                       "cold-started eigenvalue %lf",
+                       i, warm_eigenvalues[i], cold_eigenvalues[i]);
+    cold_total += cold_n_iters[i];
+    warm_total += warm_n_iters[i];
+  }
+  cr_assert_lt(warm_total, cold_total,
+               "Warm start takes %u iterations, cold start takes %u",
+               warm_total, cold_total);
+}
+
+Test(eig_solver, chebyshev_eigsh_clustered) {
+  // Matrix: diag(1, 0.99, 0.98, ..., 0.91, then evenly spaced from 0.85 down
+  //         to -0.5), 200 × 200
+  //
+  // Largest eigenvalues:  1    0.99 0.98 0.97
+  // Their eigenvectors:   e₀   e₁   e₂   e₃
+  //
+  // The eigenvalues are clustered near 1, so the power method converges
+  // slowly; the Chebyshev filter should need far fewer products.
+
+  const std::size_t n = 200, n_clustered = 10;
+  std::vector<double> diagonal(n);
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    diagonal[i] = i < n_clustered ? 1 - 0.01 * i
+                                  : 0.85 - 1.35 * (i - n_clustered) /
+                                               (n - n_clustered - 1.);
+    triplets.push_back({i, i, diagonal[i]});
+  }
+  diffusion_maps::SparseMatrix matrix(n, n, triplets);
+
+  const unsigned k = 4;
+  const double tol = 1e-8;
+  const unsigned max_iters = 100000;
+
+  std::default_random_engine rng(std::random_device{}());
+  std::normal_distribution dist;
+  const auto random = [&rng, &dist]() { return dist(rng); };
+
+  diffusion_maps::Stats power_stats, chebyshev_stats;
+  const auto [power_eigenvalues, power_eigenvectors] =
+      diffusion_maps::internal::eigsh(matrix, k, tol, max_iters, random,
+                                      nullptr, 0, nullptr, &power_stats);
+  std::vector<unsigned> n_iters;
+  const auto [eigenvalues, eigenvectors] =
+      diffusion_maps::internal::chebyshev_eigsh(matrix, k, tol, max_iters, 8,
+                                                random, nullptr, 0, &n_iters,
+                                                &chebyshev_stats);
+
+  cr_assert_eq(power_eigenvalues.size(), k,
+               "eigsh does not find all eigenvalues");
+  cr_assert_eq(eigenvalues.size(), k,
+               "chebyshev_eigsh does not find all eigenvalues");
+  cr_assert_eq(n_iters.size(), k);
+
+  for (std::size_t i = 0; i < k; ++i) {
+    cr_assert_float_eq(eigenvalues[i], diagonal[i], 1e-10,
+                       "%zu-th calculated eigenvalue %lf does not match "
+                       "expected eigenvalue %lf",
+                       i, eigenvalues[i], diagonal[i]);
+    cr_assert_float_eq(std::abs(eigenvectors(i, i)), 1, 1e-6,
+                       "%zu-th calculated eigenvector is incorrect", i);
+    cr_assert_lt(chebyshev_stats.residuals[i], tol);
+  }
+
+  cr_assert_lt(chebyshev_stats.n_spmv * 4, power_stats.n_spmv,
+               "chebyshev_eigsh takes %llu products, eigsh %llu",
+               static_cast<unsigned long long>(chebyshev_stats.n_spmv),
+               static_cast<unsigned long long>(power_stats.n_spmv));
+}
+
+Test(eig_solver, chebyshev_eigsh_bipartite) {
+  // Matrix: the "symmetrised" diffusion matrix of a cycle of 8 nodes, without
+  //         self-loops, which is bipartite
+  //
+  // Eigenvalues: cos(2π j / 8), from 1 down to -1
+  //
+  // The first guess is the eigenvector of -1, so the smallest Ritz value of
+  // the block starts at -1 and the damped interval [-1, cut] is empty. The
+  // filter should still not divide by its zero width.
+
+  const std::size_t n = 8;
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    triplets.push_back({i, (i + 1) % n, 0.5});
+    triplets.push_back({(i + 1) % n, i, 0.5});
+  }
+  const diffusion_maps::SparseMatrix matrix(n, n, triplets);
+  diffusion_maps::Vector x0(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x0[i] = i % 2 == 0 ? 1 : -1;
+  }
+
+  const unsigned k = 2;
+  const double tol = 1e-8;
+  for (unsigned seed = 0; seed < 20; ++seed) {
+    std::default_random_engine rng(seed);
+    std::normal_distribution dist;
+    const auto [eigenvalues, eigenvectors] =
+        diffusion_maps::internal::chebyshev_eigsh(
+            matrix, k, tol, 1000, 8, [&rng, &dist]() { return dist(rng); },
+            &x0, 1);
+
+    cr_assert_eq(eigenvalues.size(), k,
+                 "chebyshev_eigsh does not find all eigenvalues with seed %u",
+                 seed);
+    cr_assert_float_eq(eigenvalues[0], 1, 1e-10,
+                       "Largest eigenvalue %lf is incorrect with seed %u",
+                       eigenvalues[0], seed);
+    cr_assert_float_eq(eigenvalues[1], std::sqrt(0.5), 1e-10,
+                       "Second eigenvalue %lf is incorrect with seed %u",
+                       eigenvalues[1], seed);
+  }
+}
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/kernel_graph.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+#define PI 3.14159265358979323846
+
+Test(kernel_graph, kernel_graph_insert_remove) {
+  // Data: random points in a 3D box, some of which are removed
+  // Expected result: the snapshot matches the kernel matrix computed from
+  //                  scratch on the remaining points
+
+  const diffusion_maps::kernel::Gaussian kernel(20);
+  const double epsilon = 1e-6;
+  diffusion_maps::KernelGraph graph(3, kernel, epsilon);
+
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(-1, 1);
+  std::vector<std::size_t> ids;
+  for (std::size_t i = 0; i < 200; ++i) {
+    ids.push_back(graph.insert({dist(rng), dist(rng), dist(rng)}));
+  }
+  for (std::size_t i = 0; i < 200; i += 3) {
+    graph.remove(ids[i]);
+  }
+  for (std::size_t i = 0; i < 20; ++i) {
+    graph.insert({dist(rng), dist(rng), dist(rng)});
+  }
+
+  const std::vector<std::size_t> live_ids = graph.ids();
+  cr_assert_eq(live_ids.size(), graph.size());
+  cr_assert_eq(graph.size(), 200 - 67 + 20, "Number of points %zu is incorrect",
+               graph.size());
+
+  const diffusion_maps::SparseMatrix kernel_matrix = graph.kernel_matrix();
+  const auto [diffusion_matrix, invsqrt_row_sum] =
+      graph.symmetrised_diffusion_matrix();
+  cr_assert_eq(kernel_matrix.n_rows(), graph.size());
+  cr_assert_eq(diffusion_matrix.n_nz(), kernel_matrix.n_nz());
+
+  // Check each row against the kernel computed from scratch.
+
+  std::size_t n_nz = 0;
+  for (std::size_t i = 0; i < live_ids.size(); ++i) {
+    diffusion_maps::Vector e_i(live_ids.size());
+    e_i[i] = 1;
+    const diffusion_maps::Vector col = kernel_matrix * e_i;
+
+    double row_sum = 0;
+    for (std::size_t j = 0; j < live_ids.size(); ++j) {
+      const double value =
+          kernel(graph.point(live_ids[i]), graph.point(live_ids[j]));
+      const double expected = value > epsilon ? value : 0;
+      cr_assert_float_eq(col[j], expected, 1e-15,
+                         "Element (%zu, %zu) is incorrect", j, i);
+      n_nz += expected != 0;
+      row_sum += expected;
+    }
+
+    cr_assert_float_eq(graph.row_sum(live_ids[i]), row_sum, 1e-12,
+                       "Row sum %zu is incorrect", i);
+    cr_assert_float_eq(invsqrt_row_sum[i], 1 / std::sqrt(row_sum), 1e-12,
+                       "Inverse square root of row sum %zu is incorrect", i);
+  }
+  cr_assert_eq(kernel_matrix.n_nz(), n_nz);
+}
+
+Test(kernel_graph, kernel_graph_helix_stream) {
+  // Data: helix streamed in order, with the first quarter expiring
+  // Dimensions after reduction: 1
+  // Expected result: a straight line
+
+  const std::size_t n_samples = 400;
+  diffusion_maps::KernelGraph graph(3, diffusion_maps::kernel::Gaussian(50));
+
+  std::vector<std::size_t> ids;
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    ids.push_back(graph.insert({std::cos(t), std::sin(t), t / (4 * PI) - 1}));
+    if (i >= n_samples * 3 / 4) {
+      graph.remove(ids[i - n_samples * 3 / 4]);
+    }
+  }
+
+  std::default_random_engine rng(std::random_device{}());
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+  const auto result = diffusion_maps::diffusion_maps(graph, 1, 1, rng, options);
+
+  cr_assert_eq(result.n_rows(), n_samples * 3 / 4,
+               "Number of data points %zu is incorrect", result.n_rows());
+  cr_assert_eq(result.n_cols(), 1, "Number of dimensions %zu is incorrect",
+               result.n_cols());
+
+  // Check that result is monotonic along the helix. Reused IDs break the order
+  // of the rows, so sort the rows by the parameter of the helix first.
+
+  const std::vector<std::size_t> live_ids = graph.ids();
+  std::vector<std::pair<double, double>> points;
+  for (std::size_t i = 0; i < live_ids.size(); ++i) {
+    points.emplace_back(graph.point(live_ids[i])[2], result(i, 0));
+  }
+  std::sort(points.begin(), points.end());
+
+  auto cmp = points[0].second < points[1].second
+                 ? std::function<bool(double, double)>(std::less<double>())
+                 : std::function<bool(double, double)>(std::greater<double>());
+  for (std::size_t i = 0; i + 1 < points.size(); ++i) {
+    cr_assert(cmp(points[i].second, points[i + 1].second),
+              "Result is not monotonic");
+  }
+}
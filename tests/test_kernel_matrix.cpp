@@ -0,0 +1,516 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/internal/quantised_points.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/metric.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/stats.hpp"
+#include "diffusion_maps/vector.hpp"
+
+#define PI 3.14159265358979323846
+
+Test(kernel_matrix, symmetrised_diffusion_matrix_alpha) {
+  // Matrix:
+  // 1.0 0.5 0.0
+  // 0.5 1.0 0.2
+  // 0.0 0.2 1.0
+  //
+  // Expected result, with q = K 1 and d = K⁽ᵅ⁾ 1:
+  // K⁽ᵅ⁾ᵢⱼ = Kᵢⱼ / (qᵢ qⱼ)^α and Sᵢⱼ = K⁽ᵅ⁾ᵢⱼ / √(dᵢ dⱼ)
+
+  const double k[3][3] = {{1, 0.5, 0}, {0.5, 1, 0.2}, {0, 0.2, 1}};
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < 3; ++i) {
+    for (std::size_t j = 0; j < 3; ++j) {
+      if (k[i][j] != 0) {
+        triplets.push_back({i, j, k[i][j]});
+      }
+    }
+  }
+
+  for (const double alpha : {0.0, 0.5, 1.0}) {
+    double q[3] = {0, 0, 0}, d[3] = {0, 0, 0}, k_alpha[3][3];
+    for (std::size_t i = 0; i < 3; ++i) {
+      for (std::size_t j = 0; j < 3; ++j) {
+        q[i] += k[i][j];
+      }
+    }
+    for (std::size_t i = 0; i < 3; ++i) {
+      for (std::size_t j = 0; j < 3; ++j) {
+        k_alpha[i][j] = k[i][j] / std::pow(q[i] * q[j], alpha);
+        d[i] += k_alpha[i][j];
+      }
+    }
+
+    auto copy = triplets;
+    diffusion_maps::SparseMatrix matrix(3, 3, copy);
+    const diffusion_maps::Vector invsqrt_row_sum =
+        diffusion_maps::internal::compute_symmetrised_diffusion_matrix(matrix,
+                                                                       alpha);
+
+    for (std::size_t i = 0; i < 3; ++i) {
+      cr_assert_float_eq(invsqrt_row_sum[i], 1 / std::sqrt(d[i]), 1e-12);
+    }
+    for (std::size_t j = 0; j < 3; ++j) {
+      diffusion_maps::Vector e_j(3);
+      e_j[j] = 1;
+      const diffusion_maps::Vector col = matrix * e_j;
+      for (std::size_t i = 0; i < 3; ++i) {
+        cr_assert_float_eq(col[i], k_alpha[i][j] / std::sqrt(d[i] * d[j]),
+                           1e-12, "Element (%zu, %zu) is incorrect with α %g",
+                           i, j, alpha);
+      }
+    }
+  }
+}
+
+Test(kernel_matrix, fused_symmetrised_diffusion_matrix) {
+  // Data: random points in the unit square
+  // Expected result: assembling the diffusion matrix from the triplets in one
+  //                  pass gives the same matrix and statistics as the kernel
+  //                  matrix followed by its normalisation, exactly with α = 0
+
+  const std::size_t n_samples = 300;
+  std::default_random_engine rng(42);
+  std::uniform_real_distribution<double> dist(0, 1);
+  diffusion_maps::Matrix data(n_samples, 2);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    data(i, 0) = dist(rng);
+    data(i, 1) = dist(rng);
+  }
+  const diffusion_maps::kernel::Gaussian kernel(100);
+  const std::uint64_t n_kernel_evals = n_samples * (n_samples + 1) / 2;
+
+  for (const double alpha : {0.0, 0.5}) {
+    const double tol = alpha == 0 ? 0 : 1e-15;
+
+    diffusion_maps::Stats expected_stats;
+    diffusion_maps::SparseMatrix expected =
+        diffusion_maps::internal::compute_kernel_matrix(data, kernel, 1e-6,
+                                                        &expected_stats);
+    const diffusion_maps::Vector expected_invsqrt =
+        diffusion_maps::internal::compute_symmetrised_diffusion_matrix(
+            expected, alpha);
+
+    diffusion_maps::Stats stats;
+    std::vector<diffusion_maps::SparseMatrix::Triplet> triplets =
+        diffusion_maps::internal::compute_kernel_triplets(data, kernel, 1e-6);
+    diffusion_maps::Vector invsqrt;
+    const diffusion_maps::SparseMatrix result =
+        diffusion_maps::internal::assemble_symmetrised_diffusion_matrix(
+            n_samples, triplets, alpha, invsqrt, n_kernel_evals, &stats);
+
+    cr_assert_eq(stats.n_kernel_evals, expected_stats.n_kernel_evals);
+    cr_assert_eq(stats.n_kernel_evals_skipped,
+                 expected_stats.n_kernel_evals_skipped);
+    cr_assert_eq(result.n_nz(), expected.n_nz());
+    cr_assert_gt(result.n_nz(), n_samples);
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      cr_assert_eq(result.row_ixs()[i + 1], expected.row_ixs()[i + 1]);
+      cr_assert_leq(std::abs(invsqrt[i] - expected_invsqrt[i]),
+                    tol * expected_invsqrt[i],
+                    "Row sum %zu is incorrect with α %g", i, alpha);
+    }
+    for (std::size_t ir = 0; ir < result.n_nz(); ++ir) {
+      cr_assert_eq(result.col_ixs()[ir], expected.col_ixs()[ir]);
+      cr_assert_leq(std::abs(result.data()[ir] - expected.data()[ir]),
+                    tol * expected.data()[ir],
+                    "Element %zu is incorrect with α %g", ir, alpha);
+    }
+  }
+}
+
+Test(kernel_matrix, self_tuning_bandwidths) {
+  // Data: points 0, 1, 3, 7 and 15 on a line, all connected
+  // Expected result: σᵢ is the distance to the 2nd nearest neighbour and
+  //                  Kᵢⱼ = exp(-|xᵢ - xⱼ|² / (σᵢ σⱼ))
+
+  const std::vector<double> xs = {0, 1, 3, 7, 15};
+  const std::size_t n = xs.size();
+  diffusion_maps::Matrix data(n, 1);
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    data(i, 0) = xs[i];
+    for (std::size_t j = 0; j < n; ++j) {
+      triplets.push_back({i, j, 1});
+    }
+  }
+  diffusion_maps::SparseMatrix matrix(n, n, triplets);
+
+  const diffusion_maps::Vector sigma =
+      diffusion_maps::internal::apply_self_tuning_bandwidths(data, matrix, 2);
+
+  const std::vector<double> expected_sigma = {3, 2, 3, 6, 12};
+  for (std::size_t i = 0; i < n; ++i) {
+    cr_assert_float_eq(sigma[i], expected_sigma[i], 1e-12,
+                       "Bandwidth %zu is incorrect", i);
+  }
+  for (std::size_t j = 0; j < n; ++j) {
+    diffusion_maps::Vector e_j(n);
+    e_j[j] = 1;
+    const diffusion_maps::Vector col = matrix * e_j;
+    for (std::size_t i = 0; i < n; ++i) {
+      const double sq_distance = (xs[i] - xs[j]) * (xs[i] - xs[j]);
+      cr_assert_float_eq(
+          col[i],
+          std::exp(-sq_distance / (expected_sigma[i] * expected_sigma[j])),
+          1e-12, "Element (%zu, %zu) is incorrect", i, j);
+    }
+  }
+}
+
+Test(kernel_matrix, metric_gaussian_kernel_matrix) {
+  // Data: random points with non-negative features, stored with a column stride
+  //       of 2
+  // Expected result: for each metric, the kernel matrix computed with the
+  //                  metric inlined is the same as the one computed through
+  //                  the generic kernel function, and the distances are correct
+
+  const std::size_t n_samples = 50, n_features = 5;
+  std::vector<double> buffer(n_samples * n_features * 2);
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(0, 1);
+  for (double &x : buffer) {
+    x = dist(rng);
+  }
+  const diffusion_maps::Matrix data(buffer.data(), n_samples, n_features,
+                                    2 * n_features, 2);
+
+  const diffusion_maps::Vector x = {1, 2, 0}, y = {2, 0, 0};
+  const diffusion_maps::Vector scale = {1, 2, 4};
+  cr_assert_float_eq(diffusion_maps::metric::SqEuclidean()(x, y), 5, 1e-12);
+  cr_assert_float_eq(diffusion_maps::metric::Cosine()(x, y),
+                     1 - 2 / std::sqrt(20), 1e-12);
+  cr_assert_float_eq(diffusion_maps::metric::L1()(x, y), 3, 1e-12);
+  cr_assert_float_eq(diffusion_maps::metric::DiagonalMahalanobis(scale)(x, y),
+                     2, 1e-12);
+
+  const auto check = [&data](const auto &kernel) {
+    const diffusion_maps::SparseMatrix expected =
+        diffusion_maps::internal::compute_kernel_matrix(
+            data,
+            [&kernel](const diffusion_maps::Vector &x,
+                      const diffusion_maps::Vector &y) { return kernel(x, y); },
+            1e-6);
+    const diffusion_maps::SparseMatrix result =
+        diffusion_maps::internal::compute_kernel_matrix(data, kernel, 1e-6);
+
+    cr_assert_eq(result.n_nz(), expected.n_nz());
+    for (std::size_t i = 0; i <= n_samples; ++i) {
+      cr_assert_eq(result.row_ixs()[i], expected.row_ixs()[i]);
+    }
+    for (std::size_t ir = 0; ir < result.n_nz(); ++ir) {
+      cr_assert_eq(result.col_ixs()[ir], expected.col_ixs()[ir]);
+      cr_assert_float_eq(result.data()[ir], expected.data()[ir], 1e-12,
+                         "Element %zu is incorrect", ir);
+    }
+  };
+
+  check(diffusion_maps::kernel::Gaussian(5));
+  check(diffusion_maps::kernel::MetricGaussian<diffusion_maps::metric::Cosine>(
+      20));
+  check(diffusion_maps::kernel::MetricGaussian<diffusion_maps::metric::L1>(2));
+  check(diffusion_maps::kernel::MetricGaussian<
+        diffusion_maps::metric::DiagonalMahalanobis>(
+      1, diffusion_maps::metric::DiagonalMahalanobis(
+             diffusion_maps::Vector(n_features, 0.5))));
+}
+
+Test(kernel_matrix, cosine_zero_length) {
+  // Data: random points, two of which have zero length, stored densely and
+  //       sparsely
+  // Expected result: the kernel matrices computed with the cosine metric
+  //                  inlined agree with the kernel function off the diagonal,
+  //                  with the points of zero length at distance 1 from every
+  //                  other point, each other included
+
+  const std::size_t n_samples = 6, n_features = 3;
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(0.1, 1);
+  diffusion_maps::Matrix data(n_samples, n_features);
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t f = 0; f < n_features; ++f) {
+      data(i, f) = i == 1 || i == 4 ? 0 : dist(rng);
+      if (data(i, f) != 0) {
+        triplets.push_back({i, f, data(i, f)});
+      }
+    }
+  }
+  const diffusion_maps::SparseMatrix sparse_data(n_samples, n_features,
+                                                 triplets);
+  const diffusion_maps::kernel::MetricGaussian<diffusion_maps::metric::Cosine>
+      kernel(2);
+
+  cr_assert_eq(kernel.metric(data.row(1), data.row(4)), 1);
+  cr_assert_eq(kernel.metric(data.row(1), data.row(0)), 1);
+
+  const std::vector<diffusion_maps::SparseMatrix> results = {
+      diffusion_maps::internal::compute_kernel_matrix(data, kernel, 1e-6),
+      diffusion_maps::internal::compute_kernel_matrix(sparse_data, kernel,
+                                                      1e-6)};
+  for (const diffusion_maps::SparseMatrix &result : results) {
+    cr_assert_eq(result.n_nz(), n_samples * n_samples);
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      for (std::size_t ir = result.row_ixs()[i]; ir < result.row_ixs()[i + 1];
+           ++ir) {
+        const std::size_t j = result.col_ixs()[ir];
+        const double expected =
+            j == i ? 1 : kernel(data.row(i), data.row(j));
+        cr_assert_float_eq(result.data()[ir], expected, 1e-12,
+                           "Element (%zu, %zu) is incorrect", i, j);
+      }
+    }
+  }
+}
+
+Test(kernel_matrix, symmetric_triplets_tiles) {
+  // Data: a symmetric matrix whose size is not a multiple of the tile size,
+  //       with some zero elements
+  // Expected result: every element of both triangles is collected once
+
+  const std::size_t n = 2 * diffusion_maps::internal::PAIR_TILE_SIZE + 13;
+  const auto element = [](const std::size_t i, const std::size_t j) {
+    return (i + 2 * j) % 7 == 0 ? 0.0 : i + j / 1000.;
+  };
+
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets =
+      diffusion_maps::internal::collect_symmetric_triplets(n, element);
+  const diffusion_maps::SparseMatrix result(n, n, triplets);
+
+  std::vector<double> dense(n * n, 0);
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t ir = result.row_ixs()[i]; ir < result.row_ixs()[i + 1];
+         ++ir) {
+      dense[i * n + result.col_ixs()[ir]] += result.data()[ir];
+    }
+  }
+
+  std::size_t n_nz = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t j = 0; j < n; ++j) {
+      const double expected = element(std::min(i, j), std::max(i, j));
+      n_nz += expected != 0;
+      cr_assert_float_eq(dense[i * n + j], expected, 1e-15,
+                         "Element (%zu, %zu) is incorrect", i, j);
+    }
+  }
+  cr_assert_eq(result.n_nz(), n_nz);
+}
+
+Test(kernel_matrix, sparse_kernel_matrix) {
+  // Data: random sparse points, some of them without non-zero features, with
+  //       kernels for which some pairs without common features are connected
+  //       and others are not
+  // Expected result: for each metric, the kernel matrix, the self-tuning
+  //                  bandwidths and the eigendecomposition are the same as for
+  //                  the same points stored densely
+
+  const std::size_t n_samples = 60, n_features = 40;
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(0, 1);
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  diffusion_maps::Matrix dense(n_samples, n_features);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t f = 0; f < n_features; ++f) {
+      dense(i, f) = 0;
+      if (i % 7 != 0 && dist(rng) < 0.1) {
+        dense(i, f) = dist(rng);
+        triplets.push_back({i, f, dense(i, f)});
+      }
+    }
+  }
+  const diffusion_maps::SparseMatrix sparse(n_samples, n_features, triplets);
+
+  const auto check_equal = [](const diffusion_maps::SparseMatrix &result,
+                              const diffusion_maps::SparseMatrix &expected) {
+    cr_assert_eq(result.n_nz(), expected.n_nz());
+    for (std::size_t i = 0; i <= result.n_rows(); ++i) {
+      cr_assert_eq(result.row_ixs()[i], expected.row_ixs()[i]);
+    }
+    for (std::size_t ir = 0; ir < result.n_nz(); ++ir) {
+      cr_assert_eq(result.col_ixs()[ir], expected.col_ixs()[ir]);
+      cr_assert_float_eq(result.data()[ir], expected.data()[ir], 1e-12,
+                         "Element %zu is incorrect", ir);
+    }
+  };
+
+  const auto check = [&](const auto &kernel) {
+    diffusion_maps::SparseMatrix expected =
+        diffusion_maps::internal::compute_kernel_matrix(dense, kernel, 1e-3);
+    diffusion_maps::SparseMatrix result =
+        diffusion_maps::internal::compute_kernel_matrix(sparse, kernel, 1e-3);
+    cr_assert_lt(result.n_nz(), n_samples * n_samples);
+    check_equal(result, expected);
+
+    const diffusion_maps::Vector expected_sigma =
+        diffusion_maps::internal::apply_self_tuning_bandwidths(
+            dense, expected, 3, kernel.metric);
+    const diffusion_maps::Vector sigma =
+        diffusion_maps::internal::apply_self_tuning_bandwidths(
+            sparse, result, 3, kernel.metric);
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      cr_assert_float_eq(sigma[i], expected_sigma[i], 1e-12,
+                         "Bandwidth %zu is incorrect", i);
+    }
+    check_equal(result, expected);
+  };
+
+  check(diffusion_maps::kernel::Gaussian(4));
+  check(diffusion_maps::kernel::MetricGaussian<diffusion_maps::metric::Cosine>(
+      8));
+  check(diffusion_maps::kernel::MetricGaussian<diffusion_maps::metric::L1>(2));
+  check(diffusion_maps::kernel::MetricGaussian<
+        diffusion_maps::metric::DiagonalMahalanobis>(
+      16, diffusion_maps::metric::DiagonalMahalanobis(
+              diffusion_maps::Vector(n_features, 2))));
+
+  // The rest of the pipeline is shared.
+
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+  std::default_random_engine dense_rng(0), sparse_rng(0);
+  const auto expected = diffusion_maps::decompose(
+      dense, 2, diffusion_maps::kernel::Gaussian(4), dense_rng, options);
+  const auto result = diffusion_maps::decompose(
+      sparse, 2, diffusion_maps::kernel::Gaussian(4), sparse_rng, options);
+  for (std::size_t k = 0; k < expected.eigenvalues.size(); ++k) {
+    cr_assert_float_eq(result.eigenvalues[k], expected.eigenvalues[k], 1e-6,
+                       "Eigenvalue %zu is incorrect", k);
+  }
+
+  options.reordering = diffusion_maps::Reordering::MORTON;
+  cr_assert_throw(diffusion_maps::decompose(sparse, 2,
+                                            diffusion_maps::kernel::Gaussian(4),
+                                            sparse_rng, options),
+                  std::invalid_argument);
+}
+
+Test(kernel_matrix, quantised_kernel_matrix) {
+  // Data: random points, whose features are far from 0 except for the cosine
+  //       metric, with kernels that keep part of the pairs
+  // Expected result: for each metric and reduced precision, the sparsity
+  //                  pattern is the same as in double precision and the values
+  //                  are close, and half precision rounds correctly
+
+  using diffusion_maps::internal::Codec;
+  using diffusion_maps::internal::Half;
+  cr_assert_eq(Codec<Half>::encode(1).bits, 0x3c00);
+  cr_assert_eq(Codec<Half>::encode(-0.5).bits, 0xb800);
+  cr_assert_eq(Codec<Half>::encode(1e-6).bits, 0);
+  cr_assert_float_eq(Codec<Half>::decode(Codec<Half>::encode(0.1)), 0.1,
+                     0.1 / 2048);
+  cr_assert_eq(Codec<std::int8_t>::encode(-126.6), -127);
+
+  const std::size_t n_samples = 80, n_features = 32;
+  diffusion_maps::Matrix centred(n_samples, n_features);
+  diffusion_maps::Matrix shifted(n_samples, n_features);
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(-1, 1);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t f = 0; f < n_features; ++f) {
+      centred(i, f) = dist(rng);
+      shifted(i, f) = 10 * f + centred(i, f);
+    }
+  }
+
+  const auto check = [](const diffusion_maps::Matrix &data,
+                        const auto &kernel) {
+    const diffusion_maps::SparseMatrix expected =
+        diffusion_maps::internal::compute_kernel_matrix(data, kernel, 1e-3);
+    cr_assert_gt(expected.n_nz(), 2 * n_samples);
+    cr_assert_lt(expected.n_nz(), n_samples * n_samples / 2);
+
+    for (const auto precision : {diffusion_maps::Precision::FLOAT16,
+                                 diffusion_maps::Precision::INT8}) {
+      diffusion_maps::Stats stats;
+      const diffusion_maps::SparseMatrix result =
+          diffusion_maps::internal::compute_kernel_matrix(data, kernel, 1e-3,
+                                                          &stats, precision);
+      cr_assert_gt(stats.n_kernel_evals_exact, 0);
+      cr_assert_lt(stats.n_kernel_evals_exact, stats.n_kernel_evals);
+
+      cr_assert_eq(result.n_nz(), expected.n_nz());
+      for (std::size_t i = 0; i <= n_samples; ++i) {
+        cr_assert_eq(result.row_ixs()[i], expected.row_ixs()[i]);
+      }
+      const double tol =
+          precision == diffusion_maps::Precision::INT8 ? 1e-3 : 1e-4;
+      for (std::size_t ir = 0; ir < result.n_nz(); ++ir) {
+        cr_assert_eq(result.col_ixs()[ir], expected.col_ixs()[ir]);
+        cr_assert_float_eq(result.data()[ir], expected.data()[ir],
+                           tol, "Element %zu is incorrect", ir);
+      }
+    }
+  };
+
+  check(shifted, diffusion_maps::kernel::Gaussian(0.35));
+  check(centred,
+        diffusion_maps::kernel::MetricGaussian<diffusion_maps::metric::Cosine>(
+            8));
+  check(shifted,
+        diffusion_maps::kernel::MetricGaussian<diffusion_maps::metric::L1>(
+            0.35));
+  check(shifted, diffusion_maps::kernel::MetricGaussian<
+                     diffusion_maps::metric::DiagonalMahalanobis>(
+                     0.1, diffusion_maps::metric::DiagonalMahalanobis(
+                              diffusion_maps::Vector(n_features, 0.5))));
+}
+
+Test(kernel_matrix, diffusion_maps_helix_nonuniform) {
+  // Data: helix, sampled much more densely at one end than at the other
+  // Dimensions after reduction: 1
+  // Expected result: with α-normalisation and self-tuning bandwidths, a
+  //                  straight line
+
+  const std::size_t n_samples = 400;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double s = i / (n_samples - 1.);
+    const double t = 8 * PI * s * s;
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (4 * PI) - 1;
+  }
+
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+  options.alpha = 1;
+  options.self_tuning_neighbours = 7;
+
+  std::default_random_engine rng(std::random_device{}());
+  const auto result = diffusion_maps::diffusion_maps(
+      helix, 1, diffusion_maps::kernel::Gaussian(70), 1, rng, options);
+
+  cr_assert_eq(result.n_rows(), n_samples);
+  cr_assert_eq(result.n_cols(), 1);
+
+  // Check that result is monotonic along the helix.
+
+  auto cmp = result(0, 0) < result(1, 0)
+                 ? std::function<bool(double, double)>(std::less<double>())
+                 : std::function<bool(double, double)>(std::greater<double>());
+  for (std::size_t i = 0; i + 1 < n_samples; ++i) {
+    cr_assert(cmp(result(i, 0), result(i + 1, 0)), "Result is not monotonic");
+  }
+
+  // Alpha outside [0, 1] is rejected.
+
+  options.alpha = 2;
+  cr_assert_throw(diffusion_maps::diffusion_maps(
+                      helix, 1, diffusion_maps::kernel::Gaussian(70), 1, rng,
+                      options),
+                  std::invalid_argument);
+}
@@ -0,0 +1,247 @@
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/kernel_graph.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/plan.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/stats.hpp"
+#include "diffusion_maps/sweep.hpp"
+
+/// Draws data points uniformly in the unit square.
+static diffusion_maps::Matrix make_square(const std::size_t n_samples,
+                                          std::default_random_engine &rng) {
+  std::uniform_real_distribution<double> dist(0, 1);
+  diffusion_maps::Matrix data(n_samples, 2);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    data(i, 0) = dist(rng);
+    data(i, 1) = dist(rng);
+  }
+  return data;
+}
+
+Test(plan, plan_estimates) {
+  // Data: random points in the unit square, with a kernel that connects a few
+  //       percent of the pairs
+  // Expected result: the estimates match the counters of the fit, exactly
+  //                  when every pair is sampled
+
+  std::default_random_engine rng(42);
+  const diffusion_maps::kernel::Gaussian kernel(400);
+  diffusion_maps::Options options;
+  options.eig_solver = diffusion_maps::EigSolver::RANDOMIZED;
+
+  for (const std::size_t n_samples : {100, 1500}) {
+    const diffusion_maps::Matrix data = make_square(n_samples, rng);
+    const diffusion_maps::Plan plan =
+        diffusion_maps::plan(data, 2, kernel, options);
+    cr_assert_eq(plan.n_samples, n_samples);
+    cr_assert_eq(plan.exhaustive, n_samples == 100);
+    cr_assert_eq(plan.matrix_format, diffusion_maps::MatrixFormat::CSR);
+    cr_assert_eq(plan.eig_solver, diffusion_maps::EigSolver::RANDOMIZED);
+    cr_assert_gt(plan.density, 0.01);
+    cr_assert_lt(plan.density, 0.2);
+    cr_assert_gt(plan.kernel_time, 0);
+
+    diffusion_maps::Stats stats;
+    diffusion_maps::Plan fit_plan;
+    diffusion_maps::Options fit_options = options;
+    fit_options.stats = &stats;
+    fit_options.plan = &fit_plan;
+    diffusion_maps::decompose(data, 2, kernel, rng, fit_options);
+    cr_assert_eq(fit_plan.n_nz, plan.n_nz, "The fit was planned differently");
+
+    if (plan.exhaustive) {
+      cr_assert_eq(plan.n_nz, stats.n_nz, "Estimated %llu elements, not %zu",
+                   static_cast<unsigned long long>(plan.n_nz), stats.n_nz);
+    } else {
+      cr_assert_float_eq(static_cast<double>(plan.n_nz),
+                         static_cast<double>(stats.n_nz), 0.1 * stats.n_nz,
+                         "Estimated %llu elements, not %zu",
+                         static_cast<unsigned long long>(plan.n_nz),
+                         stats.n_nz);
+    }
+    // The triplets are counted at twice their number.
+    cr_assert_geq(plan.peak_bytes, 0.8 * stats.peak_bytes,
+                  "Estimated %zu bytes, not %zu", plan.peak_bytes,
+                  stats.peak_bytes);
+    cr_assert_leq(plan.peak_bytes, 2 * stats.peak_bytes,
+                  "Estimated %zu bytes, not %zu", plan.peak_bytes,
+                  stats.peak_bytes);
+  }
+}
+
+Test(plan, plan_memory_budget) {
+  // Data: random points with a kernel that connects about a third of the
+  //       pairs, then every pair
+  // Expected result: the planner chooses the compressed format and the
+  //                  Chebyshev-filtered solver for the large sparse matrix,
+  //                  falls back to the CSR format and the power method within
+  //                  a tight budget, and the fit refuses to start beyond it;
+  //                  it chooses the dense solver for the dense matrix, unless
+  //                  the budget rules it out
+
+  std::default_random_engine rng(42);
+  const diffusion_maps::Matrix data = make_square(3000, rng);
+  const diffusion_maps::kernel::Gaussian kernel(100);
+  diffusion_maps::Options options;
+  options.auto_plan = true;
+
+  const diffusion_maps::Plan plan =
+      diffusion_maps::plan(data, 2, kernel, options);
+  cr_assert_gt(plan.density, 0.2);
+  cr_assert_lt(plan.density, diffusion_maps::PLAN_DENSE_DENSITY);
+  cr_assert_eq(plan.matrix_format,
+               diffusion_maps::MatrixFormat::COMPRESSED_FLOAT);
+  cr_assert_eq(plan.eig_solver, diffusion_maps::EigSolver::CHEBYSHEV);
+
+  options.memory_budget = plan.peak_bytes - 1;
+  const diffusion_maps::Plan lean_plan =
+      diffusion_maps::plan(data, 2, kernel, options);
+  cr_assert_eq(lean_plan.matrix_format, diffusion_maps::MatrixFormat::CSR);
+  cr_assert_eq(lean_plan.eig_solver, diffusion_maps::EigSolver::POWER_METHOD);
+  cr_assert_leq(lean_plan.peak_bytes, plan.peak_bytes);
+
+  // The plan is stored before the fit refuses to start.
+
+  diffusion_maps::Plan fit_plan;
+  options.memory_budget = lean_plan.peak_bytes / 2;
+  options.plan = &fit_plan;
+  cr_assert_throw(diffusion_maps::decompose(data, 2, kernel, rng, options),
+                  std::invalid_argument);
+  cr_assert_eq(fit_plan.n_nz, plan.n_nz);
+  cr_assert_gt(fit_plan.peak_bytes, options.memory_budget);
+  cr_assert(!fit_plan.to_string().empty());
+
+  // Every pair is connected by a wide kernel.
+
+  const diffusion_maps::kernel::Gaussian wide_kernel(0.01);
+  options.memory_budget = 0;
+  options.plan = nullptr;
+  const diffusion_maps::Plan dense_plan =
+      diffusion_maps::plan(data, 2, wide_kernel, options);
+  cr_assert_eq(dense_plan.density, 1);
+  cr_assert_eq(dense_plan.n_nz, 3000 * 3000);
+  cr_assert_eq(dense_plan.eig_solver, diffusion_maps::EigSolver::DENSE);
+  cr_assert_neq(dense_plan.to_string().find("eig_solver=dense"),
+                std::string::npos);
+
+  options.memory_budget = dense_plan.peak_bytes - 1;
+  const diffusion_maps::Plan sparse_plan =
+      diffusion_maps::plan(data, 2, wide_kernel, options);
+  cr_assert_neq(sparse_plan.eig_solver, diffusion_maps::EigSolver::DENSE);
+
+  options.plan_n_pairs = 0;
+  cr_assert_throw(diffusion_maps::plan(data, 2, kernel, options),
+                  std::invalid_argument);
+}
+
+Test(plan, plan_sparse_and_graph) {
+  // Data: random points in the unit square, as sparse data points, in a
+  //       kernel graph and through a sweep
+  // Expected result: each path is planned, exactly when every pair is
+  //                  sampled or the diffusion matrix is given, refuses to
+  //                  start beyond the memory budget, and runs with the dense
+  //                  solver chosen for a wide kernel
+
+  const std::size_t n_samples = 300;
+  std::default_random_engine rng(42);
+  const diffusion_maps::Matrix data = make_square(n_samples, rng);
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    triplets.push_back({i, 0, data(i, 0)});
+    triplets.push_back({i, 1, data(i, 1)});
+  }
+  const diffusion_maps::SparseMatrix sparse_data(n_samples, 2, triplets);
+  const diffusion_maps::kernel::Gaussian kernel(400);
+  const diffusion_maps::kernel::Gaussian wide_kernel(0.01);
+
+  diffusion_maps::Options options;
+  options.plan_n_pairs = n_samples * n_samples;
+
+  // Sparse data points.
+
+  const diffusion_maps::Plan sparse_plan =
+      diffusion_maps::plan(sparse_data, 2, kernel, options);
+  const diffusion_maps::Plan dense_plan =
+      diffusion_maps::plan(data, 2, kernel, options);
+  cr_assert(sparse_plan.exhaustive);
+  cr_assert_eq(sparse_plan.n_nz, dense_plan.n_nz);
+
+  diffusion_maps::Stats stats;
+  diffusion_maps::Plan fit_plan;
+  diffusion_maps::Options fit_options = options;
+  fit_options.stats = &stats;
+  fit_options.plan = &fit_plan;
+  diffusion_maps::decompose(sparse_data, 2, kernel, rng, fit_options);
+  cr_assert_eq(fit_plan.n_nz, stats.n_nz,
+               "Planned %llu elements for the sparse data, not %zu",
+               static_cast<unsigned long long>(fit_plan.n_nz), stats.n_nz);
+
+  fit_options.memory_budget = sparse_plan.peak_bytes - 1;
+  cr_assert_throw(
+      diffusion_maps::decompose(sparse_data, 2, kernel, rng, fit_options),
+      std::invalid_argument);
+
+  stats = diffusion_maps::Stats();
+  fit_options.memory_budget = 0;
+  fit_options.auto_plan = true;
+  diffusion_maps::decompose(sparse_data, 2, wide_kernel, rng, fit_options);
+  cr_assert_eq(fit_plan.eig_solver, diffusion_maps::EigSolver::DENSE);
+  cr_assert_eq(stats.n_spmv, 0);
+
+  // A kernel graph, and the diffusion matrix it exports.
+
+  for (const bool wide : {false, true}) {
+    diffusion_maps::KernelGraph graph(2, wide ? wide_kernel : kernel);
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      graph.insert({data(i, 0), data(i, 1)});
+    }
+
+    stats = diffusion_maps::Stats();
+    fit_plan = diffusion_maps::Plan();
+    fit_options = options;
+    fit_options.stats = &stats;
+    fit_options.plan = &fit_plan;
+    fit_options.auto_plan = true;
+    diffusion_maps::decompose(graph, 2, rng, fit_options);
+    cr_assert(fit_plan.exhaustive);
+    cr_assert_eq(fit_plan.n_nz, stats.n_nz,
+                 "Planned %llu elements for the kernel graph, not %zu",
+                 static_cast<unsigned long long>(fit_plan.n_nz), stats.n_nz);
+    cr_assert_eq(fit_plan.eig_solver,
+                 wide ? diffusion_maps::EigSolver::DENSE
+                      : diffusion_maps::EigSolver::POWER_METHOD);
+    cr_assert_eq(stats.n_spmv == 0, wide);
+
+    fit_options.memory_budget = fit_plan.peak_bytes / 2;
+    cr_assert_throw(diffusion_maps::decompose(graph, 2, rng, fit_options),
+                    std::invalid_argument);
+
+    auto [diffusion_matrix, invsqrt_row_sum] =
+        graph.symmetrised_diffusion_matrix();
+    diffusion_maps::Plan matrix_plan;
+    fit_options.plan = &matrix_plan;
+    cr_assert_throw(diffusion_maps::internal::decompose(
+                        diffusion_matrix, std::move(invsqrt_row_sum), 2,
+                        fit_options, []() { return 0.5; }),
+                    std::invalid_argument);
+    cr_assert_eq(matrix_plan.n_nz, fit_plan.n_nz);
+  }
+
+  // A sweep plans the diffusion matrix of each setting.
+
+  const std::vector<diffusion_maps::SweepSetting> settings = {{400}, {100}};
+  options.memory_budget = 1;
+  cr_assert_throw(diffusion_maps::sweep(data, 2, settings, rng, options),
+                  std::invalid_argument);
+}
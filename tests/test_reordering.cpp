@@ -0,0 +1,199 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/internal/reordering.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+#define PI 3.14159265358979323846
+
+/// Checks that a vector is a permutation of 0, 1, ..., n - 1.
+static bool is_permutation(std::vector<std::size_t> perm, const std::size_t n) {
+  std::sort(perm.begin(), perm.end());
+  std::vector<std::size_t> identity(n);
+  std::iota(identity.begin(), identity.end(), 0);
+  return perm == identity;
+}
+
+Test(reordering, reordering_rcm_path) {
+  // Data: a path graph whose vertices are shuffled
+  // Expected result: the reordered matrix is tridiagonal
+
+  const std::size_t n = 100;
+  std::vector<std::size_t> labels(n);
+  std::iota(labels.begin(), labels.end(), 0);
+  std::shuffle(labels.begin(), labels.end(), std::default_random_engine());
+
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    triplets.push_back({labels[i], labels[i], 1});
+    if (i + 1 < n) {
+      triplets.push_back({labels[i], labels[i + 1], 0.5});
+      triplets.push_back({labels[i + 1], labels[i], 0.5});
+    }
+  }
+  const diffusion_maps::SparseMatrix a(n, n, triplets);
+
+  const auto perm = diffusion_maps::internal::reverse_cuthill_mckee(a);
+  cr_assert(is_permutation(perm, n), "Result is not a permutation");
+
+  const auto b = diffusion_maps::internal::permute(a, perm);
+  cr_assert_eq(b.n_nz(), a.n_nz());
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t ir = b.row_ixs()[i]; ir < b.row_ixs()[i + 1]; ++ir) {
+      const std::size_t j = b.col_ixs()[ir];
+      cr_assert_leq(std::max(i, j) - std::min(i, j), 1,
+                    "Element (%zu, %zu) is outside the band", i, j);
+    }
+  }
+}
+
+Test(reordering, reordering_permute) {
+  // Data: a random symmetric sparse matrix and a random permutation
+  // Expected result: element (i, j) of the result is element
+  //                  (perm[i], perm[j]) of the matrix
+
+  const std::size_t n = 20;
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(0, 1);
+
+  std::vector<std::vector<double>> dense(n, std::vector<double>(n));
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n; ++i) {
+    for (std::size_t j = i; j < n; ++j) {
+      if (dist(rng) < 0.3) {
+        dense[i][j] = dense[j][i] = dist(rng);
+        triplets.push_back({i, j, dense[i][j]});
+        if (i != j) {
+          triplets.push_back({j, i, dense[i][j]});
+        }
+      }
+    }
+  }
+  const diffusion_maps::SparseMatrix a(n, n, triplets);
+
+  std::vector<std::size_t> perm(n);
+  std::iota(perm.begin(), perm.end(), 0);
+  std::shuffle(perm.begin(), perm.end(), rng);
+
+  const auto b = diffusion_maps::internal::permute(a, perm);
+  for (std::size_t j = 0; j < n; ++j) {
+    diffusion_maps::Vector e_j(n);
+    e_j[j] = 1;
+    const diffusion_maps::Vector col = b * e_j;
+    for (std::size_t i = 0; i < n; ++i) {
+      cr_assert_eq(col[i], dense[perm[i]][perm[j]],
+                   "Element (%zu, %zu) is incorrect", i, j);
+    }
+  }
+
+  // Vectors round-trip.
+
+  diffusion_maps::Vector v(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    v[i] = dist(rng);
+  }
+  const auto pv = diffusion_maps::internal::permute(v, perm);
+  const auto v2 = diffusion_maps::internal::unpermute(pv, perm);
+  for (std::size_t i = 0; i < n; ++i) {
+    cr_assert_eq(pv[i], v[perm[i]]);
+    cr_assert_eq(v2[i], v[i]);
+  }
+}
+
+Test(reordering, reordering_morton_grid) {
+  // Data: the points of a 4×4 grid, shuffled
+  // Expected result: each quadrant of the grid is contiguous in the order
+
+  const std::size_t side = 4, n = side * side;
+  std::vector<std::pair<double, double>> points;
+  for (std::size_t x = 0; x < side; ++x) {
+    for (std::size_t y = 0; y < side; ++y) {
+      points.emplace_back(x, y);
+    }
+  }
+  std::shuffle(points.begin(), points.end(), std::default_random_engine());
+
+  diffusion_maps::Matrix data(n, 2);
+  for (std::size_t i = 0; i < n; ++i) {
+    data(i, 0) = points[i].first;
+    data(i, 1) = points[i].second;
+  }
+
+  const auto perm = diffusion_maps::internal::morton_order(data);
+  cr_assert(is_permutation(perm, n), "Result is not a permutation");
+
+  for (std::size_t q = 0; q < 4; ++q) {
+    const auto quadrant = [&data](const std::size_t i) {
+      return (data(i, 0) >= 2) * 2 + (data(i, 1) >= 2);
+    };
+    for (std::size_t k = 1; k < 4; ++k) {
+      cr_assert_eq(quadrant(perm[4 * q + k]), quadrant(perm[4 * q]),
+                   "Quadrant %zu is not contiguous", q);
+    }
+  }
+}
+
+Test(reordering, diffusion_maps_helix_reordered) {
+  // Data: helix, with the points shuffled
+  // Dimensions after reduction: 1
+  // Expected result: with each reordering, a straight line in the original
+  //                  order of the points
+
+  const std::size_t n_samples = 200;
+  std::vector<double> ts(n_samples);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    ts[i] = 8 * PI * (i / (n_samples - 1.));
+  }
+  std::shuffle(ts.begin(), ts.end(), std::default_random_engine());
+
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    helix(i, 0) = std::cos(ts[i]);
+    helix(i, 1) = std::sin(ts[i]);
+    helix(i, 2) = ts[i] / (4 * PI) - 1;
+  }
+
+  std::default_random_engine rng(std::random_device{}());
+  for (const auto reordering : {diffusion_maps::Reordering::RCM,
+                                diffusion_maps::Reordering::MORTON}) {
+    diffusion_maps::Options options;
+    options.eig_solver_max_iter = 1000000;
+    options.reordering = reordering;
+    const auto result = diffusion_maps::diffusion_maps(
+        helix, 1, diffusion_maps::kernel::Gaussian(50), 1, rng, options);
+
+    cr_assert_eq(result.n_rows(), n_samples,
+                 "Number of data points %zu is incorrect", result.n_rows());
+    cr_assert_eq(result.n_cols(), 1, "Number of dimensions %zu is incorrect",
+                 result.n_cols());
+
+    // Check that result is monotonic along the helix.
+
+    std::vector<std::pair<double, double>> points;
+    for (std::size_t i = 0; i < n_samples; ++i) {
+      points.emplace_back(ts[i], result(i, 0));
+    }
+    std::sort(points.begin(), points.end());
+
+    auto cmp =
+        points[0].second < points[1].second
+            ? std::function<bool(double, double)>(std::less<double>())
+            : std::function<bool(double, double)>(std::greater<double>());
+    for (std::size_t i = 0; i + 1 < n_samples; ++i) {
+      cr_assert(cmp(points[i].second, points[i + 1].second),
+                "Result is not monotonic");
+    }
+  }
+}
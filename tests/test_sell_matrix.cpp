@@ -0,0 +1,112 @@
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sell_matrix.hpp"
+#include "diffusion_maps/sparse_matrix.hpp"
+#include "diffusion_maps/vector.hpp"
+
+#define PI 3.14159265358979323846
+
+Test(sell_matrix, sell_matrix_random) {
+  // Data: a random sparse matrix whose rows have very different numbers of
+  //       non-zero elements, including empty rows, and whose number of rows is
+  //       not a multiple of the chunk size
+  // Expected result: the products are the same as with the CSR format, for
+  //                  any sorting window
+
+  const std::size_t n_rows = 37, n_cols = 29;
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(-1, 1);
+  std::uniform_int_distribution<std::size_t> length_dist(0, n_cols);
+
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    const std::size_t length = i % 5 == 0 ? 0 : length_dist(rng);
+    for (std::size_t j = 0; j < length; ++j) {
+      triplets.push_back({i, j, dist(rng)});
+    }
+  }
+  const diffusion_maps::SparseMatrix csr(n_rows, n_cols, triplets);
+
+  diffusion_maps::Vector v(n_cols);
+  diffusion_maps::Matrix m(n_cols, 3);
+  for (std::size_t i = 0; i < n_cols; ++i) {
+    v[i] = dist(rng);
+    for (std::size_t k = 0; k < 3; ++k) {
+      m(i, k) = dist(rng);
+    }
+  }
+  const diffusion_maps::Vector expected_v = csr * v;
+  const diffusion_maps::Matrix expected_m = csr * m;
+
+  std::size_t prev_n_stored = 0;
+  for (const std::size_t sigma : {1, 8, 16, 256}) {
+    const diffusion_maps::SellMatrix sell(csr, sigma);
+    cr_assert_eq(sell.n_rows(), n_rows);
+    cr_assert_eq(sell.n_cols(), n_cols);
+    cr_assert_eq(sell.n_nz(), csr.n_nz());
+    cr_assert_geq(sell.n_stored(), sell.n_nz());
+    cr_assert_eq(sell.n_stored() % diffusion_maps::SellMatrix::CHUNK_SIZE, 0);
+
+    // Sorting over a wider window never adds padding.
+    if (prev_n_stored != 0) {
+      cr_assert_leq(sell.n_stored(), prev_n_stored,
+                    "Padding grew with sigma %zu", sigma);
+    }
+    prev_n_stored = sell.n_stored();
+
+    const diffusion_maps::Vector result_v = sell * v;
+    const diffusion_maps::Matrix result_m = sell * m;
+    for (std::size_t i = 0; i < n_rows; ++i) {
+      cr_assert_float_eq(result_v[i], expected_v[i], 1e-12,
+                         "Element %zu is incorrect with sigma %zu", i, sigma);
+      for (std::size_t k = 0; k < 3; ++k) {
+        cr_assert_float_eq(result_m(i, k), expected_m(i, k), 1e-12,
+                           "Element (%zu, %zu) is incorrect with sigma %zu",
+                           i, k, sigma);
+      }
+    }
+  }
+}
+
+Test(sell_matrix, diffusion_maps_helix_sell) {
+  // Data: helix
+  // Dimensions after reduction: 1
+  // Expected result: the same embedding as with the CSR format
+
+  const std::size_t n_samples = 200;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (4 * PI) - 1;
+  }
+
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+
+  std::default_random_engine csr_rng(0);
+  const auto expected = diffusion_maps::diffusion_maps(
+      helix, 1, diffusion_maps::kernel::Gaussian(50), 1, csr_rng, options);
+
+  options.matrix_format = diffusion_maps::MatrixFormat::SELL;
+  std::default_random_engine sell_rng(0);
+  const auto result = diffusion_maps::diffusion_maps(
+      helix, 1, diffusion_maps::kernel::Gaussian(50), 1, sell_rng, options);
+
+  // The eigenvectors are only defined up to sign.
+
+  const double sign = result(0, 0) * expected(0, 0) < 0 ? -1 : 1;
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    cr_assert_float_eq(sign * result(i, 0), expected(i, 0), 1e-4,
+                       "Element %zu is incorrect", i);
+  }
+}
@@ -4,6 +4,8 @@
 
 #include <criterion/criterion.h>
 
+#include "diffusion_maps/allocation.hpp"
+#include "diffusion_maps/matrix.hpp"
 #include "diffusion_maps/sparse_matrix.hpp"
 #include "diffusion_maps/vector.hpp"
 
@@ -114,3 +116,133 @@ Test(sparse_matrix, sparse_matrix_zero) {
     cr_assert_eq(col, diffusion_maps::Vector(n_rows));
   }
 }
+
+Test(sparse_matrix, sparse_matrix_dense_product) {
+  // Matrix:
+  // -7  2  8  0  0  0  0
+  // 10  0  0  0 -1  0  0
+  //  0  0 -7  3  8 -8  0
+  //  0  0  4  1  7  0  0
+  // -1 -9  8  0  0 -3  4
+
+  const std::size_t n_rows = 5, n_cols = 7, n_vecs = 3;
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets = {
+      {0, 0, -7}, {0, 1, 2},  {0, 2, 8},  {1, 0, 10}, {1, 4, -1}, {2, 2, -7},
+      {2, 3, 3},  {2, 4, 8},  {2, 5, -8}, {3, 2, 4},  {3, 3, 1},  {3, 4, 7},
+      {4, 0, -1}, {4, 1, -9}, {4, 2, 8},  {4, 5, -3}, {4, 6, 4}};
+  diffusion_maps::SparseMatrix sm(n_rows, n_cols, triplets);
+
+  std::default_random_engine rng;
+  std::uniform_int_distribution<int> dist(-5, 5);
+  diffusion_maps::Matrix m(n_cols, n_vecs);
+  for (std::size_t i = 0; i < n_cols; ++i) {
+    for (std::size_t k = 0; k < n_vecs; ++k) {
+      m(i, k) = dist(rng);
+    }
+  }
+
+  const diffusion_maps::Matrix product = sm * m;
+
+  // Dimension check.
+  cr_assert_eq(product.n_rows(), n_rows);
+  cr_assert_eq(product.n_cols(), n_vecs);
+
+  // Each column of the product must match the matrix-vector product.
+  for (std::size_t k = 0; k < n_vecs; ++k) {
+    diffusion_maps::Vector v(n_cols);
+    for (std::size_t i = 0; i < n_cols; ++i) {
+      v[i] = m(i, k);
+    }
+    const diffusion_maps::Vector expected_col = sm * v;
+
+    for (std::size_t i = 0; i < n_rows; ++i) {
+      cr_assert_eq(product(i, k), expected_col[i]);
+    }
+  }
+}
+
+Test(sparse_matrix, sparse_matrix_allocation_policy) {
+  // Data: a random sparse matrix, allocated with every array treated as large
+  //       and with huge pages
+  // Expected result: the new arrays are initialised and the copies are equal
+
+  const diffusion_maps::AllocationPolicy default_policy =
+      diffusion_maps::allocation_policy();
+  diffusion_maps::AllocationPolicy policy;
+  policy.huge_pages = true;
+  policy.min_large_bytes = 0;
+  diffusion_maps::set_allocation_policy(policy);
+
+  const std::size_t n_rows = 300, n_cols = 40;
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(-1, 1);
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    for (std::size_t j = i % 7; j < n_cols; j += 5) {
+      triplets.push_back({i, j, dist(rng)});
+    }
+  }
+  std::shuffle(triplets.begin(), triplets.end(), rng);
+
+  const diffusion_maps::SparseMatrix sm(n_rows, n_cols, triplets);
+  const diffusion_maps::SparseMatrix copy(sm);
+  cr_assert_eq(copy.n_nz(), sm.n_nz());
+  for (std::size_t i = 0; i <= n_rows; ++i) {
+    cr_assert_eq(copy.row_ixs()[i], sm.row_ixs()[i]);
+  }
+  for (std::size_t ir = 0; ir < sm.n_nz(); ++ir) {
+    cr_assert_eq(sm.col_ixs()[ir], triplets[ir].col);
+    cr_assert_eq(sm.data()[ir], triplets[ir].value);
+    cr_assert_eq(copy.col_ixs()[ir], sm.col_ixs()[ir]);
+    cr_assert_eq(copy.data()[ir], sm.data()[ir]);
+  }
+
+  const diffusion_maps::Vector zeros(n_rows);
+  const diffusion_maps::Matrix matrix(n_rows, n_cols);
+  for (std::size_t i = 0; i < n_rows; ++i) {
+    cr_assert_eq(zeros[i], 0);
+    for (std::size_t j = 0; j < n_cols; ++j) {
+      cr_assert_eq(matrix(i, j), 0);
+    }
+  }
+  const diffusion_maps::Vector v(n_cols, 0.5);
+  cr_assert_eq(diffusion_maps::Vector(v), v);
+  cr_assert_eq(sm * v, copy * v);
+
+  diffusion_maps::set_allocation_policy(default_policy);
+}
+
+Test(sparse_matrix, sparse_matrix_triplet_order) {
+  // Data: the triplets of a random sparse matrix with duplicate elements, in
+  //       several orders
+  // Expected result: the same arrays for every order
+
+  const std::size_t n_rows = 50, n_cols = 30;
+  std::default_random_engine rng;
+  std::uniform_real_distribution<double> dist(-1, 1);
+  std::uniform_int_distribution<std::size_t> row_dist(0, n_rows - 1);
+  std::uniform_int_distribution<std::size_t> col_dist(0, n_cols - 1);
+  std::vector<diffusion_maps::SparseMatrix::Triplet> triplets;
+  for (std::size_t k = 0; k < 400; ++k) {
+    triplets.push_back({row_dist(rng), col_dist(rng), dist(rng)});
+  }
+  // Duplicate some elements with other values.
+  for (std::size_t k = 0; k < 100; ++k) {
+    triplets.push_back({triplets[k].row, triplets[k].col, dist(rng)});
+  }
+
+  const diffusion_maps::SparseMatrix expected(n_rows, n_cols, triplets);
+  for (int round = 0; round < 5; ++round) {
+    std::shuffle(triplets.begin(), triplets.end(), rng);
+    const diffusion_maps::SparseMatrix sm(n_rows, n_cols, triplets);
+    cr_assert_eq(sm.n_nz(), expected.n_nz());
+    for (std::size_t i = 0; i <= n_rows; ++i) {
+      cr_assert_eq(sm.row_ixs()[i], expected.row_ixs()[i]);
+    }
+    for (std::size_t ir = 0; ir < sm.n_nz(); ++ir) {
+      cr_assert_eq(sm.col_ixs()[ir], expected.col_ixs()[ir]);
+      cr_assert_eq(sm.data()[ir], expected.data()[ir],
+                   "Element %zu differs in round %d", ir, round);
+    }
+  }
+}
@@ -0,0 +1,142 @@
+#include <cmath>
+#include <cstddef>
+#include <functional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <criterion/criterion.h>
+
+#include "diffusion_maps/diffusion_maps.hpp"
+#include "diffusion_maps/internal/kernel_matrix.hpp"
+#include "diffusion_maps/kernel.hpp"
+#include "diffusion_maps/matrix.hpp"
+#include "diffusion_maps/sweep.hpp"
+
+#define PI 3.14159265358979323846
+
+Test(sweep, sweep_helix) {
+  // Data: helix
+  // Settings: two values of γ by two values of ε
+  // Dimensions after reduction: 1
+  // Expected result: each kernel matrix has the same number of non-zero
+  //                  elements as the one computed from scratch, and each
+  //                  embedding is a straight line
+
+  const std::size_t n_samples = 200;
+  diffusion_maps::Matrix helix(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    const double t = 8 * PI * (i / (n_samples - 1.));
+    helix(i, 0) = std::cos(t);
+    helix(i, 1) = std::sin(t);
+    helix(i, 2) = t / (4 * PI) - 1;
+  }
+
+  const std::vector<diffusion_maps::SweepSetting> settings = {
+      {50, 1e-6}, {50, 1e-4}, {100, 1e-6}, {100, 1e-4}};
+
+  std::default_random_engine rng(std::random_device{}());
+  diffusion_maps::Options options;
+  options.eig_solver_max_iter = 1000000;
+  const auto results = diffusion_maps::sweep(helix, 1, settings, rng, options);
+
+  cr_assert_eq(results.size(), settings.size(),
+               "Number of results %zu is incorrect", results.size());
+
+  for (std::size_t s = 0; s < settings.size(); ++s) {
+    const auto &result = results[s];
+    cr_assert_eq(result.setting.gamma, settings[s].gamma);
+    cr_assert_eq(result.setting.kernel_epsilon, settings[s].kernel_epsilon);
+
+    const auto kernel_matrix = diffusion_maps::internal::compute_kernel_matrix(
+        helix, diffusion_maps::kernel::Gaussian(settings[s].gamma),
+        settings[s].kernel_epsilon);
+    cr_assert_eq(result.n_nz, kernel_matrix.n_nz(),
+                 "Number of non-zero elements %zu of setting %zu is incorrect",
+                 result.n_nz, s);
+
+    cr_assert_eq(result.decomposition.n_components(), 1,
+                 "Number of dimensions %zu of setting %zu is incorrect",
+                 result.decomposition.n_components(), s);
+    cr_assert(result.eigengap > 0 && result.eigengap < 1,
+              "Eigengap %g of setting %zu is out of range", result.eigengap,
+              s);
+
+    // Check that the embedding is monotonic.
+
+    const auto embedding = result.decomposition.embed(1);
+    auto cmp =
+        embedding(0, 0) < embedding(1, 0)
+            ? std::function<bool(double, double)>(std::less<double>())
+            : std::function<bool(double, double)>(std::greater<double>());
+    for (std::size_t i = 0; i < n_samples - 1; ++i) {
+      cr_assert(cmp(embedding(i, 0), embedding(i + 1, 0)),
+                "Embedding of setting %zu is not monotonic", s);
+    }
+  }
+
+  // Duplicate data points are at distance 0, like the diagonal.
+
+  diffusion_maps::Matrix duplicates(n_samples, 3);
+  for (std::size_t i = 0; i < n_samples; ++i) {
+    for (std::size_t f = 0; f < 3; ++f) {
+      duplicates(i, f) = helix(i - i % 2, f);
+    }
+  }
+  const auto duplicate_results =
+      diffusion_maps::sweep(duplicates, 1, {settings[0]}, rng, options);
+  const auto duplicate_kernel_matrix =
+      diffusion_maps::internal::compute_kernel_matrix(
+          duplicates, diffusion_maps::kernel::Gaussian(settings[0].gamma),
+          settings[0].kernel_epsilon);
+  cr_assert_eq(duplicate_results[0].n_nz, duplicate_kernel_matrix.n_nz(),
+               "Number of non-zero elements %zu with duplicates is incorrect",
+               duplicate_results[0].n_nz);
+
+  cr_assert_throw(diffusion_maps::sweep(helix, 1, {{0, 1e-6}}, rng),
+                  std::invalid_argument);
+  cr_assert_throw(diffusion_maps::sweep(helix, 1, {{50, 1}}, rng),
+                  std::invalid_argument);
+
+  // The options that the sweep cannot honour are rejected.
+
+  diffusion_maps::Options self_tuning_options;
+  self_tuning_options.self_tuning_neighbours = 5;
+  cr_assert_throw(
+      diffusion_maps::sweep(helix, 1, settings, rng, self_tuning_options),
+      std::invalid_argument);
+  diffusion_maps::Options precision_options;
+  precision_options.kernel_precision = diffusion_maps::Precision::FLOAT16;
+  cr_assert_throw(
+      diffusion_maps::sweep(helix, 1, settings, rng, precision_options),
+      std::invalid_argument);
+  diffusion_maps::Options reordering_options;
+  reordering_options.reordering = diffusion_maps::Reordering::RCM;
+  cr_assert_throw(
+      diffusion_maps::sweep(helix, 1, settings, rng, reordering_options),
+      std::invalid_argument);
+
+  // Every setting exceeds the memory budget, and the failure of the first one
+  // is reported, whatever the scheduling.
+
+  diffusion_maps::Options budget_options;
+  budget_options.memory_budget = 1;
+  std::string expected;
+  try {
+    diffusion_maps::sweep(helix, 1, {settings[0]}, rng, budget_options);
+  } catch (const std::invalid_argument &e) {
+    expected = e.what();
+  }
+  cr_assert(!expected.empty());
+  for (int k = 0; k < 10; ++k) {
+    std::string message;
+    try {
+      diffusion_maps::sweep(helix, 1, settings, rng, budget_options);
+    } catch (const std::invalid_argument &e) {
+      message = e.what();
+    }
+    cr_assert_eq(message, expected, "The failure of another setting was "
+                                    "reported");
+  }
+}